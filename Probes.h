@@ -0,0 +1,81 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+#include <stdint.h>
+
+/**
+ * Static tracepoints (USDT) of the provider "calc", in the format of
+ * SystemTap's sys/sdt.h, so perf, bpftrace and stap find them in the
+ * .note.stapsdt section of the binary:
+ *
+ *   probe            arguments
+ *   ---------------  ------------------------------------------------
+ *   tokenize_start   expression length
+ *   tokenize_done    expression length, number of tokens
+ *   parse_start      number of tokens
+ *   parse_done       number of tokens, number of nodes (0 if malformed)
+ *   step_start       step number, from 1
+ *   step_done        step number
+ *   alloc            ProbeSite, bytes
+ *
+ * A probe is a single nop; its arguments are only read by a tracer
+ * attached to it, from where the compiler left them. All the arguments
+ * are 64 bits unsigned. On other targets than x86-64 ELF, the probes are
+ * compiled out.
+ *
+ *   bpftrace -e 'usdt:./main:calc:parse_done { @nodes = hist(arg1); }'
+ *
+ * See tools/probes for more scripts.
+ */
+
+/**
+ * @brief Where an allocation probe fired
+ */
+typedef enum probe_site { PROBE_TOKENS = 1, PROBE_POOL, PROBE_TREE } ProbeSite;
+
+#if defined(__x86_64__) && defined(__ELF__)
+
+#define PROBE_ARGUMENT(n) "8@%[a" #n "]"
+
+// The note refers to the nop by address, and to the .stapsdt.base symbol
+// so a tracer can tell how far the binary was relocated
+#define PROBE_NOTE(name, arguments)                                          \
+  "990: nop\n"                                                               \
+  ".pushsection .note.stapsdt,\"?\",\"note\"\n"                              \
+  ".balign 4\n"                                                              \
+  ".4byte 992f-991f, 994f-993f, 3\n"                                         \
+  "991: .asciz \"stapsdt\"\n"                                                \
+  "992: .balign 4\n"                                                         \
+  "993: .8byte 990b\n"                                                       \
+  ".8byte _.stapsdt.base\n"                                                  \
+  ".8byte 0\n"                                                               \
+  ".asciz \"calc\"\n"                                                        \
+  ".asciz \"" #name "\"\n"                                                   \
+  ".asciz \"" arguments "\"\n"                                               \
+  "994: .balign 4\n"                                                         \
+  ".popsection\n"                                                            \
+  ".ifndef _.stapsdt.base\n"                                                 \
+  ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"    \
+  ".weak _.stapsdt.base\n"                                                   \
+  ".hidden _.stapsdt.base\n"                                                 \
+  "_.stapsdt.base: .space 1\n"                                               \
+  ".size _.stapsdt.base, 1\n"                                                \
+  ".popsection\n"                                                            \
+  ".endif\n"
+
+#define PROBE1(name, a)                                                      \
+  __asm__ __volatile__(PROBE_NOTE(name, PROBE_ARGUMENT(1))                   \
+                       :: [a1] "nor" ((uint64_t)(a)))
+
+#define PROBE2(name, a, b)                                                   \
+  __asm__ __volatile__(PROBE_NOTE(name, PROBE_ARGUMENT(1) " " PROBE_ARGUMENT(2)) \
+                       :: [a1] "nor" ((uint64_t)(a)), [a2] "nor" ((uint64_t)(b)))
+
+#else
+
+#define PROBE1(name, a) ((void)(a))
+#define PROBE2(name, a, b) ((void)(a), (void)(b))
+
+#endif
+
+#endif
@@ -0,0 +1,689 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <math.h>
+#include <string.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Function.h"
+#include "../lexer/Operator.h"
+#include "Apply.h"
+#include "FastMath.h"
+#include "Limits.h"
+#include "Plugin.h"
+#include "Aggregate.h"
+
+
+/**
+ * The number of threads which evaluate the large aggregates. It is set once,
+ * before any evaluation starts, so the worker threads only read it.
+ */
+static unsigned int aggregate_threads = 1;
+
+/**
+ * The largest body evaluated in a scratch buffer on the stack
+ */
+#define AGGREGATE_STACK_NODES 32
+
+/**
+ * The largest number of arguments of a variadic function gathered on
+ * the stack, and of subtrees left to walk to find them
+ */
+#define AGGREGATE_STACK_ARGUMENTS 64
+
+
+/**
+ * @brief An aggregate being evaluated: the nodes of its body, its index and
+ *        its lower bound
+ * @details The body is evaluated in lanes if it has no aggregate and all
+ *          the children of its nodes are in it. The deadline is the one of
+ *          the evaluation, for the threads which help it.
+ */
+typedef struct range_t
+{
+  const pool_node_t *nodes;
+  FunctionID function;
+  uint32_t first;
+  uint32_t root;
+  uint32_t index;
+  long double lo;
+  bool lanes;
+  long double *bindings;
+  long double *values;
+  uint64_t deadline;
+} range_t;
+
+/**
+ * @brief A sum which keeps the rounding error of its additions, to add it
+ *        back to the next term (Kahan summation)
+ */
+typedef struct kahan_t
+{
+  long double sum;
+  long double compensation;
+} kahan_t;
+
+/**
+ * @brief The parts of a range, taken in turn by the threads which evaluate
+ *        them
+ */
+typedef struct parts_t
+{
+  const range_t *range;
+  uint64_t count;
+  uint64_t size;
+  unsigned int nbr_parts;
+  atomic_uint next;
+  long double results[AGGREGATE_PARTS];
+} parts_t;
+
+
+/**
+ * @brief Sets the number of threads which evaluate the large aggregates
+ * @details Must be called before the evaluations start.
+ *
+ * @param threads The number of threads, 1 to evaluate them serially
+ */
+void set_aggregate_threads(unsigned int threads)
+{
+  aggregate_threads = threads ? threads : 1;
+}
+
+
+/**
+ * @brief Returns the number of threads which evaluate the large aggregates
+ *
+ * @return The number of threads
+ */
+unsigned int get_aggregate_threads(void)
+{
+  return aggregate_threads;
+}
+
+
+/**
+ * @brief Adds a term to a compensated sum
+ * @details Once the sum is infinite or NaN, the compensation is meaningless
+ *          and the terms are added as they are.
+ *
+ * @param kahan The sum
+ * @param term The term to add
+ */
+static inline void add_kahan(kahan_t *kahan, long double term)
+{
+  long double y = term - kahan->compensation;
+  long double t = kahan->sum + y;
+
+  kahan->compensation = isfinite(t) ? (t - kahan->sum) - y : 0.0;
+  kahan->sum = t;
+}
+
+
+/**
+ * @brief Compares a value to the largest or the smallest one found so far
+ * @details A NaN is never kept over a number, like by fmaxl and fminl.
+ *
+ * @param largest true to keep the largest value, false the smallest
+ * @param value The value
+ * @param best The value found so far
+ * @return The value to keep
+ */
+static inline long double keep_extremum(bool largest, long double value, long double best)
+{
+  return (largest ? value > best : value < best) || isnan(best) ? value : best;
+}
+
+
+/**
+ * @brief Computes the largest or the smallest of some values
+ * @details Each of the AGGREGATE_LANES lanes keeps the extremum of its own
+ *          values, so the comparisons don't wait for each other, and the
+ *          lanes are compared at the end. Fewer values are compared in turn.
+ *
+ * @param largest true for the largest value, false for the smallest
+ * @param values The values
+ * @param n The number of values, not 0
+ * @return The extremum, NaN only if all the values are NaN
+ */
+static long double reduce_extremum(bool largest, const long double *values, size_t n)
+{
+  if (n < AGGREGATE_LANES) {
+    long double best = values[0];
+    for (size_t i = 1; i < n; ++i) best = keep_extremum(largest, values[i], best);
+
+    return best;
+  }
+
+  long double best[AGGREGATE_LANES];
+  for (size_t l = 0; l < AGGREGATE_LANES; ++l) best[l] = values[0];
+
+  size_t i = 0;
+  for (; i + AGGREGATE_LANES <= n; i += AGGREGATE_LANES) {
+    for (size_t l = 0; l < AGGREGATE_LANES; ++l)
+      best[l] = keep_extremum(largest, values[i + l], best[l]);
+  }
+
+  for (; i < n; ++i) best[0] = keep_extremum(largest, values[i], best[0]);
+  for (size_t l = 1; l < AGGREGATE_LANES; ++l) best[0] = keep_extremum(largest, best[l], best[0]);
+
+  return best[0];
+}
+
+
+/**
+ * @brief Computes the compensated sum of some values, or of their squared
+ *        deviations from a mean
+ * @details Each lane adds every AGGREGATE_LANES-th value, and the lanes are
+ *          added in order at the end, like the parts of a range. With one
+ *          value per lane at most, it is the same as adding the values in
+ *          turn, which is done directly.
+ *
+ * @param values The values
+ * @param n The number of values
+ * @param mean The mean to subtract from the values before squaring them,
+ *        NULL to add the values themselves
+ * @return The sum
+ */
+static long double reduce_sum(const long double *values, size_t n, const long double *mean)
+{
+  if (n <= AGGREGATE_LANES && !mean) {
+    kahan_t total = { 0.0, 0.0 };
+    for (size_t i = 0; i < n; ++i) add_kahan(&total, values[i]);
+
+    return total.sum - total.compensation;
+  }
+
+  kahan_t sums[AGGREGATE_LANES] = { { 0.0, 0.0 } };
+
+  for (size_t i = 0; i < n; i += AGGREGATE_LANES) {
+    size_t lanes = n - i < AGGREGATE_LANES ? n - i : AGGREGATE_LANES;
+
+    if (mean) {
+      for (size_t l = 0; l < lanes; ++l) {
+        long double deviation = values[i + l] - *mean;
+        add_kahan(&sums[l], deviation * deviation);
+      }
+    } else {
+      for (size_t l = 0; l < lanes; ++l) add_kahan(&sums[l], values[i + l]);
+    }
+  }
+
+  kahan_t total = { 0.0, 0.0 };
+  for (size_t l = 0; l < AGGREGATE_LANES; ++l)
+    add_kahan(&total, sums[l].sum - sums[l].compensation);
+
+  return total.sum - total.compensation;
+}
+
+
+/**
+ * @brief Computes a variadic function of some values
+ * @details max and min ignore the NaN values; total is compensated, mean is
+ *          the sum divided by the number of values, and stddev is the
+ *          population standard deviation, computed in two passes from the
+ *          mean, so it doesn't lose the digits the mean and the values
+ *          share. A function of a plugin is called with the values.
+ *
+ * @param id The function: MAX, MIN, MEAN, STDDEV, TOTAL or one of a plugin
+ * @param values The values of the arguments, in order
+ * @param n The number of arguments, not 0
+ * @return The value of the function
+ */
+long double reduce_values(FunctionID id, const long double *values, size_t n)
+{
+  assert(n > 0);
+
+  switch (id) {
+    case MAX:    return reduce_extremum(true, values, n);
+    case MIN:    return reduce_extremum(false, values, n);
+    case TOTAL:  return reduce_sum(values, n, NULL);
+    case MEAN:   return reduce_sum(values, n, NULL) / (long double)n;
+    case STDDEV:
+    {
+      long double mean = reduce_sum(values, n, NULL) / (long double)n;
+      return sqrtl(reduce_sum(values, n, &mean) / (long double)n);
+    }
+    default:     return is_plugin(id) ? call_plugin(id, values, n) : NAN;
+  }
+}
+
+
+/**
+ * @brief Gathers the values of the arguments of a variadic call, in order
+ * @details The ',' nodes below the call are walked from left to right, with
+ *          a stack of the subtrees left to walk. The trees of the parser are
+ *          balanced, so the stack is small; it only grows for a deeper tree
+ *          read from a compiled file.
+ *
+ * @param nodes The nodes of the tree
+ * @param node The index of the call, with two children
+ * @param values The values of the nodes
+ * @param arguments Where to store the values of the arguments, may be NULL
+ *        to only count them
+ * @return The number of arguments
+ */
+static size_t gather_arguments(const pool_node_t *nodes, uint32_t node,
+                               const long double *values, long double *arguments)
+{
+  uint32_t local[AGGREGATE_STACK_ARGUMENTS];
+  uint32_t *pending = local;
+  size_t size = 0, capacity = AGGREGATE_STACK_ARGUMENTS, n = 0;
+
+  pending[size++] = nodes[node].right;
+  pending[size++] = nodes[node].left;
+
+  while (size) {
+    uint32_t j = pending[--size];
+    if (nodes[j].type != FARGSEPARATOR) {
+      if (arguments) arguments[n] = values[j];
+      ++n;
+      continue;
+    }
+
+    if (size + 2 > capacity) {
+      capacity *= 2;
+      if (pending == local) {
+        pending = malloc(capacity * sizeof(*pending));
+        assert(pending != NULL);
+        memcpy(pending, local, size * sizeof(*pending));
+      } else {
+        pending = realloc(pending, capacity * sizeof(*pending));
+        assert(pending != NULL);
+      }
+    }
+
+    pending[size++] = nodes[j].right;
+    pending[size++] = nodes[j].left;
+  }
+
+  if (pending != local) free(pending);
+
+  return n;
+}
+
+
+/**
+ * @brief Computes a variadic function stored in a node pool
+ * @details The arguments of a call are the leaves of the tree of ',' nodes
+ *          below it, from left to right; for max(a, b, c, d):
+ *            a, b, ',', c, d, ',', max
+ *          A call of one argument has no left child. The values of the
+ *          arguments are gathered in order, then reduced at once.
+ *
+ * @param nodes The nodes of the tree
+ * @param node The index of the call, its arguments are evaluated
+ * @param values The values of the nodes
+ * @return The value of the call
+ * @see Aggregate::reduce_values
+ */
+long double eval_variadic(const pool_node_t *nodes, uint32_t node, const long double *values)
+{
+  const pool_node_t *call = &nodes[node];
+  if (call->left == POOL_NONE)
+    return reduce_values(call->value.function, &values[call->right], 1);
+
+  if (nodes[call->left].type != FARGSEPARATOR && nodes[call->right].type != FARGSEPARATOR) {
+    const long double operands[] = { values[call->left], values[call->right] };
+    return reduce_values(call->value.function, operands, 2);
+  }
+
+  size_t n = gather_arguments(nodes, node, values, NULL);
+
+  long double local[AGGREGATE_STACK_ARGUMENTS];
+  long double *arguments = local;
+  if (n > AGGREGATE_STACK_ARGUMENTS) {
+    arguments = malloc(n * sizeof(*arguments));
+    assert(arguments != NULL);
+  }
+
+  gather_arguments(nodes, node, values, arguments);
+  long double result = reduce_values(call->value.function, arguments, n);
+
+  if (arguments != local) free(arguments);
+
+  return result;
+}
+
+
+/**
+ * @brief Computes the values of a node for several lanes
+ * @details The loops on the lanes are vectorized where the arithmetic
+ *          allows it: in MATH_4ULP and MATH_FAST modes, the unary functions
+ *          are computed by the SIMD kernels. Each lane is computed by the
+ *          same operations as the serial evaluation, so the values are
+ *          identical. A function of a plugin is computed at all the lanes
+ *          at once. The variables are bound by the caller, and the ','
+ *          and the aggregates are not evaluated in lanes.
+ *
+ * @param node The node, neither a variable, a ',' nor an aggregate
+ * @param lc The values of its left child, zeros if it has none
+ * @param rc The values of its right child, zeros if it has none
+ * @param n The number of lanes, at most AGGREGATE_LANES
+ * @param out Where to store the values of the node
+ * @see Apply::eval_function_id, Operator::eval_operator,
+ *      FastMath::fast_function_array, Plugin::call_plugin_array
+ */
+void eval_node_lanes(const pool_node_t *node, const long double *lc, const long double *rc,
+                     size_t n, long double *out)
+{
+  MathMode mode = get_math_mode();
+
+  switch (node->type) {
+    case LITERAL:
+              for (size_t l = 0; l < n; ++l) out[l] = node->value.number;
+              break;
+    case FUNCTION:
+              if (is_plugin(node->value.function)) {
+                const long double *arguments[] = { lc, rc };
+                if (node->left == POOL_NONE) call_plugin_array(node->value.function, &rc, 1, out, n);
+                else                         call_plugin_array(node->value.function, arguments, 2, out, n);
+              } else if (mode != MATH_EXACT && get_function_id_type(node->value.function) == UNARY) {
+                double in[AGGREGATE_LANES], result[AGGREGATE_LANES];
+                for (size_t l = 0; l < n; ++l) in[l] = (double)rc[l];
+                fast_function_array(node->value.function, mode, in, result, n);
+                for (size_t l = 0; l < n; ++l) out[l] = result[l];
+              } else if (node->left == POOL_NONE
+                         && get_function_id_type(node->value.function) == VARIADIC) {
+                for (size_t l = 0; l < n; ++l)
+                  out[l] = reduce_values(node->value.function, &rc[l], 1);
+              } else {
+                for (size_t l = 0; l < n; ++l)
+                  out[l] = eval_function_id(node->value.function, lc[l], rc[l]);
+              }
+              break;
+    case PLUS:
+              for (size_t l = 0; l < n; ++l) out[l] = lc[l] + rc[l];
+              break;
+    case BMINUS:
+              for (size_t l = 0; l < n; ++l) out[l] = lc[l] - rc[l];
+              break;
+    case MULTIPLY:
+              for (size_t l = 0; l < n; ++l) out[l] = lc[l] * rc[l];
+              break;
+    case DIVIDE:
+              for (size_t l = 0; l < n; ++l) out[l] = lc[l] / rc[l];
+              break;
+    case UMINUS:
+              for (size_t l = 0; l < n; ++l) out[l] = -rc[l];
+              break;
+    default:
+              for (size_t l = 0; l < n; ++l) out[l] = eval_operator(node->type, lc[l], rc[l]);
+              break;
+  }
+}
+
+
+/**
+ * @brief Checks if the body of an aggregate can be evaluated in lanes
+ * @details It can if it has no ',' nor aggregate, and all the children of
+ *          its nodes are in it.
+ *
+ * @param nodes The nodes of the tree
+ * @param first The index of the first node of the body
+ * @param root The index of the root of the body
+ * @return true if the body can be evaluated by eval_body_lanes
+ */
+bool is_lane_body(const pool_node_t *nodes, uint32_t first, uint32_t root)
+{
+  for (uint32_t j = first; j <= root; ++j) {
+    const pool_node_t *body = &nodes[j];
+    if (body->type == FARGSEPARATOR
+     || (body->type == FUNCTION && get_function_id_type(body->value.function) == AGGREGATE)
+     || (body->left != POOL_NONE && body->left < first)
+     || (body->right != POOL_NONE && body->right < first))
+      return false;
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Computes the values of the body of an aggregate for several
+ *        values of its index, one per lane, inlined in eval_lanes
+ * @see Aggregate::eval_body_lanes
+ */
+static inline void body_lanes(const pool_node_t *nodes, uint32_t first, uint32_t root,
+                              uint32_t index, const long double *indices,
+                              const long double *bindings, size_t n, long double *scratch)
+{
+  static const long double zeros[AGGREGATE_LANES];
+
+  for (uint32_t j = first; j <= root; ++j) {
+    const pool_node_t *node = &nodes[j];
+    long double *out = scratch + (size_t)(j - first) * AGGREGATE_LANES;
+
+    const long double *lc = node->left == POOL_NONE ? zeros
+                          : scratch + (size_t)(node->left - first) * AGGREGATE_LANES;
+    const long double *rc = node->right == POOL_NONE ? zeros
+                          : scratch + (size_t)(node->right - first) * AGGREGATE_LANES;
+
+    if (node->type != VARIABLE) {
+      eval_node_lanes(node, lc, rc, n, out);
+    } else if (node->value.variable == index) {
+      for (size_t l = 0; l < n; ++l) out[l] = indices[l];
+    } else {
+      long double value = bindings[node->value.variable];
+      for (size_t l = 0; l < n; ++l) out[l] = value;
+    }
+  }
+}
+
+
+/**
+ * @brief Computes the values of the body of an aggregate for several
+ *        values of its index, one per lane
+ * @details The nodes are evaluated one after the other, each one for all
+ *          the lanes, so the dispatch on the type of a node is paid once
+ *          for AGGREGATE_LANES indices. The value of the root for lane l
+ *          is at scratch[(root - first) * AGGREGATE_LANES + l].
+ *
+ * @param nodes The nodes of the tree
+ * @param first The index of the first node of the body
+ * @param root The index of the root of the body
+ * @param index The variable of the index
+ * @param indices The values of the index, one per lane
+ * @param bindings The values of the other variables
+ * @param n The number of lanes, at most AGGREGATE_LANES
+ * @param scratch The values of the nodes of the body, AGGREGATE_LANES each
+ * @see Aggregate::is_lane_body, Aggregate::eval_node_lanes
+ */
+void eval_body_lanes(const pool_node_t *nodes, uint32_t first, uint32_t root, uint32_t index,
+                     const long double *indices, const long double *bindings, size_t n,
+                     long double *scratch)
+{
+  body_lanes(nodes, first, root, index, indices, bindings, n, scratch);
+}
+
+
+/**
+ * @brief Evaluates the body of an aggregate for consecutive indices, one
+ *        per lane
+ *
+ * @param range The aggregate
+ * @param offset The offset of the index of the first lane from the lower bound
+ * @param n The number of lanes, at most AGGREGATE_LANES
+ * @param scratch The values of the nodes of the body, AGGREGATE_LANES each
+ * @see Aggregate::eval_body_lanes
+ */
+static void eval_lanes(const range_t *range, uint64_t offset, size_t n, long double *scratch)
+{
+  long double indices[AGGREGATE_LANES];
+  for (size_t l = 0; l < n; ++l) indices[l] = range->lo + (long double)(offset + l);
+
+  body_lanes(range->nodes, range->first, range->root, range->index, indices,
+             range->bindings, n, scratch);
+}
+
+
+/**
+ * @brief Computes the aggregate of a part of the range
+ * @details In lanes, each lane keeps its own sum or product, and the lanes
+ *          are added or multiplied in order at the end. Otherwise, the body
+ *          is evaluated in place for each index, binding the index.
+ *          The part is given up, as a NaN, once the deadline has passed.
+ *
+ * @param range The aggregate
+ * @param begin The offset of the first index of the part
+ * @param end The offset past the last index of the part
+ * @param scratch The values of the nodes of the body for the lanes
+ * @return The sum or the product of the body over the part
+ * @see NodePool::eval_pool_range, Limits::deadline_passed
+ */
+static long double eval_part(const range_t *range, uint64_t begin, uint64_t end, long double *scratch)
+{
+  bool sum = range->function == SERIES;
+  kahan_t total = { 0.0, 0.0 };
+  long double product = 1.0;
+
+  if (!range->lanes) {
+    for (uint64_t k = begin; k < end; ++k) {
+      if (!((k - begin) % LIMITS_CHECK_INDICES) && deadline_passed()) return NAN;
+
+      range->bindings[range->index] = range->lo + (long double)k;
+      eval_pool_range(range->nodes, range->first, range->root + 1, range->bindings, range->values);
+
+      if (sum) add_kahan(&total, range->values[range->root]);
+      else     product *= range->values[range->root];
+    }
+
+    return sum ? total.sum - total.compensation : product;
+  }
+
+  kahan_t sums[AGGREGATE_LANES] = { { 0.0, 0.0 } };
+  long double products[AGGREGATE_LANES];
+  for (size_t l = 0; l < AGGREGATE_LANES; ++l) products[l] = 1.0;
+
+  const long double *result = scratch + (size_t)(range->root - range->first) * AGGREGATE_LANES;
+
+  for (uint64_t k = begin; k < end; k += AGGREGATE_LANES) {
+    if (!((k - begin) % LIMITS_CHECK_INDICES) && deadline_passed()) return NAN;
+
+    size_t n = end - k < AGGREGATE_LANES ? (size_t)(end - k) : AGGREGATE_LANES;
+    eval_lanes(range, k, n, scratch);
+
+    if (sum) for (size_t l = 0; l < n; ++l) add_kahan(&sums[l], result[l]);
+    else     for (size_t l = 0; l < n; ++l) products[l] *= result[l];
+  }
+
+  for (size_t l = 0; l < AGGREGATE_LANES; ++l) {
+    if (sum) add_kahan(&total, sums[l].sum - sums[l].compensation);
+    else     product *= products[l];
+  }
+
+  return sum ? total.sum - total.compensation : product;
+}
+
+
+/**
+ * @brief Evaluates the parts of a range until there are none left
+ *
+ * @param arg The parts
+ * @return NULL
+ */
+static void *run_parts(void *arg)
+{
+  parts_t *parts = arg;
+  const range_t *range = parts->range;
+  set_deadline(range->deadline);
+
+  long double local[AGGREGATE_STACK_NODES * AGGREGATE_LANES];
+  long double *scratch = local;
+
+  size_t body = (size_t)(range->root - range->first) + 1;
+  if (range->lanes && body > AGGREGATE_STACK_NODES) {
+    scratch = malloc(body * AGGREGATE_LANES * sizeof(*scratch));
+    assert(scratch != NULL);
+  }
+
+  unsigned int p = 0;
+  while ((p = atomic_fetch_add(&parts->next, 1U)) < parts->nbr_parts) {
+    uint64_t begin = p * parts->size;
+    uint64_t end = parts->count - begin < parts->size ? parts->count : begin + parts->size;
+
+    parts->results[p] = begin < parts->count ? eval_part(range, begin, end, scratch)
+                                             : (range->function == SERIES ? 0.0 : 1.0);
+  }
+
+  if (scratch != local) free(scratch);
+
+  return NULL;
+}
+
+
+/**
+ * @brief Computes the value of an aggregate stored in a node pool
+ * @details sum(i, lo, hi, body) adds the body for i = lo, lo + 1, ... up to
+ *          hi, and prod multiplies it; an empty range gives 0 or 1, and a
+ *          NaN or an infinite bound gives NaN. The body is the range of
+ *          nodes before the aggregate, so it is compiled once and run for
+ *          every index, AGGREGATE_LANES indices at a time. The sums are
+ *          compensated, so the rounding errors of the terms don't add up.
+ *
+ *          A range of at least AGGREGATE_SPLIT indices is split into
+ *          AGGREGATE_PARTS equal parts, which are added or multiplied in
+ *          order. If the body has no aggregate, the parts are evaluated by
+ *          the threads set by set_aggregate_threads. The parts don't depend
+ *          on the number of threads, so neither does the result.
+ *
+ *          Once the deadline of the evaluation has passed, the aggregate
+ *          gives up and is a NaN.
+ *
+ * @param nodes The nodes of the tree
+ * @param node The index of the aggregate, its bounds are evaluated
+ * @param bindings The values of the variables, the one of the index of the
+ *        aggregate is changed
+ * @param values The values of the nodes, those of the body are changed
+ * @return The value of the aggregate
+ * @see NodePool::eval_pool_range
+ */
+long double eval_aggregate(const pool_node_t *nodes, uint32_t node,
+                           long double *bindings, long double *values)
+{
+  const pool_node_t *aggregate = &nodes[node];
+  uint32_t arguments = aggregate->left, bounds = nodes[arguments].left;
+
+  range_t range = { nodes, aggregate->value.function, arguments + 1, aggregate->right,
+                    nodes[nodes[bounds].left].value.variable, values[nodes[bounds].right],
+                    true, bindings, values, get_deadline() };
+  long double hi = values[nodes[arguments].right];
+
+  if (isnan(range.lo) || isnan(hi)) return NAN;
+  if (hi < range.lo) return range.function == SERIES ? 0.0 : 1.0;
+
+  long double span = floorl(hi - range.lo);
+  if (!(span < 0x1p62L)) return NAN;
+
+  range.lanes = is_lane_body(nodes, range.first, range.root);
+
+  parts_t parts;
+  parts.range     = &range;
+  parts.count     = (uint64_t)span + 1;
+  parts.nbr_parts = parts.count >= AGGREGATE_SPLIT ? AGGREGATE_PARTS : 1;
+  parts.size      = (parts.count + parts.nbr_parts - 1) / parts.nbr_parts;
+  atomic_init(&parts.next, 0U);
+
+  unsigned int threads = range.lanes && parts.nbr_parts > 1 ? aggregate_threads : 1;
+  if (threads > parts.nbr_parts) threads = parts.nbr_parts;
+
+  pthread_t ids[AGGREGATE_PARTS];
+  unsigned int started = 0;
+  while (started + 1 < threads && !pthread_create(&ids[started], NULL, &run_parts, &parts))
+    ++started;
+
+  run_parts(&parts);
+
+  for (unsigned int i = 0; i < started; ++i)
+    pthread_join(ids[i], NULL);
+
+  if (deadline_passed()) return NAN;
+
+  kahan_t total = { 0.0, 0.0 };
+  long double product = 1.0;
+  for (unsigned int p = 0; p < parts.nbr_parts; ++p) {
+    if (range.function == SERIES) add_kahan(&total, parts.results[p]);
+    else                       product *= parts.results[p];
+  }
+
+  return range.function == SERIES ? total.sum - total.compensation : product;
+}
@@ -0,0 +1,65 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../parser/NodePool.h"
+
+/**
+ * The number of indices of an aggregate whose body is evaluated together,
+ * each one in its own lane
+ */
+#define AGGREGATE_LANES 8
+
+/**
+ * The ranges of at least AGGREGATE_SPLIT indices are split into
+ * AGGREGATE_PARTS parts, which can be evaluated by several threads
+ */
+#define AGGREGATE_SPLIT (1 << 20)
+#define AGGREGATE_PARTS 64
+
+/**
+ * @brief Sets the number of threads which evaluate the large aggregates
+ */
+void set_aggregate_threads(unsigned int);
+
+/**
+ * @brief Returns the number of threads which evaluate the large aggregates
+ */
+unsigned int get_aggregate_threads(void);
+
+/**
+ * @brief Computes the value of an aggregate stored in a node pool
+ */
+long double eval_aggregate(const pool_node_t*, uint32_t, long double*, long double*);
+
+/**
+ * @brief Computes a variadic function of some values
+ */
+long double reduce_values(FunctionID, const long double*, size_t);
+
+/**
+ * @brief Computes a variadic function stored in a node pool
+ */
+long double eval_variadic(const pool_node_t*, uint32_t, const long double*);
+
+/**
+ * @brief Computes the values of a node for several lanes
+ */
+void eval_node_lanes(const pool_node_t*, const long double*, const long double*, size_t, long double*);
+
+/**
+ * @brief Checks if the body of an aggregate can be evaluated in lanes
+ */
+bool is_lane_body(const pool_node_t*, uint32_t, uint32_t);
+
+/**
+ * @brief Computes the values of the body of an aggregate for several
+ *        values of its index, one per lane
+ */
+void eval_body_lanes(const pool_node_t*, uint32_t, uint32_t, uint32_t, const long double*,
+                     const long double*, size_t, long double*);
+
+#endif
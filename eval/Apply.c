@@ -0,0 +1,58 @@
+#include <math.h>
+
+#include "../CommonHeaders.h"
+#include "Apply.h"
+#include "FastMath.h"
+#include "Aggregate.h"
+
+
+/**
+ * @brief Evaluates a function given by its ID
+ * @details Unless the math mode is MATH_EXACT, the unary functions are
+ *          computed in double precision by our kernels. A variadic function
+ *          is applied to both operands, like a call with two arguments, and
+ *          so is a function of a plugin.
+ *
+ *          An aggregate is not a function of two operands: it is evaluated
+ *          over its range by eval_aggregate, and gives NaN here.
+ *
+ * @param id The ID of the function to evaluate
+ * @param lc The first operand
+ * @param rc The second operand
+ * @return The result of the function evaluation
+ * @see FastMath::fast_function, Aggregate::reduce_values
+ */
+long double eval_function_id(FunctionID id, long double lc, long double rc)
+{
+  long double (*ufunc[])(long double) = { sinl, cosl, tanl, sqrtl, fabsl, logl };
+
+  FunctionType type = get_function_id_type(id);
+  if (type == AGGREGATE)
+    return NAN;
+
+  if (type == VARIADIC) {
+    const long double operands[] = { lc, rc };
+    return reduce_values(id, operands, 2);
+  }
+
+  MathMode mode = get_math_mode();
+  if (mode != MATH_EXACT)
+    return fast_function(id, mode, (double)rc);
+
+  return ufunc[id](rc);
+}
+
+
+/**
+ * @brief Evaluates a function
+ *
+ * @param func The function to evaluate
+ * @param lc The first operand
+ * @param rc The second operand
+ * @return The result of the function evaluation
+ * @see Apply::eval_function_id
+ */
+long double eval_function(Function func, long double lc, long double rc)
+{
+  return eval_function_id(func->id, lc, rc);
+}
@@ -0,0 +1,16 @@
+#ifndef APPLY_H
+#define APPLY_H
+
+#include "../lexer/Function.h"
+
+/**
+ * @brief Evaluates a function given by its ID
+ */
+long double eval_function_id(FunctionID, long double, long double);
+
+/**
+ * @brief Evaluates a function
+ */
+long double eval_function(Function, long double, long double);
+
+#endif
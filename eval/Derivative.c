@@ -0,0 +1,583 @@
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Function.h"
+#include "../lexer/Number.h"
+#include "../lexer/Token.h"
+#include "Aggregate.h"
+#include "Driver.h"
+#include "Plugin.h"
+#include "Derivative.h"
+#include "Limits.h"
+
+
+/**
+ * @brief The state of the evaluation of a gradient
+ * @details The node at depth d stores the gradients of its children at
+ *          scratch[2nd] and scratch[2nd + n], so a single buffer of
+ *          2n times the height of the tree is enough. The indices of the
+ *          aggregates around the current node are not variables of the tree.
+ */
+typedef struct gradient_t
+{
+  Environment env;
+  const char *const *names;
+  size_t n;
+  long double *scratch;
+  const char **indices;
+  size_t nbr_indices;
+} gradient_t;
+
+
+/**
+ * @brief Computes the height of a tree
+ *
+ * @param root The root of the tree
+ * @return The number of nodes of the longest path from the root to a leaf
+ */
+static size_t tree_height(ASTNode root)
+{
+  if (!root) return 0;
+
+  size_t left = tree_height(root->left), right = tree_height(root->right);
+
+  return (left > right ? left : right) + 1;
+}
+
+
+/**
+ * @brief Computes the derivatives of a unary function
+ *
+ * @param func The function
+ * @param r The value of the operand
+ * @param v The value of the function
+ * @param dr The gradient of the operand
+ * @param grad Where to store the gradient of the function
+ * @param n The number of variables
+ */
+static void diff_function(Function func, long double r, long double v,
+                          const long double *dr, long double *grad, size_t n)
+{
+  long double factor = 0.0;
+  switch (func->id) {
+    case SIN:
+                factor = cosl(r);
+                break;
+    case COS:
+                factor = -sinl(r);
+                break;
+    case TAN:
+                factor = 1.0 + v * v;
+                break;
+    case SQRT:
+                factor = 0.5 / v;
+                break;
+    case ABS:
+                factor = r > 0.0 ? 1.0 : r < 0.0 ? -1.0 : 0.0;
+                break;
+    case LN:
+                factor = 1.0 / r;
+                break;
+    default:
+                break;
+  }
+
+  for (size_t i = 0; i < n; ++i)
+    grad[i] = factor * dr[i];
+}
+
+
+/**
+ * @brief Computes the derivatives of an operator
+ *
+ * @param type The operator
+ * @param l The value of the left operand, 0 if there is none
+ * @param r The value of the right operand
+ * @param v The value of the operator
+ * @param dl The gradient of the left operand
+ * @param dr The gradient of the right operand
+ * @param grad Where to store the gradient of the operator
+ * @param n The number of variables
+ */
+static void diff_operator(TokenType type, long double l, long double r, long double v,
+                          const long double *dl, const long double *dr,
+                          long double *grad, size_t n)
+{
+  switch (type) {
+    case PLUS:
+                for (size_t i = 0; i < n; ++i) grad[i] = dl[i] + dr[i];
+                break;
+    case BMINUS:
+                for (size_t i = 0; i < n; ++i) grad[i] = dl[i] - dr[i];
+                break;
+    case UMINUS:
+                for (size_t i = 0; i < n; ++i) grad[i] = -dr[i];
+                break;
+    case MULTIPLY:
+                for (size_t i = 0; i < n; ++i) grad[i] = dl[i] * r + l * dr[i];
+                break;
+    case DIVIDE:
+                for (size_t i = 0; i < n; ++i) grad[i] = (dl[i] - v * dr[i]) / r;
+                break;
+    case EXPONENT:
+    {
+                /* The ln(l) term only appears when the exponent varies, so
+                 * x^2 stays differentiable at x <= 0. */
+                long double power = 0.0, log_base = 0.0;
+                bool has_power = false, has_log = false;
+                for (size_t i = 0; i < n; ++i) {
+                  long double d = 0.0;
+                  if (dl[i] != 0.0) {
+                    if (!has_power) power = r * powl(l, r - 1.0), has_power = true;
+                    d += power * dl[i];
+                  }
+                  if (dr[i] != 0.0) {
+                    if (!has_log) log_base = v * logl(l), has_log = true;
+                    d += log_base * dr[i];
+                  }
+                  grad[i] = d;
+                }
+                break;
+    }
+    case IPOWER:
+    {
+                long double power = r * powl(l, r - 1.0);
+                for (size_t i = 0; i < n; ++i) grad[i] = power * dl[i];
+                break;
+    }
+    case MODULO:
+    {
+                /* remainder(l, r) = l - q r, where q is locally constant */
+                long double q = nearbyintl((l - v) / r);
+                for (size_t i = 0; i < n; ++i) grad[i] = dl[i] - q * dr[i];
+                break;
+    }
+    default:
+                break;
+  }
+}
+
+
+static long double eval_dual(ASTNode, size_t, gradient_t*, long double*);
+
+
+/**
+ * @brief Computes the gradient of a call of a function of a plugin
+ * @details The plugin only gives the values of its function, so its partial
+ *          derivatives are central differences, with a step of the cube
+ *          root of the epsilon relative to each argument, which balances
+ *          the rounding and the truncation errors:
+ *            df/dx_k = (f(x_k + h) - f(x_k - h)) / 2h
+ *          An argument which doesn't depend on the variables is not moved.
+ *
+ * @param id The function
+ * @param values The values of the arguments, restored on return
+ * @param count The number of arguments
+ * @param grads The gradients of the arguments, n each
+ * @param grad Where to store the gradient of the call
+ * @param n The number of variables
+ * @see Plugin::call_plugin
+ */
+static void diff_plugin(FunctionID id, long double *values, size_t count,
+                        const long double *grads, long double *grad, size_t n)
+{
+  for (size_t k = 0; k < count; ++k) {
+    bool constant = true;
+    for (size_t i = 0; i < n && constant; ++i) constant = grads[k * n + i] == 0.0;
+    if (constant) continue;
+
+    long double x = values[k], h = cbrtl(LDBL_EPSILON) * fmaxl(1.0, fabsl(x));
+
+    values[k] = x + h;
+    long double up = call_plugin(id, values, count);
+    values[k] = x - h;
+    long double down = call_plugin(id, values, count);
+    values[k] = x;
+
+    long double slope = (up - down) / (2 * h);
+    for (size_t i = 0; i < n; ++i) grad[i] += slope * grads[k * n + i];
+  }
+}
+
+
+/**
+ * @brief Computes the value and the gradient of a variadic call
+ * @details The gradients of the arguments are kept until the value of the
+ *          call is known:
+ *            d max(f) = df_k, where f_k is the first largest argument
+ *            d sum(f) = sum(df), d mean(f) = mean(df)
+ *            d stddev(f) = sum((f_k - mean(f)) df_k) / (n stddev(f))
+ *          and the derivative of stddev is 0 where it is 0, since it is not
+ *          differentiable there. A function of a plugin is differentiated
+ *          numerically.
+ *
+ * @param node The call
+ * @param depth The depth of the call in the whole tree
+ * @param state The state of the evaluation
+ * @param grad Where to store the gradient of the call
+ * @return The value of the call
+ * @see AST::get_arguments, Aggregate::reduce_values, Derivative::diff_plugin
+ */
+static long double eval_dual_variadic(ASTNode node, size_t depth, gradient_t *state,
+                                      long double *grad)
+{
+  size_t n = state->n, count = get_arguments(node, NULL);
+  FunctionID id = ((Function)node->token->data)->id;
+
+  ASTNode *arguments = malloc(count * sizeof(*arguments));
+  long double *values = malloc(count * (n + 1) * sizeof(*values));
+  assert(arguments != NULL && values != NULL);
+
+  long double *grads = values + count;
+  get_arguments(node, arguments);
+  for (size_t k = 0; k < count; ++k)
+    values[k] = eval_dual(arguments[k], depth + 1, state, grads + k * n);
+
+  long double result = reduce_values(id, values, count);
+
+  for (size_t i = 0; i < n; ++i) grad[i] = 0.0;
+
+  switch (id) {
+    case MAX:
+    case MIN:
+    {
+                size_t k = 0;
+                while (k + 1 < count && !(values[k] == result)) ++k;
+                memcpy(grad, grads + k * n, n * sizeof(*grad));
+                break;
+    }
+    case STDDEV:
+    {
+                if (result == 0.0) break;
+                long double mean = reduce_values(MEAN, values, count);
+                for (size_t k = 0; k < count; ++k)
+                  for (size_t i = 0; i < n; ++i)
+                    grad[i] += (values[k] - mean) * grads[k * n + i];
+                for (size_t i = 0; i < n; ++i) grad[i] /= (long double)count * result;
+                break;
+    }
+    default:
+                if (is_plugin(id)) {
+                  diff_plugin(id, values, count, grads, grad, n);
+                  break;
+                }
+                for (size_t k = 0; k < count; ++k)
+                  for (size_t i = 0; i < n; ++i) grad[i] += grads[k * n + i];
+                if (id == MEAN)
+                  for (size_t i = 0; i < n; ++i) grad[i] /= (long double)count;
+                break;
+  }
+
+  free(values);
+  free(arguments);
+
+  return result;
+}
+
+
+/**
+ * @brief Computes the value and the gradient of an aggregate
+ * @details The bounds are integers, their derivatives are 0. The body is
+ *          evaluated on dual numbers for each index, bound in a copy of the
+ *          environment, and the gradients are combined by the rules of sums
+ *          and products:
+ *            d sum(f)  = sum(df)
+ *            d prod(f) = sum(df_k * prod(f_j, j != k))
+ *          The value is the one of eval_tree_value, computed apart, since
+ *          the gradients are accumulated serially. The deadline is checked
+ *          every LIMITS_CHECK_INDICES indices, like the value does.
+ *
+ * @param node The aggregate
+ * @param depth The depth of the aggregate in the whole tree
+ * @param state The state of the evaluation
+ * @param grad Where to store the gradient of the aggregate
+ * @return The value of the aggregate, or NaN if the deadline is passed
+ * @see AST::eval_tree_value, Limits::deadline_passed
+ */
+static long double eval_dual_aggregate(ASTNode node, size_t depth, gradient_t *state,
+                                       long double *grad)
+{
+  size_t n = state->n;
+  ASTNode arguments = node->left;
+  bool sum = ((Function)node->token->data)->id == SERIES;
+
+  long double result = eval_tree_value(node, state->env);
+  long double lo = eval_tree_value(arguments->left->right, state->env);
+  long double hi = eval_tree_value(arguments->right, state->env);
+
+  for (size_t i = 0; i < n; ++i) grad[i] = 0.0;
+  if (isnan(result) || isnan(lo) || !(hi >= lo) || !(hi - lo < 0x1p62L)) return result;
+
+  Environment outer = state->env, env = create_environment();
+  for (size_t i = 0; outer && i < outer->size; ++i)
+    set_variable(env, outer->names[i], outer->values[i]);
+
+  const char *index = arguments->left->left->token->data;
+  state->env = env;
+  state->indices[state->nbr_indices++] = index;
+
+  long double *dr = state->scratch + 2 * n * depth + n, product = 1.0;
+  uint64_t count = (uint64_t)floorl(hi - lo) + 1;
+
+  for (uint64_t k = 0; k < count; ++k) {
+    if (!(k % LIMITS_CHECK_INDICES) && deadline_passed()) {
+      result = NAN;
+      break;
+    }
+
+    set_variable(env, index, lo + (long double)k);
+    long double value = eval_dual(node->right, depth + 1, state, dr);
+
+    for (size_t i = 0; i < n; ++i)
+      grad[i] = sum ? grad[i] + dr[i] : grad[i] * value + product * dr[i];
+    product *= value;
+  }
+
+  --state->nbr_indices;
+  state->env = outer;
+  delete_environment(env);
+
+  return result;
+}
+
+
+/**
+ * @brief The integrand of a partial derivative of an integral: the
+ *        derivative of its body with respect to one of the variables
+ */
+typedef struct partial_t
+{
+  ASTNode body;
+  size_t depth;
+  gradient_t *state;
+  const char *index;
+  size_t variable;
+  long double *grad;
+} partial_t;
+
+
+/**
+ * @brief Computes the derivative of the body of an integral with respect to
+ *        one of the variables, at some points
+ *
+ * @param context The partial derivative
+ * @param x The values of the index
+ * @param n The number of values
+ * @param fx Where to store the derivatives, NaN past the deadline
+ * @see Driver::integrate_function, Limits::deadline_passed
+ */
+static void eval_partial(void *context, const long double *x, size_t n, long double *fx)
+{
+  partial_t *partial = context;
+
+  for (size_t k = 0; k < n; ++k) {
+    if (!(k % LIMITS_CHECK_INDICES) && deadline_passed()) {
+      for (; k < n; ++k) fx[k] = NAN;
+      return;
+    }
+
+    set_variable(partial->state->env, partial->index, x[k]);
+    eval_dual(partial->body, partial->depth, partial->state, partial->grad);
+    fx[k] = partial->grad[partial->variable];
+  }
+}
+
+
+/**
+ * @brief Computes the value and the gradient of a driver
+ * @details The root r of solve(f, x, a, b) is a function of the variables
+ *          where f(r) = 0 and f is differentiable, by the implicit function
+ *          theorem, and its bounds don't matter:
+ *            d solve(f) = -df(r) / f'(r)
+ *          An integral is differentiated under the integral sign, and its
+ *          bounds by the fundamental theorem of calculus:
+ *            d integrate(f, x, a, b) = integrate(df, x, a, b) + f(b) db - f(a) da
+ *          where each partial derivative of f is integrated like f, and the
+ *          value of f at a bound is only needed if the bound varies. The
+ *          deadline is checked before each of these integrals.
+ *
+ * @param node The driver
+ * @param depth The depth of the driver in the whole tree
+ * @param state The state of the evaluation
+ * @param grad Where to store the gradient of the driver
+ * @return The value of the driver, or NaN if the deadline is passed
+ * @see AST::eval_tree_value, Driver::integrate_function
+ */
+static long double eval_dual_driver(ASTNode node, size_t depth, gradient_t *state,
+                                    long double *grad)
+{
+  size_t n = state->n;
+  ASTNode arguments = node->left;
+  bool solve = ((Function)node->token->data)->id == SOLVE;
+
+  long double result = eval_tree_value(node, state->env);
+  long double *dl = state->scratch + 2 * n * depth, *dr = dl + n, lo = 0.0, hi = 0.0;
+  if (!solve) {
+    lo = eval_dual(arguments->left->right, depth + 1, state, dl);
+    hi = eval_dual(arguments->right, depth + 1, state, dr);
+  }
+
+  for (size_t i = 0; i < n; ++i) grad[i] = 0.0;
+  if (isnan(result)) return result;
+
+  Environment outer = state->env, env = create_environment();
+  for (size_t i = 0; outer && i < outer->size; ++i)
+    set_variable(env, outer->names[i], outer->values[i]);
+
+  const char *index = arguments->left->left->token->data;
+  state->env = env;
+  state->indices[state->nbr_indices++] = index;
+
+  if (solve) {
+    set_variable(env, index, result);
+    eval_dual(node->right, depth + 1, state, dl);
+
+    long double slope = 0.0;
+    eval_tree_gradient(node->right, env, &index, 1, &slope);
+    for (size_t i = 0; i < n; ++i) grad[i] = -dl[i] / slope;
+  } else {
+    const long double bounds[] = { lo, hi }, *moves[] = { dl, dr };
+
+    for (size_t b = 0; b < 2; ++b) {
+      bool moving = false;
+      for (size_t i = 0; i < n; ++i) moving = moving || moves[b][i] != 0.0;
+      if (!moving) continue;
+
+      set_variable(env, index, bounds[b]);
+      long double value = eval_tree_value(node->right, env);
+      for (size_t i = 0; i < n; ++i)
+        if (moves[b][i] != 0.0) grad[i] += (b ? value : -value) * moves[b][i];
+    }
+
+    long double *partials = malloc(n * sizeof(*partials));
+    assert(partials != NULL);
+
+    partial_t partial = { node->right, depth + 1, state, index, 0, partials };
+    for (size_t i = 0; i < n; ++i) {
+      if (deadline_passed()) {
+        result = NAN;
+        break;
+      }
+
+      partial.variable = i;
+      grad[i] += integrate_function(&eval_partial, &partial, lo, hi);
+    }
+
+    free(partials);
+  }
+
+  --state->nbr_indices;
+  state->env = outer;
+  delete_environment(env);
+
+  return result;
+}
+
+
+/**
+ * @brief Computes the value and the gradient of a subtree
+ *
+ * @param node The root of the subtree
+ * @param depth The depth of the subtree in the whole tree
+ * @param state The state of the evaluation
+ * @param grad Where to store the gradient of the subtree
+ * @return The value of the subtree
+ * @see AST::eval_node
+ */
+static long double eval_dual(ASTNode node, size_t depth, gradient_t *state, long double *grad)
+{
+  size_t n = state->n;
+
+  if (!node->right) {
+    const char *data = node->token->data;
+    for (size_t i = 0; i < n; ++i) grad[i] = 0.0;
+
+    if (node->token->type == LITERAL)
+      return parse_number(data, strlen(data));
+
+    bool index = false;
+    for (size_t i = state->nbr_indices; i-- > 0 && !index; )
+      index = !strcmp(state->indices[i], data);
+
+    for (size_t i = 0; i < n && !index; ++i) {
+      if (!strcmp(state->names[i], data)) grad[i] = 1.0;
+    }
+
+    return get_variable(state->env, data);
+  }
+
+  if (node->token->type == FUNCTION && get_function_type(node->token->data) == AGGREGATE)
+    return is_driver(((Function)node->token->data)->id) ? eval_dual_driver(node, depth, state, grad)
+                                                        : eval_dual_aggregate(node, depth, state, grad);
+
+  if (node->token->type == FUNCTION && get_function_type(node->token->data) == VARIADIC)
+    return eval_dual_variadic(node, depth, state, grad);
+
+  long double *dl = state->scratch + 2 * n * depth, *dr = dl + n;
+
+  long double lc = 0.0;
+  if (node->left) lc = eval_dual(node->left, depth + 1, state, dl);
+  else            for (size_t i = 0; i < n; ++i) dl[i] = 0.0;
+
+  long double rc = eval_dual(node->right, depth + 1, state, dr);
+
+  long double result = eval_node(node, lc, rc);
+
+  if (node->token->type == FUNCTION)
+    diff_function(node->token->data, rc, result, dr, grad, n);
+  else
+    diff_operator(node->token->type, lc, rc, result, dl, dr, grad, n);
+
+  return result;
+}
+
+
+/**
+ * @brief Computes the value of the parse tree and its partial derivatives
+ *        with respect to some variables
+ * @details The tree is evaluated once on dual numbers: each node carries
+ *          its value and its gradient, computed from the ones of its
+ *          children by the chain rule. The value is identical to the one
+ *          of eval_tree_value, and the derivatives are exact up to the
+ *          rounding of the arithmetic, unlike finite differences.
+ *
+ *          At the points where a function is not differentiable (abs at 0,
+ *          max and min when several arguments are equal), the derivative of
+ *          one side is taken. The index of an aggregate is not a variable:
+ *          the derivative of sum(i, 1, n, i * x) with respect to i is 0.
+ *          The roots and the integrals are differentiated by the implicit
+ *          function theorem and under the integral sign, and the functions
+ *          of the plugins by central differences.
+ *
+ * @param root The root of the tree
+ * @param env The values of the variables, may be NULL
+ * @param names The names of the variables to differentiate with respect to
+ * @param n The number of variables
+ * @param gradient Where to store the n partial derivatives
+ * @return The value of the tree
+ * @see AST::eval_tree_value
+ */
+long double eval_tree_gradient(ASTNode root, Environment env, const char *const *names,
+                               size_t n, long double *gradient)
+{
+  assert(root != NULL);
+
+  if (!n) return eval_tree_value(root, env);
+
+  size_t height = tree_height(root);
+  gradient_t state = { env, names, n, NULL, NULL, 0 };
+  state.scratch = malloc(2 * n * height * sizeof(*state.scratch));
+  state.indices = malloc(height * sizeof(*state.indices));
+  assert(state.scratch != NULL && state.indices != NULL);
+
+  long double result = eval_dual(root, 0, &state, gradient);
+
+  free(state.indices);
+  free(state.scratch);
+
+  return result;
+}
@@ -0,0 +1,15 @@
+#ifndef DERIVATIVE_H
+#define DERIVATIVE_H
+
+#include <stddef.h>
+
+#include "../parser/AST.h"
+#include "../parser/Environment.h"
+
+/**
+ * @brief Computes the value of the parse tree and its partial derivatives
+ *        with respect to some variables
+ */
+long double eval_tree_gradient(ASTNode, Environment, const char *const*, size_t, long double*);
+
+#endif
@@ -0,0 +1,578 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Function.h"
+#include "Aggregate.h"
+#include "FastMath.h"
+#include "Limits.h"
+#include "Driver.h"
+
+
+/**
+ * The number of points of the Gauss-Kronrod rule on a subinterval
+ */
+#define KRONROD_POINTS 15
+
+/**
+ * The points of the 15-point Kronrod rule on [-1, 1], from the end to the
+ * center, and their weights; the odd ones are the points of the 7-point
+ * Gauss rule, whose weights follow (QUADPACK's qk15)
+ */
+static const long double kronrod_points[8] = {
+  0.991455371120812639206854697526329L, 0.949107912342758524526189684047851L,
+  0.864864423359769072789712788640926L, 0.741531185599394439863864773280788L,
+  0.586087235467691130294144845693013L, 0.405845151377397166906606412076961L,
+  0.207784955007898467600689403773245L, 0.000000000000000000000000000000000L
+};
+
+static const long double kronrod_weights[8] = {
+  0.022935322010529224963732008058970L, 0.063092092629978553290700663189204L,
+  0.104790010322250183839876322541518L, 0.140653259715525918745189590510238L,
+  0.169004726639267902826583426598550L, 0.190350578064785409913256402421014L,
+  0.204432940075298892414161999234649L, 0.209482141084727828012999174891714L
+};
+
+static const long double gauss_weights[4] = {
+  0.129484966168869693270611432679082L, 0.279705391489276667901467771423780L,
+  0.381830050505118944950369775488975L, 0.417959183673469387755102040816327L
+};
+
+
+/**
+ * @brief The body of a driver being run, or a function given by the caller
+ * @details The body is evaluated in lanes if it has no aggregate and all
+ *          the children of its nodes are in it; then it only reads the
+ *          bindings, and several threads can run it. The deadline is the
+ *          one of the evaluation, for the threads which help it.
+ */
+typedef struct driver_t
+{
+  const pool_node_t *nodes;
+  uint32_t first;
+  uint32_t root;
+  uint32_t index;
+  bool lanes;
+  long double *bindings;
+  long double *values;
+  integrand_t function;
+  void *context;
+  uint64_t deadline;
+} driver_t;
+
+/**
+ * @brief A subinterval of an integral, with the estimates of the rule on it:
+ *        the integral, its error and the integral of the absolute value
+ */
+typedef struct interval_t
+{
+  long double a;
+  long double b;
+  long double result;
+  long double error;
+  long double absolute;
+} interval_t;
+
+/**
+ * @brief The subintervals evaluated by a round, taken in turn by the
+ *        threads which evaluate them
+ */
+typedef struct round_t
+{
+  const driver_t *driver;
+  interval_t *intervals;
+  const size_t *pending;
+  size_t count;
+  atomic_size_t next;
+} round_t;
+
+
+/**
+ * @brief Computes the body of a driver at some points
+ * @details In lanes, AGGREGATE_LANES points are evaluated at once.
+ *          Otherwise, the body is evaluated in place for each point,
+ *          binding the index.
+ *
+ * @param driver The driver
+ * @param x The points
+ * @param n The number of points
+ * @param fx Where to store the values of the body
+ * @param scratch The values of the nodes of the body for the lanes
+ * @see Aggregate::eval_body_lanes, NodePool::eval_pool_range
+ */
+static void eval_points(const driver_t *driver, const long double *x, size_t n,
+                        long double *fx, long double *scratch)
+{
+  if (driver->function) {
+    driver->function(driver->context, x, n, fx);
+    return;
+  }
+
+  if (!driver->lanes) {
+    for (size_t k = 0; k < n; ++k) {
+      driver->bindings[driver->index] = x[k];
+      eval_pool_range(driver->nodes, driver->first, driver->root + 1, driver->bindings, driver->values);
+      fx[k] = driver->values[driver->root];
+    }
+    return;
+  }
+
+  const long double *result = scratch + (size_t)(driver->root - driver->first) * AGGREGATE_LANES;
+
+  for (size_t k = 0; k < n; k += AGGREGATE_LANES) {
+    size_t lanes = n - k < AGGREGATE_LANES ? n - k : AGGREGATE_LANES;
+    eval_body_lanes(driver->nodes, driver->first, driver->root, driver->index, x + k,
+                    driver->bindings, lanes, scratch);
+    memcpy(fx + k, result, lanes * sizeof(*fx));
+  }
+}
+
+
+/**
+ * @brief Allocates the scratch buffer of the lanes of a driver
+ *
+ * @param driver The driver
+ * @return The buffer, or NULL if the body is not evaluated in lanes
+ */
+static long double *create_scratch(const driver_t *driver)
+{
+  if (!driver->lanes) return NULL;
+
+  size_t body = (size_t)(driver->root - driver->first) + 1;
+  long double *scratch = malloc(body * AGGREGATE_LANES * sizeof(*scratch));
+  assert(scratch != NULL);
+
+  return scratch;
+}
+
+
+/**
+ * @brief Computes the 15-point Gauss-Kronrod rule on a subinterval
+ * @details The 15 points are evaluated together. The error is estimated
+ *          from the difference between the Kronrod and the Gauss rules,
+ *          scaled like QUADPACK does, and never below the rounding error of
+ *          the sum.
+ *
+ * @param driver The driver
+ * @param interval The subinterval, whose estimates are set
+ * @param scratch The values of the nodes of the body for the lanes
+ */
+static void eval_interval(const driver_t *driver, interval_t *interval, long double *scratch)
+{
+  long double center = 0.5L * (interval->a + interval->b);
+  long double half = 0.5L * (interval->b - interval->a);
+  long double x[KRONROD_POINTS], f[KRONROD_POINTS];
+
+  x[0] = center;
+  for (size_t j = 0; j < 7; ++j) {
+    x[2 * j + 1] = center - half * kronrod_points[j];
+    x[2 * j + 2] = center + half * kronrod_points[j];
+  }
+
+  eval_points(driver, x, KRONROD_POINTS, f, scratch);
+
+  long double kronrod = kronrod_weights[7] * f[0], gauss = gauss_weights[3] * f[0];
+  long double absolute = kronrod_weights[7] * fabsl(f[0]);
+  for (size_t j = 0; j < 7; ++j) {
+    long double pair = f[2 * j + 1] + f[2 * j + 2];
+    kronrod  += kronrod_weights[j] * pair;
+    absolute += kronrod_weights[j] * (fabsl(f[2 * j + 1]) + fabsl(f[2 * j + 2]));
+    if (j % 2) gauss += gauss_weights[j / 2] * pair;
+  }
+
+  long double mean = 0.5L * kronrod;
+  long double deviation = kronrod_weights[7] * fabsl(f[0] - mean);
+  for (size_t j = 0; j < 7; ++j)
+    deviation += kronrod_weights[j] * (fabsl(f[2 * j + 1] - mean) + fabsl(f[2 * j + 2] - mean));
+
+  long double width = fabsl(half);
+  long double error = fabsl((kronrod - gauss) * half);
+  deviation *= width;
+  absolute  *= width;
+
+  if (deviation != 0.0 && error != 0.0)
+    error = deviation * fminl(1.0, powl(200.0 * error / deviation, 1.5L));
+  if (absolute > LDBL_MIN / (50.0 * LDBL_EPSILON))
+    error = fmaxl(50.0 * LDBL_EPSILON * absolute, error);
+
+  interval->result   = kronrod * half;
+  interval->error    = error;
+  interval->absolute = absolute;
+}
+
+
+/**
+ * @brief Evaluates the subintervals of a round until there are none left
+ * @details A thread stops once the deadline has passed.
+ *
+ * @param arg The round
+ * @return NULL
+ */
+static void *run_round(void *arg)
+{
+  round_t *round = arg;
+  const driver_t *driver = round->driver;
+  set_deadline(driver->deadline);
+
+  long double *scratch = create_scratch(driver);
+
+  size_t k = 0;
+  while ((k = atomic_fetch_add(&round->next, 1)) < round->count && !deadline_passed())
+    eval_interval(driver, &round->intervals[round->pending[k]], scratch);
+
+  free(scratch);
+
+  return NULL;
+}
+
+
+/**
+ * @brief Evaluates the new subintervals of a round
+ * @details If the body is evaluated in lanes and the round evaluates at
+ *          least DRIVER_SPLIT nodes, the subintervals are shared by the
+ *          threads set by set_aggregate_threads. Each one is computed
+ *          alone, so the results don't depend on the number of threads.
+ *
+ * @param driver The driver
+ * @param intervals The subintervals
+ * @param pending The indices of those to evaluate
+ * @param count The number of subintervals to evaluate
+ */
+static void eval_round(const driver_t *driver, interval_t *intervals, const size_t *pending, size_t count)
+{
+  round_t round;
+  round.driver    = driver;
+  round.intervals = intervals;
+  round.pending   = pending;
+  round.count     = count;
+  atomic_init(&round.next, 0);
+
+  size_t nodes = count * KRONROD_POINTS * ((size_t)(driver->root - driver->first) + 1);
+  unsigned int threads = driver->lanes && nodes >= DRIVER_SPLIT ? get_aggregate_threads() : 1;
+  if (threads > count) threads = (unsigned int)count;
+  if (threads > AGGREGATE_PARTS) threads = AGGREGATE_PARTS;
+
+  pthread_t ids[AGGREGATE_PARTS];
+  unsigned int started = 0;
+  while (started + 1 < threads && !pthread_create(&ids[started], NULL, &run_round, &round))
+    ++started;
+
+  run_round(&round);
+
+  for (unsigned int i = 0; i < started; ++i)
+    pthread_join(ids[i], NULL);
+}
+
+
+/**
+ * @brief Returns the accuracy asked of an integral, relative to the
+ *        integral of the absolute value
+ * @details It follows the accuracy of the functions in the math mode.
+ *
+ * @return The relative tolerance
+ * @see FastMath::get_math_mode
+ */
+static long double quadrature_tolerance(void)
+{
+  switch (get_math_mode()) {
+    case MATH_EXACT: return 1e-15L;
+    case MATH_4ULP:  return 1e-13L;
+    default:         return 1e-6L;
+  }
+}
+
+
+/**
+ * @brief Computes the integral of the body of a driver between two bounds
+ * @details Adaptive Gauss-Kronrod quadrature: the interval is estimated by
+ *          the 15-point rule, then, by rounds, the subintervals whose error
+ *          is above their share of the tolerance are cut in two, until the
+ *          total error is below the tolerance times the integral of the
+ *          absolute value. Near a singularity, only the subinterval which
+ *          holds it is cut again; where the body is smooth or oscillates,
+ *          most of them are. The new subintervals of a round are
+ *          independent, so they are evaluated together.
+ *
+ *          The integral is NaN if a bound is not finite, if the body is not
+ *          finite at a point, or if it doesn't converge within
+ *          DRIVER_INTERVALS subintervals or before the deadline. If b < a,
+ *          it is the opposite of the integral from b to a.
+ *
+ * @param driver The driver
+ * @param a The lower bound
+ * @param b The upper bound
+ * @return The integral
+ * @see Driver::eval_round, Driver::eval_interval
+ */
+static long double integrate(const driver_t *driver, long double a, long double b)
+{
+  if (!isfinite(a) || !isfinite(b)) return NAN;
+  if (a == b) return 0.0;
+
+  size_t capacity = 16;
+  interval_t *intervals = malloc(capacity * sizeof(*intervals));
+  size_t *pending = malloc(2 * capacity * sizeof(*pending));
+  assert(intervals != NULL && pending != NULL);
+
+  long double limit = quadrature_tolerance(), value = NAN;
+
+  intervals[0].a = a;
+  intervals[0].b = b;
+  pending[0] = 0;
+  size_t size = 1, count = 1;
+
+  while (count) {
+    eval_round(driver, intervals, pending, count);
+    if (deadline_passed()) break;
+
+    long double result = 0.0, error = 0.0, absolute = 0.0;
+    for (size_t i = 0; i < size; ++i) {
+      result   += intervals[i].result;
+      error    += intervals[i].error;
+      absolute += intervals[i].absolute;
+    }
+
+    if (!isfinite(result) || !isfinite(error)) break;
+    if (error <= limit * absolute) {
+      value = result;
+      break;
+    }
+
+    // A round cuts at most all the subintervals in two
+    if (2 * size > capacity && capacity < DRIVER_INTERVALS) {
+      capacity = 2 * size < DRIVER_INTERVALS ? 2 * size : DRIVER_INTERVALS;
+      intervals = realloc(intervals, capacity * sizeof(*intervals));
+      pending = realloc(pending, 2 * capacity * sizeof(*pending));
+      assert(intervals != NULL && pending != NULL);
+    }
+
+    long double share = limit * absolute / (long double)size;
+    size_t added = 0;
+    count = 0;
+
+    for (size_t i = 0; i < size && size + added < capacity; ++i) {
+      interval_t *interval = &intervals[i];
+      long double middle = 0.5L * (interval->a + interval->b);
+      if (!(interval->error > share) || middle == interval->a || middle == interval->b) continue;
+
+      interval_t *right = &intervals[size + added];
+      right->a = middle;
+      right->b = interval->b;
+      interval->b = middle;
+
+      pending[count++] = i;
+      pending[count++] = size + added++;
+    }
+
+    size += added;
+  }
+
+  free(pending);
+  free(intervals);
+
+  return value;
+}
+
+
+/**
+ * @brief Looks for a change of sign of the body of a driver between two
+ *        bounds
+ * @details The body is evaluated at DRIVER_SCAN + 1 equally spaced points,
+ *          together, and the first two consecutive points where it has
+ *          opposite signs become the bounds. A point where it is 0 becomes
+ *          both bounds.
+ *
+ * @param driver The driver
+ * @param a The lower bound, and where to store the new one
+ * @param b The upper bound, and where to store the new one
+ * @param fa Where to store the value of the body at the new lower bound
+ * @param fb Where to store the value of the body at the new upper bound
+ * @param scratch The values of the nodes of the body for the lanes
+ * @return true if a change of sign was found
+ */
+static bool scan(const driver_t *driver, long double *a, long double *b,
+                 long double *fa, long double *fb, long double *scratch)
+{
+  long double x[DRIVER_SCAN + 1], fx[DRIVER_SCAN + 1];
+  long double step = (*b - *a) / DRIVER_SCAN;
+
+  for (size_t k = 0; k < DRIVER_SCAN; ++k) x[k] = *a + step * (long double)k;
+  x[DRIVER_SCAN] = *b;
+
+  eval_points(driver, x, DRIVER_SCAN + 1, fx, scratch);
+
+  for (size_t k = 1; k <= DRIVER_SCAN; ++k) {
+    if (fx[k] == 0.0) {
+      *a = *b = x[k];
+      *fa = *fb = 0.0;
+      return true;
+    }
+
+    if (!isnan(fx[k - 1]) && !isnan(fx[k]) && (fx[k - 1] > 0.0) != (fx[k] > 0.0)) {
+      *a = x[k - 1];
+      *b = x[k];
+      *fa = fx[k - 1];
+      *fb = fx[k];
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/**
+ * @brief Finds a root of the body of a driver between two bounds
+ * @details Brent's method: the root stays bracketed by b and c, where the
+ *          body has opposite signs, and each step takes the inverse
+ *          quadratic interpolation of the last three points (or the secant
+ *          of the last two), unless it falls out of the bracket or doesn't
+ *          shrink it fast enough, then it bisects. So it converges
+ *          superlinearly on a smooth body, and never slower than bisection.
+ *          It stops when the bracket is within a few units in the last place
+ *          of the root.
+ *
+ *          If the body has the same sign at both bounds, the interval is
+ *          scanned for a change of sign first, and the first one from a is
+ *          refined. The root is NaN if there is none, if the body is NaN at
+ *          a point, or if it doesn't converge within DRIVER_STEPS steps or
+ *          before the deadline.
+ *
+ * @param driver The driver
+ * @param a The lower bound
+ * @param b The upper bound
+ * @param scratch The values of the nodes of the body for the lanes
+ * @return The root
+ * @see Driver::scan
+ */
+static long double solve(const driver_t *driver, long double a, long double b, long double *scratch)
+{
+  if (!isfinite(a) || !isfinite(b)) return NAN;
+
+  long double fa = 0.0, fb = 0.0;
+  eval_points(driver, &a, 1, &fa, scratch);
+  eval_points(driver, &b, 1, &fb, scratch);
+
+  if (fa == 0.0) return a;
+  if (fb == 0.0) return b;
+  if (isnan(fa) || isnan(fb)) return NAN;
+
+  if ((fa > 0.0) == (fb > 0.0) && !scan(driver, &a, &b, &fa, &fb, scratch)) return NAN;
+
+  long double c = a, fc = fa;
+
+  for (size_t step = 0; step < DRIVER_STEPS; ++step) {
+    if (!(step % LIMITS_CHECK_INDICES) && step && deadline_passed()) return NAN;
+    if (isnan(fb)) return NAN;
+
+    long double previous = b - a;
+
+    if (fabsl(fc) < fabsl(fb)) {
+      a = b;   b = c;   c = a;
+      fa = fb; fb = fc; fc = fa;
+    }
+
+    long double tolerance = 2.0 * LDBL_EPSILON * fabsl(b) + LDBL_MIN;
+    long double middle = 0.5L * (c - b), next = middle;
+
+    if (fabsl(middle) <= tolerance || fb == 0.0) return b;
+
+    if (fabsl(previous) >= tolerance && fabsl(fa) > fabsl(fb)) {
+      long double p = 0.0, q = 0.0, s = fb / fa, span = c - b;
+
+      if (a == c) {
+        p = span * s;
+        q = 1.0 - s;
+      } else {
+        long double r = fa / fc, t = fb / fc;
+        p = s * (span * r * (r - t) - (b - a) * (t - 1.0));
+        q = (r - 1.0) * (t - 1.0) * (s - 1.0);
+      }
+
+      if (p > 0.0) q = -q;
+      else         p = -p;
+
+      if (p < 0.75L * span * q - 0.5L * fabsl(tolerance * q) && p < fabsl(0.5L * previous * q))
+        next = p / q;
+    }
+
+    if (fabsl(next) < tolerance) next = next > 0.0 ? tolerance : -tolerance;
+
+    a = b;
+    fa = fb;
+    b += next;
+    eval_points(driver, &b, 1, &fb, scratch);
+
+    if ((fb > 0.0 && fc > 0.0) || (fb < 0.0 && fc < 0.0)) {
+      c = a;
+      fc = fa;
+    }
+  }
+
+  return NAN;
+}
+
+
+/**
+ * @brief Computes the value of a driver stored in a node pool: solve or
+ *        integrate
+ * @details solve(body, x, a, b) is a root of the body for x between a and b,
+ *          and integrate(body, x, a, b) the integral of the body for x from
+ *          a to b. The body is the range of nodes before the driver, like
+ *          the one of an aggregate, so it is parsed once and evaluated in
+ *          place at each point, AGGREGATE_LANES points at a time when the
+ *          points are known together: the 15 points of a subinterval of an
+ *          integral, and the points of a scan for a change of sign.
+ *
+ * @param nodes The nodes of the tree
+ * @param node The index of the driver, its bounds are evaluated
+ * @param bindings The values of the variables, the one of the index of the
+ *        driver is changed
+ * @param values The values of the nodes, those of the body are changed
+ * @return The value of the driver
+ * @see Driver::solve, Driver::integrate
+ */
+long double eval_driver(const pool_node_t *nodes, uint32_t node,
+                        long double *bindings, long double *values)
+{
+  const pool_node_t *call = &nodes[node];
+  uint32_t arguments = call->left, bounds = nodes[arguments].left;
+
+  driver_t driver = { nodes, arguments + 1, call->right, nodes[nodes[bounds].left].value.variable,
+                      false, bindings, values, NULL, NULL, get_deadline() };
+  driver.lanes = is_lane_body(nodes, driver.first, driver.root);
+
+  long double a = values[nodes[bounds].right], b = values[nodes[arguments].right];
+
+  if (call->value.function == INTEGRATE) return integrate(&driver, a, b);
+
+  long double *scratch = create_scratch(&driver);
+  long double root = solve(&driver, a, b, scratch);
+  free(scratch);
+
+  return root;
+}
+
+
+/**
+ * @brief Computes the integral of a function between two bounds
+ * @details The integral is computed like the one of integrate, on the
+ *          calling thread.
+ *
+ * @param function The function, called with its context and the points
+ * @param context The context of the function
+ * @param a The lower bound
+ * @param b The upper bound
+ * @return The integral, NaN if it doesn't converge
+ * @see Driver::integrate
+ */
+long double integrate_function(integrand_t function, void *context, long double a, long double b)
+{
+  driver_t driver = { NULL, 0, 0, 0, false, NULL, NULL, function, context, get_deadline() };
+
+  return integrate(&driver, a, b);
+}
@@ -0,0 +1,48 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../parser/NodePool.h"
+
+/**
+ * The number of intervals where solve looks for a change of sign of its
+ * body, when it has the same sign at both bounds
+ */
+#define DRIVER_SCAN 64
+
+/**
+ * The largest number of steps of solve
+ */
+#define DRIVER_STEPS (1 << 16)
+
+/**
+ * The largest number of subintervals of an integral
+ */
+#define DRIVER_INTERVALS (1 << 16)
+
+/**
+ * The rounds of subintervals of an integral which evaluate at least
+ * DRIVER_SPLIT nodes are shared by the threads of the aggregates
+ */
+#define DRIVER_SPLIT (1 << 16)
+
+/**
+ * @brief A function of one variable, computed at several points at once:
+ *        its context, the points, their number and where to store the values
+ */
+typedef void (*integrand_t)(void*, const long double*, size_t, long double*);
+
+/**
+ * @brief Computes the value of a driver stored in a node pool: solve or
+ *        integrate
+ */
+long double eval_driver(const pool_node_t*, uint32_t, long double*, long double*);
+
+/**
+ * @brief Computes the integral of a function between two bounds
+ */
+long double integrate_function(integrand_t, void*, long double, long double);
+
+#endif
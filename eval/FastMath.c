@@ -0,0 +1,434 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "../CommonHeaders.h"
+#include "FastMath.h"
+
+#if defined(__x86_64__) || defined(__SSE2__)
+#include <immintrin.h>
+#define FAST_MATH_SIMD 1
+#endif
+
+/**
+ * The kernels are written once on vectors of 4 doubles (GCC vector
+ * extensions), and compiled twice: for the baseline SSE2, where each vector
+ * takes two registers, and for AVX2. Neither of them uses FMA, so both give
+ * bit-identical results, and so does the scalar fast_function.
+ */
+typedef double vdouble __attribute__((vector_size(32)));
+typedef int64_t vlong __attribute__((vector_size(32)));
+
+#define LANES 4
+
+/* pi/2 split in pieces of 33 bits: q * PIO2_n is exact for q < 2^20 */
+#define TWO_OVER_PI 6.36619772367581382433e-01
+#define PIO2_1      1.57079632673412561417e+00
+#define PIO2_2      6.07710050630396597660e-11
+#define PIO2_3      2.02226624871116645580e-21
+#define PIO2_1T     6.07710050650619224932e-11
+
+/* Adding then subtracting it rounds a double below 2^51 to an integer */
+#define ROUND_MAGIC 0x1.8p52
+
+#define SQRT2 1.41421356237309504880
+
+#define LN2_HI 6.93147180369123816490e-01
+#define LN2_LO 1.90821492927058770002e-10
+
+/* The polynomial coefficients of fdlibm's __kernel_sin, __kernel_cos and log */
+#define S1 -1.66666666666666324348e-01
+#define S2  8.33333333332248946124e-03
+#define S3 -1.98412698298579493134e-04
+#define S4  2.75573137070700676789e-06
+#define S5 -2.50507602534068634195e-08
+#define S6  1.58969099521155010221e-10
+
+#define C1  4.16666666666666019037e-02
+#define C2 -1.38888888888741095749e-03
+#define C3  2.48015872894767294178e-05
+#define C4 -2.75573143513906633035e-07
+#define C5  2.08757232129817482790e-09
+#define C6 -1.13596475577881948265e-11
+
+#define LG1 6.666666666666735130e-01
+#define LG2 3.999999999940941908e-01
+#define LG3 2.857142874366239149e-01
+#define LG4 2.222219843214978396e-01
+#define LG5 1.818357216161805012e-01
+#define LG6 1.531383769920937332e-01
+#define LG7 1.479819860511658591e-01
+
+
+/**
+ * The accuracy of the functions evaluated by eval_function. It is set once,
+ * before any evaluation starts, so the worker threads only read it.
+ */
+static MathMode math_mode = MATH_EXACT;
+
+
+/**
+ * @brief Sets the accuracy of the functions evaluated by eval_function
+ * @details Must be called before the evaluations start.
+ *
+ * @param mode The accuracy
+ */
+void set_math_mode(MathMode mode)
+{
+  math_mode = mode;
+}
+
+
+/**
+ * @brief Returns the accuracy of the functions evaluated by eval_function
+ *
+ * @return The accuracy
+ */
+MathMode get_math_mode(void)
+{
+  return math_mode;
+}
+
+
+/**
+ * @brief Computes a unary function with the long double functions of the
+ *        C library
+ */
+static double exact_function(FunctionID id, double x)
+{
+  switch (id) {
+    case SIN:  return (double)sinl(x);
+    case COS:  return (double)cosl(x);
+    case TAN:  return (double)tanl(x);
+    case SQRT: return (double)sqrtl(x);
+    case LN:   return (double)logl(x);
+    case ABS:  return fabs(x);
+    default:   return NAN;
+  }
+}
+
+
+/**
+ * @brief Selects the lanes of a where the mask is set, and those of b elsewhere
+ */
+static inline __attribute__((always_inline))
+vdouble vselect(vlong mask, vdouble a, vdouble b)
+{
+  return (vdouble)(((vlong)a & mask) | ((vlong)b & ~mask));
+}
+
+
+/**
+ * @brief Reduces the arguments of the trigonometric functions to
+ *        [-pi/4, pi/4]: x = q pi/2 + (y + yy)
+ * @details The exact reduction computes y + yy as a double-double with
+ *          pi/2 known to 99 bits (Cody and Waite), the fast one as a double
+ *          with pi/2 known to 86 bits.
+ *
+ * @param x The arguments, at most FAST_MATH_MAX_TRIG in absolute value
+ * @param fast true for the fast reduction
+ * @param yy Where to store the low parts of the reduced arguments
+ * @param quadrant Where to store q modulo 4
+ * @return The high parts of the reduced arguments
+ */
+static inline __attribute__((always_inline))
+vdouble reduce(vdouble x, bool fast, vdouble *yy, vlong *quadrant)
+{
+  vdouble shifted = x * TWO_OVER_PI + ROUND_MAGIC;
+  vdouble q = shifted - ROUND_MAGIC;
+  *quadrant = (vlong)shifted & 3;
+
+  vdouble t = x - q * PIO2_1;
+  if (fast) {
+    *yy = t - t;
+    return t - q * PIO2_1T;
+  }
+
+  vdouble w = q * PIO2_2;
+  vdouble r = t - w;
+  vdouble b = r - t;
+  vdouble err = ((t - (r - b)) - (w + b)) - q * PIO2_3;
+
+  vdouble y = r + err;
+  *yy = err - (y - r);
+
+  return y;
+}
+
+
+/**
+ * @brief Computes sin(y + yy) for |y| <= pi/4 (fdlibm's __kernel_sin)
+ */
+static inline __attribute__((always_inline))
+vdouble sin_kernel(vdouble y, vdouble yy, bool fast)
+{
+  vdouble z = y * y;
+  vdouble v = z * y;
+
+  if (fast) return y + v * (S1 + z * (S2 + z * (S3 + z * S4)));
+
+  vdouble r = S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)));
+  return y - ((z * (0.5 * yy - v * r) - yy) - v * S1);
+}
+
+
+/**
+ * @brief Computes cos(y + yy) for |y| <= pi/4 (fdlibm's __kernel_cos)
+ */
+static inline __attribute__((always_inline))
+vdouble cos_kernel(vdouble y, vdouble yy, bool fast)
+{
+  vdouble z = y * y;
+
+  if (fast) return 1.0 + z * (-0.5 + z * (C1 + z * (C2 + z * C3)));
+
+  vdouble r = z * (C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6)))));
+  vdouble hz = 0.5 * z;
+  vdouble w = 1.0 - hz;
+  return w + (((1.0 - w) - hz) + (z * r - y * yy));
+}
+
+
+/**
+ * @brief Computes sin, cos or tan of the reduced arguments, according to
+ *        their quadrant
+ */
+static inline __attribute__((always_inline))
+vdouble trig(FunctionID id, vdouble x, bool fast)
+{
+  vdouble yy;
+  vlong quadrant;
+  vdouble y = reduce(x, fast, &yy, &quadrant);
+
+  vdouble s = sin_kernel(y, yy, fast);
+  vdouble c = cos_kernel(y, yy, fast);
+
+  vlong odd = -(quadrant & 1);
+  if (id == TAN) return vselect(odd, -c / s, s / c);
+
+  /* cos(x) = sin(x + pi/2) */
+  if (id == COS) quadrant = (quadrant + 1) & 3;
+
+  vdouble result = vselect(-(quadrant & 1), c, s);
+  vlong negative = -(quadrant >> 1);
+
+  return (vdouble)((vlong)result ^ (negative & INT64_MIN));
+}
+
+
+/**
+ * @brief Computes the natural logarithm of normal positive arguments
+ *        (fdlibm's log): x = 2^k (1 + f), with sqrt(2)/2 <= 1 + f < sqrt(2)
+ */
+static inline __attribute__((always_inline))
+vdouble ln(vdouble x, bool fast)
+{
+  vlong bits = (vlong)x;
+  vlong exponent = (bits >> 52) & 0x7FF;
+  vdouble m = (vdouble)((bits & 0x000FFFFFFFFFFFFFLL) | 0x3FF0000000000000LL);
+
+  vlong above = m > SQRT2;
+  m = vselect(above, m * 0.5, m);
+  exponent -= above;
+
+  /* Converts the biased exponent to a double without cvtepi64, which is
+   * missing before AVX-512 */
+  vdouble k = (vdouble)(exponent | 0x4330000000000000LL) - (0x1p52 + 1023.0);
+
+  vdouble f = m - 1.0;
+  vdouble hfsq = 0.5 * f * f;
+  vdouble s = f / (2.0 + f);
+  vdouble z = s * s;
+  vdouble w = z * z;
+
+  vdouble r;
+  if (fast) {
+    r = z * (LG1 + w * LG3) + w * (LG2 + w * LG4);
+  } else {
+    vdouble t1 = w * (LG2 + w * (LG4 + w * LG6));
+    vdouble t2 = z * (LG1 + w * (LG3 + w * (LG5 + w * LG7)));
+    r = t2 + t1;
+  }
+
+  return k * LN2_HI - ((hfsq - (s * (hfsq + r) + k * LN2_LO)) - f);
+}
+
+
+/**
+ * @brief Computes a function on a vector of arguments
+ * @details The lanes out of the domain of the kernels (large trigonometric
+ *          arguments, non-positive, subnormal or non-finite logarithms) are
+ *          computed by the C library, and so are the zeros of sin and tan,
+ *          which keep their sign.
+ */
+static inline __attribute__((always_inline))
+vdouble apply(FunctionID id, bool fast, vdouble x)
+{
+  vdouble result;
+  vlong outside;
+
+  if (id == LN) {
+    result  = ln(x, fast);
+    outside = ~((x >= DBL_MIN) & (x <= DBL_MAX));
+  } else {
+    result  = trig(id, x, fast);
+    vdouble magnitude = (vdouble)((vlong)x & INT64_MAX);
+    outside = ~(magnitude <= FAST_MATH_MAX_TRIG);
+    if (id != COS) outside |= magnitude == 0.0;
+  }
+
+  if (outside[0] | outside[1] | outside[2] | outside[3]) {
+    for (int i = 0; i < LANES; ++i)
+      if (outside[i]) result[i] = exact_function(id, x[i]);
+  }
+
+  return result;
+}
+
+
+/**
+ * @brief Computes a function on each element of an array, 4 at a time
+ *
+ * @see fast_function_array
+ */
+static void array_generic(FunctionID id, bool fast, const double *in, double *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    vdouble x;
+    memcpy(&x, in + i, sizeof x);
+    x = apply(id, fast, x);
+    memcpy(out + i, &x, sizeof x);
+  }
+
+  if (i < n) {
+    vdouble x = { 1.0, 1.0, 1.0, 1.0 };
+    memcpy(&x, in + i, (n - i) * sizeof(*in));
+    x = apply(id, fast, x);
+    memcpy(out + i, &x, (n - i) * sizeof(*out));
+  }
+}
+
+
+#ifdef FAST_MATH_SIMD
+
+/**
+ * @brief Computes the square root of each element of an array (SSE2)
+ */
+static void sqrt_sse2(const double *in, double *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(out + i, _mm_sqrt_pd(_mm_loadu_pd(in + i)));
+
+  if (i < n) out[i] = sqrt(in[i]);
+}
+
+
+/**
+ * @brief Computes a function on one argument (AVX2)
+ * @details The argument is broadcast to a single AVX2 vector, which costs
+ *          about the same as scalar instructions, where SSE2 takes two
+ *          registers for it.
+ */
+__attribute__((target("avx2")))
+static double scalar_avx2(FunctionID id, bool fast, double x)
+{
+  vdouble v = { x, x, x, x };
+
+  return apply(id, fast, v)[0];
+}
+
+
+/**
+ * @brief Computes a function on each element of an array (AVX2)
+ *
+ * @see array_generic
+ */
+__attribute__((target("avx2")))
+static void array_avx2(FunctionID id, bool fast, const double *in, double *out, size_t n)
+{
+  if (id == SQRT) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+      _mm256_storeu_pd(out + i, _mm256_sqrt_pd(_mm256_loadu_pd(in + i)));
+
+    sqrt_sse2(in + i, out + i, n - i);
+    return;
+  }
+
+  array_generic(id, fast, in, out, n);
+}
+
+#endif
+
+
+/**
+ * @brief Computes a unary function with a given accuracy
+ * @details sin, cos, tan and ln are computed by our kernels, unless the mode
+ *          is MATH_EXACT. sqrt is correctly rounded in every mode, and abs
+ *          is exact.
+ *
+ * @param id The function
+ * @param mode The accuracy
+ * @param x The argument
+ * @return The result of the function
+ */
+double fast_function(FunctionID id, MathMode mode, double x)
+{
+  if (mode == MATH_EXACT || id == ABS) return exact_function(id, x);
+  if (id == SQRT) return sqrt(x);
+  if (id != LN && !(fabs(x) <= FAST_MATH_MAX_TRIG)) return exact_function(id, x);
+
+#ifdef FAST_MATH_SIMD
+  if (__builtin_cpu_supports("avx2"))
+    return scalar_avx2(id, mode == MATH_FAST, x);
+#endif
+
+  vdouble v = { x, x, x, x };
+
+  return apply(id, mode == MATH_FAST, v)[0];
+}
+
+
+/**
+ * @brief Computes a unary function on each element of an array
+ * @details The kernels process 4 elements at a time, with AVX2 if the
+ *          processor supports it, SSE2 otherwise. The results are the ones
+ *          of fast_function, whatever the instruction set.
+ *
+ * @param id The function
+ * @param mode The accuracy
+ * @param in The arguments
+ * @param out Where to store the results, may be the arguments
+ * @param n The number of elements
+ * @see FastMath::fast_function
+ */
+void fast_function_array(FunctionID id, MathMode mode, const double *in, double *out, size_t n)
+{
+  if (mode == MATH_EXACT || id == ABS) {
+    for (size_t i = 0; i < n; ++i) out[i] = exact_function(id, in[i]);
+    return;
+  }
+
+#ifdef FAST_MATH_SIMD
+  if (__builtin_cpu_supports("avx2")) {
+    array_avx2(id, mode == MATH_FAST, in, out, n);
+    return;
+  }
+
+  if (id == SQRT) {
+    sqrt_sse2(in, out, n);
+    return;
+  }
+#else
+  if (id == SQRT) {
+    for (size_t i = 0; i < n; ++i) out[i] = sqrt(in[i]);
+    return;
+  }
+#endif
+
+  array_generic(id, mode == MATH_FAST, in, out, n);
+}
@@ -0,0 +1,43 @@
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include <stddef.h>
+
+#include "../lexer/Function.h"
+
+/**
+ * @brief Represents how accurate the functions are
+ * @details MATH_EXACT uses the long double functions of the C library.
+ *          MATH_4ULP and MATH_FAST use our own double kernels: the results
+ *          are within 4 units in the last place of a double for MATH_4ULP,
+ *          and have a relative error below 1e-7 for MATH_FAST.
+ */
+typedef enum math_mode { MATH_EXACT, MATH_4ULP, MATH_FAST } MathMode;
+
+/**
+ * The largest absolute argument of sin, cos and tan which is reduced by the
+ * kernels, the larger ones are computed by the C library
+ */
+#define FAST_MATH_MAX_TRIG 1e5
+
+/**
+ * @brief Sets the accuracy of the functions evaluated by eval_function
+ */
+void set_math_mode(MathMode);
+
+/**
+ * @brief Returns the accuracy of the functions evaluated by eval_function
+ */
+MathMode get_math_mode(void);
+
+/**
+ * @brief Computes a unary function with a given accuracy
+ */
+double fast_function(FunctionID, MathMode, double);
+
+/**
+ * @brief Computes a unary function on each element of an array
+ */
+void fast_function_array(FunctionID, MathMode, const double*, double*, size_t);
+
+#endif
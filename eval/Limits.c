@@ -0,0 +1,110 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "../CommonHeaders.h"
+#include "Limits.h"
+
+
+/**
+ * The budget of each evaluation. It is set once, before any evaluation
+ * starts, so the worker threads only read it.
+ */
+static limits_t limits = { 0, 0, LIMITS_DEPTH, 0, 0, 0 };
+
+/**
+ * The deadline of the evaluation of the thread, on the monotonic clock, 0
+ * if there is none, and whether it was seen passed
+ */
+static _Thread_local uint64_t deadline = 0;
+static _Thread_local bool passed = false;
+
+
+/**
+ * @brief Reads the monotonic clock
+ *
+ * @return The time in nanoseconds
+ */
+static uint64_t now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+/**
+ * @brief Sets the budget of the evaluations
+ * @details Must be called before the evaluations start. The depth can be
+ *          raised but not removed, since an expression which overflows the
+ *          stack can't be refused cleanly.
+ *
+ * @param budget The limits, 0 for none, or LIMITS_DEPTH for the depth
+ */
+void set_limits(const limits_t *budget)
+{
+  limits = *budget;
+  if (!limits.depth) limits.depth = LIMITS_DEPTH;
+}
+
+
+/**
+ * @brief Returns the budget of the evaluations
+ *
+ * @return The limits
+ */
+const limits_t *get_limits(void)
+{
+  return &limits;
+}
+
+
+/**
+ * @brief Starts the deadline of an evaluation on the calling thread
+ * @details Without a time limit, the clock is never read.
+ */
+void start_deadline(void)
+{
+  deadline = limits.time ? now() + limits.time : 0;
+  passed   = false;
+}
+
+
+/**
+ * @brief Returns the deadline of the evaluation of the calling thread
+ *
+ * @return The deadline, 0 if there is none
+ */
+uint64_t get_deadline(void)
+{
+  return deadline;
+}
+
+
+/**
+ * @brief Gives the deadline of an evaluation to a thread which helps it
+ *
+ * @param at The deadline, from get_deadline
+ */
+void set_deadline(uint64_t at)
+{
+  deadline = at;
+  passed   = false;
+}
+
+
+/**
+ * @brief Checks if the deadline of the evaluation of the calling thread
+ *        has passed
+ * @details The long loops call it every so often, and give up with a NaN
+ *          if it has. Since the clock only moves forward, a thread which
+ *          finishes after one of its helpers gave up sees it passed too.
+ *
+ * @return true if the deadline has passed
+ */
+bool deadline_passed(void)
+{
+  if (!passed && deadline) passed = now() >= deadline;
+
+  return passed;
+}
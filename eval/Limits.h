@@ -0,0 +1,72 @@
+#ifndef LIMITS_H
+#define LIMITS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * How many indices of an aggregate are evaluated between two looks at the
+ * clock, a power of two
+ */
+#define LIMITS_CHECK_INDICES 1024
+
+/**
+ * The depth of the expressions when no other is given: the parser and the
+ * walks of the trees recurse once per level, so a deeper expression would
+ * overflow the stack of a thread
+ */
+#define LIMITS_DEPTH 4096
+
+/**
+ * @brief The budget of each evaluation, 0 for no limit but for depth,
+ *        which is LIMITS_DEPTH when it is 0
+ * @details The expression is refused by the lexer if it has more than
+ *          bytes characters or tokens tokens, and by the parser if it is
+ *          nested or its tree is deeper than depth, has more than nodes
+ *          nodes, or needs more than memory bytes for its tokens, its pool
+ *          and its tree. The evaluation is stopped when it lasts more than
+ *          time nanoseconds.
+ */
+typedef struct limits_t
+{
+  size_t bytes;
+  size_t tokens;
+  size_t depth;
+  size_t nodes;
+  size_t memory;
+  uint64_t time;
+} limits_t;
+
+/**
+ * @brief Sets the budget of the evaluations
+ */
+void set_limits(const limits_t*);
+
+/**
+ * @brief Returns the budget of the evaluations
+ */
+const limits_t *get_limits(void);
+
+/**
+ * @brief Starts the deadline of an evaluation on the calling thread
+ */
+void start_deadline(void);
+
+/**
+ * @brief Returns the deadline of the evaluation of the calling thread
+ */
+uint64_t get_deadline(void);
+
+/**
+ * @brief Gives the deadline of an evaluation to a thread which helps it
+ */
+void set_deadline(uint64_t);
+
+/**
+ * @brief Checks if the deadline of the evaluation of the calling thread
+ *        has passed
+ */
+bool deadline_passed(void);
+
+#endif
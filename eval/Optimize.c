@@ -0,0 +1,350 @@
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Number.h"
+#include "../lexer/Token.h"
+#include "Optimize.h"
+
+
+/**
+ * @brief A term of a polynomial: coefficient * variable ^ degree
+ */
+typedef struct term_t
+{
+  long double coefficient;
+  long degree;
+} term_t;
+
+/**
+ * @brief A polynomial in one variable, collected from a sum
+ */
+typedef struct polynomial_t
+{
+  const char *variable;
+  term_t terms[OPTIMIZE_MAX_TERMS];
+  size_t size;
+} polynomial_t;
+
+
+/**
+ * @brief Gets the value of a constant operand: a literal, or the opposite
+ *        of a literal
+ *
+ * @param node The operand
+ * @param value Where to store its value
+ * @return true if the operand is constant, false otherwise
+ * @see Number::parse_number
+ */
+static bool constant_value(ASTNode node, long double *value)
+{
+  long double sign = 1.0;
+  if (node->token->type == UMINUS) {
+    sign = -1.0;
+    node = node->right;
+  }
+
+  if (node->token->type != LITERAL) return false;
+
+  const char *literal = node->token->data;
+  *value = sign * parse_number(literal, strlen(literal));
+
+  return true;
+}
+
+
+/**
+ * @brief Gets the value of a constant integer exponent
+ *
+ * @param node The exponent
+ * @param n Where to store its value
+ * @return true if the exponent is a small enough constant integer
+ */
+static bool integer_exponent(ASTNode node, long *n)
+{
+  long double value = 0.0;
+  if (!constant_value(node, &value)) return false;
+  if (value != truncl(value) || fabsl(value) > OPTIMIZE_MAX_EXPONENT) return false;
+
+  *n = (long)value;
+
+  return true;
+}
+
+
+/**
+ * @brief Checks if a subtree is a power of a variable: x or x ^ k,
+ *        where k is a positive constant integer
+ *
+ * @param node The root of the subtree
+ * @param variable Where to store the name of the variable
+ * @param degree Where to store the power
+ * @return true if the subtree is a power of a variable
+ */
+static bool monomial(ASTNode node, const char **variable, long *degree)
+{
+  if (node->token->type == VARIABLE) {
+    *variable = node->token->data;
+    *degree = 1;
+    return true;
+  }
+
+  if (node->token->type == EXPONENT && node->left->token->type == VARIABLE
+      && integer_exponent(node->right, degree) && *degree >= 1) {
+    *variable = node->left->token->data;
+    return true;
+  }
+
+  return false;
+}
+
+
+/**
+ * @brief Adds a term to a polynomial, merging it with the term of the same
+ *        degree if there is one
+ *
+ * @return false if the variable differs, or if there are too many terms
+ */
+static bool add_term(polynomial_t *poly, const char *variable,
+                     long double coefficient, long degree)
+{
+  if (variable) {
+    if (!poly->variable) poly->variable = variable;
+    else if (strcmp(poly->variable, variable)) return false;
+  }
+
+  for (size_t i = 0; i < poly->size; ++i) {
+    if (poly->terms[i].degree == degree) {
+      poly->terms[i].coefficient += coefficient;
+      return true;
+    }
+  }
+
+  if (poly->size == OPTIMIZE_MAX_TERMS) return false;
+
+  poly->terms[poly->size].coefficient = coefficient;
+  poly->terms[poly->size++].degree    = degree;
+
+  return true;
+}
+
+
+/**
+ * @brief Collects the terms of a sum into a polynomial
+ * @details The terms are constants c, powers of a variable p, or their
+ *          products c * p and p * c, added or subtracted.
+ *
+ * @param poly The polynomial
+ * @param node The root of the sum
+ * @param sign The sign of the sum in the whole polynomial
+ * @return true if the sum is a polynomial in one variable
+ */
+static bool collect_terms(polynomial_t *poly, ASTNode node, long double sign)
+{
+  const char *variable = NULL;
+  long double coefficient = 0.0;
+  long degree = 0;
+
+  switch (node->token->type) {
+    case PLUS:
+                return collect_terms(poly, node->left, sign)
+                    && collect_terms(poly, node->right, sign);
+    case BMINUS:
+                return collect_terms(poly, node->left, sign)
+                    && collect_terms(poly, node->right, -sign);
+    case UMINUS:
+                return collect_terms(poly, node->right, -sign);
+    case LITERAL:
+                constant_value(node, &coefficient);
+                return add_term(poly, NULL, sign * coefficient, 0);
+    case MULTIPLY:
+                if (constant_value(node->left, &coefficient)
+                    && monomial(node->right, &variable, &degree))
+                  return add_term(poly, variable, sign * coefficient, degree);
+                if (constant_value(node->right, &coefficient)
+                    && monomial(node->left, &variable, &degree))
+                  return add_term(poly, variable, sign * coefficient, degree);
+                return false;
+    default:
+                if (monomial(node, &variable, &degree))
+                  return add_term(poly, variable, sign, degree);
+                return false;
+  }
+}
+
+
+/**
+ * @brief Creates a literal leaf
+ *
+ * @param value The value of the literal
+ * @return The leaf
+ * @see Number::format_number
+ */
+static ASTNode create_literal(long double value)
+{
+  char str[NUMBER_BUFFER_SIZE];
+  format_number(value, str, sizeof str);
+
+  return create_ast_node(create_token(LITERAL, str), NULL, NULL);
+}
+
+
+/**
+ * @brief Creates a binary operator node
+ */
+static ASTNode create_operator_node(TokenType type, const char *value,
+                                    ASTNode left, ASTNode right)
+{
+  return create_ast_node(create_token(type, value), left, right);
+}
+
+
+/**
+ * @brief Creates the subtree of a power of a variable: x, or x ^ k
+ *        computed by a chain of multiplications
+ */
+static ASTNode create_power(const char *variable, long degree)
+{
+  ASTNode leaf = create_ast_node(create_token(VARIABLE, variable), NULL, NULL);
+  if (degree == 1) return leaf;
+
+  return create_operator_node(IPOWER, "^", leaf, create_literal((long double)degree));
+}
+
+
+/**
+ * @brief Compares two terms by decreasing degree
+ */
+static int compare_terms(const void *a, const void *b)
+{
+  long da = ((const term_t*)a)->degree, db = ((const term_t*)b)->degree;
+
+  return (da < db) - (da > db);
+}
+
+
+/**
+ * @brief Rewrites a polynomial sum in one variable by Horner's rule
+ * @details example: 2*x^3 - x^2 + 4    -> (2*x - 1) * x^2 + 4
+ *          The gaps between the degrees are powers computed by chains of
+ *          multiplications, so sparse polynomials stay cheap.
+ *
+ * @param node The root of the sum
+ * @return The root of the rewritten sum, or NULL if it is not a polynomial
+ *         worth rewriting
+ */
+static ASTNode horner(ASTNode node)
+{
+  polynomial_t poly = { NULL, { { 0.0, 0 } }, 0 };
+  if (!collect_terms(&poly, node, 1.0) || !poly.variable) return NULL;
+
+  size_t size = 0;
+  for (size_t i = 0; i < poly.size; ++i) {
+    if (poly.terms[i].coefficient != 0.0) poly.terms[size++] = poly.terms[i];
+  }
+
+  // Without a constant term, the sign of a zero result would depend on the
+  // order of the operations, so x^2 - x at 0 would give -0 instead of 0
+  qsort(poly.terms, size, sizeof(*poly.terms), &compare_terms);
+  if (size < 2 || poly.terms[0].degree < 2 || poly.terms[size - 1].degree) return NULL;
+
+  ASTNode result = NULL;
+  for (size_t i = 0; i < size; ++i) {
+    long gap = poly.terms[i].degree - (i + 1 < size ? poly.terms[i + 1].degree : 0);
+    long double coefficient = poly.terms[i].coefficient;
+
+    if (!result) {
+      result = create_literal(coefficient);
+    } else if (coefficient < 0.0) {
+      result = create_operator_node(BMINUS, "-", result, create_literal(-coefficient));
+    } else {
+      result = create_operator_node(PLUS, "+", result, create_literal(coefficient));
+    }
+
+    if (gap) {
+      ASTNode power = create_power(poly.variable, gap);
+      if (i == 0 && coefficient == 1.0) {
+        result->destroy(result);
+        result = power;
+      } else {
+        result = create_operator_node(MULTIPLY, "*", result, power);
+      }
+    }
+  }
+
+  return result;
+}
+
+
+/**
+ * @brief Rewrites a power with a constant exponent
+ * @details x ^ n, where n is a small integer, becomes an IPOWER node which
+ *          is computed by a chain of multiplications, and x ^ 0.5 becomes
+ *          abs(sqrt(x)), since sqrt(-0) is -0 where (-0) ^ 0.5 is 0.
+ *
+ * @param node The exponent node
+ * @return The rewritten node
+ */
+static ASTNode reduce_power(ASTNode node)
+{
+  long double value = 0.0;
+  long n = 0;
+
+  if (integer_exponent(node->right, &n)) {
+    node->token->type = IPOWER;
+  } else if (constant_value(node->right, &value) && value == 0.5L) {
+    ASTNode base = node->left;
+    node->left = NULL;
+    node->destroy(node);
+    node = create_ast_node(create_token(FUNCTION, "sqrt"), NULL, base);
+    node = create_ast_node(create_token(FUNCTION, "abs"), NULL, node);
+  }
+
+  return node;
+}
+
+
+/**
+ * @brief Rewrites the parse tree into an equivalent one which is
+ *        cheaper to evaluate
+ * @details The rewrites are:
+ *            . the sums which are polynomials in one variable with a
+ *              constant term, like a*x^3 + b*x^2 + c*x + d, are evaluated
+ *              by Horner's rule;
+ *            . x ^ n, where n is a constant integer up to
+ *              OPTIMIZE_MAX_EXPONENT in absolute value, is computed by
+ *              a chain of multiplications instead of powl;
+ *            . x ^ 0.5 is computed by abs(sqrt(x)).
+ *
+ *          These change the rounding of the results, by a few units in the
+ *          last place in general, but more near the roots of a polynomial
+ *          where its terms cancel out. The results may also differ for
+ *          special operands: sqrt(-inf) is NaN where (-inf)^0.5 is inf,
+ *          and a polynomial at an infinite variable may be infinite instead
+ *          of NaN. The signs of the zeros are kept. The checkopt
+ *          tool compares the optimized trees with the original ones.
+ *
+ * @param root The root of the tree, which is consumed
+ * @return The root of the rewritten tree
+ */
+ASTNode optimize_tree(ASTNode root)
+{
+  if (!root) return NULL;
+
+  TokenType type = root->token->type;
+  if (type == PLUS || type == BMINUS) {
+    ASTNode poly = horner(root);
+    if (poly) {
+      root->destroy(root);
+      return poly;
+    }
+  }
+
+  root->left  = optimize_tree(root->left);
+  root->right = optimize_tree(root->right);
+
+  if (type == EXPONENT) root = reduce_power(root);
+
+  return root;
+}
@@ -0,0 +1,23 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include "../parser/AST.h"
+
+/**
+ * The largest absolute value of a constant integer exponent which is
+ * computed by a chain of multiplications instead of powl
+ */
+#define OPTIMIZE_MAX_EXPONENT 32
+
+/**
+ * The largest number of terms of a polynomial evaluated by Horner's rule
+ */
+#define OPTIMIZE_MAX_TERMS 64
+
+/**
+ * @brief Rewrites the parse tree into an equivalent one which is
+ *        cheaper to evaluate
+ */
+ASTNode optimize_tree(ASTNode);
+
+#endif
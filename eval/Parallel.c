@@ -0,0 +1,360 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Function.h"
+#include "../parser/AST.h"
+#include "Limits.h"
+#include "Parallel.h"
+
+
+/**
+ * @brief The subtrees large enough to be evaluated in parallel
+ * @details A plan node is created for each node of the parse tree which
+ *          has at least PARALLEL_THRESHOLD nodes. Its children are the plan
+ *          nodes of the children of the tree node, or NULL if these are
+ *          too small, and evaluated serially.
+ */
+typedef struct plan_t *Plan;
+typedef struct plan_t
+{
+  ASTNode node;
+  Plan left;
+  Plan right;
+} plan_t;
+
+/**
+ * @brief A subtree to be evaluated by any worker
+ */
+typedef struct task_t
+{
+  Plan plan;
+  long double result;
+  atomic_bool done;
+} task_t;
+
+/**
+ * @brief The tasks of a worker: the owner pushes and pops the newest ones,
+ *        the other workers steal the oldest ones
+ */
+typedef struct deque_t
+{
+  task_t **tasks;
+  size_t capacity;
+  size_t top;
+  size_t bottom;
+  pthread_mutex_t lock;
+} deque_t;
+
+typedef struct pool_t pool_t;
+
+/**
+ * @brief A worker of the pool, and its tasks
+ */
+typedef struct worker_t
+{
+  pool_t *pool;
+  deque_t deque;
+  unsigned int id;
+  unsigned int seed;
+} worker_t;
+
+/**
+ * @brief The pool of workers which evaluate one tree, before the deadline
+ *        of its evaluation
+ */
+struct pool_t
+{
+  worker_t *workers;
+  unsigned int size;
+  Environment env;
+  uint64_t deadline;
+  atomic_bool finished;
+};
+
+
+/**
+ * @brief Deletes a plan
+ *
+ * @param plan The plan to delete
+ */
+static void delete_plan(Plan plan)
+{
+  if (plan) {
+    delete_plan(plan->left);
+    delete_plan(plan->right);
+    free(plan);
+  }
+}
+
+
+/**
+ * @brief Creates the plan of the subtrees large enough to be evaluated
+ *        in parallel
+ * @details An aggregate is never split: its body depends on its index, and
+ *          it splits its range itself (see Aggregate::eval_aggregate).
+ *          A variadic call of two arguments is split like an operator, but
+ *          the other ones are evaluated serially as a whole, since their
+ *          arguments are reduced together.
+ *
+ * @param node The root of the tree
+ * @param plan Where to store the plan, NULL if the tree is too small
+ * @return The number of nodes of the tree, an aggregate counts for one
+ */
+static size_t create_plan(ASTNode node, Plan *plan)
+{
+  *plan = NULL;
+  if (!node) return 0;
+
+  FunctionType type = node->token->type == FUNCTION ? get_function_type(node->token->data) : 0;
+  if (type == AGGREGATE) return 1;
+
+  Plan left = NULL, right = NULL;
+  size_t size = create_plan(node->left, &left) + create_plan(node->right, &right) + 1;
+
+  if (type == VARIADIC && (!node->left || node->left->token->type == FARGSEPARATOR
+                           || node->right->token->type == FARGSEPARATOR)) {
+    delete_plan(left);
+    delete_plan(right);
+    return size;
+  }
+
+  if (size >= PARALLEL_THRESHOLD) {
+    *plan = malloc(sizeof(**plan));
+    assert(*plan != NULL);
+
+    (*plan)->node  = node;
+    (*plan)->left  = left;
+    (*plan)->right = right;
+  }
+
+  return size;
+}
+
+
+/**
+ * @brief Pushes a task at the bottom of the deque of its owner
+ */
+static void push_task(deque_t *deque, task_t *task)
+{
+  pthread_mutex_lock(&deque->lock);
+
+  if (deque->bottom == deque->capacity) {
+    deque->capacity = deque->capacity ? 2 * deque->capacity : 64;
+    deque->tasks = realloc(deque->tasks, deque->capacity * sizeof(*deque->tasks));
+    assert(deque->tasks != NULL);
+  }
+
+  deque->tasks[deque->bottom++] = task;
+
+  pthread_mutex_unlock(&deque->lock);
+}
+
+
+/**
+ * @brief Takes back a given task from the bottom of the deque of its owner
+ *
+ * @return true if the task was still there, false if it was stolen
+ */
+static bool pop_task(deque_t *deque, task_t *task)
+{
+  bool found = false;
+
+  pthread_mutex_lock(&deque->lock);
+  if (deque->bottom > deque->top && deque->tasks[deque->bottom - 1] == task) {
+    --deque->bottom;
+    found = true;
+  }
+  if (deque->top == deque->bottom) deque->top = deque->bottom = 0;
+  pthread_mutex_unlock(&deque->lock);
+
+  return found;
+}
+
+
+/**
+ * @brief Steals the oldest task at the top of the deque of another worker
+ *
+ * @return The task, or NULL if the deque is empty
+ */
+static task_t *steal_task(deque_t *deque)
+{
+  task_t *task = NULL;
+
+  pthread_mutex_lock(&deque->lock);
+  if (deque->bottom > deque->top) task = deque->tasks[deque->top++];
+  pthread_mutex_unlock(&deque->lock);
+
+  return task;
+}
+
+
+static long double eval_plan(Plan, worker_t*);
+
+
+/**
+ * @brief Steals a task from a random worker, and runs it
+ *
+ * @param self The worker looking for work
+ * @return true if a task was run, false if none was found
+ */
+static bool help(worker_t *self)
+{
+  pool_t *pool = self->pool;
+  unsigned int start = (unsigned int)rand_r(&self->seed) % pool->size;
+
+  for (unsigned int i = 0; i < pool->size; ++i) {
+    worker_t *victim = &pool->workers[(start + i) % pool->size];
+    if (victim == self) continue;
+
+    task_t *task = steal_task(&victim->deque);
+    if (task) {
+      task->result = eval_plan(task->plan, self);
+      atomic_store_explicit(&task->done, true, memory_order_release);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/**
+ * @brief Evaluates a planned subtree
+ * @details If both children are large, the left one is pushed as a task
+ *          that an idle worker can steal, while the right one is evaluated
+ *          in place. If the left task was not stolen in the meantime, it is
+ *          evaluated in place too, otherwise the worker runs other tasks
+ *          until it is done.
+ *
+ *          Each node is computed by the same operations whatever the worker,
+ *          so the result is identical to the serial evaluation.
+ *
+ * @param plan The plan of the subtree
+ * @param self The worker evaluating the subtree
+ * @return The value of the subtree
+ * @see AST::eval_tree_value, AST::eval_node
+ */
+static long double eval_plan(Plan plan, worker_t *self)
+{
+  ASTNode node = plan->node;
+  Environment env = self->pool->env;
+  long double lc = 0.0, rc = 0.0;
+
+  if (plan->left && plan->right) {
+    task_t task = { .plan = plan->left, .result = 0.0 };
+    atomic_init(&task.done, false);
+    push_task(&self->deque, &task);
+
+    rc = eval_plan(plan->right, self);
+
+    if (pop_task(&self->deque, &task)) {
+      lc = eval_plan(plan->left, self);
+    } else {
+      while (!atomic_load_explicit(&task.done, memory_order_acquire)) {
+        if (!help(self)) sched_yield();
+      }
+      lc = task.result;
+    }
+  } else {
+    if (plan->left)      lc = eval_plan(plan->left, self);
+    else if (node->left) lc = eval_tree_value(node->left, env);
+
+    if (plan->right) rc = eval_plan(plan->right, self);
+    else             rc = eval_tree_value(node->right, env);
+  }
+
+  return eval_node(node, lc, rc);
+}
+
+
+/**
+ * @brief Runs the tasks of the other workers, until the tree is evaluated
+ *
+ * @param arg The worker
+ * @return NULL
+ */
+static void *run_worker(void *arg)
+{
+  worker_t *self = arg;
+  set_deadline(self->pool->deadline);
+
+  while (!atomic_load_explicit(&self->pool->finished, memory_order_acquire)) {
+    if (!help(self)) sched_yield();
+  }
+
+  return NULL;
+}
+
+
+/**
+ * @brief Computes the value of the parse tree, evaluating the independent
+ *        subtrees in parallel
+ * @details The operands of a binary operator or function are independent,
+ *          so the subtrees of at least PARALLEL_THRESHOLD nodes are run as
+ *          tasks on a work-stealing pool. The calling thread is one of the
+ *          workers. Smaller trees are evaluated serially.
+ *
+ *          The result is identical to the one of eval_tree_value.
+ *
+ * @param root The root of the tree
+ * @param env The values of the variables, may be NULL
+ * @param threads The number of threads
+ * @return The value of the tree
+ * @see AST::eval_tree_value
+ */
+long double eval_tree_parallel(ASTNode root, Environment env, unsigned int threads)
+{
+  assert(root != NULL);
+
+  Plan plan = NULL;
+  if (threads > 1) create_plan(root, &plan);
+  if (!plan) return eval_tree_value(root, env);
+
+  pool_t pool;
+  pool.size     = threads;
+  pool.env      = env;
+  pool.deadline = get_deadline();
+  atomic_init(&pool.finished, false);
+
+  pool.workers = calloc(threads, sizeof(*pool.workers));
+  assert(pool.workers != NULL);
+
+  for (unsigned int i = 0; i < threads; ++i) {
+    pool.workers[i].pool = &pool;
+    pool.workers[i].id   = i;
+    pool.workers[i].seed = i + 1;
+    pthread_mutex_init(&pool.workers[i].deque.lock, NULL);
+  }
+
+  pthread_t *ids = malloc(threads * sizeof(*ids));
+  assert(ids != NULL);
+
+  // A worker which can't be started has nothing to steal from, as its
+  // deque stays empty, so the others do without it
+  unsigned int started = 1;
+  while (started < threads && !pthread_create(&ids[started], NULL, &run_worker,
+                                              &pool.workers[started]))
+    ++started;
+
+  long double result = eval_plan(plan, &pool.workers[0]);
+
+  atomic_store_explicit(&pool.finished, true, memory_order_release);
+  for (unsigned int i = 1; i < started; ++i)
+    pthread_join(ids[i], NULL);
+
+  for (unsigned int i = 0; i < threads; ++i) {
+    pthread_mutex_destroy(&pool.workers[i].deque.lock);
+    free(pool.workers[i].deque.tasks);
+  }
+
+  free(ids);
+  free(pool.workers);
+  delete_plan(plan);
+
+  return result;
+}
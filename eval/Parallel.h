@@ -0,0 +1,18 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "../parser/AST.h"
+
+/**
+ * The number of nodes of a subtree from which it is worth evaluating it
+ * in a separate task
+ */
+#define PARALLEL_THRESHOLD 4096
+
+/**
+ * @brief Computes the value of the parse tree, evaluating the independent
+ *        subtrees in parallel
+ */
+long double eval_tree_parallel(ASTNode, Environment, unsigned int);
+
+#endif
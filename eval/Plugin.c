@@ -0,0 +1,172 @@
+#include <dlfcn.h>
+#include <strings.h>
+#include <string.h>
+#include <math.h>
+
+#include "../CommonHeaders.h"
+#include "Plugin.h"
+
+
+/**
+ * The functions of the plugins, by ID from FIRST_PLUGIN_FUNCTION, whose
+ * names the lexer knows. They are loaded once, before any evaluation
+ * starts, so the evaluations only read them, and the plugins are never
+ * unloaded.
+ */
+static const plugin_function_t *plugins[PLUGIN_FUNCTIONS];
+static size_t nbr_plugins = 0;
+
+
+/**
+ * @brief Checks a function of a plugin before it is loaded
+ * @details Its name must be read as a function by the lexer: letters only,
+ *          and not the name of a function already known, nor of one before
+ *          it in the table.
+ *
+ * @param table The table of the plugin
+ * @param k The index of the function in the table
+ * @return NULL if the function is valid, why it is not otherwise
+ */
+static const char *check_function(const plugin_table_t *table, unsigned int k)
+{
+  const plugin_function_t *function = &table->functions[k];
+
+  if (!function->name || !*function->name) return "a function has no name";
+  if (strlen(function->name) >= FUNCTION_NAME_SIZE) return "its name is too long";
+
+  for (const char *c = function->name; *c; ++c)
+    if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z')))
+      return "its name is not made of letters";
+
+  if (get_function_id(function->name) != NONE) return "it is already a function";
+  for (unsigned int j = 0; j < k; ++j)
+    if (!strcasecmp(table->functions[j].name, function->name))
+      return "it is defined twice";
+
+  if (!function->arity || function->arity > PLUGIN_ARGUMENTS)
+    return "its number of arguments is not supported";
+  if (!function->scalar) return "it has no scalar function";
+
+  return NULL;
+}
+
+
+/**
+ * @brief Loads the functions of a plugin
+ * @details The plugin is a shared object which exports a plugin_table_t
+ *          named PLUGIN_SYMBOL. Its functions are called like the variadic
+ *          functions, with as many arguments as their arity, and get the
+ *          IDs after the ones already loaded, from add_plugin_function. They may be called by several
+ *          threads at once. A plugin is loaded whole or not at all, and the
+ *          error is printed.
+ *
+ *          Must be called before the evaluations start.
+ *
+ * @param path The path of the shared object, as given to dlopen
+ * @return true if the plugin was loaded, false otherwise
+ * @see Function::add_plugin_function
+ */
+bool load_plugin(const char *path)
+{
+  void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    fprintf(stderr, "%s\n", dlerror());
+    return false;
+  }
+
+  const plugin_table_t *table = dlsym(handle, PLUGIN_SYMBOL);
+  const char *error = NULL;
+  unsigned int k = 0;
+
+  if (!table) {
+    fprintf(stderr, "%s: no table '%s'\n", path, PLUGIN_SYMBOL);
+  } else if (table->version != PLUGIN_VERSION) {
+    fprintf(stderr, "%s: version %u, expected %u\n", path, table->version, PLUGIN_VERSION);
+  } else if (table->count && !table->functions) {
+    fprintf(stderr, "%s: no functions in the table\n", path);
+  } else if (nbr_plugins + table->count > PLUGIN_FUNCTIONS) {
+    fprintf(stderr, "%s: more than %d functions in all the plugins\n", path, PLUGIN_FUNCTIONS);
+  } else {
+    while (k < table->count && !(error = check_function(table, k))) ++k;
+    if (!error) {
+      for (k = 0; k < table->count; ++k) {
+        const plugin_function_t *function = &table->functions[k];
+        add_plugin_function(function->name, function->arity);
+        plugins[nbr_plugins++] = function;
+      }
+      return true;
+    }
+
+    const char *name = table->functions[k].name;
+    fprintf(stderr, "%s: function '%s': %s\n", path, name ? name : "", error);
+  }
+
+  dlclose(handle);
+  return false;
+}
+
+
+/**
+ * @brief Returns a function of a plugin given by its ID
+ *
+ * @param id The ID of a loaded function
+ * @return The function
+ */
+const plugin_function_t *get_plugin(FunctionID id)
+{
+  assert(is_plugin(id) && (size_t)(id - FIRST_PLUGIN_FUNCTION) < nbr_plugins);
+
+  return plugins[id - FIRST_PLUGIN_FUNCTION];
+}
+
+
+/**
+ * @brief Computes a function of a plugin at a point
+ *
+ * @param id The ID of the function
+ * @param arguments The values of the arguments
+ * @param n The number of arguments
+ * @return The value of the function, or NaN if it doesn't take n arguments
+ */
+long double call_plugin(FunctionID id, const long double *arguments, size_t n)
+{
+  const plugin_function_t *function = get_plugin(id);
+  if (n != function->arity) return NAN;
+
+  return function->scalar(arguments);
+}
+
+
+/**
+ * @brief Computes a function of a plugin at several points
+ * @details By its array function if it has one, and point by point
+ *          otherwise.
+ *
+ * @param id The ID of the function
+ * @param arguments The values of the arguments, one array for each
+ * @param count The number of arguments
+ * @param results Where to store the values of the function
+ * @param n The number of points
+ * @see Plugin::call_plugin
+ */
+void call_plugin_array(FunctionID id, const long double *const *arguments, size_t count,
+                       long double *results, size_t n)
+{
+  const plugin_function_t *function = get_plugin(id);
+
+  if (count != function->arity) {
+    for (size_t l = 0; l < n; ++l) results[l] = NAN;
+    return;
+  }
+
+  if (function->array) {
+    function->array(arguments, results, n);
+    return;
+  }
+
+  long double point[PLUGIN_ARGUMENTS];
+  for (size_t l = 0; l < n; ++l) {
+    for (size_t k = 0; k < count; ++k) point[k] = arguments[k][l];
+    results[l] = function->scalar(point);
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../lexer/Function.h"
+
+/**
+ * The version of the interface of the plugins, in their table
+ */
+#define PLUGIN_VERSION 1
+
+/**
+ * The name of the table exported by a plugin
+ */
+#define PLUGIN_SYMBOL "calc_plugin"
+
+/**
+ * The largest number of arguments of a function of a plugin
+ */
+#define PLUGIN_ARGUMENTS 64
+
+/**
+ * @brief Computes a function of a plugin at a point: its arguments, as many
+ *        as its arity
+ */
+typedef long double (*plugin_scalar_t)(const long double*);
+
+/**
+ * @brief Computes a function of a plugin at several points: the values of
+ *        each argument, one array per argument, the values of the function
+ *        and their number
+ */
+typedef void (*plugin_array_t)(const long double *const*, long double*, size_t);
+
+/**
+ * @brief A function of a plugin: its name, of letters only, its number of
+ *        arguments, and how to compute it at a point, and optionally at
+ *        several points at once
+ */
+typedef struct plugin_function_t
+{
+  const char *name;
+  unsigned int arity;
+  plugin_scalar_t scalar;
+  plugin_array_t array;
+} plugin_function_t;
+
+/**
+ * @brief The table exported by a plugin under the name PLUGIN_SYMBOL
+ *
+ *          const plugin_table_t calc_plugin = { PLUGIN_VERSION, 2, functions };
+ */
+typedef struct plugin_table_t
+{
+  unsigned int version;
+  unsigned int count;
+  const plugin_function_t *functions;
+} plugin_table_t;
+
+/**
+ * @brief Loads the functions of a plugin
+ */
+bool load_plugin(const char*);
+
+/**
+ * @brief Returns a function of a plugin given by its ID
+ */
+const plugin_function_t *get_plugin(FunctionID);
+
+/**
+ * @brief Computes a function of a plugin at a point
+ */
+long double call_plugin(FunctionID, const long double*, size_t);
+
+/**
+ * @brief Computes a function of a plugin at several points
+ */
+void call_plugin_array(FunctionID, const long double *const*, size_t, long double*, size_t);
+
+#endif
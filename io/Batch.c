@@ -0,0 +1,821 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Number.h"
+#include "../lexer/TokenArray.h"
+#include "../parser/AST.h"
+#include "../parser/Parser.h"
+#include "../parser/NodePool.h"
+#include "../eval/Parallel.h"
+#include "../eval/Derivative.h"
+#include "../eval/Limits.h"
+#include "../eval/Optimize.h"
+#include "Batch.h"
+#include "Records.h"
+#include "Ring.h"
+
+/**
+ * The size of the chunks the input is split into, before they are aligned
+ * on the next line
+ */
+#define BATCH_CHUNK_SIZE (4U << 20)
+
+/**
+ * The number of chunks per worker which can be evaluated ahead of the
+ * chunk being written, to bound the memory taken by the results
+ */
+#define BATCH_WINDOW 4
+
+/**
+ * The largest number of chunks written at once
+ */
+#define BATCH_IOV 64
+
+/**
+ * The number of lines in flight between the stages of a pipelined
+ * evaluation, which bounds the memory it takes
+ */
+#define PIPELINE_JOBS 256
+
+
+/**
+ * @brief A growable buffer where the results of a chunk are written
+ */
+typedef struct buffer_t
+{
+  char *data;
+  size_t size;
+  size_t capacity;
+} buffer_t;
+
+/**
+ * @brief A line-aligned part of the input, and its results
+ */
+typedef struct chunk_t
+{
+  const char *start;
+  const char *end;
+  buffer_t output;
+  uint64_t lines;
+  bool done;
+} chunk_t;
+
+/**
+ * @brief A line going through the stages of a pipelined evaluation: its
+ *        tokens, then its node pool or parse tree
+ * @details The jobs are recycled, so their token arrays are reused for the
+ *          next lines. The last job marks the end of the input.
+ */
+typedef struct job_t
+{
+  const char *line;
+  size_t length;
+  uint64_t index;
+  bool end;
+
+  TokenArray tokens;
+  NodePool pool;
+  ASTNode root;
+  parse_error_t error;
+} job_t;
+
+/**
+ * @brief The rings between the stages of a pipelined evaluation, and the
+ *        time each stage spent waiting
+ * @details The lexer takes the free jobs, the parser the lexed ones and the
+ *          evaluator the parsed ones, which it frees. Each ring has a single
+ *          producer and a single consumer. Each stage writes its own times.
+ */
+typedef struct pipeline_t
+{
+  ring_t free;
+  ring_t lexed;
+  ring_t parsed;
+
+  const char *data;
+  size_t size;
+  BatchOptions options;
+
+  uint64_t lines;
+  struct timespec start;
+  uint64_t waited[PIPELINE_STAGES];
+  uint64_t finished[PIPELINE_STAGES];
+} pipeline_t;
+
+/**
+ * @brief The state shared by the workers and the writer
+ */
+typedef struct batch_t
+{
+  chunk_t *chunks;
+  size_t nbr_chunks;
+  size_t next;
+  size_t written;
+  size_t window;
+  BatchOptions options;
+
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+} batch_t;
+
+
+/**
+ * @brief Appends bytes at the end of a buffer
+ *
+ * @param buffer The buffer
+ * @param data The bytes to append
+ * @param size The number of bytes
+ */
+static void append(buffer_t *buffer, const char *data, size_t size)
+{
+  if (buffer->size + size > buffer->capacity) {
+    buffer->capacity = 2 * (buffer->size + size) + 256;
+    buffer->data = realloc(buffer->data, buffer->capacity);
+    assert(buffer->data != NULL);
+  }
+
+  memcpy(buffer->data + buffer->size, data, size);
+  buffer->size += size;
+}
+
+
+/**
+ * @brief Checks if the lines are parsed into trees rather than node pools
+ * @details A line needs a tree to be optimized, derived, or evaluated by
+ *          several threads.
+ *
+ * @param options The options of the batch
+ * @return true if the lines need a tree
+ */
+static bool needs_tree(BatchOptions options)
+{
+  return options->optimize || (options->format == OUTPUT_TEXT && options->nbr_wrt)
+      || options->threads > 1;
+}
+
+
+/**
+ * @brief Evaluates a parsed line, and appends its result to a buffer
+ * @details In text format, the result is written on its own line, followed
+ *          by its partial derivatives if any were asked, or 'error: ...' if
+ *          the expression is malformed, uses a variable which is not bound,
+ *          or runs past the deadline of its evaluation. In binary formats, a record is written (see Records.h), without
+ *          the derivatives.
+ *
+ *          A line which needs no tree is evaluated by a scan of its pool,
+ *          without allocating its nodes one by one. The tree or the pool is
+ *          deleted.
+ *
+ * @param root The parse tree of the line, or NULL
+ * @param pool The node pool of the line, or NULL
+ * @param error The syntax error of the line, if it has neither
+ * @param index The number of the line
+ * @param options The options of the batch
+ * @param output Where to write the result
+ * @see NodePool::eval_pool, Optimize::optimize_tree,
+ *      Parallel::eval_tree_parallel, Derivative::eval_tree_gradient,
+ *      Number::format_number, Limits::start_deadline
+ */
+static void evaluate_parsed(ASTNode root, NodePool pool, const parse_error_t *error,
+                            uint64_t index, BatchOptions options, buffer_t *output)
+{
+  OutputFormat format = options->format;
+  size_t nbr_wrt = format == OUTPUT_TEXT ? options->nbr_wrt : 0;
+  long double value = NAN, *gradient = NULL;
+  const char *unbound = NULL;
+
+  if (nbr_wrt) {
+    gradient = malloc(nbr_wrt * sizeof(*gradient));
+    assert(gradient != NULL);
+  }
+
+  start_deadline();
+
+  if (root) {
+    if (options->optimize) root = optimize_tree(root);
+
+    ASTNode leaf = find_unbound_variable(root, options->env);
+    if (leaf)
+      unbound = leaf->token->data;
+    else if (nbr_wrt)
+      value = eval_tree_gradient(root, options->env, options->wrt, nbr_wrt, gradient);
+    else
+      value = eval_tree_parallel(root, options->env, options->threads);
+  } else if (pool) {
+    unbound = find_unbound_pool_variable(pool, options->env);
+    if (!unbound) value = eval_pool(pool, options->env);
+  }
+
+  bool parsed = root || pool;
+  uint32_t status = !parsed ? RESULT_SYNTAX_ERROR : unbound ? RESULT_UNBOUND_VARIABLE : RESULT_OK;
+  if (status == RESULT_OK && deadline_passed()) {
+    status = RESULT_DEADLINE_EXCEEDED;
+    value  = NAN;
+  }
+  uint32_t position = parsed ? 0 : (uint32_t)error->position;
+
+  if (format == OUTPUT_DOUBLE) {
+    result_double_t record = { index, status, position, (double)value };
+    append(output, (const char*)&record, sizeof record);
+  } else if (format == OUTPUT_LONG_DOUBLE) {
+    result_long_double_t record;
+    memset(&record, 0, sizeof record);
+    record.index    = index;
+    record.status   = status;
+    record.position = position;
+    record.value    = value;
+    // Storing the value may leave anything in its padding, past the 80 bits
+    memset((char*)&record.value + 10, 0, sizeof(record.value) - 10);
+    append(output, (const char*)&record, sizeof record);
+  } else {
+    char str[NUMBER_BUFFER_SIZE + 128];
+    size_t len = 0;
+    if (status == RESULT_OK) {
+      len = format_number(value, str, NUMBER_BUFFER_SIZE);
+      for (size_t i = 0; i < nbr_wrt; ++i) {
+        append(output, str, len);
+        str[0] = ' ';
+        len = 1 + format_number(gradient[i], str + 1, NUMBER_BUFFER_SIZE);
+      }
+    } else if (unbound) {
+      len = (size_t)snprintf(str, sizeof str, "error: Unbound variable '%.64s'", unbound);
+    } else if (status == RESULT_DEADLINE_EXCEEDED) {
+      len = (size_t)snprintf(str, sizeof str, "error: Deadline exceeded");
+    } else {
+      len = (size_t)snprintf(str, sizeof str, "error: %s at position %zu",
+                             error->message, error->position);
+    }
+
+    str[len++] = '\n';
+    append(output, str, len);
+  }
+
+  if (root) root->destroy(root);
+  if (pool) delete_node_pool(pool);
+  free(gradient);
+}
+
+
+/**
+ * @brief Evaluates a line, and appends its result to a buffer
+ * @details The line is read in place, and parsed into a tree only if it
+ *          needs one.
+ *
+ * @param line The expression
+ * @param length The length of the expression
+ * @param index The number of the line in its chunk
+ * @param options The options of the batch
+ * @param output Where to write the result
+ * @see Parser::parse_expression, Parser::parse_expression_pool,
+ *      Batch::evaluate_parsed
+ */
+static void evaluate_line(const char *line, size_t length, uint64_t index,
+                          BatchOptions options, buffer_t *output)
+{
+  parse_error_t error;
+  ASTNode root = NULL;
+  NodePool pool = NULL;
+
+  if (needs_tree(options))
+    root = parse_expression(line, length, &error);
+  else
+    pool = parse_expression_pool(line, length, &error);
+
+  evaluate_parsed(root, pool, &error, index, options, output);
+}
+
+
+/**
+ * @brief Evaluates the lines of a chunk
+ * @details The records are numbered from the start of the chunk, since the
+ *          number of lines of the previous chunks is not known yet.
+ *
+ * @param chunk The chunk
+ * @param options The options of the batch
+ */
+static void evaluate_chunk(chunk_t *chunk, BatchOptions options)
+{
+  const char *line = chunk->start;
+  while (line < chunk->end) {
+    const char *eol = memchr(line, '\n', (size_t)(chunk->end - line));
+    if (!eol) eol = chunk->end;
+
+    evaluate_line(line, (size_t)(eol - line), chunk->lines++, options, &chunk->output);
+    line = eol + 1;
+  }
+}
+
+
+/**
+ * @brief Takes the next chunks and evaluates them, until there are no more
+ * @details A worker waits if it is too far ahead of the writer.
+ *
+ * @param arg The batch
+ * @return NULL
+ */
+static void *worker(void *arg)
+{
+  batch_t *batch = arg;
+
+  for (;;) {
+    pthread_mutex_lock(&batch->lock);
+    while (batch->next < batch->nbr_chunks && batch->next >= batch->written + batch->window)
+      pthread_cond_wait(&batch->changed, &batch->lock);
+
+    if (batch->next == batch->nbr_chunks) {
+      pthread_mutex_unlock(&batch->lock);
+      break;
+    }
+
+    chunk_t *chunk = &batch->chunks[batch->next++];
+    pthread_mutex_unlock(&batch->lock);
+
+    evaluate_chunk(chunk, batch->options);
+
+    pthread_mutex_lock(&batch->lock);
+    chunk->done = true;
+    pthread_cond_broadcast(&batch->changed);
+    pthread_mutex_unlock(&batch->lock);
+  }
+
+  return NULL;
+}
+
+
+/**
+ * @brief Splits a buffer into chunks which end on a line boundary
+ *
+ * @param data The buffer
+ * @param size The size of the buffer
+ * @param nbr_chunks Where to store the number of chunks
+ * @return The array of chunks
+ */
+static chunk_t *split_chunks(const char *data, size_t size, size_t *nbr_chunks)
+{
+  size_t capacity = size / BATCH_CHUNK_SIZE + 1;
+  chunk_t *chunks = calloc(capacity, sizeof(*chunks));
+  assert(chunks != NULL);
+
+  size_t n = 0;
+  const char *start = data, *end = data + size;
+  while (start < end) {
+    const char *stop = end;
+    if ((size_t)(end - start) > BATCH_CHUNK_SIZE) {
+      stop = memchr(start + BATCH_CHUNK_SIZE, '\n', (size_t)(end - start) - BATCH_CHUNK_SIZE);
+      stop = stop ? stop + 1 : end;
+    }
+
+    if (n == capacity) {
+      chunks = realloc(chunks, 2 * capacity * sizeof(*chunks));
+      assert(chunks != NULL);
+      memset(chunks + capacity, 0, capacity * sizeof(*chunks));
+      capacity *= 2;
+    }
+
+    chunks[n].start = start;
+    chunks[n].end   = stop;
+    ++n;
+
+    start = stop;
+  }
+
+  *nbr_chunks = n;
+
+  return chunks;
+}
+
+
+/**
+ * @brief Writes buffers, until all of them are written
+ *
+ * @param fd The file descriptor where to write
+ * @param iov The buffers, modified by the partial writes
+ * @param count The number of buffers
+ */
+static void write_all(int fd, struct iovec *iov, int count)
+{
+  while (count > 0) {
+    ssize_t written = writev(fd, iov, count);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      perror("Can't write the results");
+      exit(EXIT_FAILURE);
+    }
+
+    size_t left = (size_t)written;
+    while (count > 0 && left >= iov->iov_len) {
+      left -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+
+    if (count > 0) {
+      iov->iov_base = (char*)iov->iov_base + left;
+      iov->iov_len -= left;
+    }
+  }
+}
+
+
+/**
+ * @brief Renumbers the records of a chunk from the start of the input
+ *
+ * @param chunk The chunk
+ * @param format The format of the records
+ * @param base The number of lines of the previous chunks
+ */
+static void renumber_records(chunk_t *chunk, OutputFormat format, uint64_t base)
+{
+  size_t record_size = sizeof(result_double_t);
+  if (format == OUTPUT_LONG_DOUBLE) record_size = sizeof(result_long_double_t);
+
+  for (size_t offset = 0; offset < chunk->output.size; offset += record_size)
+    *(uint64_t*)(chunk->output.data + offset) += base;
+}
+
+
+/**
+ * @brief Returns the time elapsed since the start of a pipelined evaluation
+ *
+ * @param start The start of the evaluation
+ * @return The number of nanoseconds elapsed
+ */
+static uint64_t elapsed(const struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000U
+       + (uint64_t)now.tv_nsec - (uint64_t)start->tv_nsec;
+}
+
+
+/**
+ * @brief Hands a job to the next stage, waiting while its ring is full
+ *
+ * @param pipeline The pipeline
+ * @param ring The ring of the next stage
+ * @param job The job
+ * @param stage The stage which hands the job, whose waiting time grows
+ */
+static void push_job(pipeline_t *pipeline, Ring ring, job_t *job, PipelineStage stage)
+{
+  if (try_push_ring(ring, job)) return;
+
+  uint64_t since = elapsed(&pipeline->start);
+  while (!try_push_ring(ring, job)) sched_yield();
+  pipeline->waited[stage] += elapsed(&pipeline->start) - since;
+}
+
+
+/**
+ * @brief Takes a job from the previous stage, waiting while its ring is empty
+ *
+ * @param pipeline The pipeline
+ * @param ring The ring of the previous stage
+ * @param stage The stage which takes the job, whose waiting time grows
+ * @return The job
+ */
+static job_t *pop_job(pipeline_t *pipeline, Ring ring, PipelineStage stage)
+{
+  job_t *job = try_pop_ring(ring);
+  if (job) return job;
+
+  uint64_t since = elapsed(&pipeline->start);
+  while (!(job = try_pop_ring(ring))) sched_yield();
+  pipeline->waited[stage] += elapsed(&pipeline->start) - since;
+
+  return job;
+}
+
+
+/**
+ * @brief Splits the input into lines, and tokenizes each one into a free job
+ * @details A line can't be read before a job is freed by the evaluator, so
+ *          the lexer is never more than PIPELINE_JOBS lines ahead of it.
+ *
+ * @param arg The pipeline
+ * @return NULL
+ * @see TokenArray::tokenize_expression
+ */
+static void *lex_stage(void *arg)
+{
+  pipeline_t *pipeline = arg;
+  const char *line = pipeline->data, *end = pipeline->data + pipeline->size;
+
+  for (uint64_t index = 0; ; ++index) {
+    job_t *job = pop_job(pipeline, &pipeline->free, STAGE_LEX);
+    if (line >= end) {
+      job->end = true;
+      push_job(pipeline, &pipeline->lexed, job, STAGE_LEX);
+      pipeline->lines = index;
+      break;
+    }
+
+    const char *eol = memchr(line, '\n', (size_t)(end - line));
+    if (!eol) eol = end;
+
+    job->line   = line;
+    job->length = (size_t)(eol - line);
+    job->index  = index;
+    tokenize_expression(job->tokens, job->line, job->length);
+
+    push_job(pipeline, &pipeline->lexed, job, STAGE_LEX);
+    line = eol + 1;
+  }
+
+  pipeline->finished[STAGE_LEX] = elapsed(&pipeline->start);
+
+  return NULL;
+}
+
+
+/**
+ * @brief Parses the tokens of a lexed job into a node pool, or into a tree
+ *
+ * @param job The job
+ * @param tree Whether the line needs a tree
+ * @see Parser::parse_token_range, Parser::create_tree_from_pool
+ */
+static void parse_job(job_t *job, bool tree)
+{
+  job->pool = parse_token_range(job->tokens, job->line, 0, job->tokens->size, &job->error, NULL);
+  if (job->pool && tree) {
+    job->root = create_tree_from_pool(job->pool, job->tokens, job->line, NULL);
+    delete_node_pool(job->pool);
+    job->pool = NULL;
+  }
+}
+
+
+/**
+ * @brief Parses the tokens of the lexed jobs into node pools, or into trees
+ *        if the lines need them
+ *
+ * @param arg The pipeline
+ * @return NULL
+ * @see Batch::parse_job
+ */
+static void *parse_stage(void *arg)
+{
+  pipeline_t *pipeline = arg;
+  bool tree = needs_tree(pipeline->options);
+
+  for (;;) {
+    job_t *job = pop_job(pipeline, &pipeline->lexed, STAGE_PARSE);
+    if (job->end) {
+      push_job(pipeline, &pipeline->parsed, job, STAGE_PARSE);
+      break;
+    }
+
+    parse_job(job, tree);
+    push_job(pipeline, &pipeline->parsed, job, STAGE_PARSE);
+  }
+
+  pipeline->finished[STAGE_PARSE] = elapsed(&pipeline->start);
+
+  return NULL;
+}
+
+
+/**
+ * @brief Evaluates the parsed jobs in order, frees them, and writes their
+ *        results
+ * @details Without the parser thread, the lexed jobs are parsed here first.
+ *
+ * @param pipeline The pipeline
+ * @param fd Where to write the results
+ * @param parse Whether the jobs are taken lexed rather than parsed
+ * @see Batch::evaluate_parsed
+ */
+static void eval_stage(pipeline_t *pipeline, int fd, bool parse)
+{
+  buffer_t output = { NULL, 0, 0 };
+  bool tree = needs_tree(pipeline->options);
+
+  for (;;) {
+    job_t *job = pop_job(pipeline, parse ? &pipeline->lexed : &pipeline->parsed, STAGE_EVAL);
+    if (job->end) break;
+
+    if (parse) parse_job(job, tree);
+    evaluate_parsed(job->root, job->pool, &job->error, job->index, pipeline->options, &output);
+    job->root = NULL;
+    job->pool = NULL;
+    push_job(pipeline, &pipeline->free, job, STAGE_EVAL);
+
+    if (output.size >= BATCH_CHUNK_SIZE) {
+      struct iovec iov = { output.data, output.size };
+      write_all(fd, &iov, 1);
+      output.size = 0;
+    }
+  }
+
+  struct iovec iov = { output.data, output.size };
+  write_all(fd, &iov, 1);
+  free(output.data);
+
+  pipeline->finished[STAGE_EVAL] = elapsed(&pipeline->start);
+}
+
+
+/**
+ * @brief Evaluates each line of a buffer by a pipeline of three threads,
+ *        which lex, parse and evaluate the lines
+ * @details The stages hand the lines over through lock-free rings, with a
+ *          single producer and a single consumer each. PIPELINE_JOBS jobs
+ *          go round from the lexer to the evaluator and back, so the memory
+ *          is bounded whatever the stage which lags behind, and the token
+ *          arrays are reused. The results are written in the order of the
+ *          input by the evaluator, which is the calling thread.
+ *
+ *          The time each stage was busy, that is not waiting for a job, is
+ *          stored in the statistics of the options, if any.
+ *
+ *          If the parser thread can't be created, the evaluator parses the
+ *          lines too, and the parse stage is never busy. If the lexer
+ *          can't be, nothing is evaluated.
+ *
+ * @param data The lines to evaluate
+ * @param size The size of the buffer
+ * @param options The options of the batch
+ * @param fd Where to write the results
+ * @return false if the lexer thread can't be created
+ */
+static bool evaluate_pipeline(const char *data, size_t size, BatchOptions options, int fd)
+{
+  pipeline_t pipeline;
+  memset(&pipeline, 0, sizeof pipeline);
+  pipeline.data    = data;
+  pipeline.size    = size;
+  pipeline.options = options;
+
+  init_ring(&pipeline.free, PIPELINE_JOBS);
+  init_ring(&pipeline.lexed, PIPELINE_JOBS);
+  init_ring(&pipeline.parsed, PIPELINE_JOBS);
+
+  job_t *jobs = calloc(PIPELINE_JOBS, sizeof(*jobs));
+  assert(jobs != NULL);
+
+  for (size_t i = 0; i < PIPELINE_JOBS; ++i) {
+    jobs[i].tokens = create_token_array();
+    try_push_ring(&pipeline.free, &jobs[i]);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &pipeline.start);
+
+  pthread_t lexer, parser;
+  bool lexing = !pthread_create(&lexer, NULL, &lex_stage, &pipeline);
+  bool parsing = lexing && !pthread_create(&parser, NULL, &parse_stage, &pipeline);
+
+  if (lexing) {
+    eval_stage(&pipeline, fd, !parsing);
+
+    pthread_join(lexer, NULL);
+    if (parsing) pthread_join(parser, NULL);
+  }
+
+  if (lexing && options->stats) {
+    PipelineStats stats = options->stats;
+    uint64_t total = elapsed(&pipeline.start);
+
+    stats->seconds = (double)total / 1e9;
+    stats->lines   = pipeline.lines;
+
+    for (int stage = 0; stage < PIPELINE_STAGES; ++stage)
+      stats->busy[stage] = (double)(pipeline.finished[stage] - pipeline.waited[stage]) / 1e9;
+  }
+
+  for (size_t i = 0; i < PIPELINE_JOBS; ++i)
+    delete_token_array(jobs[i].tokens);
+  free(jobs);
+
+  release_ring(&pipeline.free);
+  release_ring(&pipeline.lexed);
+  release_ring(&pipeline.parsed);
+
+  return lexing;
+}
+
+
+/**
+ * @brief Evaluates each line of a buffer, and writes the results in order
+ * @details The buffer is split into line-aligned chunks of a few megabytes,
+ *          which are evaluated by a pool of workers. The lines are read in
+ *          place, the buffer is never copied. The calling thread gathers the
+ *          results of the chunks which are ready, in the order of the input,
+ *          and writes them with a single writev.
+ *
+ *          In binary formats, the results start with a header, and are
+ *          fixed-size records (see Records.h).
+ *
+ *          The large expressions are evaluated by options->threads threads
+ *          each (see Parallel::eval_tree_parallel).
+ *
+ *          With options->pipeline, the lines are rather lexed, parsed and
+ *          evaluated by three threads in turn (see Batch::evaluate_pipeline).
+ *          If the pipeline can't be started, options->pipeline is cleared
+ *          and the chunks are evaluated as without it.
+ *
+ * @param data The lines to evaluate, typically a mapped file
+ * @param size The size of the buffer
+ * @param options The number of workers, of threads per expression and
+ *                the format of the results
+ * @param fd Where to write the results, one for each input line
+ */
+void evaluate_batch(const char *data, size_t size, BatchOptions options, int fd)
+{
+  OutputFormat format = options->format;
+  unsigned int jobs = options->jobs ? options->jobs : 1;
+
+  if (format != OUTPUT_TEXT) {
+    result_header_t header = { RESULT_MAGIC, RESULT_VERSION, RESULT_DOUBLE,
+                               sizeof(result_double_t) };
+    if (format == OUTPUT_LONG_DOUBLE) {
+      header.value_type  = RESULT_LONG_DOUBLE;
+      header.record_size = sizeof(result_long_double_t);
+    }
+
+    struct iovec iov = { &header, sizeof header };
+    write_all(fd, &iov, 1);
+  }
+
+  if (options->pipeline) {
+    if (evaluate_pipeline(data, size, options, fd)) return;
+    options->pipeline = false;
+  }
+
+  batch_t batch;
+  batch.chunks  = split_chunks(data, size, &batch.nbr_chunks);
+  batch.next    = 0;
+  batch.written = 0;
+  batch.window  = (size_t)jobs * BATCH_WINDOW;
+  batch.options = options;
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.changed, NULL);
+
+  pthread_t *workers = malloc(jobs * sizeof(*workers));
+  assert(workers != NULL);
+
+  unsigned int started = 0;
+  while (started < jobs && !pthread_create(&workers[started], NULL, &worker, &batch))
+    ++started;
+
+  uint64_t lines = 0;
+  size_t first = 0;
+  while (first < batch.nbr_chunks) {
+    // Without any worker, the chunks are evaluated here, in order
+    if (!started) {
+      evaluate_chunk(&batch.chunks[first], options);
+      batch.chunks[first].done = true;
+    }
+
+    pthread_mutex_lock(&batch.lock);
+    while (!batch.chunks[first].done)
+      pthread_cond_wait(&batch.changed, &batch.lock);
+
+    size_t last = first;
+    while (last < batch.nbr_chunks && last - first < BATCH_IOV && batch.chunks[last].done)
+      ++last;
+    pthread_mutex_unlock(&batch.lock);
+
+    struct iovec iov[BATCH_IOV];
+    for (size_t i = first; i < last; ++i) {
+      chunk_t *chunk = &batch.chunks[i];
+      if (format != OUTPUT_TEXT) renumber_records(chunk, format, lines);
+      lines += chunk->lines;
+
+      iov[i - first].iov_base = chunk->output.data;
+      iov[i - first].iov_len  = chunk->output.size;
+    }
+
+    write_all(fd, iov, (int)(last - first));
+
+    for (size_t i = first; i < last; ++i)
+      free(batch.chunks[i].output.data);
+
+    pthread_mutex_lock(&batch.lock);
+    batch.written = last;
+    pthread_cond_broadcast(&batch.changed);
+    pthread_mutex_unlock(&batch.lock);
+
+    first = last;
+  }
+
+  for (unsigned int i = 0; i < started; ++i)
+    pthread_join(workers[i], NULL);
+
+  pthread_cond_destroy(&batch.changed);
+  pthread_mutex_destroy(&batch.lock);
+  free(workers);
+  free(batch.chunks);
+}
@@ -0,0 +1,52 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../parser/Environment.h"
+
+/**
+ * @brief Represents the format of the results
+ */
+typedef enum output_format { OUTPUT_TEXT, OUTPUT_DOUBLE, OUTPUT_LONG_DOUBLE } OutputFormat;
+
+/**
+ * @brief Represents the stages of a pipelined batch evaluation, each one
+ *        run by its own thread
+ */
+typedef enum pipeline_stage { STAGE_LEX, STAGE_PARSE, STAGE_EVAL, PIPELINE_STAGES } PipelineStage;
+
+/**
+ * @brief How long each stage of a pipelined batch evaluation was busy
+ */
+typedef struct pipeline_stats_t
+{
+  double seconds;
+  double busy[PIPELINE_STAGES];
+  uint64_t lines;
+} pipeline_stats_t, *PipelineStats;
+
+/**
+ * @brief Holds the options of a batch evaluation
+ */
+typedef struct batch_options_t
+{
+  unsigned int jobs;
+  unsigned int threads;
+  OutputFormat format;
+  bool optimize;
+  Environment env;
+  const char *const *wrt;
+  size_t nbr_wrt;
+  bool pipeline;
+  PipelineStats stats;
+} batch_options_t, *BatchOptions;
+
+/**
+ * @brief Evaluates each line of a buffer, and writes the results in order
+ */
+void evaluate_batch(const char*, size_t, BatchOptions, int);
+
+#endif
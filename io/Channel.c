@@ -0,0 +1,459 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/TokenArray.h"
+#include "../parser/AST.h"
+#include "../parser/Parser.h"
+#include "../parser/NodePool.h"
+#include "../eval/Optimize.h"
+#include "../eval/Limits.h"
+#include "Channel.h"
+
+/**
+ * How many times a side checks an index before it sleeps on it
+ */
+#define CHANNEL_SPINS 4096
+
+/**
+ * How long the server sleeps before it checks whether it was stopped
+ */
+#define CHANNEL_POLL_NS 100000000L
+
+
+/**
+ * @brief Tells the CPU that the thread is spinning
+ */
+static inline void pause_cpu(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ volatile("yield");
+#endif
+}
+
+
+/**
+ * @brief Waits, or wakes the processes waiting, on an index of a ring
+ * @details The futex is not private, since the ring is shared by two
+ *          processes.
+ *
+ * @param word The index
+ * @param op FUTEX_WAIT or FUTEX_WAKE
+ * @param value The value the index must still have to wait, or the number
+ *        of processes to wake
+ * @param timeout How long to wait at most, or NULL
+ */
+static void futex(atomic_uint *word, int op, unsigned int value, const struct timespec *timeout)
+{
+  syscall(SYS_futex, (unsigned int*)word, op, value, timeout, NULL, 0);
+}
+
+
+/**
+ * @brief Waits until an index of a ring is not the one seen anymore
+ * @details The caller spins first, then announces that it sleeps and reads
+ *          the index again before it does: since the other side publishes
+ *          the index before it reads the number of sleepers, either this
+ *          side sees the new index, or the other side sees the sleeper and
+ *          wakes it. It returns early when the channel is closed, or after
+ *          the timeout.
+ *
+ * @param channel The channel
+ * @param index The index
+ * @param sleepers The number of processes sleeping on the index
+ * @param seen The value of the index seen
+ * @param timeout How long to sleep at most, or NULL
+ */
+static void wait_index(Channel channel, atomic_uint *index, atomic_uint *sleepers,
+                       unsigned int seen, const struct timespec *timeout)
+{
+  for (unsigned int i = 0; i < channel->spins; ++i) {
+    if (atomic_load_explicit(index, memory_order_acquire) != seen) return;
+    pause_cpu();
+  }
+
+  atomic_fetch_add(sleepers, 1);
+  if (atomic_load(index) == seen && !atomic_load(&channel->region->closed))
+    futex(index, FUTEX_WAIT, seen, timeout);
+  atomic_fetch_sub(sleepers, 1);
+}
+
+
+/**
+ * @brief Moves an index of a ring forward, and wakes the other side if it
+ *        sleeps on it
+ *
+ * @param index The index
+ * @param sleepers The number of processes sleeping on the index
+ * @param value The new value of the index
+ */
+static void publish_index(atomic_uint *index, atomic_uint *sleepers, unsigned int value)
+{
+  atomic_store(index, value);
+  if (atomic_load(sleepers)) futex(index, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+
+/**
+ * @brief Waits until a ring has a free slot, for its producer
+ *
+ * @param channel The channel
+ * @param ring The ring
+ * @param tail Where to store the index of the free slot
+ * @param stop Stops the wait when set, or NULL
+ * @return true if there is a free slot, false if the channel was closed
+ *         or stopped
+ */
+static bool wait_slot(Channel channel, channel_ring_t *ring, unsigned int *tail,
+                      volatile sig_atomic_t *stop)
+{
+  struct timespec poll = { 0, CHANNEL_POLL_NS };
+  *tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+  for (;;) {
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (*tail - head < CHANNEL_SLOTS) return true;
+    if (atomic_load(&channel->region->closed) || (stop && *stop)) return false;
+    wait_index(channel, &ring->head, &ring->head_sleepers, head, stop ? &poll : NULL);
+  }
+}
+
+
+/**
+ * @brief Waits until a ring has an item, for its consumer
+ *
+ * @param channel The channel
+ * @param ring The ring
+ * @param head Where to store the index of the item
+ * @param stop Stops the wait when set, or NULL
+ * @return true if there is an item, false if the channel was closed or
+ *         stopped
+ */
+static bool wait_item(Channel channel, channel_ring_t *ring, unsigned int *head,
+                      volatile sig_atomic_t *stop)
+{
+  struct timespec poll = { 0, CHANNEL_POLL_NS };
+  *head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+  for (;;) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (tail != *head) return true;
+    if (atomic_load(&channel->region->closed) || (stop && *stop)) return false;
+    wait_index(channel, &ring->tail, &ring->tail_sleepers, tail, stop ? &poll : NULL);
+  }
+}
+
+
+/**
+ * @brief Maps the shared memory of a channel
+ *
+ * @param name The shared memory name
+ * @param fd The shared memory, which is closed
+ * @param owner Whether the channel is the server's
+ * @return The channel, or NULL if it can't be mapped (errno is set)
+ */
+static Channel map_channel(const char *name, int fd, bool owner)
+{
+  void *region = mmap(NULL, sizeof(channel_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int error = errno;
+  close(fd);
+  if (region == MAP_FAILED) {
+    errno = error;
+    return NULL;
+  }
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  Channel channel = malloc(sizeof(channel_t));
+  assert(channel != NULL);
+  channel->region = region;
+  channel->name   = strdup(name);
+  assert(channel->name != NULL);
+  channel->owner  = owner;
+  // Spinning on a single CPU only delays the other side
+  channel->spins  = cpus > 1 ? CHANNEL_SPINS : 0;
+
+  return channel;
+}
+
+
+/**
+ * @brief Creates a channel under a shared memory name, for the server
+ * @details The name must not exist yet. The memory is zeroed by the kernel,
+ *          so the rings start empty.
+ *
+ * @param name The shared memory name, such as "/calc"
+ * @return The channel, or NULL if it can't be created (errno is set)
+ * @see Channel::serve_channel
+ */
+Channel create_channel(const char *name)
+{
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) return NULL;
+
+  if (ftruncate(fd, sizeof(channel_region_t)) < 0) {
+    int error = errno;
+    close(fd);
+    shm_unlink(name);
+    errno = error;
+    return NULL;
+  }
+
+  Channel channel = map_channel(name, fd, true);
+  if (!channel) {
+    int error = errno;
+    shm_unlink(name);
+    errno = error;
+    return NULL;
+  }
+
+  channel->region->version = CHANNEL_VERSION;
+  channel->region->magic   = CHANNEL_MAGIC;
+
+  return channel;
+}
+
+
+/**
+ * @brief Opens the channel of a server, for a client
+ * @details A channel has one client at a time: the rings have a single
+ *          producer and a single consumer on each side.
+ *
+ * @param name The shared memory name of the server
+ * @return The channel, or NULL if it can't be opened (errno is set, to
+ *         EINVAL if the memory is not a channel)
+ */
+Channel open_channel(const char *name)
+{
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size != sizeof(channel_region_t)) {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  Channel channel = map_channel(name, fd, false);
+  if (channel && (channel->region->magic != CHANNEL_MAGIC
+               || channel->region->version != CHANNEL_VERSION)) {
+    close_channel(channel);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  return channel;
+}
+
+
+/**
+ * @brief Unmaps a channel, and removes its name if it created it
+ *
+ * @param channel The channel
+ */
+void close_channel(Channel channel)
+{
+  if (channel->owner) shm_unlink(channel->name);
+  munmap(channel->region, sizeof(channel_region_t));
+  free(channel->name);
+  free(channel);
+}
+
+
+/**
+ * @brief Sends an expression to the server
+ * @details Waits while the request ring is full. The responses are not
+ *          read here: a client must not have more than CHANNEL_SLOTS
+ *          requests in flight, or the server waits for room in the response
+ *          ring while the client waits for room in the request ring.
+ *
+ * @param channel The channel
+ * @param text The expression
+ * @param length The length of the expression, at most CHANNEL_TEXT
+ * @return true if it was sent, false if it is too long (errno is EMSGSIZE)
+ *         or the server is gone (EPIPE)
+ */
+bool send_request(Channel channel, const char *text, size_t length)
+{
+  if (length > CHANNEL_TEXT) {
+    errno = EMSGSIZE;
+    return false;
+  }
+
+  channel_ring_t *ring = &channel->region->requests;
+  unsigned int tail;
+  if (!wait_slot(channel, ring, &tail, NULL)) {
+    errno = EPIPE;
+    return false;
+  }
+
+  channel_request_t *request = &channel->region->request_slots[tail % CHANNEL_SLOTS];
+  request->length = (uint32_t)length;
+  memcpy(request->text, text, length);
+  publish_index(&ring->tail, &ring->tail_sleepers, tail + 1);
+
+  return true;
+}
+
+
+/**
+ * @brief Asks the server to stop, after the requests already sent
+ *
+ * @param channel The channel
+ * @return true if it was sent, false if the server is gone (errno is EPIPE)
+ */
+bool send_shutdown(Channel channel)
+{
+  channel_ring_t *ring = &channel->region->requests;
+  unsigned int tail;
+  if (!wait_slot(channel, ring, &tail, NULL)) {
+    errno = EPIPE;
+    return false;
+  }
+
+  channel->region->request_slots[tail % CHANNEL_SLOTS].length = CHANNEL_SHUTDOWN;
+  publish_index(&ring->tail, &ring->tail_sleepers, tail + 1);
+
+  return true;
+}
+
+
+/**
+ * @brief Receives the result of the oldest request not answered yet
+ * @details Waits while the response ring is empty.
+ *
+ * @param channel The channel
+ * @param record Where to store the result: its index is the number of the
+ *        request since the server started
+ * @return true if a result was received, false if the server is gone
+ *         (errno is EPIPE)
+ */
+bool receive_response(Channel channel, result_long_double_t *record)
+{
+  channel_ring_t *ring = &channel->region->responses;
+  unsigned int head;
+  if (!wait_item(channel, ring, &head, NULL)) {
+    errno = EPIPE;
+    return false;
+  }
+
+  *record = channel->region->response_slots[head % CHANNEL_SLOTS];
+  publish_index(&ring->head, &ring->head_sleepers, head + 1);
+
+  return true;
+}
+
+
+/**
+ * @brief Evaluates the expression of a request
+ * @details The expression is read in place, in the request slot. The tokens
+ *          are stored in an array reused from one request to the next. The
+ *          evaluation has its own deadline.
+ *
+ * @param request The request
+ * @param tokens The token array
+ * @param env The variables
+ * @param optimize Whether the expression is optimized first
+ * @param record Where to store the result
+ * @see Parser::parse_token_range, NodePool::eval_pool, Optimize::optimize_tree,
+ *      Limits::start_deadline
+ */
+static void evaluate_request(const channel_request_t *request, TokenArray tokens,
+                             Environment env, bool optimize, result_long_double_t *record)
+{
+  size_t length = request->length;
+  parse_error_t error = { "Expression too long", CHANNEL_TEXT };
+  NodePool pool = NULL;
+  long double value = NAN;
+  bool unbound = false;
+
+  if (length <= CHANNEL_TEXT) {
+    tokenize_expression(tokens, request->text, length);
+    pool = parse_token_range(tokens, request->text, 0, tokens->size, &error, NULL);
+  }
+
+  start_deadline();
+
+  if (pool && optimize) {
+    ASTNode root = optimize_tree(create_tree_from_pool(pool, tokens, request->text, NULL));
+    unbound = find_unbound_variable(root, env) != NULL;
+    if (!unbound) value = eval_tree_value(root, env);
+    root->destroy(root);
+  } else if (pool) {
+    unbound = find_unbound_pool_variable(pool, env) != NULL;
+    if (!unbound) value = eval_pool(pool, env);
+  }
+
+  memset(record, 0, sizeof *record);
+  record->status   = !pool ? RESULT_SYNTAX_ERROR : unbound ? RESULT_UNBOUND_VARIABLE : RESULT_OK;
+  if (record->status == RESULT_OK && deadline_passed()) {
+    record->status = RESULT_DEADLINE_EXCEEDED;
+    value = NAN;
+  }
+  record->position = pool ? 0 : (uint32_t)error.position;
+  record->value    = value;
+  // Storing the value may leave anything in its padding, past the 80 bits
+  memset((char*)&record->value + 10, 0, sizeof(record->value) - 10);
+
+  if (pool) delete_node_pool(pool);
+}
+
+
+/**
+ * @brief Evaluates the requests of a channel until it is shut down or stopped
+ * @details Each request is answered in order, by a record whose index is the
+ *          number of the request. When the server stops, the channel is
+ *          closed and a client waiting on it is woken, so it fails instead
+ *          of waiting forever.
+ *
+ * @param channel The channel, created by the server
+ * @param env The variables
+ * @param optimize Whether the expressions are optimized first
+ * @param stop Set by a signal handler to stop the server
+ * @see Channel::create_channel
+ */
+void serve_channel(Channel channel, Environment env, bool optimize, volatile sig_atomic_t *stop)
+{
+  channel_region_t *region = channel->region;
+  TokenArray tokens = create_token_array();
+
+  for (uint64_t index = 0; ; ++index) {
+    unsigned int head, tail;
+    if (!wait_item(channel, &region->requests, &head, stop)) break;
+
+    const channel_request_t *request = &region->request_slots[head % CHANNEL_SLOTS];
+    bool shutdown = request->length == CHANNEL_SHUTDOWN;
+
+    result_long_double_t record;
+    if (!shutdown) evaluate_request(request, tokens, env, optimize, &record);
+    record.index = index;
+    publish_index(&region->requests.head, &region->requests.head_sleepers, head + 1);
+
+    if (shutdown || !wait_slot(channel, &region->responses, &tail, stop)) break;
+
+    region->response_slots[tail % CHANNEL_SLOTS] = record;
+    publish_index(&region->responses.tail, &region->responses.tail_sleepers, tail + 1);
+  }
+
+  atomic_store(&region->closed, 1);
+  futex(&region->requests.head, FUTEX_WAKE, INT_MAX, NULL);
+  futex(&region->responses.tail, FUTEX_WAKE, INT_MAX, NULL);
+
+  delete_token_array(tokens);
+}
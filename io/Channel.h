@@ -0,0 +1,136 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <signal.h>
+
+#include "Records.h"
+#include "../parser/Environment.h"
+
+/**
+ * The layout of a shared-memory channel, created by the server under a
+ * POSIX shared memory name and mapped by one client at a time:
+ *
+ *   - a request ring: the client writes expressions, the server reads them;
+ *   - a response ring: the server writes one result_long_double_t record
+ *     (see Records.h) for each request, in the order of the requests.
+ *
+ * Each ring is a bounded queue between one producer and one consumer: the
+ * producer owns the tail and the consumer the head, each one on its own
+ * cache line. A side which finds its ring empty or full spins a while, then
+ * sleeps on a futex on the index it waits for; the other side only makes
+ * the wake-up system call when someone is sleeping, so a busy channel makes
+ * no system calls at all.
+ */
+
+#define CHANNEL_MAGIC 0x4E414843U
+
+/**
+ * The version of the layout, checked when a client attaches: version 2 adds
+ * the status RESULT_DEADLINE_EXCEEDED to the responses
+ */
+#define CHANNEL_VERSION 2
+
+/**
+ * The number of slots of each ring, a power of two
+ */
+#define CHANNEL_SLOTS 256
+
+/**
+ * The longest expression a request holds
+ */
+#define CHANNEL_TEXT 252
+
+/**
+ * The length of the request which stops the server
+ */
+#define CHANNEL_SHUTDOWN UINT32_MAX
+
+/**
+ * @brief A request: an expression, not terminated by a '\0'
+ */
+typedef struct channel_request_t
+{
+  uint32_t length;
+  char text[CHANNEL_TEXT];
+} channel_request_t;
+
+/**
+ * @brief The indices of a ring, which only grow
+ */
+typedef struct channel_ring_t
+{
+  _Alignas(64) atomic_uint tail;
+  atomic_uint tail_sleepers;
+
+  _Alignas(64) atomic_uint head;
+  atomic_uint head_sleepers;
+} channel_ring_t;
+
+/**
+ * @brief The shared memory of a channel
+ */
+typedef struct channel_region_t
+{
+  uint32_t magic;
+  uint32_t version;
+  atomic_uint closed;
+
+  channel_ring_t requests;
+  channel_ring_t responses;
+
+  channel_request_t request_slots[CHANNEL_SLOTS];
+  result_long_double_t response_slots[CHANNEL_SLOTS];
+} channel_region_t;
+
+/**
+ * @brief A channel mapped by the server or by a client
+ */
+typedef struct channel_t *Channel;
+typedef struct channel_t
+{
+  channel_region_t *region;
+  char *name;
+  bool owner;
+  unsigned int spins;
+} channel_t;
+
+/**
+ * @brief Creates a channel under a shared memory name, for the server
+ */
+Channel create_channel(const char*);
+
+/**
+ * @brief Opens the channel of a server, for a client
+ */
+Channel open_channel(const char*);
+
+/**
+ * @brief Unmaps a channel, and removes its name if it created it
+ */
+void close_channel(Channel);
+
+/**
+ * @brief Sends an expression to the server
+ */
+bool send_request(Channel, const char*, size_t);
+
+/**
+ * @brief Asks the server to stop
+ */
+bool send_shutdown(Channel);
+
+/**
+ * @brief Receives the result of the oldest request not answered yet
+ */
+bool receive_response(Channel, result_long_double_t*);
+
+/**
+ * @brief Evaluates the requests of a channel until it is shut down or stopped
+ */
+void serve_channel(Channel, Environment, bool, volatile sig_atomic_t*);
+
+#endif
@@ -0,0 +1,471 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Operator.h"
+#include "../lexer/Function.h"
+#include "../parser/NodePool.h"
+#include "../parser/Environment.h"
+#include "MappedFile.h"
+#include "Compiled.h"
+
+_Static_assert(sizeof(pool_node_t) == 32, "the nodes are written as they are laid out in memory");
+
+/**
+ * @brief An expression to write, and its name
+ */
+typedef struct named_pool_t
+{
+  const char *name;
+  NodePool pool;
+} named_pool_t;
+
+
+/**
+ * @brief Compares the names of two expressions to write (for qsort)
+ */
+static int compare_names(const void *a, const void *b)
+{
+  return strcmp(((const named_pool_t*)a)->name, ((const named_pool_t*)b)->name);
+}
+
+
+/**
+ * @brief Rounds a size up to a multiple of 16
+ */
+static uint64_t align16(uint64_t size)
+{
+  return (size + 15) & ~(uint64_t)15;
+}
+
+
+/**
+ * @brief Writes expressions to a file of compiled expressions
+ * @details The expressions are sorted by name, so they can be found by
+ *          a binary search when the file is loaded. The padding of the nodes
+ *          is zeroed, so the same expressions always give the same file.
+ *          The layout is documented in Compiled.h.
+ *
+ * @param out Where to write the file
+ * @param names The names of the expressions, all different
+ * @param pools The expressions
+ * @param count The number of expressions
+ * @return true if the file is written, false if two expressions have the
+ *         same name (errno is EINVAL), if the file would be too large
+ *         (errno is EOVERFLOW) or if an error occurred while writing
+ */
+bool write_compiled_file(FILE *out, const char *const *names, const NodePool *pools, size_t count)
+{
+  named_pool_t *sorted = malloc((count ? count : 1) * sizeof(*sorted));
+  assert(sorted != NULL);
+
+  for (size_t i = 0; i < count; ++i) {
+    sorted[i].name = names[i];
+    sorted[i].pool = pools[i];
+  }
+  qsort(sorted, count, sizeof(*sorted), &compare_names);
+
+  uint64_t nbr_variables = 0, nbr_nodes = 0, strings_size = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (i && !strcmp(sorted[i - 1].name, sorted[i].name)) {
+      free(sorted);
+      errno = EINVAL;
+      return false;
+    }
+
+    NodePool pool = sorted[i].pool;
+    nbr_variables += pool->nbr_variables;
+    nbr_nodes += pool->size;
+    strings_size += strlen(sorted[i].name) + 1;
+    for (size_t v = 0; v < pool->nbr_variables; ++v)
+      strings_size += strlen(pool->variables[v]) + 1;
+  }
+
+  if (count > UINT32_MAX || nbr_variables > UINT32_MAX || nbr_nodes >= POOL_NONE
+   || strings_size > UINT32_MAX) {
+    free(sorted);
+    errno = EOVERFLOW;
+    return false;
+  }
+
+  compiled_header_t header;
+  memset(&header, 0, sizeof header);
+  memcpy(header.magic, COMPILED_MAGIC, sizeof COMPILED_MAGIC);
+  header.version         = COMPILED_VERSION;
+  header.node_size       = sizeof(pool_node_t);
+  header.nbr_expressions = (uint32_t)count;
+  header.nbr_variables   = (uint32_t)nbr_variables;
+  header.nbr_nodes       = (uint32_t)nbr_nodes;
+  header.nodes_offset    = align16(sizeof header + count * sizeof(compiled_expression_t)
+                                   + nbr_variables * sizeof(uint32_t));
+  header.strings_offset  = header.nodes_offset + nbr_nodes * sizeof(pool_node_t);
+  header.strings_size    = strings_size;
+
+  fwrite(&header, sizeof header, 1, out);
+
+  // The names of the expressions come first in the strings, then the
+  // names of their variables
+  uint32_t name = 0, variable_name = 0, first_node = 0, first_variable = 0;
+  for (size_t i = 0; i < count; ++i)
+    variable_name += (uint32_t)strlen(sorted[i].name) + 1;
+
+  for (size_t i = 0; i < count; ++i) {
+    NodePool pool = sorted[i].pool;
+    compiled_expression_t expression = { name, first_node, (uint32_t)pool->size,
+                                         first_variable, (uint32_t)pool->nbr_variables };
+    fwrite(&expression, sizeof expression, 1, out);
+
+    name += (uint32_t)strlen(sorted[i].name) + 1;
+    first_node += (uint32_t)pool->size;
+    first_variable += (uint32_t)pool->nbr_variables;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    NodePool pool = sorted[i].pool;
+    for (size_t v = 0; v < pool->nbr_variables; ++v) {
+      fwrite(&variable_name, sizeof variable_name, 1, out);
+      variable_name += (uint32_t)strlen(pool->variables[v]) + 1;
+    }
+  }
+
+  static const char padding[16];
+  fwrite(padding, 1, (size_t)(header.nodes_offset - sizeof header - count * sizeof(compiled_expression_t)
+                              - nbr_variables * sizeof(uint32_t)), out);
+
+  for (size_t i = 0; i < count; ++i) {
+    NodePool pool = sorted[i].pool;
+    for (size_t n = 0; n < pool->size; ++n) {
+      const pool_node_t *node = &pool->nodes[n];
+
+      pool_node_t copy;
+      memset(&copy, 0, sizeof copy);
+      copy.type  = node->type;
+      copy.token = POOL_NONE;
+      copy.left  = node->left;
+      copy.right = node->right;
+
+      if (node->type == LITERAL) copy.value.number = node->value.number;
+      else if (node->type == VARIABLE) copy.value.variable = node->value.variable;
+      else if (node->type == FUNCTION) copy.value.function = node->value.function;
+      else if (node->type == FARGSEPARATOR) copy.value.aggregate = node->value.aggregate;
+
+      fwrite(&copy, sizeof copy, 1, out);
+    }
+  }
+
+  for (size_t i = 0; i < count; ++i)
+    fwrite(sorted[i].name, 1, strlen(sorted[i].name) + 1, out);
+
+  for (size_t i = 0; i < count; ++i) {
+    NodePool pool = sorted[i].pool;
+    for (size_t v = 0; v < pool->nbr_variables; ++v)
+      fwrite(pool->variables[v], 1, strlen(pool->variables[v]) + 1, out);
+  }
+
+  free(sorted);
+
+  return !ferror(out);
+}
+
+
+/**
+ * @brief Checks a node of a compiled expression
+ * @details The children must come before the node, and the node must have
+ *          the operands its type needs, so the evaluation only reads values
+ *          already computed. The arguments of an aggregate must be laid out
+ *          as ','(','(index, lo), hi), followed by a body, and the last ','
+ *          must point to the aggregate, so the scan skips its body; no
+ *          other ',' points anywhere. A variadic call may have any left
+ *          child, its arguments are read from its ',' nodes, which are
+ *          checked themselves.
+ *
+ * @param nodes The nodes of the expression
+ * @param index The index of the node in its expression
+ * @param nbr_nodes The number of nodes of the expression
+ * @param nbr_variables The number of variables of the expression
+ * @return true if the node is valid, false otherwise
+ */
+static bool valid_node(const pool_node_t *nodes, uint32_t index, uint32_t nbr_nodes,
+                       uint32_t nbr_variables)
+{
+  const pool_node_t *node = &nodes[index];
+
+  if (node->left != POOL_NONE && node->left >= index) return false;
+  if (node->right != POOL_NONE && node->right >= index) return false;
+
+  bool leaf = node->left == POOL_NONE && node->right == POOL_NONE;
+  bool binary = node->left != POOL_NONE && node->right != POOL_NONE;
+
+  switch (node->type) {
+    case LITERAL:       return leaf;
+    case VARIABLE:      return leaf && node->value.variable < nbr_variables;
+    case FARGSEPARATOR:
+    {
+      // Checked from here, as the aggregate comes after its arguments
+      uint32_t aggregate = node->value.aggregate;
+      if (!binary || !aggregate) return binary;
+
+      return aggregate > index && aggregate < nbr_nodes && nodes[aggregate].type == FUNCTION
+          && nodes[aggregate].left == index
+          && (unsigned int)nodes[aggregate].value.function < TOTAL_FUNCTIONS
+          && get_function_id_type(nodes[aggregate].value.function) == AGGREGATE;
+    }
+    case FUNCTION:
+    {
+      if ((unsigned int)node->value.function >= TOTAL_FUNCTIONS || node->right == POOL_NONE)
+        return false;
+
+      FunctionType type = get_function_id_type(node->value.function);
+      if (type == UNARY) return node->left == POOL_NONE;
+      if (type == VARIADIC) return true;
+
+      if (node->left == POOL_NONE || node->right <= node->left) return false;
+
+      const pool_node_t *arguments = &nodes[node->left];
+      return arguments->type == FARGSEPARATOR && arguments->value.aggregate == index
+          && nodes[arguments->left].type == FARGSEPARATOR
+          && nodes[nodes[arguments->left].left].type == VARIABLE;
+    }
+    case UMINUS:        return node->left == POOL_NONE && node->right != POOL_NONE;
+    default:            return is_operator(node->type) && binary;
+  }
+}
+
+
+/**
+ * @brief Checks the layout of a compiled file, and finds its sections
+ * @details Everything the evaluation reads is checked once here, so a
+ *          truncated or corrupted file is rejected instead of being read
+ *          out of bounds.
+ *
+ * @param compiled The compiled file, its sections are set
+ * @param max_nodes Where to store the largest number of nodes of an expression
+ * @param max_variables Where to store the largest number of variables of
+ *        an expression
+ * @return true if the file is valid, false otherwise
+ */
+static bool check_compiled_file(CompiledFile compiled, size_t *max_nodes, size_t *max_variables)
+{
+  const char *data = compiled->file->data;
+  uint64_t size = compiled->file->size;
+
+  const compiled_header_t *header = (const compiled_header_t*)data;
+  if (size < sizeof *header
+   || memcmp(header->magic, COMPILED_MAGIC, sizeof COMPILED_MAGIC)
+   || header->version != COMPILED_VERSION
+   || header->node_size != sizeof(pool_node_t))
+    return false;
+
+  uint64_t tables = sizeof *header + (uint64_t)header->nbr_expressions * sizeof(compiled_expression_t)
+                  + (uint64_t)header->nbr_variables * sizeof(uint32_t);
+  uint64_t nodes_size = (uint64_t)header->nbr_nodes * sizeof(pool_node_t);
+
+  if (header->nodes_offset % 16 || header->nodes_offset < tables
+   || header->strings_offset < header->nodes_offset
+   || header->strings_offset - header->nodes_offset < nodes_size
+   || header->strings_offset > size || size - header->strings_offset < header->strings_size
+   || (header->strings_size ? data[header->strings_offset + header->strings_size - 1] != '\0'
+                            : header->nbr_expressions || header->nbr_variables))
+    return false;
+
+  compiled->header      = header;
+  compiled->expressions = (const compiled_expression_t*)(header + 1);
+  compiled->variables   = (const uint32_t*)(compiled->expressions + header->nbr_expressions);
+  compiled->nodes       = (const pool_node_t*)(data + header->nodes_offset);
+  compiled->strings     = data + header->strings_offset;
+
+  for (uint32_t v = 0; v < header->nbr_variables; ++v)
+    if (compiled->variables[v] >= header->strings_size) return false;
+
+  *max_nodes = *max_variables = 0;
+
+  for (uint32_t e = 0; e < header->nbr_expressions; ++e) {
+    const compiled_expression_t *expression = &compiled->expressions[e];
+
+    if (expression->name >= header->strings_size || !expression->nbr_nodes
+     || expression->first_node > header->nbr_nodes
+     || header->nbr_nodes - expression->first_node < expression->nbr_nodes
+     || expression->first_variable > header->nbr_variables
+     || header->nbr_variables - expression->first_variable < expression->nbr_variables)
+      return false;
+
+    if (e && strcmp(compiled->strings + compiled->expressions[e - 1].name,
+                    compiled->strings + expression->name) >= 0)
+      return false;
+
+    const pool_node_t *nodes = compiled->nodes + expression->first_node;
+    for (uint32_t n = 0; n < expression->nbr_nodes; ++n)
+      if (!valid_node(nodes, n, expression->nbr_nodes, expression->nbr_variables)) return false;
+
+    if (expression->nbr_nodes > *max_nodes) *max_nodes = expression->nbr_nodes;
+    if (expression->nbr_variables > *max_variables) *max_variables = expression->nbr_variables;
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Maps a file of compiled expressions, and checks it
+ * @details The expressions are evaluated in place, from the mapped file:
+ *          nothing is parsed or copied, so loading costs a read of the file.
+ *
+ * @param path The path of the file
+ * @return The address of the compiled file, or NULL if the file can't be
+ *         opened or mapped (errno is set), or if it is not a valid file of
+ *         compiled expressions (errno is EINVAL)
+ * @see MappedFile::open_mapped_file
+ */
+CompiledFile open_compiled_file(const char *path)
+{
+  MappedFile file = open_mapped_file(path);
+  if (!file) return NULL;
+
+  CompiledFile compiled = malloc(sizeof(*compiled));
+  assert(compiled != NULL);
+  compiled->file = file;
+
+  size_t max_nodes = 0, max_variables = 0;
+  if (!check_compiled_file(compiled, &max_nodes, &max_variables)) {
+    close_mapped_file(file);
+    free(compiled);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  // The file was read in order to be checked, the expressions are then
+  // evaluated in any order
+  posix_madvise((void*)file->data, file->size, POSIX_MADV_NORMAL);
+
+  compiled->values   = malloc((max_nodes ? max_nodes : 1) * sizeof(*compiled->values));
+  compiled->bindings = malloc((max_variables ? max_variables : 1) * sizeof(*compiled->bindings));
+  assert(compiled->values != NULL && compiled->bindings != NULL);
+
+  return compiled;
+}
+
+
+/**
+ * @brief Returns the number of expressions of a compiled file
+ *
+ * @param compiled The compiled file
+ * @return The number of expressions
+ */
+size_t compiled_expressions(CompiledFile compiled)
+{
+  return compiled->header->nbr_expressions;
+}
+
+
+/**
+ * @brief Returns the name of a compiled expression
+ *
+ * @param compiled The compiled file
+ * @param index The index of the expression
+ * @return The name of the expression
+ */
+const char *compiled_name(CompiledFile compiled, size_t index)
+{
+  assert(index < compiled->header->nbr_expressions);
+
+  return compiled->strings + compiled->expressions[index].name;
+}
+
+
+/**
+ * @brief Returns the index of a compiled expression given by its name
+ * @details The expressions are sorted by name, so they are found by
+ *          a binary search.
+ *
+ * @param compiled The compiled file
+ * @param name The name of the expression
+ * @return The index of the expression, or -1 if there is none of this name
+ */
+long find_compiled_expression(CompiledFile compiled, const char *name)
+{
+  size_t lo = 0, hi = compiled->header->nbr_expressions;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = strcmp(compiled->strings + compiled->expressions[mid].name, name);
+
+    if (!cmp) return (long)mid;
+    if (cmp < 0) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return -1;
+}
+
+
+/**
+ * @brief Finds the first variable of a compiled expression which is not bound
+ * @details The variables with an empty name are the indices of the
+ *          aggregates, bound by their aggregates.
+ *
+ * @param compiled The compiled file
+ * @param index The index of the expression
+ * @param env The values of the variables, may be NULL
+ * @return The name of the variable, or NULL if all of them are bound
+ * @see Environment::find_variable
+ */
+const char *find_unbound_compiled_variable(CompiledFile compiled, size_t index, Environment env)
+{
+  assert(index < compiled->header->nbr_expressions);
+
+  const compiled_expression_t *expression = &compiled->expressions[index];
+  for (uint32_t v = 0; v < expression->nbr_variables; ++v) {
+    const char *name = compiled->strings + compiled->variables[expression->first_variable + v];
+    if (*name && find_variable(env, name) < 0) return name;
+  }
+
+  return NULL;
+}
+
+
+/**
+ * @brief Computes the value of a compiled expression
+ * @details The nodes are read from the mapped file. The values are kept in
+ *          the compiled file, so a compiled file must not be evaluated by
+ *          two threads at once.
+ *
+ *          A variable which is not bound evaluates to NaN.
+ *
+ * @param compiled The compiled file
+ * @param index The index of the expression
+ * @param env The values of the variables, may be NULL
+ * @return The value of the expression
+ * @see NodePool::eval_pool_nodes, Environment::get_variable
+ */
+long double eval_compiled_expression(CompiledFile compiled, size_t index, Environment env)
+{
+  assert(index < compiled->header->nbr_expressions);
+
+  const compiled_expression_t *expression = &compiled->expressions[index];
+  for (uint32_t v = 0; v < expression->nbr_variables; ++v) {
+    const char *name = compiled->strings + compiled->variables[expression->first_variable + v];
+    compiled->bindings[v] = get_variable(env, name);
+  }
+
+  return eval_pool_nodes(compiled->nodes + expression->first_node, expression->nbr_nodes,
+                         compiled->bindings, compiled->values);
+}
+
+
+/**
+ * @brief Unmaps a file of compiled expressions
+ *
+ * @param compiled The compiled file
+ * @see MappedFile::close_mapped_file
+ */
+void close_compiled_file(CompiledFile compiled)
+{
+  close_mapped_file(compiled->file);
+  free(compiled->values);
+  free(compiled->bindings);
+  free(compiled);
+}
@@ -0,0 +1,150 @@
+#ifndef COMPILED_H
+#define COMPILED_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../parser/NodePool.h"
+#include "../parser/Environment.h"
+#include "MappedFile.h"
+
+/**
+ * The layout of a file of compiled expressions:
+ *
+ *   offset  size  field
+ *   ------  ----  ------------------------------------------------------
+ *   header (48 bytes)
+ *        0     8  magic: "CALCEXP" followed by a '\0'
+ *        8     2  version: 2
+ *       10     2  node size: 32
+ *       12     4  number of expressions
+ *       16     4  number of variables, for all the expressions
+ *       20     4  number of nodes, for all the expressions
+ *       24     8  nodes offset: where the nodes start, a multiple of 16
+ *       32     8  strings offset: where the names start
+ *       40     8  strings size
+ *
+ *   expressions, sorted by name, after the header (20 bytes each)
+ *        0     4  name: offset of the name in the strings
+ *        4     4  first node: index of its first node
+ *        8     4  number of nodes, at least 1
+ *       12     4  first variable: index of its first variable
+ *       16     4  number of variables
+ *
+ *   variables, after the expressions (4 bytes each)
+ *        0     4  name: offset of the name in the strings, an empty name
+ *                 for the index of an aggregate
+ *
+ *   nodes, at the nodes offset (32 bytes each, see NodePool.h)
+ *        0     4  type: a TokenType
+ *        4     4  token: POOL_NONE
+ *        8     4  left: index of the left child, or POOL_NONE
+ *       12     4  right: index of the right child, or POOL_NONE
+ *       16    16  value: a long double for a literal, a FunctionID for
+ *                 a function, the index of a variable for a variable,
+ *                 the index of its aggregate (or 0) for a ','
+ *
+ *   strings, at the strings offset: the names, each followed by a '\0'
+ *
+ * The nodes of an expression are in post-order, and their children and
+ * variables are indices relative to the expression, so an expression is
+ * evaluated in place from its first node. The arguments of a variadic call
+ * and of an aggregate are laid out as in a node pool:
+ *   max(a, b, c, d)       a..., b..., ',', c..., d..., ',', max
+ *   sum(i, lo, hi, body)  i, lo..., ',', hi..., ',', body..., sum
+ * All the fields are in the native byte order, and the long double is the
+ * 80 bits extended format padded to 16 bytes, as laid out by the compiler.
+ */
+
+#define COMPILED_MAGIC "CALCEXP"
+#define COMPILED_VERSION 2
+
+/**
+ * @brief The header of a file of compiled expressions
+ */
+typedef struct compiled_header_t
+{
+  char magic[8];
+  uint16_t version;
+  uint16_t node_size;
+  uint32_t nbr_expressions;
+  uint32_t nbr_variables;
+  uint32_t nbr_nodes;
+  uint64_t nodes_offset;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+} compiled_header_t;
+
+/**
+ * @brief An expression of a compiled file
+ */
+typedef struct compiled_expression_t
+{
+  uint32_t name;
+  uint32_t first_node;
+  uint32_t nbr_nodes;
+  uint32_t first_variable;
+  uint32_t nbr_variables;
+} compiled_expression_t;
+
+/**
+ * @brief A file of compiled expressions, mapped in memory
+ */
+typedef struct compiled_file_t *CompiledFile;
+typedef struct compiled_file_t
+{
+  MappedFile file;
+
+  const compiled_header_t *header;
+  const compiled_expression_t *expressions;
+  const uint32_t *variables;
+  const pool_node_t *nodes;
+  const char *strings;
+
+  long double *values;
+  long double *bindings;
+} compiled_file_t;
+
+/**
+ * @brief Writes expressions to a file of compiled expressions
+ */
+bool write_compiled_file(FILE*, const char *const*, const NodePool*, size_t);
+
+/**
+ * @brief Maps a file of compiled expressions, and checks it
+ */
+CompiledFile open_compiled_file(const char*);
+
+/**
+ * @brief Returns the number of expressions of a compiled file
+ */
+size_t compiled_expressions(CompiledFile);
+
+/**
+ * @brief Returns the name of a compiled expression
+ */
+const char *compiled_name(CompiledFile, size_t);
+
+/**
+ * @brief Returns the index of a compiled expression given by its name
+ */
+long find_compiled_expression(CompiledFile, const char*);
+
+/**
+ * @brief Finds the first variable of a compiled expression which is not bound
+ */
+const char *find_unbound_compiled_variable(CompiledFile, size_t, Environment);
+
+/**
+ * @brief Computes the value of a compiled expression
+ */
+long double eval_compiled_expression(CompiledFile, size_t, Environment);
+
+/**
+ * @brief Unmaps a file of compiled expressions
+ */
+void close_compiled_file(CompiledFile);
+
+#endif
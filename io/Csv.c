@@ -0,0 +1,619 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Function.h"
+#include "../lexer/Number.h"
+#include "../parser/NodePool.h"
+#include "../parser/Environment.h"
+#include "../eval/Aggregate.h"
+#include "../eval/Limits.h"
+#include "Csv.h"
+
+/**
+ * The size of the buffer the stream is read into, it grows for the rows
+ * which don't fit in it
+ */
+#define CSV_INPUT_SIZE (1U << 20)
+
+/**
+ * The number of rows whose fields are converted before they are evaluated
+ * together
+ */
+#define CSV_BLOCK_ROWS 1024
+
+/**
+ * The number of results handed to the writer at once, a multiple of
+ * CSV_BLOCK_ROWS
+ */
+#define CSV_OUTPUT_ROWS (16 * CSV_BLOCK_ROWS)
+
+
+/**
+ * @brief A field of a row, read in place: the quotes and the spaces around
+ *        it are not part of it
+ */
+typedef struct field_t
+{
+  const char *start;
+  size_t length;
+} field_t;
+
+/**
+ * @brief A buffer of results, CSV_OUTPUT_ROWS at most
+ */
+typedef struct results_t
+{
+  long double *values;
+  size_t size;
+} results_t;
+
+/**
+ * @brief The thread which formats and writes the results
+ * @details The results are computed in the current buffer while the other
+ *          one, if it is pending, is being formatted and written. If the
+ *          thread can't be started, the buffers are written in turn by
+ *          the evaluation itself.
+ */
+typedef struct writer_t
+{
+  int fd;
+  results_t buffers[2];
+  char *text;
+  int current;
+  int pending;
+  bool finished;
+  bool started;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+} writer_t;
+
+/**
+ * @brief The expression, the columns it reads and the values of a block
+ *        of rows
+ * @details Each column read by the expression has a slot, which holds its
+ *          values for CSV_BLOCK_ROWS rows. The other columns are skipped
+ *          without being converted.
+ */
+typedef struct csv_t
+{
+  NodePool pool;
+  long *slots;
+  size_t nbr_columns;
+  long *variables;
+  size_t nbr_slots;
+  long double *columns;
+  bool lanes;
+  long double *scratch;
+} csv_t;
+
+
+/**
+ * @brief Checks if a character is a space around a field
+ */
+static inline bool is_blank(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+/**
+ * @brief Reads a field of a row
+ * @details A field is either quoted, where a quote is written "", or read
+ *          up to the next ',' or end of line.
+ *
+ * @param p The start of the field
+ * @param end The end of the data read so far
+ * @param field Where to store the field
+ * @return The ',' or the end of line after the field, or NULL if the field
+ *         doesn't end in the data read so far
+ */
+static const char *scan_field(const char *p, const char *end, field_t *field)
+{
+  while (p < end && (*p == ' ' || *p == '\t')) ++p;
+
+  const char *stop = NULL;
+  if (p < end && *p == '"') {
+    field->start = ++p;
+    while ((p = memchr(p, '"', (size_t)(end - p))) && p + 1 < end && p[1] == '"')
+      p += 2;
+    if (!p || p + 1 >= end) return NULL;
+    stop = p++;
+  } else {
+    field->start = p;
+  }
+
+  while (p < end && *p != ',' && *p != '\n') ++p;
+  if (p == end) return NULL;
+
+  if (!stop) {
+    stop = p;
+    while (stop > field->start && is_blank(stop[-1])) --stop;
+  }
+  field->length = (size_t)(stop - field->start);
+
+  return p;
+}
+
+
+/**
+ * @brief Converts a field to a number
+ * @details The field must be a whole number as written in an expression,
+ *          optionally signed, like -12, .5 or 1.5e-3.
+ *
+ * @param field The field
+ * @return Its value, or NaN if it is empty or not a number
+ * @see Number::parse_number
+ */
+static long double read_value(field_t field)
+{
+  const char *p = field.start, *end = field.start + field.length;
+  size_t digits = 0;
+
+  if (p < end && (*p == '-' || *p == '+')) ++p;
+  for (; p < end && (unsigned char)(*p - '0') < 10; ++p) ++digits;
+  if (p < end && *p == '.')
+    for (++p; p < end && (unsigned char)(*p - '0') < 10; ++p) ++digits;
+
+  if (!digits) return NAN;
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    if (++p < end && (*p == '-' || *p == '+')) ++p;
+    const char *exponent = p;
+    while (p < end && (unsigned char)(*p - '0') < 10) ++p;
+    if (p == exponent) return NAN;
+  }
+
+  return p == end ? parse_number(field.start, field.length) : NAN;
+}
+
+
+/**
+ * @brief Reads the header, and gives a slot to each column which is a
+ *        variable of the expression
+ * @details When several columns have the same name, the first one is used.
+ *
+ * @param csv The columns
+ * @param p The start of the header
+ * @param end The end of the data read so far
+ * @return The start of the first row, or NULL if the header doesn't end
+ *         in the data read so far
+ */
+static const char *parse_header(csv_t *csv, const char *p, const char *end)
+{
+  NodePool pool = csv->pool;
+  size_t capacity = 0;
+
+  csv->nbr_columns = 0;
+  csv->nbr_slots = 0;
+  for (size_t v = 0; v < pool->nbr_variables; ++v) csv->variables[v] = -1;
+
+  for (bool last = false; !last; ++p) {
+    field_t field;
+    if (!(p = scan_field(p, end, &field))) return NULL;
+    last = *p == '\n';
+
+    if (csv->nbr_columns == capacity) {
+      capacity = capacity ? 2 * capacity : 16;
+      csv->slots = realloc(csv->slots, capacity * sizeof(*csv->slots));
+      assert(csv->slots != NULL);
+    }
+
+    long slot = -1;
+    for (size_t v = 0; v < pool->nbr_variables && slot < 0; ++v) {
+      const char *name = pool->variables[v];
+      if (*name && csv->variables[v] < 0 && strlen(name) == field.length
+          && !memcmp(name, field.start, field.length)) {
+        slot = (long)csv->nbr_slots++;
+        csv->variables[v] = slot;
+      }
+    }
+
+    csv->slots[csv->nbr_columns++] = slot;
+  }
+
+  while (csv->nbr_columns > 0 && csv->slots[csv->nbr_columns - 1] < 0)
+    --csv->nbr_columns;
+
+  return p;
+}
+
+
+/**
+ * @brief Reads a row, and converts the fields of the columns which have
+ *        a slot
+ * @details A missing field is NaN, and the fields after the last column
+ *          read by the expression are skipped.
+ *
+ * @param csv The columns
+ * @param p The start of the row
+ * @param end The end of the data read so far
+ * @param row The index of the row in the block
+ * @return The start of the next row, or NULL if the row doesn't end in the
+ *         data read so far
+ */
+static const char *parse_row(csv_t *csv, const char *p, const char *end, size_t row)
+{
+  size_t column = 0;
+
+  for (bool last = false; !last; ++p, ++column) {
+    field_t field;
+    if (!(p = scan_field(p, end, &field))) return NULL;
+    last = *p == '\n';
+
+    if (column < csv->nbr_columns && csv->slots[column] >= 0)
+      csv->columns[(size_t)csv->slots[column] * CSV_BLOCK_ROWS + row] = read_value(field);
+  }
+
+  for (; column < csv->nbr_columns; ++column)
+    if (csv->slots[column] >= 0)
+      csv->columns[(size_t)csv->slots[column] * CSV_BLOCK_ROWS + row] = NAN;
+
+  return p;
+}
+
+
+/**
+ * @brief Evaluates the expression on a block of rows
+ * @details Without ',' nor aggregates, the nodes are evaluated one after
+ *          the other, each one for AGGREGATE_LANES rows, so the dispatch on
+ *          the type of a node is paid once for all of them. Otherwise each
+ *          row is evaluated in turn, binding its fields to the variables,
+ *          with its own deadline: a row which runs past it is a NaN.
+ *          Both give the same values as the evaluation of a single row.
+ *
+ * @param csv The expression and the fields of the rows
+ * @param rows The number of rows of the block
+ * @param results Where to store the value of each row
+ * @see Aggregate::eval_node_lanes, NodePool::eval_pool_nodes,
+ *      Limits::start_deadline
+ */
+static void eval_block(csv_t *csv, size_t rows, long double *results)
+{
+  static const long double zeros[AGGREGATE_LANES];
+  NodePool pool = csv->pool;
+
+  if (!csv->lanes) {
+    for (size_t r = 0; r < rows; ++r) {
+      for (size_t v = 0; v < pool->nbr_variables; ++v)
+        if (csv->variables[v] >= 0)
+          pool->bindings[v] = csv->columns[(size_t)csv->variables[v] * CSV_BLOCK_ROWS + r];
+
+      start_deadline();
+      results[r] = eval_pool_nodes(pool->nodes, pool->size, pool->bindings, pool->values);
+      if (deadline_passed()) results[r] = NAN;
+    }
+    return;
+  }
+
+  for (size_t first = 0; first < rows; first += AGGREGATE_LANES) {
+    size_t n = rows - first < AGGREGATE_LANES ? rows - first : AGGREGATE_LANES;
+
+    for (size_t j = 0; j < pool->size; ++j) {
+      const pool_node_t *node = &pool->nodes[j];
+      long double *out = csv->scratch + j * AGGREGATE_LANES;
+
+      const long double *lc = node->left == POOL_NONE ? zeros
+                            : csv->scratch + (size_t)node->left * AGGREGATE_LANES;
+      const long double *rc = node->right == POOL_NONE ? zeros
+                            : csv->scratch + (size_t)node->right * AGGREGATE_LANES;
+
+      if (node->type != VARIABLE) {
+        eval_node_lanes(node, lc, rc, n, out);
+      } else if (csv->variables[node->value.variable] >= 0) {
+        const long double *column = csv->columns + first
+                                  + (size_t)csv->variables[node->value.variable] * CSV_BLOCK_ROWS;
+        memcpy(out, column, n * sizeof(*out));
+      } else {
+        long double value = pool->bindings[node->value.variable];
+        for (size_t l = 0; l < n; ++l) out[l] = value;
+      }
+    }
+
+    memcpy(results + first, csv->scratch + (pool->size - 1) * AGGREGATE_LANES,
+           n * sizeof(*results));
+  }
+}
+
+
+/**
+ * @brief Writes a buffer, until all of it is written
+ *
+ * @param fd The file descriptor where to write
+ * @param data The buffer
+ * @param left The size of the buffer
+ */
+static void write_buffer(int fd, const char *data, size_t left)
+{
+  while (left > 0) {
+    ssize_t written = write(fd, data, left);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      perror("Can't write the results");
+      exit(EXIT_FAILURE);
+    }
+
+    data += written;
+    left -= (size_t)written;
+  }
+}
+
+
+/**
+ * @brief Formats and writes a buffer of results, one per line
+ *
+ * @param writer The writer
+ * @param results The results
+ * @see Number::format_number
+ */
+static void write_results(writer_t *writer, const results_t *results)
+{
+  char *out = writer->text;
+  for (size_t r = 0; r < results->size; ++r) {
+    out += format_number(results->values[r], out, NUMBER_BUFFER_SIZE);
+    *out++ = '\n';
+  }
+  write_buffer(writer->fd, writer->text, (size_t)(out - writer->text));
+}
+
+
+/**
+ * @brief Formats and writes the results handed by the evaluation, until
+ *        it is finished
+ *
+ * @param arg The writer
+ * @return NULL
+ * @see Csv::write_results
+ */
+static void *run_writer(void *arg)
+{
+  writer_t *writer = arg;
+
+  for (;;) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->pending < 0 && !writer->finished)
+      pthread_cond_wait(&writer->changed, &writer->lock);
+    int pending = writer->pending;
+    pthread_mutex_unlock(&writer->lock);
+
+    if (pending < 0) break;
+
+    write_results(writer, &writer->buffers[pending]);
+
+    pthread_mutex_lock(&writer->lock);
+    writer->pending = -1;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+  }
+
+  return NULL;
+}
+
+
+/**
+ * @brief Hands the current buffer to the writer, and continues in the other
+ *        one once the writer is done with it
+ * @details Without the thread, the buffer is written right away.
+ *
+ * @param writer The writer
+ */
+static void hand_off(writer_t *writer)
+{
+  if (!writer->started) {
+    write_results(writer, &writer->buffers[writer->current]);
+    writer->buffers[writer->current].size = 0;
+    return;
+  }
+
+  pthread_mutex_lock(&writer->lock);
+  while (writer->pending >= 0)
+    pthread_cond_wait(&writer->changed, &writer->lock);
+  writer->pending = writer->current;
+  pthread_cond_broadcast(&writer->changed);
+  pthread_mutex_unlock(&writer->lock);
+
+  writer->current ^= 1;
+  writer->buffers[writer->current].size = 0;
+}
+
+
+/**
+ * @brief Evaluates a block of rows, and hands the results to the writer
+ *        when they are enough
+ *
+ * @param csv The expression and the fields of the rows
+ * @param rows The number of rows
+ * @param writer The writer
+ */
+static void flush_block(csv_t *csv, size_t rows, writer_t *writer)
+{
+  results_t *results = &writer->buffers[writer->current];
+
+  eval_block(csv, rows, results->values + results->size);
+  results->size += rows;
+
+  if (results->size + CSV_BLOCK_ROWS > CSV_OUTPUT_ROWS) hand_off(writer);
+}
+
+
+/**
+ * @brief Binds the variables of the expression which are not columns to
+ *        their values, and prepares the evaluation of the blocks
+ *
+ * @param csv The expression and its columns, after the header
+ * @param env The values of the variables, may be NULL
+ * @return true if all the variables are bound, false otherwise
+ */
+static bool bind_variables(csv_t *csv, Environment env)
+{
+  NodePool pool = csv->pool;
+
+  for (size_t v = 0; v < pool->nbr_variables; ++v) {
+    const char *name = pool->variables[v];
+    if (!*name || csv->variables[v] >= 0) continue;
+
+    if (find_variable(env, name) < 0) {
+      fprintf(stderr, "Unbound variable '%s'\n", name);
+      return false;
+    }
+    pool->bindings[v] = get_variable(env, name);
+  }
+
+  csv->lanes = true;
+  for (size_t j = 0; j < pool->size && csv->lanes; ++j) {
+    const pool_node_t *node = &pool->nodes[j];
+    csv->lanes = node->type != FARGSEPARATOR
+              && !(node->type == FUNCTION && get_function_id_type(node->value.function) == AGGREGATE);
+  }
+
+  csv->columns = malloc((csv->nbr_slots ? csv->nbr_slots : 1) * CSV_BLOCK_ROWS * sizeof(*csv->columns));
+  assert(csv->columns != NULL);
+
+  if (csv->lanes) {
+    csv->scratch = malloc(pool->size * AGGREGATE_LANES * sizeof(*csv->scratch));
+    assert(csv->scratch != NULL);
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Evaluates an expression on each row of a CSV stream, and writes
+ *        the column of the results
+ * @details The first row is the header: the variables of the expression
+ *          are bound to the columns of the same name, and to their values
+ *          in the environment otherwise. The results are a column named
+ *          'result', in the order of the rows; the empty lines are skipped.
+ *          A field which is not a number is NaN.
+ *
+ *          The expression is parsed once by the caller. The stream is read
+ *          into one buffer where the rows are parsed in place, without
+ *          allocating their fields, and only the columns read by the
+ *          expression are converted, CSV_BLOCK_ROWS rows at a time. Each
+ *          block is evaluated at once, while a writer thread formats and
+ *          writes the results of the previous ones, so the output overlaps
+ *          the reading and the evaluation.
+ *
+ * @param pool The expression
+ * @param env The values of the variables which are not columns, may be NULL
+ * @param in The stream of rows
+ * @param fd Where to write the results
+ * @return true if the stream was evaluated, false if it has no header, it
+ *         can't be read or a variable is neither a column nor bound
+ * @see Csv::eval_block
+ */
+bool evaluate_csv(NodePool pool, Environment env, int in, int fd)
+{
+  csv_t csv = { pool, NULL, 0, NULL, 0, NULL, false, NULL };
+  csv.variables = malloc((pool->nbr_variables ? pool->nbr_variables : 1) * sizeof(*csv.variables));
+  assert(csv.variables != NULL);
+
+  writer_t writer;
+  memset(&writer, 0, sizeof writer);
+  writer.fd = fd;
+  writer.pending = -1;
+  for (int i = 0; i < 2; ++i) {
+    writer.buffers[i].values = malloc(CSV_OUTPUT_ROWS * sizeof(*writer.buffers[i].values));
+    assert(writer.buffers[i].values != NULL);
+  }
+  writer.text = malloc(CSV_OUTPUT_ROWS * (NUMBER_BUFFER_SIZE + 1));
+  assert(writer.text != NULL);
+  pthread_mutex_init(&writer.lock, NULL);
+  pthread_cond_init(&writer.changed, NULL);
+  writer.started = !pthread_create(&writer.thread, NULL, &run_writer, &writer);
+
+  size_t capacity = CSV_INPUT_SIZE, size = 0, rows = 0;
+  char *input = malloc(capacity);
+  assert(input != NULL);
+
+  bool header = false, eof = false, ok = true;
+  while (!eof && ok) {
+    if (size == capacity) {
+      capacity *= 2;
+      input = realloc(input, capacity);
+      assert(input != NULL);
+    }
+
+    ssize_t n = read(in, input + size, capacity - size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      perror("Can't read the rows");
+      ok = false;
+      break;
+    }
+
+    size += (size_t)n;
+    if (!n) {
+      eof = true;
+      if (size > 0 && input[size - 1] != '\n') input[size++] = '\n';
+    }
+
+    const char *p = input, *end = input + size;
+
+    if (!header) {
+      if (!(p = parse_header(&csv, p, end))) {
+        if (eof) fprintf(stderr, "The rows have no header\n");
+        ok = !eof;
+        continue;
+      }
+
+      header = true;
+      if (!(ok = bind_variables(&csv, env))) break;
+
+      write_buffer(fd, "result\n", 7);
+    }
+
+    while (p < end) {
+      if (*p == '\n' || (*p == '\r' && p + 1 < end && p[1] == '\n')) {
+        p += *p == '\n' ? 1 : 2;
+        continue;
+      }
+
+      const char *next = parse_row(&csv, p, end, rows);
+      if (!next) break;
+      p = next;
+
+      if (++rows == CSV_BLOCK_ROWS) {
+        flush_block(&csv, rows, &writer);
+        rows = 0;
+      }
+    }
+
+    size = (size_t)(end - p);
+    memmove(input, p, size);
+  }
+
+  if (ok && rows) flush_block(&csv, rows, &writer);
+  if (writer.buffers[writer.current].size) hand_off(&writer);
+
+  if (writer.started) {
+    pthread_mutex_lock(&writer.lock);
+    writer.finished = true;
+    pthread_cond_broadcast(&writer.changed);
+    pthread_mutex_unlock(&writer.lock);
+    pthread_join(writer.thread, NULL);
+  }
+
+  pthread_cond_destroy(&writer.changed);
+  pthread_mutex_destroy(&writer.lock);
+  free(writer.buffers[0].values);
+  free(writer.buffers[1].values);
+  free(writer.text);
+  free(input);
+  free(csv.slots);
+  free(csv.variables);
+  free(csv.columns);
+  free(csv.scratch);
+
+  return ok;
+}
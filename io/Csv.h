@@ -0,0 +1,15 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <stdbool.h>
+
+#include "../parser/NodePool.h"
+#include "../parser/Environment.h"
+
+/**
+ * @brief Evaluates an expression on each row of a CSV stream, and writes
+ *        the column of the results
+ */
+bool evaluate_csv(NodePool, Environment, int, int);
+
+#endif
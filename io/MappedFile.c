@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "../CommonHeaders.h"
+#include "MappedFile.h"
+
+
+/**
+ * @brief Reads a stream which can't be mapped until its end
+ * @details The buffer doubles as it fills, from 64 KiB.
+ *
+ * @param fd The stream
+ * @param file Where to store the data and its size
+ * @return true if the stream was read, false otherwise (errno is set)
+ */
+static bool read_stream(int fd, MappedFile file)
+{
+  size_t capacity = 65536, size = 0;
+  char *data = malloc(capacity);
+  assert(data != NULL);
+
+  while (true) {
+    if (size == capacity) {
+      capacity *= 2;
+      data = realloc(data, capacity);
+      assert(data != NULL);
+    }
+
+    ssize_t count = read(fd, data + size, capacity - size);
+    if (count == 0) break;
+    if (count < 0) {
+      if (errno == EINTR) continue;
+      free(data);
+      return false;
+    }
+    size += (size_t)count;
+  }
+
+  file->data = data;
+  file->size = size;
+
+  return true;
+}
+
+
+/**
+ * @brief Maps a file in memory, to be read sequentially
+ * @details The kernel is advised that the pages are read in order, so it
+ *          reads ahead aggressively and drops the pages already read.
+ *          An empty file is not mapped, its data is an empty string.
+ *          A file which is not a regular file, like a pipe, has no size
+ *          to map, so it is read into memory until its end instead.
+ *
+ * @param path The path of the file
+ * @return The address of the mapped file, or NULL if the file can't be
+ *         opened or mapped (errno is set)
+ */
+MappedFile open_mapped_file(const char *path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  MappedFile file = malloc(sizeof(*file));
+  assert(file != NULL);
+
+  file->size   = (size_t)st.st_size;
+  file->data   = "";
+  file->mapped = S_ISREG(st.st_mode);
+
+  if (!file->mapped) {
+    int error = read_stream(fd, file) ? 0 : errno;
+    close(fd);
+    if (error) {
+      free(file);
+      errno = error;
+      return NULL;
+    }
+    return file;
+  }
+
+  if (file->size) {
+    void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      free(file);
+      return NULL;
+    }
+
+    posix_madvise(data, file->size, POSIX_MADV_SEQUENTIAL);
+    file->data = data;
+  }
+
+  close(fd);
+
+  return file;
+}
+
+
+/**
+ * @brief Unmaps a file, or frees it if it was read
+ *
+ * @param file The file to unmap
+ */
+void close_mapped_file(MappedFile file)
+{
+  if (!file->mapped) free((void*)file->data);
+  else if (file->size) munmap((void*)file->data, file->size);
+  free(file);
+}
@@ -0,0 +1,28 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief A read-only file mapped in memory, or read into memory if it
+ *        can't be mapped (a pipe, a FIFO, a terminal)
+ */
+typedef struct mapped_file_t
+{
+  const char *data;
+  size_t size;
+  bool mapped;
+} mapped_file_t, *MappedFile;
+
+/**
+ * @brief Maps a file in memory, to be read sequentially
+ */
+MappedFile open_mapped_file(const char*);
+
+/**
+ * @brief Unmaps a file, or frees it if it was read
+ */
+void close_mapped_file(MappedFile);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef RECORDS_H
+#define RECORDS_H
+
+#include <stdint.h>
+
+/**
+ * The layout of the binary results written by the batch mode:
+ *
+ *   offset  size  field
+ *   ------  ----  ------------------------------------------------------
+ *   header (16 bytes)
+ *        0     8  magic: "CALCRES" followed by a '\0'
+ *        8     2  version: 2, see RESULT_VERSION
+ *       10     2  value type: 1 for double, 2 for long double
+ *       12     4  record size: 24 for double, 32 for long double
+ *
+ *   records, one for each input line, in the order of the input
+ *        0     8  index: the number of the line, counted from 0
+ *        8     4  status: a ResultStatus
+ *       12     4  position: where the syntax error is in the line, 0 if none
+ *       16   8/16 value: the result, a NaN if the status is not RESULT_OK
+ *
+ * All the fields are in the native byte order. The long double value is the
+ * 80 bits extended format padded to 16 bytes, as laid out by the compiler.
+ * The records are naturally aligned, so the file can be mapped and read as
+ * an array of result_double_t or result_long_double_t after the header.
+ */
+
+#define RESULT_MAGIC "CALCRES"
+
+/**
+ * The version of the layout, bumped when a reader of the previous one would
+ * misread a file: version 2 adds the status RESULT_DEADLINE_EXCEEDED. A
+ * file of version 1 is a valid file of version 2.
+ */
+#define RESULT_VERSION 2
+
+/**
+ * @brief Represents the status of the evaluation of a line
+ */
+typedef enum result_status { RESULT_OK, RESULT_SYNTAX_ERROR, RESULT_UNBOUND_VARIABLE,
+                             RESULT_DEADLINE_EXCEEDED } ResultStatus;
+
+/**
+ * @brief Represents the type of the value of the records
+ */
+typedef enum result_value_type { RESULT_DOUBLE = 1, RESULT_LONG_DOUBLE } ResultValueType;
+
+/**
+ * @brief The header of a binary results file
+ */
+typedef struct result_header_t
+{
+  char magic[8];
+  uint16_t version;
+  uint16_t value_type;
+  uint32_t record_size;
+} result_header_t;
+
+/**
+ * @brief A result record holding a double
+ */
+typedef struct result_double_t
+{
+  uint64_t index;
+  uint32_t status;
+  uint32_t position;
+  double value;
+} result_double_t;
+
+/**
+ * @brief A result record holding a long double
+ */
+typedef struct result_long_double_t
+{
+  uint64_t index;
+  uint32_t status;
+  uint32_t position;
+  long double value;
+} result_long_double_t;
+
+#endif
@@ -0,0 +1,89 @@
+#include <stdint.h>
+
+#include "../CommonHeaders.h"
+#include "Ring.h"
+
+
+/**
+ * @brief Initializes an empty ring
+ * @details The capacity is rounded up to a power of two, so the indices
+ *          only grow and are reduced to a slot by a mask.
+ *
+ * @param ring The ring to initialize
+ * @param capacity The least number of pointers the ring can hold
+ */
+void init_ring(Ring ring, size_t capacity)
+{
+  size_t size = 1;
+  while (size < capacity) size *= 2;
+
+  ring->slots = malloc(size * sizeof(*ring->slots));
+  assert(ring->slots != NULL);
+  ring->mask = size - 1;
+
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->head, 0);
+  ring->cached_head = 0;
+  ring->cached_tail = 0;
+}
+
+
+/**
+ * @brief Adds a pointer at the tail of a ring, if it is not full
+ * @details Only called by the producer. The pointer is stored before the
+ *          tail is published, so the consumer sees it when it sees the tail.
+ *
+ * @param ring The ring
+ * @param item The pointer to add
+ * @return true if it was added, false if the ring is full
+ */
+bool try_push_ring(Ring ring, void *item)
+{
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+  if (tail - ring->cached_head > ring->mask) {
+    ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - ring->cached_head > ring->mask) return false;
+  }
+
+  ring->slots[tail & ring->mask] = item;
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+  return true;
+}
+
+
+/**
+ * @brief Takes the pointer at the head of a ring, if it is not empty
+ * @details Only called by the consumer. The slot is released after it was
+ *          read, so the producer never overwrites it before.
+ *
+ * @param ring The ring
+ * @return The pointer, or NULL if the ring is empty
+ */
+void *try_pop_ring(Ring ring)
+{
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+  if (head == ring->cached_tail) {
+    ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head == ring->cached_tail) return NULL;
+  }
+
+  void *item = ring->slots[head & ring->mask];
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+  return item;
+}
+
+
+/**
+ * @brief Releases the slots of a ring
+ *
+ * @param ring The ring, which no thread uses anymore
+ */
+void release_ring(Ring ring)
+{
+  free(ring->slots);
+  ring->slots = NULL;
+}
@@ -0,0 +1,54 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/**
+ * The size of a cache line, which separates the indices written by the
+ * producer from the ones written by the consumer
+ */
+#define RING_LINE 64
+
+/**
+ * @brief A bounded queue of pointers between one producer and one consumer
+ *        thread, without locks
+ * @details The producer owns the tail and the consumer the head; each one
+ *          keeps a copy of the other index, read again only when the ring
+ *          looks full or empty, so the threads rarely touch the same lines.
+ */
+typedef struct ring_t *Ring;
+typedef struct ring_t
+{
+  void **slots;
+  size_t mask;
+
+  _Alignas(RING_LINE) atomic_size_t tail;
+  size_t cached_head;
+
+  _Alignas(RING_LINE) atomic_size_t head;
+  size_t cached_tail;
+} ring_t;
+
+/**
+ * @brief Initializes an empty ring
+ */
+void init_ring(Ring, size_t);
+
+/**
+ * @brief Adds a pointer at the tail of a ring, if it is not full
+ */
+bool try_push_ring(Ring, void*);
+
+/**
+ * @brief Takes the pointer at the head of a ring, if it is not empty
+ */
+void *try_pop_ring(Ring);
+
+/**
+ * @brief Releases the slots of a ring
+ */
+void release_ring(Ring);
+
+#endif
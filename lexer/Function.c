@@ -1,10 +1,19 @@
 #include <strings.h>
-#include <math.h>
 
 #include "../CommonHeaders.h"
 #include "Function.h"
 
 
+/**
+ * The names and the numbers of arguments of the functions of the plugins,
+ * by ID from FIRST_PLUGIN_FUNCTION. They are added before any expression
+ * is read, so the lexer and the parser only read them.
+ */
+static const char *plugin_names[PLUGIN_FUNCTIONS];
+static unsigned int plugin_arities[PLUGIN_FUNCTIONS];
+static size_t nbr_plugin_names = 0;
+
+
 /**
  * @brief Creates a function type
  * @details If the given name is not a valid mathematical function,
@@ -49,11 +58,44 @@ FunctionID get_function_id(const char *name)
   if (!strcasecmp(name, "ln"))   return LN;
   if (!strcasecmp(name, "max"))  return MAX;
   if (!strcasecmp(name, "min"))  return MIN;
+  if (!strcasecmp(name, "mean")) return MEAN;
+  if (!strcasecmp(name, "stddev")) return STDDEV;
+  if (!strcasecmp(name, "total")) return TOTAL;
+  if (!strcasecmp(name, "sum"))  return SERIES;
+  if (!strcasecmp(name, "prod")) return PRODUCT;
+  if (!strcasecmp(name, "solve")) return SOLVE;
+  if (!strcasecmp(name, "integrate")) return INTEGRATE;
+
+  for (size_t k = 0; k < nbr_plugin_names; ++k)
+    if (!strcasecmp(plugin_names[k], name)) return (FunctionID)(FIRST_PLUGIN_FUNCTION + k);
 
   return NONE;
 }
 
 
+/**
+ * @brief Adds the name of a function loaded from a plugin, so the lexer
+ *        reads it as a function
+ * @details Must be called before any expression is read. The name is not
+ *          copied, it must stay valid.
+ *
+ * @param name The name of the function, of letters only
+ * @param arity The number of arguments of the function
+ * @return The ID of the function, the one after the previous function
+ *         added, or NONE if there are already PLUGIN_FUNCTIONS of them
+ * @see Plugin::load_plugin
+ */
+FunctionID add_plugin_function(const char *name, unsigned int arity)
+{
+  if (nbr_plugin_names == PLUGIN_FUNCTIONS) return NONE;
+
+  plugin_names[nbr_plugin_names]   = name;
+  plugin_arities[nbr_plugin_names] = arity;
+
+  return (FunctionID)(FIRST_PLUGIN_FUNCTION + nbr_plugin_names++);
+}
+
+
 /**
  * @brief Returns a copy of a given function type
  *
@@ -73,51 +115,118 @@ Function clone_function(Function func)
 
 
 /**
- * @brief Returns the type of a given function
- * @details The Unary function??
+ * @brief Returns the type of a function given by its ID
+ * @details A unary function takes one argument, a variadic function any
+ *          number of them: max(1, x, 3). An aggregate takes an index
+ *          variable, its bounds and a body: sum(i, 1, 10, 1 / i). The sum
+ *          of some values is total(1, x, 3), so each name has one shape.
+ *          The drivers solve and integrate are aggregates too, whose body
+ *          comes first: integrate(x^2, x, 0, 1). The functions of the
+ *          plugins are called like variadic functions, with the number of
+ *          arguments they take.
  *
- * @param func The function
+ * @param id The ID of the function
  * @return The type of the function
  */
-FunctionType get_function_type(Function func)
+FunctionType get_function_id_type(FunctionID id)
 {
-  if (func->id >= TOTAL_UNARY_FUNCTIONS)
-    return BINARY;
+  if (is_plugin(id))
+    return VARIADIC;
+
+  if (id >= TOTAL_UNARY_FUNCTIONS + TOTAL_VARIADIC_FUNCTIONS)
+    return AGGREGATE;
+
+  if (id >= TOTAL_UNARY_FUNCTIONS)
+    return VARIADIC;
 
   return UNARY;
 }
 
 
 /**
- * @brief Prints the name of a given function type
+ * @brief Checks if an aggregate given by its ID is a driver: solve or
+ *        integrate
+ * @details A driver is laid out like the other aggregates, but it runs its
+ *          body at points of a real interval, chosen as it goes, instead of
+ *          at each integer of its range.
  *
- * @param function The function to print
+ * @param id The ID of the function
+ * @return true if the function is solve or integrate
+ * @see Driver::eval_driver
  */
-void print_function(Function function)
+bool is_driver(FunctionID id)
+{
+  return id == SOLVE || id == INTEGRATE;
+}
+
+
+/**
+ * @brief Checks if a function given by its ID was loaded from a plugin
+ *
+ * @param id The ID of the function
+ * @return true if the function comes from a plugin
+ * @see Function::add_plugin_function
+ */
+bool is_plugin(FunctionID id)
+{
+  return id >= FIRST_PLUGIN_FUNCTION;
+}
+
+
+/**
+ * @brief Returns the number of arguments of a function loaded from a plugin
+ *
+ * @param id The ID of the function
+ * @return The number of arguments it takes
+ */
+unsigned int get_plugin_arity(FunctionID id)
+{
+  assert(is_plugin(id) && (size_t)(id - FIRST_PLUGIN_FUNCTION) < nbr_plugin_names);
+
+  return plugin_arities[id - FIRST_PLUGIN_FUNCTION];
+}
+
+
+/**
+ * @brief Returns the type of a given function
+ *
+ * @param func The function
+ * @return The type of the function
+ * @see Function::get_function_id_type
+ */
+FunctionType get_function_type(Function func)
 {
-  const char *funcs[] = { "sin", "cos", "tan", "sqrt", "abs", "ln", "max", "min" };
-  printf("%s", funcs[function->id]);
+  return get_function_id_type(func->id);
 }
 
 
 /**
- * @brief Evaluates a function
+ * @brief Returns the name of a function given by its ID
  *
- * @param func The function to evaluate
- * @param lc The first operand
- * @param rc The second operand
- * @return The result of the function evaluation
+ * @param id The ID of the function, NONE excluded
+ * @return The name of the function, in lower case for the built-in ones
  */
-long double eval_function(Function func, long double lc, long double rc)
+const char *get_function_name(FunctionID id)
 {
-  long double (*bfunc[])(long double, long double) = { fmaxl, fminl };
-  long double (*ufunc[])(long double) = { sinl, cosl, tanl, sqrtl, fabsl, logl };
+  const char *names[] = { "sin", "cos", "tan", "sqrt", "abs", "ln", "max", "min", "mean",
+                          "stddev", "total", "sum", "prod", "solve", "integrate" };
+
+  if (is_plugin(id)) {
+    assert((size_t)(id - FIRST_PLUGIN_FUNCTION) < nbr_plugin_names);
+    return plugin_names[id - FIRST_PLUGIN_FUNCTION];
+  }
+
+  return names[id];
+}
 
-  long double result = 0.0;
-  if (get_function_type(func) == UNARY)
-    result = ufunc[func->id](rc);
-  else
-    result = bfunc[func->id - TOTAL_UNARY_FUNCTIONS](lc, rc);
 
-  return result;
-}
\ No newline at end of file
+/**
+ * @brief Prints the name of a given function type
+ *
+ * @param function The function to print
+ * @see Function::get_function_name
+ */
+void print_function(Function function)
+{
+  printf("%s", get_function_name(function->id));
+}
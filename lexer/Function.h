@@ -1,18 +1,37 @@
 #ifndef FUNCTION_H
 #define FUNCTION_H
 
-#define TOTAL_FUNCTIONS 8
+#include <stdbool.h>
+
+#define TOTAL_FUNCTIONS 15
 #define TOTAL_UNARY_FUNCTIONS 6
+#define TOTAL_VARIADIC_FUNCTIONS 5
+
+/**
+ * The size of the longest name of a function, with its '\0'
+ */
+#define FUNCTION_NAME_SIZE 32
 
 /**
  * @brief Represents the type of the function ID
  */
-typedef enum function_id { SIN, COS, TAN, SQRT, ABS, LN, MAX, MIN, NONE } FunctionID;
+typedef enum function_id { SIN, COS, TAN, SQRT, ABS, LN, MAX, MIN, MEAN, STDDEV, TOTAL,
+                           SERIES, PRODUCT, SOLVE, INTEGRATE, NONE } FunctionID;
+
+/**
+ * The ID of the first function loaded from a plugin, the next ones follow
+ */
+#define FIRST_PLUGIN_FUNCTION (NONE + 1)
+
+/**
+ * The largest number of functions of all the plugins
+ */
+#define PLUGIN_FUNCTIONS 64
 
 /**
  * @brief Represents the type of the function type
  */
-typedef enum function_type { UNARY = 1, BINARY } FunctionType;
+typedef enum function_type { UNARY = 1, VARIADIC, AGGREGATE } FunctionType;
 
 /**
  * @brief Represents the function type which holds the function information
@@ -33,11 +52,43 @@ Function create_function(const char*);
  */
 FunctionID get_function_id(const char*);
 
+/**
+ * @brief Adds the name of a function loaded from a plugin, so the lexer
+ *        reads it as a function
+ */
+FunctionID add_plugin_function(const char*, unsigned int);
+
+/**
+ * @brief Returns the type of a function given by its ID
+ */
+FunctionType get_function_id_type(FunctionID);
+
+/**
+ * @brief Checks if an aggregate given by its ID is a driver: solve or
+ *        integrate
+ */
+bool is_driver(FunctionID);
+
+/**
+ * @brief Checks if a function given by its ID was loaded from a plugin
+ */
+bool is_plugin(FunctionID);
+
+/**
+ * @brief Returns the number of arguments of a function loaded from a plugin
+ */
+unsigned int get_plugin_arity(FunctionID);
+
 /**
  * @brief Returns the type of a given function
  */
 FunctionType get_function_type(Function);
 
+/**
+ * @brief Returns the name of a function given by its ID
+ */
+const char *get_function_name(FunctionID);
+
 /**
  * @brief Prints the name of a given function type
  */
@@ -48,9 +99,4 @@ void print_function(Function);
  */
 Function clone_function(Function);
 
-/**
- * @brief Evaluates a function
- */
-long double eval_function(Function, long double, long double);
-
 #endif
\ No newline at end of file
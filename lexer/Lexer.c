@@ -0,0 +1,232 @@
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../CommonHeaders.h"
+#include "Lexer.h"
+#include "Transition.h"
+#include "Scan.h"
+#include "Operator.h"
+#include "Function.h"
+#include "Number.h"
+#include "Token.h"
+
+
+/**
+ * The tables of the DFA, shared by all the lexers
+ */
+static TransitionTable transition_table = NULL;
+static int *final_table = NULL;
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+
+/**
+ * @brief Creates the tables of the DFA, once for the whole program
+ *
+ * @see Transition::create_transition_table, Transition::generate_transition_table,
+ *      Transition::create_final_table
+ */
+static void create_tables(void)
+{
+  transition_table = create_transition_table();
+  generate_transition_table(transition_table);
+  final_table = create_final_table();
+}
+
+
+/**
+ * @brief Initializes a lexer which reads a given expression
+ * @details The expression is not copied, so it must outlive the lexer.
+ *          It doesn't need to be null-terminated. The tables of the DFA
+ *          are created by the first lexer, and shared by the next ones.
+ *          The lexer holds no other resource, so it can live on the stack.
+ *
+ * @param lexer The lexer to initialize
+ * @param input The expression to read
+ * @param length The length of the expression
+ */
+void init_lexer(Lexer lexer, const char *input, size_t length)
+{
+  lexer->input       = input;
+  lexer->length      = length;
+  lexer->position    = 0;
+  lexer->token_start = 0;
+  lexer->prev_token  = -1;
+  lexer->error       = NULL;
+
+  if (length > UINT32_MAX) lexer->error = "Expression too long";
+
+  pthread_once(&tables_once, &create_tables);
+  lexer->transition = transition_table;
+  lexer->final = final_table;
+}
+
+
+/**
+ * @brief Creates a lexer which reads a given expression
+ *
+ * @param input The expression to read
+ * @param length The length of the expression
+ * @return The address of the created lexer
+ * @see Lexer::init_lexer
+ */
+Lexer create_lexer(const char *input, size_t length)
+{
+  Lexer lexer = malloc(sizeof(*lexer));
+  assert(lexer != NULL);
+
+  init_lexer(lexer, input, length);
+
+  return lexer;
+}
+
+
+/**
+ * @brief Moves a lexer to the end of a token of its expression
+ * @details The lexer goes on as if it had just read the previous token:
+ *          its type is all that is needed to tell a unary minus from
+ *          a binary one.
+ *
+ * @param lexer The lexer
+ * @param position Where to resume reading
+ * @param previous The token before the position, or NULL if there is none
+ */
+void resume_lexer(Lexer lexer, size_t position, const flat_token_t *previous)
+{
+  lexer->position    = position;
+  lexer->token_start = position;
+  lexer->prev_token  = previous ? (int)previous->type : -1;
+}
+
+
+/**
+ * @brief Gets the ID of the function named by an identifier
+ *
+ * @param name The identifier, not null-terminated
+ * @param length The length of the identifier
+ * @return The ID of the function, or NONE if it is a variable
+ * @see Function::get_function_id
+ */
+static FunctionID identifier_function(const char *name, size_t length)
+{
+  char buffer[FUNCTION_NAME_SIZE];
+  if (length >= sizeof buffer) return NONE;
+
+  memcpy(buffer, name, length);
+  buffer[length] = '\0';
+
+  return get_function_id(buffer);
+}
+
+
+/**
+ * @brief Reads the next token of the expression
+ * @details Runs the deterministic finite automata (DFA) from the current
+ *          position, until it reaches a final state. A negative final state
+ *          means that the last character read doesn't belong to the token.
+ *          The end of the expression is read as a '\0' character.
+ *          The runs of spaces, digits and letters are skipped by the
+ *          vectorized scanner, so the DFA only handles the token starts,
+ *          the decimal point and the exponent.
+ *
+ *          A minus is unary when it starts the expression or follows an
+ *          operator, a left parenthesis or a function argument separator.
+ *          An identifier which is not the name of a function is a variable.
+ *
+ *          The value of the token is computed here: literals are converted
+ *          to numbers, and the properties of the operators are looked up.
+ *
+ *          If the expression is malformed, sets the error of the lexer and
+ *          moves its position to the character in fault.
+ *
+ * @param lexer The lexer
+ * @param token Where to store the token
+ * @return true if a token was read, false at the end of the expression
+ *         or if an error has occurred
+ * @see Operator::is_operator, Operator::operator_properties,
+ *      Function::get_function_id, Number::parse_number, Scan::span_class
+ */
+bool next_token(Lexer lexer, flat_token_t *token)
+{
+  if (lexer->error) return false;
+
+  lexer->position = span_class(lexer->input, lexer->position, lexer->length, SPACE);
+
+  lexer->token_start = lexer->position;
+  if (lexer->position >= lexer->length) return false;
+
+  size_t state = 0;
+  while (!lexer->final[state])
+  {
+    unsigned char c = '\0';
+    if (lexer->position < lexer->length) c = (unsigned char)lexer->input[lexer->position];
+
+    state = c < MAX_CHARS_LENGTH ? lexer->transition[state][c] : 0;
+    if (!state) {
+      lexer->error = c ? "Unexpected character" : "Unexpected end of expression";
+      return false;
+    }
+
+    ++lexer->position;
+
+    // The states which loop on digits or letters skip the rest of the run at once
+    if (lexer->transition[state]['0'] == state)
+      lexer->position = span_class(lexer->input, lexer->position, lexer->length, DIGIT);
+    else if (lexer->transition[state]['a'] == state)
+      lexer->position = span_class(lexer->input, lexer->position, lexer->length, LETTER);
+  }
+
+  if (lexer->final[state] < 0) --lexer->position;
+
+  const char *lexeme = lexer->input + lexer->token_start;
+  size_t len = lexer->position - lexer->token_start;
+
+  int current_token = abs(lexer->final[state]);
+
+  TokenType type = current_token;
+  FunctionID function = NONE;
+  if (current_token == FUNCTION) {
+    function = identifier_function(lexeme, len);
+    if (function == NONE) type = VARIABLE;
+  } else if (current_token == MINUS) {
+    if (lexer->prev_token == -1
+      || is_operator(lexer->prev_token)
+      || lexer->prev_token == LPARENTHESIS
+      || lexer->prev_token == FARGSEPARATOR) {
+      type = UMINUS;
+    } else {
+      type = BMINUS;
+    }
+  }
+
+  lexer->prev_token = current_token;
+
+  token->type   = type;
+  token->offset = (uint32_t)lexer->token_start;
+  token->length = (uint32_t)len;
+
+  if (type == LITERAL) {
+    token->value.number = parse_number(lexeme, len);
+  } else if (type == FUNCTION) {
+    token->value.function = function;
+  } else if (is_operator(type)) {
+    unsigned int precedence = 0;
+    AssocType associativity = LEFT;
+    operator_properties(type, &precedence, &associativity);
+    token->value.operator.precedence    = (uint8_t)precedence;
+    token->value.operator.associativity = (uint8_t)associativity;
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Deletes a lexer
+ *
+ * @param lexer The lexer to delete
+ */
+void delete_lexer(Lexer lexer)
+{
+  free(lexer);
+}
@@ -0,0 +1,51 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "Token.h"
+#include "Transition.h"
+
+/**
+ * @brief The lexer which reads the tokens of an expression one at a time
+ */
+typedef struct lexer_t *Lexer;
+typedef struct lexer_t
+{
+  const char *input;
+  size_t length;
+  size_t position;
+  size_t token_start;
+  int prev_token;
+  const char *error;
+
+  TransitionTable transition;
+  int *final;
+} lexer_t;
+
+/**
+ * @brief Initializes a lexer which reads a given expression
+ */
+void init_lexer(Lexer, const char*, size_t);
+
+/**
+ * @brief Creates a lexer which reads a given expression
+ */
+Lexer create_lexer(const char*, size_t);
+
+/**
+ * @brief Moves a lexer to the end of a token of its expression
+ */
+void resume_lexer(Lexer, size_t, const flat_token_t*);
+
+/**
+ * @brief Reads the next token of the expression
+ */
+bool next_token(Lexer, flat_token_t*);
+
+/**
+ * @brief Deletes a lexer
+ */
+void delete_lexer(Lexer);
+
+#endif
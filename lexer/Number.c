@@ -0,0 +1,609 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "../CommonHeaders.h"
+#include "Number.h"
+
+/**
+ * The largest power of ten which is exactly representable, that is
+ * 5^MAX_EXACT_POW10 fits in the significand of a long double.
+ */
+#if LDBL_MANT_DIG >= 113
+#define MAX_EXACT_POW10 48
+#elif LDBL_MANT_DIG >= 64
+#define MAX_EXACT_POW10 27
+#else
+#define MAX_EXACT_POW10 22
+#endif
+
+/**
+ * The largest mantissa which is exactly representable
+ */
+#if LDBL_MANT_DIG >= 64
+#define MAX_EXACT_MANTISSA UINT64_MAX
+#else
+#define MAX_EXACT_MANTISSA (UINT64_C(1) << LDBL_MANT_DIG)
+#endif
+
+/**
+ * The largest number of significant digits kept in the 64 bits mantissa
+ */
+#define MAX_DIGITS 19
+
+
+/**
+ * @brief Converts a number which doesn't fit the fast path, like
+ *        '123456789012345678901234' or '1e300'
+ * @details Delegates to strtold, which is correctly rounded, on a
+ *          null-terminated copy of the lexeme.
+ *
+ * @param lexeme The number to convert
+ * @param length The length of the number
+ * @return The value of the number
+ */
+static long double parse_number_slow(const char *lexeme, size_t length)
+{
+  char buffer[64];
+  char *str = buffer;
+  if (length >= sizeof buffer) {
+    str = malloc(length + 1);
+    assert(str != NULL);
+  }
+
+  memcpy(str, lexeme, length);
+  str[length] = '\0';
+
+  long double value = strtold(str, NULL);
+
+  if (str != buffer) free(str);
+
+  return value;
+}
+
+
+/**
+ * @brief Converts a number lexeme to a long double, correctly rounded
+ * @details The lexeme is a number validated by the lexer, like: 12, .12,
+ *          78e+23, 12.34E56, optionally preceded by a sign, as the numbers
+ *          written by the evaluator. It doesn't need to be null-terminated.
+ *
+ *          The significant digits are read into a 64 bits integer mantissa.
+ *          If there are at most 19 of them and the power of ten is small
+ *          enough to be exact, both the mantissa and the power of ten are
+ *          exactly representable as long doubles, so a single multiplication
+ *          or division gives the correctly rounded result (Clinger's fast
+ *          path). The other numbers take the slow path.
+ *
+ *          The conversion doesn't depend on the current locale.
+ *
+ * @param lexeme The number to convert
+ * @param length The length of the number
+ * @return The value of the number
+ */
+long double parse_number(const char *lexeme, size_t length)
+{
+  static const long double pow10[] = {
+    1e0L,  1e1L,  1e2L,  1e3L,  1e4L,  1e5L,  1e6L,  1e7L,  1e8L,  1e9L,
+    1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L,
+    1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L, 1e28L, 1e29L,
+    1e30L, 1e31L, 1e32L, 1e33L, 1e34L, 1e35L, 1e36L, 1e37L, 1e38L, 1e39L,
+    1e40L, 1e41L, 1e42L, 1e43L, 1e44L, 1e45L, 1e46L, 1e47L, 1e48L
+  };
+
+  const char *p = lexeme, *end = lexeme + length;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+  uint64_t mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool truncated = false, any_digit = false;
+
+  for (; p < end && (unsigned char)(*p - '0') < 10; ++p) {
+    any_digit = true;
+    if (digits < MAX_DIGITS) {
+      mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+      if (mantissa) ++digits;
+    } else {
+      ++exponent;
+      truncated |= *p != '0';
+    }
+  }
+
+  if (p < end && *p == '.') {
+    for (++p; p < end && (unsigned char)(*p - '0') < 10; ++p) {
+      any_digit = true;
+      if (digits < MAX_DIGITS) {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        if (mantissa) ++digits;
+        --exponent;
+      } else {
+        truncated |= *p != '0';
+      }
+    }
+  }
+
+  if (any_digit && p < end && (*p == 'e' || *p == 'E')) {
+    ++p;
+
+    bool negative_exp = false;
+    if (p < end && (*p == '-' || *p == '+')) negative_exp = (*p++ == '-');
+
+    int exp = 0;
+    for (; p < end && (unsigned char)(*p - '0') < 10; ++p)
+      if (exp < 100000) exp = exp * 10 + (*p - '0');
+
+    exponent += negative_exp ? -exp : exp;
+  }
+
+  // Not a plain number (inf, nan, ...)
+  if (!any_digit || p != end) return parse_number_slow(lexeme, length);
+
+  long double value = 0.0L;
+  if (mantissa == 0) {
+    value = 0.0L;
+  } else if (!truncated && exponent >= -MAX_EXACT_POW10 && exponent <= MAX_EXACT_POW10
+          && mantissa <= MAX_EXACT_MANTISSA) {
+    value = (long double)mantissa;
+    if (exponent >= 0) value *= pow10[exponent];
+    else               value /= pow10[-exponent];
+  } else {
+    return parse_number_slow(lexeme, length);
+  }
+
+  return negative ? -value : value;
+}
+
+
+/**
+ * The number of 32 bits words of a big integer, enough to hold the scaled
+ * values of the smallest subnormal and the largest long double
+ */
+#define BIGNUM_WORDS ((LDBL_MAX_EXP - LDBL_MIN_EXP + LDBL_MANT_DIG) / 32 + 8)
+
+/**
+ * @brief Represents an unsigned big integer, the least significant word first
+ */
+typedef struct bignum_t
+{
+  size_t size;
+  uint32_t words[BIGNUM_WORDS];
+} bignum_t;
+
+
+/**
+ * @brief Sets a big integer from a 128 bits value given as two halves
+ */
+static void big_set(bignum_t *a, uint64_t hi, uint64_t lo)
+{
+  a->words[0] = (uint32_t)lo;
+  a->words[1] = (uint32_t)(lo >> 32);
+  a->words[2] = (uint32_t)hi;
+  a->words[3] = (uint32_t)(hi >> 32);
+
+  a->size = 4;
+  while (a->size && !a->words[a->size - 1]) --a->size;
+}
+
+
+/**
+ * @brief Multiplies a big integer by a small one
+ */
+static void big_mul_small(bignum_t *a, uint32_t factor)
+{
+  uint64_t carry = 0;
+  for (size_t i = 0; i < a->size; ++i) {
+    carry += (uint64_t)a->words[i] * factor;
+    a->words[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+
+  if (carry) {
+    assert(a->size < BIGNUM_WORDS);
+    a->words[a->size++] = (uint32_t)carry;
+  }
+}
+
+
+/**
+ * @brief Multiplies a big integer by 2^n
+ */
+static void big_shift_left(bignum_t *a, unsigned int n)
+{
+  if (!a->size) return;
+
+  size_t words = n / 32;
+  unsigned int bits = n % 32;
+  assert(a->size + words + 1 <= BIGNUM_WORDS);
+
+  a->words[a->size + words] = 0;
+  for (size_t i = a->size; i-- > 0;) {
+    uint64_t w = (uint64_t)a->words[i] << bits;
+    a->words[i + words + 1] |= (uint32_t)(w >> 32);
+    a->words[i + words] = (uint32_t)w;
+  }
+  for (size_t i = 0; i < words; ++i) a->words[i] = 0;
+
+  a->size += words + 1;
+  while (a->size && !a->words[a->size - 1]) --a->size;
+}
+
+
+/**
+ * @brief Multiplies a big integer by 10^n
+ */
+static void big_mul_pow10(bignum_t *a, unsigned int n)
+{
+  for (; n >= 9; n -= 9) big_mul_small(a, 1000000000U);
+
+  uint32_t factor = 1;
+  while (n--) factor *= 10;
+  big_mul_small(a, factor);
+}
+
+
+/**
+ * @brief Compares two big integers
+ *
+ * @return A negative number, zero or a positive number if the first big
+ *         integer is lesser, equal or greater than the second one
+ */
+static int big_cmp(const bignum_t *a, const bignum_t *b)
+{
+  if (a->size != b->size) return a->size < b->size ? -1 : 1;
+
+  for (size_t i = a->size; i-- > 0;) {
+    if (a->words[i] != b->words[i]) return a->words[i] < b->words[i] ? -1 : 1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * @brief Compares the sum of two big integers with a third one
+ *
+ * @see big_cmp
+ */
+static int big_cmp_sum(const bignum_t *a, const bignum_t *b, const bignum_t *c)
+{
+  static _Thread_local bignum_t sum;
+
+  const bignum_t *longest = a->size >= b->size ? a : b;
+  uint64_t carry = 0;
+  for (size_t i = 0; i < longest->size; ++i) {
+    carry += (uint64_t)(i < a->size ? a->words[i] : 0) + (i < b->size ? b->words[i] : 0);
+    sum.words[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+
+  sum.size = longest->size;
+  if (carry) sum.words[sum.size++] = (uint32_t)carry;
+
+  return big_cmp(&sum, c);
+}
+
+
+/**
+ * @brief Subtracts a big integer from a greater or equal one
+ */
+static void big_sub(bignum_t *a, const bignum_t *b)
+{
+  int64_t borrow = 0;
+  for (size_t i = 0; i < a->size; ++i) {
+    borrow += (int64_t)a->words[i] - (i < b->size ? b->words[i] : 0);
+    a->words[i] = (uint32_t)borrow;
+    borrow = borrow < 0 ? -1 : 0;
+  }
+
+  while (a->size && !a->words[a->size - 1]) --a->size;
+}
+
+
+/**
+ * @brief Divides a big integer by a greater tenth of it, and keeps the
+ *        remainder
+ * @details The top word of the divisor is normalized in [2^27, 2^28), so
+ *          the quotient estimated from the top words is at most one less
+ *          than the exact one, and the dividend fits in as many words as
+ *          the divisor.
+ *
+ * @param r The dividend, lesser than 10 times the divisor
+ * @param s The normalized divisor
+ * @return The quotient, a decimal digit
+ */
+static uint32_t big_div_digit(bignum_t *r, const bignum_t *s)
+{
+  if (r->size < s->size) return 0;
+
+  uint32_t quotient = r->words[s->size - 1] / (s->words[s->size - 1] + 1);
+
+  if (quotient) {
+    uint64_t carry = 0;
+    int64_t borrow = 0;
+    for (size_t i = 0; i < s->size; ++i) {
+      carry += (uint64_t)s->words[i] * quotient;
+      borrow += (int64_t)r->words[i] - (uint32_t)carry;
+      r->words[i] = (uint32_t)borrow;
+      carry >>= 32;
+      borrow = borrow < 0 ? -1 : 0;
+    }
+    while (r->size && !r->words[r->size - 1]) --r->size;
+  }
+
+  if (big_cmp(r, s) >= 0) {
+    big_sub(r, s);
+    ++quotient;
+  }
+
+  return quotient;
+}
+
+
+/**
+ * @brief Splits a positive finite number into an integer mantissa and the
+ *        exponent of its unit in the last place: value = (hi.lo) * 2^e
+ * @details The 80 bits extended format is read directly, the other formats
+ *          are split with frexpl and ldexpl.
+ *
+ * @param value The number to split
+ * @param hi Where to store the high 64 bits of the mantissa
+ * @param lo Where to store the low 64 bits of the mantissa
+ * @param e Where to store the exponent of the unit in the last place
+ * @param exp Where to store the exponent such that 2^(exp-1) <= value < 2^exp
+ */
+static void decompose_number(long double value, uint64_t *hi, uint64_t *lo, int *e, int *exp)
+{
+#if LDBL_MANT_DIG == 64 && LDBL_MAX_EXP == 16384 && defined(__x86_64__)
+  uint64_t mantissa = 0;
+  uint16_t biased = 0;
+  memcpy(&mantissa, &value, sizeof mantissa);
+  memcpy(&biased, (const char*)&value + sizeof mantissa, sizeof biased);
+  biased &= 0x7FFF;
+
+  *hi = 0;
+  *lo = mantissa;
+  *e = (biased ? biased : 1) - (LDBL_MAX_EXP - 1) - (LDBL_MANT_DIG - 1);
+  *exp = *e + (64 - __builtin_clzll(mantissa));
+#else
+  frexpl(value, exp);
+  *e = (*exp > LDBL_MIN_EXP ? *exp : LDBL_MIN_EXP) - LDBL_MANT_DIG;
+
+  long double f = ldexpl(value, -*e);
+  *hi = (uint64_t)ldexpl(f, -64);
+  *lo = (uint64_t)(f - ldexpl((long double)*hi, 64));
+#endif
+}
+
+
+/**
+ * @brief Generates the shortest digits of a positive finite number
+ * @details Implementing the free-format algorithm of Steele & White, as
+ *          refined by Burger & Dybvig, with exact big integers:
+ *
+ *          The number v = f * 2^e lies between its neighbours, at the
+ *          distances m- and m+, and every number in between reads back to v.
+ *          With r / s = v / 10^k, the digits are generated one at a time
+ *          until the remainder r is closer than m- to zero, or closer than
+ *          m+ to s. The last digit is then rounded to the nearest.
+ *
+ * @param value The number to convert
+ * @param digits Where to store the digits, without the null terminator
+ * @param k Where to store the decimal exponent: value = 0.d1d2... * 10^k
+ * @return The number of digits
+ */
+static size_t generate_digits(long double value, char *digits, int *k)
+{
+  static _Thread_local bignum_t r, s, mplus, mminus;
+
+  int exp = 0, e = 0;
+  uint64_t hi = 0, lo = 0;
+  decompose_number(value, &hi, &lo, &e, &exp);
+
+  // The lower neighbour is closer if the mantissa is a power of two
+  bool boundary = exp > LDBL_MIN_EXP && hi == 0 && lo == UINT64_C(1) << (LDBL_MANT_DIG - 1);
+
+  // The neighbours which are exactly half way read back to v if f is even
+  bool even = (lo & 1) == 0;
+
+  big_set(&r, hi, lo);
+  big_set(&s, 0, 1);
+  big_set(&mplus, 0, 1);
+  big_set(&mminus, 0, 1);
+
+  // r = 2f * 2^e, s = 2, m+ = m- = 2^e: the values are doubled, so
+  // the neighbours are half an ulp away
+  unsigned int shift = boundary ? 2 : 1;
+  if (e >= 0) {
+    big_shift_left(&r, (unsigned int)e + shift);
+    big_shift_left(&s, shift);
+    big_shift_left(&mplus, (unsigned int)e + shift - 1);
+    big_shift_left(&mminus, (unsigned int)e);
+  } else {
+    big_shift_left(&r, shift);
+    big_shift_left(&s, (unsigned int)-e + shift);
+    big_shift_left(&mplus, shift - 1);
+  }
+
+  // Without boundary, both neighbours are at the same distance
+  bignum_t *low_margin = boundary ? &mminus : &mplus;
+
+  // 2^(exp-1) <= v < 2^exp, so the estimate of k is exact or one too low
+  int estimate = (int)ceil((exp - 1) * 0.30102999566398114 - 1e-10);
+  if (estimate >= 0) {
+    big_mul_pow10(&s, (unsigned int)estimate);
+  } else {
+    big_mul_pow10(&r, (unsigned int)-estimate);
+    big_mul_pow10(&mplus, (unsigned int)-estimate);
+    if (boundary) big_mul_pow10(&mminus, (unsigned int)-estimate);
+  }
+
+  // The estimate may be one too low
+  int high = big_cmp_sum(&r, &mplus, &s);
+  if (high > 0 || (even && high == 0)) {
+    *k = estimate + 1;
+  } else {
+    *k = estimate;
+    big_mul_small(&r, 10);
+    big_mul_small(&mplus, 10);
+    if (boundary) big_mul_small(&mminus, 10);
+  }
+
+  // Scaling all the values by the same power of two normalizes the divisor
+  int top_bit = 31 - __builtin_clz(s.words[s.size - 1]);
+  unsigned int normalize = (unsigned int)(27 - top_bit + 32) % 32;
+
+  big_shift_left(&r, normalize);
+  big_shift_left(&s, normalize);
+  big_shift_left(&mplus, normalize);
+  if (boundary) big_shift_left(&mminus, normalize);
+
+  size_t n = 0;
+  for (;;) {
+    uint32_t digit = big_div_digit(&r, &s);
+
+    int low = big_cmp(&r, low_margin);
+    high = big_cmp_sum(&r, &mplus, &s);
+
+    bool low_reached  = low < 0  || (even && low == 0);
+    bool high_reached = high > 0 || (even && high == 0);
+
+    if (low_reached && high_reached) {
+      // Round half to the nearest: compare 2r with s, m- is not used anymore
+      bignum_t *twice = &mminus;
+      twice->size = r.size;
+      memcpy(twice->words, r.words, r.size * sizeof(*r.words));
+      big_shift_left(twice, 1);
+      if (big_cmp(twice, &s) >= 0) ++digit;
+    } else if (high_reached) {
+      ++digit;
+    }
+
+    digits[n++] = (char)('0' + digit);
+    if (low_reached || high_reached) break;
+
+    big_mul_small(&r, 10);
+    big_mul_small(&mplus, 10);
+    if (boundary) big_mul_small(&mminus, 10);
+  }
+
+  return n;
+}
+
+
+/**
+ * @brief Generates the digits of an integer, without its trailing zeros
+ *
+ * @see generate_digits
+ */
+static size_t generate_integer_digits(uint64_t value, char *digits, int *k)
+{
+  char reversed[20];
+  size_t n = 0;
+  do {
+    reversed[n++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value);
+
+  *k = (int)n;
+
+  size_t zeros = 0;
+  while (reversed[zeros] == '0') ++zeros;
+
+  for (size_t i = 0; i < n - zeros; ++i)
+    digits[i] = reversed[n - 1 - i];
+
+  return n - zeros;
+}
+
+
+/**
+ * @brief Writes the shortest representation of a number which reads back
+ *        to the same value
+ * @details The digits are the fewest that parse_number converts back to
+ *          the exact same long double. They are written in fixed notation,
+ *          like 1500 or 0.25, unless the exponent notation is shorter,
+ *          like 7.8e+24 or 1e-7. Infinities and NaNs are written inf,
+ *          -inf and nan. The output doesn't depend on the current locale.
+ *
+ *          The integers are converted directly, the other numbers with exact
+ *          big integers arithmetic (see generate_digits).
+ *
+ * @param value The number to write
+ * @param buffer Where to write the number
+ * @param size The size of the buffer, NUMBER_BUFFER_SIZE is always enough
+ * @return The length of the written number, without the null terminator
+ * @see Number::parse_number
+ */
+size_t format_number(long double value, char *buffer, size_t size)
+{
+  char out[NUMBER_BUFFER_SIZE];
+  size_t len = 0;
+
+  if (signbit(value) && !isnan(value)) {
+    out[len++] = '-';
+    value = -value;
+  }
+
+  if (isnan(value) || isinf(value)) {
+    memcpy(out + len, isnan(value) ? "nan" : "inf", 3);
+    len += 3;
+  } else if (value == 0.0L) {
+    out[len++] = '0';
+  } else {
+    char digits[NUMBER_BUFFER_SIZE];
+    size_t n = 0;
+    int k = 0;
+
+    if (value <= (long double)MAX_EXACT_MANTISSA && value == floorl(value))
+      n = generate_integer_digits((uint64_t)value, digits, &k);
+    else
+      n = generate_digits(value, digits, &k);
+
+    int exp10 = k - 1;
+    int abs_exp = exp10 < 0 ? -exp10 : exp10;
+    size_t exp_digits = abs_exp >= 1000 ? 4 : abs_exp >= 100 ? 3 : abs_exp >= 10 ? 2 : 1;
+
+    size_t fixed_length = 0;
+    if (k <= 0)              fixed_length = 2 + (size_t)-k + n;
+    else if ((size_t)k < n)  fixed_length = n + 1;
+    else                     fixed_length = (size_t)k;
+
+    size_t exp_length = n + (n > 1) + 2 + exp_digits;
+
+    if (fixed_length <= exp_length) {
+      if (k <= 0) {
+        out[len++] = '0';
+        out[len++] = '.';
+        for (int i = 0; i < -k; ++i) out[len++] = '0';
+        for (size_t i = 0; i < n; ++i) out[len++] = digits[i];
+      } else {
+        for (size_t i = 0; i < n || i < (size_t)k; ++i) {
+          if (i == (size_t)k) out[len++] = '.';
+          out[len++] = i < n ? digits[i] : '0';
+        }
+      }
+    } else {
+      out[len++] = digits[0];
+      if (n > 1) {
+        out[len++] = '.';
+        for (size_t i = 1; i < n; ++i) out[len++] = digits[i];
+      }
+
+      out[len++] = 'e';
+      out[len++] = exp10 < 0 ? '-' : '+';
+      for (size_t i = exp_digits; i-- > 0; abs_exp /= 10)
+        out[len + i] = (char)('0' + abs_exp % 10);
+      len += exp_digits;
+    }
+  }
+
+  assert(len < size);
+  memcpy(buffer, out, len);
+  buffer[len] = '\0';
+
+  return len;
+}
@@ -0,0 +1,22 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <stddef.h>
+
+/**
+ * The size of a buffer large enough to hold any formatted number
+ */
+#define NUMBER_BUFFER_SIZE 64
+
+/**
+ * @brief Converts a number lexeme to a long double, correctly rounded
+ */
+long double parse_number(const char*, size_t);
+
+/**
+ * @brief Writes the shortest representation of a number which reads back
+ *        to the same value
+ */
+size_t format_number(long double, char*, size_t);
+
+#endif
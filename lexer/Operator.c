@@ -8,12 +8,13 @@
 
 
 /**
- * @brief Creates an operator type
+ * @brief Gets the properties of an operator
  * @details Associate to each operator their propreties:
  *          ----------------------------------------
  *         | Operator | Precedence | Associativity |
  *         -----------------------------------------
  *         |     ^    |      4     |   Right       |
+ *         | unary -  |      4     |   Left        |
  *         |     *    |      3     |   Left        |
  *         |     /    |      3     |   Left        |
  *         |     %    |      3     |   Left        |
@@ -22,40 +23,55 @@
  *         -----------------------------------------
  *
  * @param type The token type
+ * @param precedence Where to store the precedence
+ * @param associativity Where to store the associativity
+ */
+void operator_properties(TokenType type, unsigned int *precedence, AssocType *associativity)
+{
+  *associativity = LEFT;
+
+  switch (type) {
+    case EXPONENT:
+    case IPOWER:
+                *precedence = 4U;
+                *associativity = RIGHT;
+                break;
+    case UMINUS:
+                *precedence = 4U;
+                break;
+    case MULTIPLY:
+    case DIVIDE:
+    case MODULO:
+                *precedence = 3U;
+                break;
+    case PLUS:
+    case BMINUS:
+                *precedence = 2U;
+                break;
+    default:
+                *precedence = 0U;
+                break;
+  }
+}
+
+
+/**
+ * @brief Creates an operator type
+ *
+ * @param type The token type
  * @param value The operator value
  *
  * @return The address of the created operator type
+ * @see Operator::operator_properties
  */
 Operator create_operator(TokenType type, const char *value)
 {
   Operator operator = malloc(sizeof(*operator));
   assert(operator != NULL);
 
-  operator->precedence    = 0;
-  operator->associativity = 0;
+  operator_properties(type, &operator->precedence, &operator->associativity);
   strcpy(operator->value, value);
 
-  operator_t ops[] = {
-    {4U, RIGHT, "^"}, {3U, LEFT, "*"}, {3U, LEFT, "/"},
-    {3U, LEFT, "%"},  {2U, LEFT, "+"}
-  };
-  const size_t nbr_operators = sizeof ops / sizeof *ops;
-
-  if (type == UMINUS)
-    operator->precedence = 4U;
-  else if (type == BMINUS)
-    operator->precedence = 2U;
-
-  if (type == MINUS) {
-    operator->associativity = LEFT;
-  } else {
-    for (size_t i = 0; i < nbr_operators; ++i) {
-      if (ops[i].value[0] == value[0]) {
-        operator->associativity = ops[i].associativity;
-        operator->precedence    = ops[i].precedence;
-      }
-    }
-  }
   return operator;
 }
 
@@ -94,7 +110,34 @@ bool is_operator(TokenType type)
       || type == MINUS
       || type == UMINUS
       || type == BMINUS
-      || type == MODULO;
+      || type == MODULO
+      || type == IPOWER;
+}
+
+
+/**
+ * @brief Returns the symbol of an operator given by its token type
+ *
+ * @param type The token type of the operator
+ * @return The symbol, as it is written in an expression
+ */
+const char *get_operator_symbol(TokenType type)
+{
+  switch (type) {
+    case EXPONENT:
+    case IPOWER:
+                return "^";
+    case MULTIPLY:
+                return "*";
+    case DIVIDE:
+                return "/";
+    case MODULO:
+                return "%";
+    case PLUS:
+                return "+";
+    default:
+                return "-";
+  }
 }
 
 
@@ -109,6 +152,31 @@ void print_operator(Operator operator)
 }
 
 
+/**
+ * @brief Raises a number to an integer power by repeated squaring
+ * @details Takes about 2 log2(n) multiplications, which is much faster than
+ *          powl for the small exponents of the polynomials. The result may
+ *          differ from powl by a few units in the last place.
+ *
+ * @param base The base
+ * @param n The exponent
+ * @return The base raised to the power n
+ */
+static long double integer_power(long double base, long n)
+{
+  unsigned long e = n < 0 ? -(unsigned long)n : (unsigned long)n;
+  long double result = 1.0;
+
+  while (e) {
+    if (e & 1) result *= base;
+    e >>= 1;
+    if (e) base *= base;
+  }
+
+  return n < 0 ? 1.0 / result : result;
+}
+
+
 /**
  * @brief Evaluates an operator calculation
  *
@@ -136,6 +204,9 @@ long double eval_operator(TokenType type, long double lc, long double rc)
     case EXPONENT:
                 result = powl(lc, rc);
                 break;
+    case IPOWER:
+                result = integer_power(lc, (long)rc);
+                break;
     case MODULO:
                 result = remainderl(lc, rc);
                 break;
@@ -19,6 +19,11 @@ typedef struct operator_t
   char value[2];
 } operator_t, *Operator;
 
+/**
+ * @brief Gets the properties of an operator
+ */
+void operator_properties(TokenType, unsigned int*, AssocType*);
+
 /**
  * @brief Creates an operator type
  */
@@ -34,6 +39,11 @@ Operator clone_operator(Operator);
  */
 bool is_operator(TokenType);
 
+/**
+ * @brief Returns the symbol of an operator given by its token type
+ */
+const char *get_operator_symbol(TokenType);
+
 /**
  * @brief Prints a given operator type
  */
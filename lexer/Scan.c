@@ -0,0 +1,190 @@
+#include <stdbool.h>
+
+#include "../CommonHeaders.h"
+#include "Scan.h"
+
+#if defined(__x86_64__) || defined(__SSE2__)
+#include <immintrin.h>
+#define SCAN_SIMD 1
+#endif
+
+
+/**
+ * @brief Checks if a character belongs to a given class
+ * @details The classes are the ones of the "C" locale, whatever the current
+ *          locale is.
+ *
+ * @param c The character to check
+ * @param cls The class
+ * @return true if the character belongs to the class, false otherwise
+ */
+static inline bool in_class(unsigned char c, CharClass cls)
+{
+  switch (cls) {
+    case SPACE:
+                return c == ' ' || (unsigned char)(c - '\t') < 5;
+    case DIGIT:
+                return (unsigned char)(c - '0') < 10;
+    case LETTER:
+                return (unsigned char)((c | 0x20) - 'a') < 26;
+  }
+
+  return false;
+}
+
+
+/**
+ * @brief Returns the position of the first character which doesn't belong
+ *        to a given class, one character at a time
+ *
+ * @param input The expression
+ * @param position Where to start
+ * @param length The length of the expression
+ * @param cls The class of the run
+ * @return The position of the end of the run
+ */
+static size_t span_scalar(const char *input, size_t position, size_t length, CharClass cls)
+{
+  while (position < length && in_class((unsigned char)input[position], cls))
+    ++position;
+
+  return position;
+}
+
+
+#ifdef SCAN_SIMD
+
+/**
+ * @brief Selects the bytes of a vector within [lo, lo + n)
+ * @details The comparison is unsigned: v - lo <= n - 1
+ */
+static inline __m128i in_range_sse2(__m128i v, char lo, char n)
+{
+  __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8((char)(n - 1))), d);
+}
+
+
+/**
+ * @brief Selects the bytes of a vector which belong to a given class
+ */
+static inline __m128i class_mask_sse2(__m128i v, CharClass cls)
+{
+  switch (cls) {
+    case SPACE:
+                return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                    in_range_sse2(v, '\t', 5));
+    case DIGIT:
+                return in_range_sse2(v, '0', 10);
+    case LETTER:
+                return in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 26);
+  }
+
+  return _mm_setzero_si128();
+}
+
+
+/**
+ * @brief Returns the end of a run, 16 characters at a time (SSE2)
+ *
+ * @see span_scalar
+ */
+static size_t span_sse2(const char *input, size_t position, size_t length, CharClass cls)
+{
+  while (position + 16 <= length) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(input + position));
+    unsigned int outside = ~(unsigned int)_mm_movemask_epi8(class_mask_sse2(v, cls)) & 0xFFFFU;
+
+    if (outside) return position + (size_t)__builtin_ctz(outside);
+    position += 16;
+  }
+
+  return span_scalar(input, position, length, cls);
+}
+
+
+/**
+ * @brief Selects the bytes of a vector within [lo, lo + n)
+ *
+ * @see in_range_sse2
+ */
+__attribute__((target("avx2")))
+static inline __m256i in_range_avx2(__m256i v, char lo, char n)
+{
+  __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8((char)(n - 1))), d);
+}
+
+
+/**
+ * @brief Selects the bytes of a vector which belong to a given class
+ *
+ * @see class_mask_sse2
+ */
+__attribute__((target("avx2")))
+static inline __m256i class_mask_avx2(__m256i v, CharClass cls)
+{
+  switch (cls) {
+    case SPACE:
+                return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                       in_range_avx2(v, '\t', 5));
+    case DIGIT:
+                return in_range_avx2(v, '0', 10);
+    case LETTER:
+                return in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 26);
+  }
+
+  return _mm256_setzero_si256();
+}
+
+
+/**
+ * @brief Returns the end of a run, 32 characters at a time (AVX2)
+ *
+ * @see span_scalar
+ */
+__attribute__((target("avx2")))
+static size_t span_avx2(const char *input, size_t position, size_t length, CharClass cls)
+{
+  while (position + 32 <= length) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(input + position));
+    unsigned int outside = ~(unsigned int)_mm256_movemask_epi8(class_mask_avx2(v, cls));
+
+    if (outside) return position + (size_t)__builtin_ctz(outside);
+    position += 32;
+  }
+
+  return span_sse2(input, position, length, cls);
+}
+
+#endif
+
+
+/**
+ * @brief Returns the position of the first character which doesn't belong
+ *        to a given class
+ * @details Used by the lexer to skip the runs of spaces, digits and letters
+ *          without running the DFA on each character. The first character
+ *          is checked alone, since most of the runs are short. Long runs are
+ *          classified 32 characters at a time if the processor supports AVX2,
+ *          16 at a time with SSE2, and one at a time otherwise. Nothing is
+ *          read past the given length.
+ *
+ * @param input The expression
+ * @param position Where to start
+ * @param length The length of the expression
+ * @param cls The class of the run
+ * @return The position of the end of the run
+ */
+size_t span_class(const char *input, size_t position, size_t length, CharClass cls)
+{
+  if (position >= length || !in_class((unsigned char)input[position], cls))
+    return position;
+
+#ifdef SCAN_SIMD
+  if (__builtin_cpu_supports("avx2")) return span_avx2(input, position + 1, length, cls);
+  return span_sse2(input, position + 1, length, cls);
+#else
+  return span_scalar(input, position + 1, length, cls);
+#endif
+}
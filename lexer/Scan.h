@@ -0,0 +1,17 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+/**
+ * @brief Represents the classes of characters which form runs in an expression
+ */
+typedef enum char_class { SPACE, DIGIT, LETTER } CharClass;
+
+/**
+ * @brief Returns the position of the first character which doesn't belong
+ *        to a given class
+ */
+size_t span_class(const char*, size_t, size_t, CharClass);
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <stdint.h>
+
+#include "Function.h"
 
 /**
  * @brief Represents the type of the token's ID
@@ -19,7 +22,9 @@ typedef enum token_type
   MINUS,
   UMINUS,
   BMINUS,
-  MODULO
+  MODULO,
+  VARIABLE,
+  IPOWER
 } TokenType;
 
 /**
@@ -34,6 +39,27 @@ typedef struct token_t {
   void (*destroy)(Token);
 } token_t;
 
+/**
+ * @brief A token of a token array: its type, where it is in the expression,
+ *        and its value inline
+ * @details The value depends on the type: the number of a literal, the ID
+ *          of a function, or the precedence and the associativity (LEFT or
+ *          RIGHT) of an operator. The name of a variable is read from the
+ *          expression.
+ */
+typedef struct flat_token_t
+{
+  TokenType type;
+  uint32_t offset;
+  uint32_t length;
+  union
+  {
+    long double number;
+    FunctionID function;
+    struct { uint8_t precedence; uint8_t associativity; } operator;
+  } value;
+} flat_token_t;
+
 /**
  * @brief Creates a new token
  */
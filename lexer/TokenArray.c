@@ -0,0 +1,232 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../CommonHeaders.h"
+#include "../Probes.h"
+#include "TokenArray.h"
+#include "Lexer.h"
+#include "Token.h"
+#include "../eval/Limits.h"
+
+
+/**
+ * @brief Creates an empty token array
+ *
+ * @return The address of the created token array
+ */
+TokenArray create_token_array(void)
+{
+  TokenArray array = malloc(sizeof(*array));
+  assert(array != NULL);
+
+  array->tokens   = NULL;
+  array->size     = 0;
+  array->capacity = 0;
+
+  array->error          = NULL;
+  array->error_position = 0;
+
+  return array;
+}
+
+
+/**
+ * @brief Tokenize a mathematic expression
+ * @details Takes a string represents a mathematic expression, and fills
+ *          the array with its tokens using a deterministic finite automata
+ *          (DFA). The previous tokens of the array are replaced, and its
+ *          storage is reused, so an array can tokenize many expressions
+ *          without allocating. The expression is not copied: the tokens
+ *          refer to it by offset.
+ *
+ *          If the expression is malformed, the tokens before the error are
+ *          kept, and the error and its position are recorded in the array.
+ *          So is an expression over the limits of bytes, tokens or memory:
+ *          it is read no further, and the array never grows past them.
+ *
+ * @param array The array where to store the tokens
+ * @param expression String represents the mathematic expression
+ * @param length The length of the expression
+ * @return true if the whole expression was read, false if it is malformed
+ * @see Lexer::create_lexer, Lexer::next_token, Lexer::delete_lexer,
+ *      Limits::get_limits
+ */
+bool tokenize_expression(TokenArray array, const char *expression, size_t length)
+{
+  array->size  = 0;
+  array->error = NULL;
+  PROBE1(tokenize_start, length);
+
+  const limits_t *limits = get_limits();
+  if (limits->bytes && length > limits->bytes) {
+    array->error          = "Expression too long";
+    array->error_position = limits->bytes;
+    PROBE2(tokenize_done, length, 0);
+    return false;
+  }
+
+  size_t most_tokens = limits->tokens ? limits->tokens : SIZE_MAX;
+  size_t most_memory = limits->memory ? limits->memory / sizeof(*array->tokens) : SIZE_MAX;
+  size_t most = most_tokens < most_memory ? most_tokens : most_memory;
+
+  lexer_t lexer;
+  init_lexer(&lexer, expression, length);
+
+  for (;;) {
+    if (array->size == array->capacity) {
+      size_t capacity = array->capacity ? 2 * array->capacity : 16 + length / 2;
+      // One more than the most tokens, to read the one which is too many
+      if (capacity > most) capacity = most + 1;
+
+      array->capacity = capacity;
+      array->tokens = realloc(array->tokens, array->capacity * sizeof(*array->tokens));
+      assert(array->tokens != NULL);
+      PROBE2(alloc, PROBE_TOKENS, array->capacity * sizeof(*array->tokens));
+    }
+
+    if (!next_token(&lexer, &array->tokens[array->size])) break;
+
+    if (array->size == most) {
+      array->error = most == most_tokens ? "Too many tokens" : "Expression needs too much memory";
+      array->error_position = array->tokens[array->size].offset;
+      break;
+    }
+
+    ++array->size;
+  }
+
+  if (lexer.error) {
+    array->error          = lexer.error;
+    array->error_position = lexer.position;
+  }
+
+  PROBE2(tokenize_done, length, array->size);
+
+  return !array->error;
+}
+
+
+/**
+ * @brief Updates the tokens of an expression after a part of it was replaced
+ * @details The array holds the tokens of the expression before the edit.
+ *          The DFA is run again from the end of the last token before the
+ *          edit, until it reads a token after the edit which is one of the
+ *          previous tokens, moved by the edit: since a token only depends on
+ *          its text, the next character and the type of the token before it,
+ *          the following tokens are unchanged, and only their offsets are
+ *          moved. If it never meets such a token, the rest of the expression
+ *          is read again, and its error recorded.
+ *
+ *          example: "12 + 3" -> "12 + 345" replaces the token '3' by '345'
+ *
+ * @param array The tokens of the expression before the edit
+ * @param expression The expression after the edit
+ * @param length The length of the expression after the edit
+ * @param offset Where the edit starts
+ * @param deleted The number of characters deleted at the offset
+ * @param inserted The number of characters inserted at the offset
+ * @param edit Where to store the tokens which were replaced
+ * @return true if the whole expression was read, false if it is malformed
+ * @see Lexer::resume_lexer, Lexer::next_token
+ */
+bool retokenize_expression(TokenArray array, const char *expression, size_t length,
+                           size_t offset, size_t deleted, size_t inserted,
+                           token_edit_t *edit)
+{
+  flat_token_t *tokens = array->tokens;
+  size_t size = array->size;
+
+  // The first token which ends at or after the edit: the DFA read the
+  // character after it, which may have changed
+  size_t lo = 0, hi = size;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (tokens[mid].offset + tokens[mid].length < offset) lo = mid + 1;
+    else hi = mid;
+  }
+  size_t first = lo;
+
+  lexer_t lexer;
+  init_lexer(&lexer, expression, length);
+  if (first)
+    resume_lexer(&lexer, tokens[first - 1].offset + tokens[first - 1].length, &tokens[first - 1]);
+
+  int64_t shift = (int64_t)inserted - (int64_t)deleted;
+  size_t old_end = offset + deleted, new_end = offset + inserted;
+
+  flat_token_t *added = NULL;
+  size_t nbr_added = 0, capacity = 0, next = first;
+  bool synchronized = false;
+
+  for (;;) {
+    flat_token_t token;
+    if (!next_token(&lexer, &token)) break;
+
+    if (token.offset >= new_end) {
+      while (next < size && (tokens[next].offset < old_end
+                          || (int64_t)tokens[next].offset + shift < (int64_t)token.offset))
+        ++next;
+
+      if (next < size && tokens[next].offset >= old_end
+       && (int64_t)tokens[next].offset + shift == (int64_t)token.offset
+       && tokens[next].length == token.length && tokens[next].type == token.type) {
+        synchronized = true;
+        break;
+      }
+    }
+
+    if (nbr_added == capacity) {
+      capacity = capacity ? 2 * capacity : 16;
+      added = realloc(added, capacity * sizeof(*added));
+      assert(added != NULL);
+    }
+    added[nbr_added++] = token;
+  }
+
+  if (synchronized) {
+    if (array->error) array->error_position = (size_t)((int64_t)array->error_position + shift);
+  } else {
+    next = size;
+    array->error          = lexer.error;
+    array->error_position = lexer.error ? lexer.position : 0;
+  }
+
+  size_t kept = size - next, new_size = first + nbr_added + kept;
+  if (new_size > array->capacity) {
+    array->capacity = new_size + new_size / 2;
+    array->tokens = realloc(array->tokens, array->capacity * sizeof(*array->tokens));
+    assert(array->tokens != NULL);
+    PROBE2(alloc, PROBE_TOKENS, array->capacity * sizeof(*array->tokens));
+  }
+  tokens = array->tokens;
+
+  memmove(tokens + first + nbr_added, tokens + next, kept * sizeof(*tokens));
+  if (nbr_added) memcpy(tokens + first, added, nbr_added * sizeof(*tokens));
+
+  if (shift)
+    for (size_t i = first + nbr_added; i < new_size; ++i)
+      tokens[i].offset = (uint32_t)((int64_t)tokens[i].offset + shift);
+
+  array->size = new_size;
+
+  edit->first   = first;
+  edit->removed = next - first;
+  edit->added   = nbr_added;
+
+  free(added);
+
+  return !array->error;
+}
+
+
+/**
+ * @brief Deletes a token array
+ *
+ * @param array The token array to delete
+ */
+void delete_token_array(TokenArray array)
+{
+  free(array->tokens);
+  free(array);
+}
@@ -0,0 +1,56 @@
+#ifndef TOKEN_ARRAY_H
+#define TOKEN_ARRAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Token.h"
+
+/**
+ * @brief The growable array where to store the tokens of an expression
+ * @details If the expression is malformed, the tokens before the error are
+ *          kept, and the error is recorded with its position.
+ */
+typedef struct token_array_t *TokenArray;
+typedef struct token_array_t
+{
+  flat_token_t *tokens;
+  size_t size;
+  size_t capacity;
+
+  const char *error;
+  size_t error_position;
+} token_array_t;
+
+/**
+ * @brief The tokens replaced by an edit of the expression: from the index
+ *        first, the removed tokens are replaced by the added ones
+ */
+typedef struct token_edit_t
+{
+  size_t first;
+  size_t removed;
+  size_t added;
+} token_edit_t;
+
+/**
+ * @brief Creates an empty token array
+ */
+TokenArray create_token_array(void);
+
+/**
+ * @brief Tokenize a mathematic expression
+ */
+bool tokenize_expression(TokenArray, const char*, size_t);
+
+/**
+ * @brief Updates the tokens of an expression after a part of it was replaced
+ */
+bool retokenize_expression(TokenArray, const char*, size_t, size_t, size_t, size_t, token_edit_t*);
+
+/**
+ * @brief Deletes a token array
+ */
+void delete_token_array(TokenArray);
+
+#endif
@@ -15,11 +15,6 @@ TransitionTable create_transition_table(void)
   TransitionTable transition = calloc((NUM_STATES+1), sizeof(*transition));
   assert(transition != NULL);
 
-  for (size_t i = 0; i <= NUM_STATES; ++i) {
-    transition[i] = calloc(MAX_CHARS_LENGTH, sizeof(**transition));
-    assert(transition[i] != NULL);
-  }
-
   return transition;
 }
 
@@ -27,7 +22,7 @@ TransitionTable create_transition_table(void)
 /**
  * @brief Fill the transition table
  * @details The deterministic finite automata recognizes:
- *            . function names (identifiers):  [a-zA-Z][a-zA-Z0-9]*
+ *            . function and variable names (identifiers):  [a-zA-Z]+
  *            . floating-point numbers - like 3.12, 5, 6.23e12 -:
  *                ([0-9]+(\.[0-9]*)? | (\.[0-9]+))(([eE][+-]?[0-9])?)
  *            . arithmetic operators: '^', '*', '+', '-', '%', '/'
@@ -84,8 +79,6 @@ void generate_transition_table(TransitionTable transition)
  */
 void delete_transition_table(TransitionTable transition)
 {
-  for (size_t i = 0; i <= NUM_STATES; ++i)
-    free(transition[i]);
   free(transition);
 }
 
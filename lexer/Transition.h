@@ -6,8 +6,10 @@
 
 /**
  * @brief Represents the type of the transition table
+ * @details The rows of the states are stored contiguously, so a transition
+ *          is a single lookup: transition[state][c]
  */
-typedef unsigned int **TransitionTable;
+typedef unsigned char (*TransitionTable)[MAX_CHARS_LENGTH];
 
 /**
  * @brief Creates a transition table
@@ -1,12 +1,414 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
 
-#include "lexer/List.h"
+#include "lexer/Function.h"
+#include "lexer/Number.h"
 #include "parser/AST.h"
 #include "parser/Parser.h"
+#include "parser/Environment.h"
+#include "parser/Definition.h"
+#include "eval/Derivative.h"
+#include "eval/Optimize.h"
+#include "eval/FastMath.h"
+#include "eval/Aggregate.h"
+#include "eval/Limits.h"
+#include "eval/Plugin.h"
+#include "io/MappedFile.h"
+#include "io/Batch.h"
+#include "io/Compiled.h"
+#include "io/Csv.h"
+#include "io/Channel.h"
+
+static void usage(const char *program)
+{
+  fprintf(stderr, "usage: %s [-O] [-t THREADS] [-m exact|4ulp|fast] [-D NAME=VALUE]...\n"
+                  "          [-d NAME[,NAME]...]\n"
+                  "                       evaluate an expression step by step\n"
+                  "       %s -f FILE [-j JOBS | -P] [-t THREADS] [-o text|double|long-double]\n"
+                  "          [-O] [-m exact|4ulp|fast] [-D NAME=VALUE]... [-d NAME[,NAME]...]\n"
+                  "                       evaluate each line of FILE\n"
+                  "       %s -c FILE [-t THREADS] [-m exact|4ulp|fast] [-D NAME=VALUE]...\n"
+                  "                       evaluate each expression of a compiled FILE\n"
+                  "       %s -x EXPRESSION [-t THREADS] [-O] [-m exact|4ulp|fast] [-D NAME=VALUE]...\n"
+                  "                       evaluate EXPRESSION on each row of the CSV read on stdin\n"
+                  "       %s -s NAME [-O] [-m exact|4ulp|fast] [-D NAME=VALUE]...\n"
+                  "                       serve the expressions of the shared-memory channel NAME\n"
+                  "every mode takes [-L bytes|tokens|depth|nodes|memory|time=LIMIT]... to bound\n"
+                  "each evaluation and each -D (time in milliseconds, memory in bytes), and\n"
+                  "[-l PLUGIN]... to load the functions of a shared object for the -D and the\n"
+                  "expressions; -D NAME(X[,Y]...)=EXPRESSION defines a function, inlined where\n"
+                  "it is called\n",
+                  program, program, program, program, program);
+  exit(EXIT_FAILURE);
+}
+
+static int is_variable_name(const char *name)
+{
+  if (!*name || get_function_id(name) != NONE) return 0;
+
+  for (const char *c = name; *c; ++c)
+    if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z'))) return 0;
+
+  return 1;
+}
+
+static void define_user_function(Environment env, const char *definition)
+{
+  size_t length = strlen(definition);
 
-int main(void)
+  parse_error_t error;
+  if (!define_function(definition, length, env, &error))
+  {
+    print_parse_error(stderr, definition, length, &error);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void define_variable(Environment env, char *definition, const char *program)
 {
+  char *value = strchr(definition, '=');
+  if (!value) usage(program);
+
+  char *parenthesis = strchr(definition, '(');
+  if (parenthesis && parenthesis < value)
+  {
+    define_user_function(env, definition);
+    return;
+  }
+  *value++ = '\0';
+
+  if (!is_variable_name(definition))
+  {
+    fprintf(stderr, "Invalid variable name '%s'\n", definition);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t length = strlen(value);
+
+  parse_error_t error;
+  ASTNode root = parse_expression(value, length, &error);
+  if (!root)
+  {
+    print_parse_error(stderr, value, length, &error);
+    exit(EXIT_FAILURE);
+  }
+
+  ASTNode unbound = find_unbound_variable(root, env);
+  if (unbound)
+  {
+    fprintf(stderr, "Unbound variable '%s'\n", (char*)unbound->token->data);
+    exit(EXIT_FAILURE);
+  }
+
+  start_deadline();
+  long double result = eval_tree_value(root, env);
+  if (deadline_passed())
+  {
+    fprintf(stderr, "Deadline exceeded\n");
+    exit(EXIT_FAILURE);
+  }
+
+  set_variable(env, definition, result);
+  root->destroy(root);
+}
+
+static void set_limit(limits_t *limits, char *definition, const char *program)
+{
+  char *value = strchr(definition, '=');
+  if (!value) usage(program);
+  *value++ = '\0';
+
+  char *end = NULL;
+  errno = 0;
+  unsigned long long limit = strtoull(value, &end, 10);
+  if (errno || end == value || *end || *value == '-')
+  {
+    fprintf(stderr, "Invalid limit '%s'\n", value);
+    exit(EXIT_FAILURE);
+  }
+
+  if (!strcmp(definition, "bytes")) limits->bytes = (size_t)limit;
+  else if (!strcmp(definition, "tokens")) limits->tokens = (size_t)limit;
+  else if (!strcmp(definition, "depth")) limits->depth = (size_t)limit;
+  else if (!strcmp(definition, "nodes")) limits->nodes = (size_t)limit;
+  else if (!strcmp(definition, "memory")) limits->memory = (size_t)limit;
+  else if (!strcmp(definition, "time")) limits->time = (uint64_t)limit * 1000000ULL;
+  else
+  {
+    fprintf(stderr, "Unknown limit '%s'\n", definition);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void add_derivatives(const char ***wrt, size_t *nbr_wrt, char *names)
+{
+  for (char *name = strtok(names, ","); name; name = strtok(NULL, ","))
+  {
+    if (!is_variable_name(name))
+    {
+      fprintf(stderr, "Invalid variable name '%s'\n", name);
+      exit(EXIT_FAILURE);
+    }
+
+    *wrt = realloc(*wrt, (*nbr_wrt + 1) * sizeof(**wrt));
+    if (!*wrt) exit(EXIT_FAILURE);
+    (*wrt)[(*nbr_wrt)++] = name;
+  }
+}
+
+static void evaluate_file(const char *path, BatchOptions options)
+{
+  MappedFile file = open_mapped_file(path);
+  if (!file)
+  {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  fflush(stdout);
+  evaluate_batch(file->data, file->size, options, fileno(stdout));
+
+  close_mapped_file(file);
+}
+
+static void evaluate_compiled(const char *path, Environment env)
+{
+  CompiledFile compiled = open_compiled_file(path);
+  if (!compiled)
+  {
+    if (errno == EINVAL) fprintf(stderr, "'%s' is not a compiled expressions file\n", path);
+    else perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < compiled_expressions(compiled); ++i)
+  {
+    const char *unbound = find_unbound_compiled_variable(compiled, i, env);
+    if (unbound)
+    {
+      printf("%s = error: Unbound variable '%s'\n", compiled_name(compiled, i), unbound);
+      continue;
+    }
+
+    start_deadline();
+    long double value = eval_compiled_expression(compiled, i, env);
+    if (deadline_passed())
+    {
+      printf("%s = error: Deadline exceeded\n", compiled_name(compiled, i));
+      continue;
+    }
+
+    char str[NUMBER_BUFFER_SIZE];
+    format_number(value, str, sizeof str);
+    printf("%s = %s\n", compiled_name(compiled, i), str);
+  }
+
+  close_compiled_file(compiled);
+}
+
+static void evaluate_rows(const char *expression, BatchOptions options)
+{
+  size_t length = strlen(expression);
+
+  parse_error_t error;
+  NodePool pool = NULL;
+  if (options->optimize)
+  {
+    ASTNode root = parse_expression(expression, length, &error);
+    if (root)
+    {
+      root = optimize_tree(root);
+      pool = create_pool_from_tree(root);
+      root->destroy(root);
+    }
+  }
+  else
+  {
+    pool = parse_expression_pool(expression, length, &error);
+  }
+
+  if (!pool)
+  {
+    print_parse_error(stderr, expression, length, &error);
+    exit(EXIT_FAILURE);
+  }
+
+  fflush(stdout);
+  bool evaluated = evaluate_csv(pool, options->env, STDIN_FILENO, fileno(stdout));
+
+  delete_node_pool(pool);
+  if (!evaluated) exit(EXIT_FAILURE);
+}
+
+static volatile sig_atomic_t stopped = 0;
+
+static void stop(int signal)
+{
+  (void)signal;
+  stopped = 1;
+}
+
+static void serve(const char *name, BatchOptions options)
+{
+  Channel channel = create_channel(name);
+  if (!channel)
+  {
+    perror(name);
+    exit(EXIT_FAILURE);
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof action);
+  action.sa_handler = stop;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  serve_channel(channel, options->env, options->optimize, &stopped);
+
+  close_channel(channel);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = NULL, *compiled = NULL, *rows = NULL, *name = NULL;
+  long value = sysconf(_SC_NPROCESSORS_ONLN);
+  pipeline_stats_t stats;
+  batch_options_t options = { value > 0 ? (unsigned int)value : 1U, 1U, OUTPUT_TEXT,
+                              false, create_environment(), NULL, 0, false, NULL };
+  const char **wrt = NULL;
+  char **definitions = NULL;
+  size_t nbr_definitions = 0;
+  limits_t limits = { 0, 0, 0, 0, 0, 0 };
+
+  int opt = 0;
+  while ((opt = getopt(argc, argv, "f:c:x:s:j:Pt:o:Om:D:d:L:l:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'f':
+        path = optarg;
+        break;
+      case 'c':
+        compiled = optarg;
+        break;
+      case 'x':
+        rows = optarg;
+        break;
+      case 's':
+        name = optarg;
+        break;
+      case 'j':
+        value = strtol(optarg, NULL, 10);
+        if (value < 1) usage(argv[0]);
+        options.jobs = (unsigned int)value;
+        break;
+      case 'P':
+        options.pipeline = true;
+        options.stats = &stats;
+        break;
+      case 't':
+        value = strtol(optarg, NULL, 10);
+        if (value < 1) usage(argv[0]);
+        options.threads = (unsigned int)value;
+        break;
+      case 'o':
+        if (!strcmp(optarg, "text")) options.format = OUTPUT_TEXT;
+        else if (!strcmp(optarg, "double")) options.format = OUTPUT_DOUBLE;
+        else if (!strcmp(optarg, "long-double")) options.format = OUTPUT_LONG_DOUBLE;
+        else usage(argv[0]);
+        break;
+      case 'O':
+        options.optimize = true;
+        break;
+      case 'm':
+        if (!strcmp(optarg, "exact")) set_math_mode(MATH_EXACT);
+        else if (!strcmp(optarg, "4ulp")) set_math_mode(MATH_4ULP);
+        else if (!strcmp(optarg, "fast")) set_math_mode(MATH_FAST);
+        else usage(argv[0]);
+        break;
+      case 'D':
+        definitions = realloc(definitions, (nbr_definitions + 1) * sizeof(*definitions));
+        if (!definitions) exit(EXIT_FAILURE);
+        definitions[nbr_definitions++] = optarg;
+        break;
+      case 'd':
+        add_derivatives(&wrt, &options.nbr_wrt, optarg);
+        options.wrt = wrt;
+        break;
+      case 'L':
+        set_limit(&limits, optarg, argv[0]);
+        break;
+      case 'l':
+        if (!load_plugin(optarg)) exit(EXIT_FAILURE);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (optind != argc || (path && compiled) || (rows && (path || compiled))
+   || (name && (path || compiled || rows))) usage(argv[0]);
+
+  // A binary record has room for the value only, not for its derivatives
+  if (options.format != OUTPUT_TEXT && options.nbr_wrt)
+  {
+    fprintf(stderr, "%s: -d can't be written with -o double or -o long-double\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  set_aggregate_threads(options.threads);
+  set_limits(&limits);
+
+  // The -D are read once the limits and the plugins are known, in their order
+  for (size_t i = 0; i < nbr_definitions; ++i)
+    define_variable(options.env, definitions[i], argv[0]);
+  free(definitions);
+
+  if (compiled)
+  {
+    evaluate_compiled(compiled, options.env);
+    delete_environment(options.env);
+    free(wrt);
+    return 0;
+  }
+
+  if (name)
+  {
+    serve(name, &options);
+    delete_environment(options.env);
+    free(wrt);
+    return 0;
+  }
+
+  if (rows)
+  {
+    evaluate_rows(rows, &options);
+    delete_environment(options.env);
+    free(wrt);
+    return 0;
+  }
+
+  if (path)
+  {
+    evaluate_file(path, &options);
+    if (options.pipeline)
+      fprintf(stderr, "%llu lines in %.3f s, busy: lex %.0f%%, parse %.0f%%, eval %.0f%%\n",
+              (unsigned long long)stats.lines, stats.seconds,
+              100 * stats.busy[STAGE_LEX] / stats.seconds,
+              100 * stats.busy[STAGE_PARSE] / stats.seconds,
+              100 * stats.busy[STAGE_EVAL] / stats.seconds);
+    delete_environment(options.env);
+    free(wrt);
+    return 0;
+  }
+
   char expression[256];
   printf("\nEnter your mathematical expression:\n  -> ");
   if (!fgets(expression, sizeof expression, stdin))
@@ -15,11 +417,52 @@ int main(void)
     exit(EXIT_FAILURE);
   }
 
-  List list = tokenize_expression(expression);
-  ASTNode root = parse_expression(list);
+  size_t length = strlen(expression);
+
+  parse_error_t error;
+  ASTNode root = parse_expression(expression, length, &error);
+  if (!root)
+  {
+    print_parse_error(stderr, expression, length, &error);
+    exit(EXIT_FAILURE);
+  }
+
+  if (options.optimize) root = optimize_tree(root);
 
-  root = eval_tree(root);
+  ASTNode unbound = find_unbound_variable(root, options.env);
+  if (unbound)
+  {
+    fprintf(stderr, "Unbound variable '%s'\n", (char*)unbound->token->data);
+    exit(EXIT_FAILURE);
+  }
+
+  start_deadline();
+
+  long double *gradient = NULL;
+  if (options.nbr_wrt)
+  {
+    gradient = malloc(options.nbr_wrt * sizeof(*gradient));
+    if (!gradient) exit(EXIT_FAILURE);
+    eval_tree_gradient(root, options.env, wrt, options.nbr_wrt, gradient);
+  }
+
+  root = eval_tree(root, options.env);
+
+  if (deadline_passed())
+  {
+    fprintf(stderr, "Deadline exceeded\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < options.nbr_wrt; ++i)
+  {
+    char str[NUMBER_BUFFER_SIZE];
+    format_number(gradient[i], str, sizeof str);
+    printf("\td/d%s = %s\n", wrt[i], str);
+  }
 
   root->destroy(root);
-  list->destroy(list);
-}
\ No newline at end of file
+  delete_environment(options.env);
+  free(gradient);
+  free(wrt);
+}
@@ -1,11 +1,117 @@
-#include <math.h>
-#include <float.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include "../CommonHeaders.h"
+#include "../Probes.h"
 #include "AST.h"
 #include "../lexer/Operator.h"
 #include "../lexer/Function.h"
+#include "../lexer/Number.h"
 #include "../lexer/Token.h"
+#include "Environment.h"
+#include "NodePool.h"
+#include "../eval/Apply.h"
+#include "../eval/Aggregate.h"
+#include "../eval/Limits.h"
+
+
+/**
+ * @brief The indices of the aggregates around a subtree
+ */
+typedef struct tree_scope_t
+{
+  const char *name;
+  const struct tree_scope_t *next;
+} tree_scope_t;
+
+
+/**
+ * @brief Checks if a node is an aggregate: sum, prod, solve or integrate
+ *
+ * @param node The node
+ * @return true if the node is an aggregate
+ * @see Function::get_function_type
+ */
+static bool is_aggregate(ASTNode node)
+{
+  return node->token->type == FUNCTION && get_function_type(node->token->data) == AGGREGATE;
+}
+
+
+/**
+ * @brief Checks if a node is a call of a variadic function: max, min, mean,
+ *        stddev or sum
+ *
+ * @param node The node
+ * @return true if the node is a variadic call
+ * @see Function::get_function_type
+ */
+static bool is_variadic(ASTNode node)
+{
+  return node->token->type == FUNCTION && get_function_type(node->token->data) == VARIADIC;
+}
+
+
+/**
+ * @brief Checks if a variable is the index of an aggregate around it
+ *
+ * @param scope The indices in scope
+ * @param name The name of the variable
+ * @return true if the variable is bound by an aggregate
+ */
+static bool in_scope(const tree_scope_t *scope, const char *name)
+{
+  for (; scope; scope = scope->next)
+    if (!strcmp(scope->name, name)) return true;
+
+  return false;
+}
+
+
+/**
+ * @brief Prints some arguments of a variadic call, separated by commas
+ *
+ * @param arguments A child of the call, or of one of its ',' nodes
+ */
+static void print_arguments(ASTNode arguments)
+{
+  if (arguments->token->type == FARGSEPARATOR) {
+    print_arguments(arguments->left);
+    printf(",");
+    print_arguments(arguments->right);
+  } else {
+    arguments->print(arguments);
+  }
+}
+
+
+/**
+ * @brief Finds the last argument of a variadic call which is not a leaf
+ *
+ * @param holder The call, or one of its ',' nodes
+ * @param argument Where to store the argument
+ * @param parent Where to store the node which holds it
+ * @return true if an argument was found, false if they are all leaves
+ */
+static bool last_operand(ASTNode holder, ASTNode *argument, ASTNode *parent)
+{
+  ASTNode children[] = { holder->right, holder->left };
+
+  for (size_t i = 0; i < 2; ++i) {
+    ASTNode child = children[i];
+    if (!child) continue;
+
+    if (child->token->type == FARGSEPARATOR) {
+      if (last_operand(child, argument, parent)) return true;
+    } else if (child->right) {
+      *argument = child;
+      *parent = holder;
+      return true;
+    }
+  }
+
+  return false;
+}
 
 
 /**
@@ -15,6 +121,8 @@
  *          avoid confusion.
  *          example: 3 * 5 - 2   -> ((3 * 5) - 2)
  *                   3 * (5 - 2) -> (3 * (5 - 2))
+ *          The arguments of a variadic call and of an aggregate are printed
+ *          as they were written.
  *
  * @param root The root of the tree
  * @see Function::print_function, Function::get_function_type, Token::print
@@ -22,22 +130,45 @@
 static void print_ast(ASTNode root)
 {
   if (root) {
-    if (root->token->type == FUNCTION) {
+    if (is_aggregate(root) && is_driver(((Function)root->token->data)->id)) {
+      print_function(root->token->data);
+      printf("(");
+      print_ast(root->right);
+      printf(",");
+      print_ast(root->left->left->left);
+      printf(",");
+      print_ast(root->left->left->right);
+      printf(",");
+      print_ast(root->left->right);
+      printf(")");
+    } else if (is_aggregate(root)) {
+      print_function(root->token->data);
+      printf("(");
+      print_ast(root->left->left->left);
+      printf(",");
+      print_ast(root->left->left->right);
+      printf(",");
+      print_ast(root->left->right);
+      printf(",");
+      print_ast(root->right);
+      printf(")");
+    } else if (root->token->type == FUNCTION) {
       print_function(root->token->data);
       printf("(");
-      print_ast(root->left);
 
-      if (get_function_type(root->token->data) == BINARY)
+      if (root->left) {
+        print_arguments(root->left);
         printf(",");
+      }
 
-      print_ast(root->right);
+      print_arguments(root->right);
       printf(")");
     } else {
-      if (root->token->type != LITERAL) printf("(");
+      if (root->right) printf("(");
       print_ast(root->left);
       (root->token)->print(root->token);
       print_ast(root->right);
-      if (root->token->type != LITERAL) printf(")");
+      if (root->right) printf(")");
     }
   }
 }
@@ -72,6 +203,7 @@ ASTNode create_ast_node(Token token, ASTNode left, ASTNode right)
 {
   ASTNode node = malloc(sizeof(*node));
   assert(node != NULL);
+  PROBE2(alloc, PROBE_TREE, sizeof(*node));
 
   node->token = token;
   node->left  = left;
@@ -84,6 +216,59 @@ ASTNode create_ast_node(Token token, ASTNode left, ASTNode right)
 }
 
 
+/**
+ * @brief Creates a copy of a tree
+ *
+ * @param root The root of the tree to copy
+ * @return The root of the copy
+ * @see Token::clone_token
+ */
+ASTNode clone_tree(ASTNode root)
+{
+  if (!root) return NULL;
+
+  return create_ast_node(clone_token(root->token), clone_tree(root->left),
+                         clone_tree(root->right));
+}
+
+
+/**
+ * @brief Applies the operator or the function of a node to its operands
+ *
+ * @param node The node
+ * @param lc The value of the left child, 0 if there is none
+ * @param rc The value of the right child
+ * @return The result of the operator or the function
+ * @see Apply::eval_function, Operator::eval_operator
+ */
+long double eval_node(ASTNode node, long double lc, long double rc)
+{
+  if (node->token->type == FUNCTION)
+    return eval_function(node->token->data, lc, rc);
+
+  return eval_operator(node->token->type, lc, rc);
+}
+
+
+/**
+ * @brief Gets the value of a leaf of the tree
+ *
+ * @param leaf The leaf, a literal or a variable
+ * @param env The values of the variables
+ * @return The value of the literal, or the value bound to the variable
+ * @see Number::parse_number, Environment::get_variable
+ */
+static long double leaf_value(ASTNode leaf, Environment env)
+{
+  const char *data = leaf->token->data;
+
+  if (leaf->token->type == VARIABLE)
+    return get_variable(env, data);
+
+  return parse_number(data, strlen(data));
+}
+
+
 /**
  * @brief Gets the address of the first operator the evaluate and
  *        the address of its parent
@@ -94,6 +279,11 @@ ASTNode create_ast_node(Token token, ASTNode left, ASTNode right)
  *                  / \
  *                 5  2
  *
+ *          An aggregate is evaluated in one step once its bounds are
+ *          evaluated, its body is never evaluated on its own. A variadic
+ *          call is evaluated in one step once all its arguments are, the
+ *          last ones first, like the right operand of an operator.
+ *
  * @param root The root of the tree
  * @param first_op Where to store the address of the first operator to evaluate
  * @param p Where to store the address of its parent
@@ -104,7 +294,20 @@ static void get_first_operator(ASTNode root, ASTNode *first_op, ASTNode *p)
 
   ASTNode loperator = root, parent = NULL;
   while (loperator) {
-    if (loperator->right && loperator->right->right) {
+    if (is_variadic(loperator)) {
+      if (!last_operand(loperator, &loperator, &parent)) break;
+    } else if (is_aggregate(loperator)) {
+      ASTNode arguments = loperator->left;
+      if (arguments->right->right) {
+        parent = arguments;
+        loperator = arguments->right;
+      } else if (arguments->left->right->right) {
+        parent = arguments->left;
+        loperator = arguments->left->right;
+      } else {
+        break;
+      }
+    } else if (loperator->right && loperator->right->right) {
       parent = loperator;
       loperator = loperator->right;
     } else if (loperator->left && loperator->left->right) {
@@ -134,33 +337,33 @@ static void get_first_operator(ASTNode root, ASTNode *first_op, ASTNode *p)
  *                 5  2
  *
  * @param root The root of the tree
+ * @param env The values of the variables
+ * @param step The number of the step, from 1
  * @return The root address of the updated tree
- * @see Function::eval_function, Operator::eval_operator, Token::create_token,
- *      Token::destroy
+ * @see AST::eval_node, Token::create_token, Token::destroy,
+ *      Number::format_number
  */
-static ASTNode evaluate_step_by_step(ASTNode root)
+static ASTNode evaluate_step_by_step(ASTNode root, Environment env, size_t step)
 {
+  PROBE1(step_start, step);
+
   ASTNode parent = NULL, first_op = NULL;
   get_first_operator(root, &first_op, &parent);
 
-  long double lc = 0.0;
-  if (first_op->left) lc = strtod(first_op->left->token->data, NULL);
-
-  long double rc = strtod(first_op->right->token->data, NULL);
-
   long double result = 0.0;
-  if (first_op->token->type == FUNCTION)
-    result = eval_function(first_op->token->data, lc, rc);
-  else
-    result = eval_operator(first_op->token->type, lc, rc);
+  if (is_aggregate(first_op) || is_variadic(first_op)) {
+    result = eval_tree_value(first_op, env);
+  } else {
+    long double lc = 0.0;
+    if (first_op->left) lc = leaf_value(first_op->left, env);
 
-  char str[128];
+    long double rc = leaf_value(first_op->right, env);
 
-  // If there is no fractional part, store the whole part of the number
-  if ((result - floorl(result)) < DBL_EPSILON)
-    sprintf(str, "%.*Lf", 0, result);
-  else
-    sprintf(str, "%.*Lf", DBL_DIG, result);
+    result = eval_node(first_op, lc, rc);
+  }
+
+  char str[NUMBER_BUFFER_SIZE];
+  format_number(result, str, sizeof str);
 
   ASTNode node = create_ast_node(create_token(LITERAL, str), NULL, NULL);
 
@@ -172,28 +375,225 @@ static ASTNode evaluate_step_by_step(ASTNode root)
 
   (first_op)->destroy(first_op);
 
+  PROBE1(step_done, step);
+
   return root;
 }
 
 
 /**
  * @brief Evaluates the parse tree
+ * @details Each step walks the tree again, so the steps stop once the
+ *          deadline of the evaluation has passed, leaving the tree partly
+ *          evaluated.
  *
  * @param root The root of the tree
+ * @param env The values of the variables, may be NULL
  * @return The root address of the evaluated tree
- * @see Token::print
+ * @see Token::print, Limits::deadline_passed
  */
-ASTNode eval_tree(ASTNode root)
+ASTNode eval_tree(ASTNode root, Environment env)
 {
   assert(root != NULL);
 
-  while (root->left || root->right)
+  for (size_t step = 1; (root->left || root->right) && !deadline_passed(); ++step)
   {
+    root = evaluate_step_by_step(root, env, step);
+    if (deadline_passed()) break;
+
     printf("\n\t= ");
-    root = evaluate_step_by_step(root);
     root->print(root);
     printf("\n");
   }
   
   return root;
-}
\ No newline at end of file
+}
+
+
+/**
+ * @brief Gets the arguments of the subtree of a variadic call
+ *
+ * @param node A child of the call, or of one of its ',' nodes
+ * @param arguments Where to store the arguments, may be NULL
+ * @param n The number of arguments found before the subtree
+ * @return The number of arguments found up to the end of the subtree
+ */
+static size_t get_subtree_arguments(ASTNode node, ASTNode *arguments, size_t n)
+{
+  if (!node) return n;
+
+  if (node->token->type != FARGSEPARATOR) {
+    if (arguments) arguments[n] = node;
+    return n + 1;
+  }
+
+  n = get_subtree_arguments(node->left, arguments, n);
+  return get_subtree_arguments(node->right, arguments, n);
+}
+
+
+/**
+ * @brief Gets the arguments of a variadic call, in order
+ * @details The arguments are the leaves of the balanced tree of ',' nodes
+ *          below the call, from left to right:
+ *            max(a, b, c, d) -> max(','(a, b), ','(c, d))
+ *
+ * @param call The call
+ * @param arguments Where to store the arguments, may be NULL to only count them
+ * @return The number of arguments
+ */
+size_t get_arguments(ASTNode call, ASTNode *arguments)
+{
+  size_t n = get_subtree_arguments(call->left, arguments, 0);
+
+  return get_subtree_arguments(call->right, arguments, n);
+}
+
+
+/**
+ * @brief Computes the value of the parse tree
+ * @details Unlike eval_tree, the tree is left unchanged and the steps
+ *          are not printed.
+ *
+ *          The arguments of a variadic call are evaluated, then reduced at
+ *          once. An aggregate is compiled into a node pool, where its body
+ *          is evaluated for all its indices.
+ *
+ *          A variable which is not bound evaluates to NaN.
+ *
+ * @param root The root of the tree
+ * @param env The values of the variables, may be NULL
+ * @return The value of the tree
+ * @see AST::eval_node, NodePool::create_pool_from_tree, NodePool::eval_pool,
+ *      Aggregate::reduce_values
+ */
+long double eval_tree_value(ASTNode root, Environment env)
+{
+  assert(root != NULL);
+
+  if (!root->right) return leaf_value(root, env);
+
+  if (is_variadic(root)) {
+    size_t n = get_arguments(root, NULL);
+    ASTNode *arguments = malloc(n * sizeof(*arguments));
+    long double *values = malloc(n * sizeof(*values));
+    assert(arguments != NULL && values != NULL);
+
+    get_arguments(root, arguments);
+    for (size_t i = 0; i < n; ++i)
+      values[i] = eval_tree_value(arguments[i], env);
+
+    long double value = reduce_values(((Function)root->token->data)->id, values, n);
+
+    free(values);
+    free(arguments);
+
+    return value;
+  }
+
+  if (is_aggregate(root)) {
+    NodePool pool = create_pool_from_tree(root);
+    long double value = eval_pool(pool, env);
+    delete_node_pool(pool);
+
+    return value;
+  }
+
+  long double lc = 0.0;
+  if (root->left) lc = eval_tree_value(root->left, env);
+
+  long double rc = eval_tree_value(root->right, env);
+
+  return eval_node(root, lc, rc);
+}
+
+
+/**
+ * @brief Finds the first free variable of a subtree which is not bound
+ *
+ * @param root The root of the subtree
+ * @param env The values of the variables, may be NULL
+ * @param scope The indices of the aggregates around the subtree
+ * @return The leaf of the variable, or NULL if all of them are bound
+ */
+static ASTNode find_unbound_leaf(ASTNode root, Environment env, const tree_scope_t *scope)
+{
+  if (!root) return NULL;
+
+  if (root->token->type == VARIABLE) {
+    const char *name = root->token->data;
+    return !in_scope(scope, name) && find_variable(env, name) < 0 ? root : NULL;
+  }
+
+  if (is_aggregate(root)) {
+    ASTNode arguments = root->left, leaf = NULL;
+    if ((leaf = find_unbound_leaf(arguments->left->right, env, scope))) return leaf;
+    if ((leaf = find_unbound_leaf(arguments->right, env, scope))) return leaf;
+
+    tree_scope_t body = { arguments->left->left->token->data, scope };
+    return find_unbound_leaf(root->right, env, &body);
+  }
+
+  ASTNode leaf = find_unbound_leaf(root->left, env, scope);
+  return leaf ? leaf : find_unbound_leaf(root->right, env, scope);
+}
+
+
+/**
+ * @brief Finds the first variable of the tree which is not bound
+ * @details The index of an aggregate is bound in its body.
+ *
+ * @param root The root of the tree
+ * @param env The values of the variables, may be NULL
+ * @return The leaf of the variable, or NULL if all of them are bound
+ * @see Environment::find_variable
+ */
+ASTNode find_unbound_variable(ASTNode root, Environment env)
+{
+  return find_unbound_leaf(root, env, NULL);
+}
+
+
+/**
+ * @brief Collects the free variables of a subtree, in the order they appear
+ *
+ * @param root The root of the subtree
+ * @param variables Where to add the variables
+ * @param scope The indices of the aggregates around the subtree
+ */
+static void collect_free_variables(ASTNode root, Environment variables, const tree_scope_t *scope)
+{
+  if (!root) return;
+
+  if (is_aggregate(root)) {
+    ASTNode arguments = root->left;
+    collect_free_variables(arguments->left->right, variables, scope);
+    collect_free_variables(arguments->right, variables, scope);
+
+    tree_scope_t body = { arguments->left->left->token->data, scope };
+    collect_free_variables(root->right, variables, &body);
+    return;
+  }
+
+  collect_free_variables(root->left, variables, scope);
+  if (root->token->type == VARIABLE && !in_scope(scope, root->token->data)
+      && find_variable(variables, root->token->data) < 0)
+    set_variable(variables, root->token->data, 0.0);
+  collect_free_variables(root->right, variables, scope);
+}
+
+
+/**
+ * @brief Collects the variables of a tree, in the order they appear
+ * @details The variables are added to the environment, bound to 0, if they
+ *          are not there yet. The index of an aggregate is not a variable of
+ *          the tree, unless it also appears outside of the body.
+ *
+ * @param root The root of the tree
+ * @param variables Where to add the variables
+ * @see Environment::set_variable
+ */
+void collect_variables(ASTNode root, Environment variables)
+{
+  collect_free_variables(root, variables, NULL);
+}
@@ -1,7 +1,10 @@
 #ifndef AST_H
 #define AST_H
 
+#include <stddef.h>
+
 #include "../lexer/Token.h"
+#include "Environment.h"
 
 /**
  * @brief The tree node which holds the token and its children
@@ -23,8 +26,38 @@ typedef struct ast_t
 ASTNode create_ast_node(Token, ASTNode, ASTNode);
 
 /**
- * @brief Evaluates the parse tree
+ * @brief Creates a copy of a tree
+ */
+ASTNode clone_tree(ASTNode);
+
+/**
+ * @brief Applies the operator or the function of a node to its operands
+ */
+long double eval_node(ASTNode, long double, long double);
+
+/**
+ * @brief Evaluates the parse tree step by step
+ */
+ASTNode eval_tree(ASTNode, Environment);
+
+/**
+ * @brief Gets the arguments of a variadic call, in order
+ */
+size_t get_arguments(ASTNode, ASTNode*);
+
+/**
+ * @brief Computes the value of the parse tree
+ */
+long double eval_tree_value(ASTNode, Environment);
+
+/**
+ * @brief Finds the first variable of the tree which is not bound
+ */
+ASTNode find_unbound_variable(ASTNode, Environment);
+
+/**
+ * @brief Collects the variables of a tree, in the order they appear
  */
-ASTNode eval_tree(ASTNode);
+void collect_variables(ASTNode, Environment);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include <string.h>
+#include <strings.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/TokenArray.h"
+#include "Definition.h"
+#include "Parser.h"
+#include "NodePool.h"
+#include "Environment.h"
+
+
+/**
+ * The role of a variable of a body which is neither a parameter nor an
+ * index, until it is replaced by its value
+ */
+#define FREE_VARIABLE (DEFINITION_INDEX - 1)
+
+
+/**
+ * The user-defined functions, in the order of their definitions. They are
+ * defined once, before any evaluation starts, so the parsers only read them.
+ */
+static Definition *definitions = NULL;
+static size_t nbr_definitions = 0;
+
+
+/**
+ * @brief Records an error of a definition
+ *
+ * @param error Where to store the error
+ * @param message The reason of the error
+ * @param position The position of the error in the definition
+ * @return false
+ */
+static bool definition_error(ParseError error, const char *message, size_t position)
+{
+  error->message  = message;
+  error->position = position;
+
+  return false;
+}
+
+
+/**
+ * @brief Deletes a user-defined function
+ *
+ * @param definition The function to delete
+ */
+static void delete_definition(Definition definition)
+{
+  for (size_t k = 0; k < definition->nbr_parameters; ++k)
+    free(definition->parameters[k]);
+
+  if (definition->body) delete_node_pool(definition->body);
+  free(definition->parameters);
+  free(definition->roles);
+  free(definition->name);
+  free(definition);
+}
+
+
+/**
+ * @brief Copies the text of a token into a new string
+ *
+ * @param text The text the token was read from
+ * @param token The token
+ * @return The string
+ */
+static char *copy_lexeme(const char *text, const flat_token_t *token)
+{
+  char *copy = malloc(token->length + 1);
+  assert(copy != NULL);
+
+  memcpy(copy, text + token->offset, token->length);
+  copy[token->length] = '\0';
+
+  return copy;
+}
+
+
+/**
+ * @brief Parses the head of a definition: f '(' (x (',' x)*)? ')'
+ * @details The name must not be the one of a function, and the parameters
+ *          must have distinct names.
+ *
+ * @param definition Where to store the name and the parameters
+ * @param text The definition
+ * @param length The length of the head, up to its '='
+ * @param error Where to store the error if the head is malformed
+ * @return true if the head was parsed, false otherwise
+ */
+static bool parse_head(Definition definition, const char *text, size_t length, ParseError error)
+{
+  TokenArray array = create_token_array();
+  tokenize_expression(array, text, length);
+
+  const flat_token_t *tokens = array->tokens;
+  size_t size = array->size, i = 0;
+  bool parsed = false;
+
+  if (array->error) {
+    definition_error(error, array->error, array->error_position);
+  } else if (!size || tokens[0].type != VARIABLE) {
+    definition_error(error, size && tokens[0].type == FUNCTION ? "Already a function"
+                                                               : "Expected the name of the function",
+                     size ? tokens[0].offset : length);
+  } else if (find_definition(text + tokens[0].offset, tokens[0].length)) {
+    definition_error(error, "Already a function", tokens[0].offset);
+  } else if (size < 2 || tokens[1].type != LPARENTHESIS) {
+    definition_error(error, "Expected '(' after the function name",
+                     size < 2 ? length : tokens[1].offset);
+  } else {
+    definition->name = copy_lexeme(text, &tokens[0]);
+    definition->parameters = malloc(DEFINITION_PARAMETERS * sizeof(*definition->parameters));
+    assert(definition->parameters != NULL);
+
+    for (i = 2; i < size && tokens[i].type != RPARENTHESIS; ++i) {
+      if (definition->nbr_parameters && tokens[i++].type != FARGSEPARATOR) {
+        definition_error(error, "Expected ',' or ')' after a parameter", tokens[i - 1].offset);
+        break;
+      }
+      if (i == size || tokens[i].type != VARIABLE) {
+        definition_error(error, "Expected a parameter", i == size ? length : tokens[i].offset);
+        break;
+      }
+      if (definition->nbr_parameters == DEFINITION_PARAMETERS) {
+        definition_error(error, "Too many parameters", tokens[i].offset);
+        break;
+      }
+
+      char *parameter = copy_lexeme(text, &tokens[i]);
+      for (size_t k = 0; k < definition->nbr_parameters && parameter; ++k)
+        if (!strcmp(definition->parameters[k], parameter)) {
+          free(parameter);
+          parameter = NULL;
+        }
+
+      if (!parameter) {
+        definition_error(error, "Duplicate parameter", tokens[i].offset);
+        break;
+      }
+      definition->parameters[definition->nbr_parameters++] = parameter;
+    }
+
+    if (error->message) {
+      // The error of a parameter is recorded
+    } else if (i == size) {
+      definition_error(error, "Expected ')' after the parameters", length);
+    } else if (i + 1 < size) {
+      definition_error(error, "Expected '=' after the parameters", tokens[i + 1].offset);
+    } else {
+      parsed = true;
+    }
+  }
+
+  delete_token_array(array);
+
+  return parsed;
+}
+
+
+/**
+ * @brief Binds the variables of a body: to the parameters, to the indices
+ *        of its aggregates, or to their values
+ * @details A variable which is neither a parameter nor an index takes its
+ *          value in the environment at the time of the definition, and its
+ *          nodes become literals.
+ *
+ * @param definition The function, whose body was parsed
+ * @param tokens The tokens of the body
+ * @param offset The position of the body in the definition
+ * @param env The values of the variables, may be NULL
+ * @param error Where to store the error if a variable has no value
+ * @return true if the variables were bound, false otherwise
+ */
+static bool bind_body(Definition definition, TokenArray tokens, size_t offset, Environment env,
+                      ParseError error)
+{
+  NodePool body = definition->body;
+
+  definition->roles = malloc((body->nbr_variables + 1) * sizeof(*definition->roles));
+  assert(definition->roles != NULL);
+
+  for (size_t v = 0; v < body->nbr_variables; ++v) {
+    const char *name = body->variables[v];
+    uint32_t role = *name ? FREE_VARIABLE : DEFINITION_INDEX;
+
+    for (size_t k = 0; k < definition->nbr_parameters && role == FREE_VARIABLE; ++k)
+      if (!strcmp(definition->parameters[k], name)) role = (uint32_t)k;
+
+    definition->roles[v] = role;
+  }
+
+  for (size_t i = 0; i < body->size; ++i) {
+    pool_node_t *node = &body->nodes[i];
+    if (node->type != VARIABLE || definition->roles[node->value.variable] != FREE_VARIABLE)
+      continue;
+
+    const char *name = body->variables[node->value.variable];
+    if (!env || find_variable(env, name) < 0)
+      return definition_error(error, "Unbound variable",
+                              offset + tokens->tokens[node->token & ~POOL_INLINED].offset);
+
+    node->type = LITERAL;
+    node->value.number = get_variable(env, name);
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Defines a function from its definition: 'f(x, y) = expression'
+ * @details The body is parsed once, and a call of the function is parsed
+ *          into a copy of it where the parameters are the arguments of the
+ *          call, so it costs what writing the body inline would. The body
+ *          may call the functions defined before, but not the function
+ *          itself, so a function is never recursive. Its other variables
+ *          take their values in the environment now, like a -D value.
+ *
+ *          Must be called before the evaluations start.
+ *
+ * @param text The definition
+ * @param length The length of the definition
+ * @param env The values of the variables, may be NULL
+ * @param error Where to store the error if the definition is malformed
+ * @return true if the function was defined, false otherwise
+ * @see Parser::parse_token_range, Parser::parse_call
+ */
+bool define_function(const char *text, size_t length, Environment env, ParseError error)
+{
+  parse_error_t ignored;
+  if (!error) error = &ignored;
+
+  error->message  = NULL;
+  error->position = 0;
+
+  const char *equal = memchr(text, '=', length);
+  size_t head = equal ? (size_t)(equal - text) : length;
+
+  Definition definition = calloc(1, sizeof(*definition));
+  assert(definition != NULL);
+
+  if (!parse_head(definition, text, head, error)) {
+    delete_definition(definition);
+    return false;
+  }
+
+  if (!equal) {
+    delete_definition(definition);
+    return definition_error(error, "Expected '=' after the parameters", length);
+  }
+
+  definitions = realloc(definitions, (nbr_definitions + 1) * sizeof(*definitions));
+  assert(definitions != NULL);
+  definitions[nbr_definitions++] = definition;
+
+  size_t offset = head + 1;
+  TokenArray tokens = create_token_array();
+  tokenize_expression(tokens, text + offset, length - offset);
+
+  definition->body = parse_token_range(tokens, text + offset, 0, tokens->size, error, NULL);
+  if (!definition->body) error->position += offset;
+
+  bool defined = definition->body && bind_body(definition, tokens, offset, env, error);
+  if (!defined) delete_definition(definitions[--nbr_definitions]);
+
+  delete_token_array(tokens);
+
+  return defined;
+}
+
+
+/**
+ * @brief Returns the user-defined function of a given name
+ *
+ * @param name The name, in any case, like the names of the functions
+ * @param length The length of the name
+ * @return The function, whose body is NULL while it is defined, or NULL if
+ *         no function has this name
+ */
+Definition find_definition(const char *name, size_t length)
+{
+  for (size_t k = 0; k < nbr_definitions; ++k)
+    if (!strncasecmp(definitions[k]->name, name, length) && !definitions[k]->name[length])
+      return definitions[k];
+
+  return NULL;
+}
@@ -0,0 +1,52 @@
+#ifndef DEFINITION_H
+#define DEFINITION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Parser.h"
+#include "NodePool.h"
+#include "Environment.h"
+
+/**
+ * The largest number of parameters of a user-defined function
+ */
+#define DEFINITION_PARAMETERS 64
+
+/**
+ * The role of a variable of a body which is the index of an aggregate
+ */
+#define DEFINITION_INDEX UINT32_MAX
+
+/**
+ * @brief A user-defined function: its name, its parameters, and its body
+ *        parsed into a pool, which is inlined at each call
+ * @details The role of each variable of the body is the number of the
+ *          parameter it is, or DEFINITION_INDEX for the index of an
+ *          aggregate. The other variables were replaced by their values
+ *          when the function was defined. While the body is parsed, it is
+ *          NULL, so a call of the function in its own body is refused.
+ */
+typedef struct definition_t *Definition;
+typedef struct definition_t
+{
+  char *name;
+  char **parameters;
+  size_t nbr_parameters;
+
+  NodePool body;
+  uint32_t *roles;
+} definition_t;
+
+/**
+ * @brief Defines a function from its definition: 'f(x, y) = expression'
+ */
+bool define_function(const char*, size_t, Environment, ParseError);
+
+/**
+ * @brief Returns the user-defined function of a given name
+ */
+Definition find_definition(const char*, size_t);
+
+#endif
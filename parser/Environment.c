@@ -0,0 +1,107 @@
+#include <string.h>
+#include <math.h>
+
+#include "../CommonHeaders.h"
+#include "Environment.h"
+
+
+/**
+ * @brief Creates an empty environment
+ *
+ * @return The address of the created environment
+ */
+Environment create_environment(void)
+{
+  Environment env = malloc(sizeof(*env));
+  assert(env != NULL);
+
+  env->names    = NULL;
+  env->values   = NULL;
+  env->size     = 0;
+  env->capacity = 0;
+
+  return env;
+}
+
+
+/**
+ * @brief Binds a value to a variable
+ * @details If the variable is already bound, its value is replaced.
+ *
+ * @param env The environment
+ * @param name The name of the variable
+ * @param value The value to bind
+ */
+void set_variable(Environment env, const char *name, long double value)
+{
+  long index = find_variable(env, name);
+  if (index >= 0) {
+    env->values[index] = value;
+    return;
+  }
+
+  if (env->size == env->capacity) {
+    env->capacity = env->capacity ? 2 * env->capacity : 8;
+    env->names  = realloc(env->names, env->capacity * sizeof(*env->names));
+    env->values = realloc(env->values, env->capacity * sizeof(*env->values));
+    assert(env->names != NULL && env->values != NULL);
+  }
+
+  env->names[env->size] = malloc(strlen(name) + 1);
+  assert(env->names[env->size] != NULL);
+  strcpy(env->names[env->size], name);
+
+  env->values[env->size++] = value;
+}
+
+
+/**
+ * @brief Returns the index of a variable in the environment
+ * @details The variables keep their index as long as the environment
+ *          lives, in the order they were bound.
+ *
+ * @param env The environment, may be NULL
+ * @param name The name of the variable
+ * @return The index of the variable, or -1 if it is not bound
+ */
+long find_variable(Environment env, const char *name)
+{
+  if (!env) return -1;
+
+  for (size_t i = 0; i < env->size; ++i) {
+    if (!strcmp(env->names[i], name)) return (long)i;
+  }
+
+  return -1;
+}
+
+
+/**
+ * @brief Returns the value bound to a variable
+ *
+ * @param env The environment, may be NULL
+ * @param name The name of the variable
+ * @return The value of the variable, or NaN if it is not bound
+ */
+long double get_variable(Environment env, const char *name)
+{
+  long index = find_variable(env, name);
+
+  return index >= 0 ? env->values[index] : NAN;
+}
+
+
+/**
+ * @brief Deletes an environment
+ *
+ * @param env The environment to delete
+ */
+void delete_environment(Environment env)
+{
+  for (size_t i = 0; i < env->size; ++i)
+    free(env->names[i]);
+
+  free(env->names);
+  free(env->values);
+  free(env);
+}
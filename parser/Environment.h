@@ -0,0 +1,43 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include <stddef.h>
+
+/**
+ * @brief The values bound to the variables of the expressions
+ */
+typedef struct environment_t *Environment;
+typedef struct environment_t
+{
+  char **names;
+  long double *values;
+  size_t size;
+  size_t capacity;
+} environment_t;
+
+/**
+ * @brief Creates an empty environment
+ */
+Environment create_environment(void);
+
+/**
+ * @brief Binds a value to a variable
+ */
+void set_variable(Environment, const char*, long double);
+
+/**
+ * @brief Returns the index of a variable in the environment
+ */
+long find_variable(Environment, const char*);
+
+/**
+ * @brief Returns the value bound to a variable
+ */
+long double get_variable(Environment, const char*);
+
+/**
+ * @brief Deletes an environment
+ */
+void delete_environment(Environment);
+
+#endif
@@ -0,0 +1,374 @@
+#include <string.h>
+
+#include "../CommonHeaders.h"
+#include "../Probes.h"
+#include "NodePool.h"
+#include "../lexer/Operator.h"
+#include "../lexer/Function.h"
+#include "../lexer/Number.h"
+#include "Environment.h"
+#include "AST.h"
+#include "../eval/Apply.h"
+#include "../eval/Aggregate.h"
+#include "../eval/Driver.h"
+
+
+/**
+ * @brief An index variable in scope while a tree is added to a pool: the
+ *        variables of this name in the body of its aggregate are the index
+ */
+typedef struct pool_scope_t
+{
+  const char *name;
+  uint32_t variable;
+  const struct pool_scope_t *next;
+} pool_scope_t;
+
+
+/**
+ * @brief Creates an empty node pool
+ * @details The nodes of a pool are appended in post-order. Each node keeps
+ *          the index of the token it comes from, in the token array of its
+ *          expression.
+ *
+ * @param capacity The number of nodes to reserve, may be 0
+ * @return The address of the created pool
+ */
+NodePool create_node_pool(size_t capacity)
+{
+  NodePool pool = malloc(sizeof(*pool));
+  assert(pool != NULL);
+
+  pool->size     = 0;
+  pool->capacity = capacity ? capacity : 16;
+
+  pool->nodes  = malloc(pool->capacity * sizeof(*pool->nodes));
+  pool->values = malloc(pool->capacity * sizeof(*pool->values));
+  assert(pool->nodes != NULL && pool->values != NULL);
+  PROBE2(alloc, PROBE_POOL, pool->capacity * (sizeof(*pool->nodes) + sizeof(*pool->values)));
+
+  pool->variables     = NULL;
+  pool->bindings      = NULL;
+  pool->nbr_variables = 0;
+
+  return pool;
+}
+
+
+/**
+ * @brief Appends a node to the pool
+ * @details The children must already be in the pool, so the nodes are
+ *          stored in post-order. The value of the node is left to the caller.
+ *
+ * @param pool The pool
+ * @param type The type of the node
+ * @param token The index of the token the node comes from
+ * @param left The index of the left child, or POOL_NONE
+ * @param right The index of the right child, or POOL_NONE
+ * @return The index of the node
+ */
+uint32_t add_pool_node(NodePool pool, TokenType type, uint32_t token,
+                       uint32_t left, uint32_t right)
+{
+  assert(pool->size < POOL_NONE);
+
+  if (pool->size == pool->capacity) {
+    pool->capacity *= 2;
+    pool->nodes  = realloc(pool->nodes, pool->capacity * sizeof(*pool->nodes));
+    pool->values = realloc(pool->values, pool->capacity * sizeof(*pool->values));
+    assert(pool->nodes != NULL && pool->values != NULL);
+    PROBE2(alloc, PROBE_POOL, pool->capacity * (sizeof(*pool->nodes) + sizeof(*pool->values)));
+  }
+
+  pool_node_t *node = &pool->nodes[pool->size];
+  node->type  = type;
+  node->token = token;
+  node->left  = left;
+  node->right = right;
+  node->value.number = 0.0;
+
+  return (uint32_t)pool->size++;
+}
+
+
+/**
+ * @brief Releases the storage reserved beyond the nodes of the pool
+ *
+ * @param pool The pool, not empty
+ */
+void trim_node_pool(NodePool pool)
+{
+  assert(pool->size > 0);
+
+  pool->capacity = pool->size;
+  pool->nodes  = realloc(pool->nodes, pool->capacity * sizeof(*pool->nodes));
+  pool->values = realloc(pool->values, pool->capacity * sizeof(*pool->values));
+  assert(pool->nodes != NULL && pool->values != NULL);
+}
+
+
+/**
+ * @brief Returns the index of a variable of the pool, adding it if needed
+ *
+ * @param pool The pool
+ * @param name The name of the variable, not null-terminated
+ * @param length The length of the name
+ * @return The index of the variable
+ */
+uint32_t add_pool_variable(NodePool pool, const char *name, size_t length)
+{
+  for (size_t i = 0; i < pool->nbr_variables; ++i)
+    if (!strncmp(pool->variables[i], name, length) && !pool->variables[i][length])
+      return (uint32_t)i;
+
+  size_t n = pool->nbr_variables + 1;
+  pool->variables = realloc(pool->variables, n * sizeof(*pool->variables));
+  pool->bindings  = realloc(pool->bindings, n * sizeof(*pool->bindings));
+  assert(pool->variables != NULL && pool->bindings != NULL);
+
+  char *copy = malloc(length + 1);
+  assert(copy != NULL);
+  memcpy(copy, name, length);
+  copy[length] = '\0';
+
+  pool->variables[pool->nbr_variables] = copy;
+
+  return (uint32_t)pool->nbr_variables++;
+}
+
+
+/**
+ * @brief Adds the variable of the index of an aggregate to the pool
+ * @details Its name is empty, so it is never looked up in an environment:
+ *          it is bound by the aggregate while its body is evaluated.
+ *
+ * @param pool The pool
+ * @return The index of the variable
+ * @see NodePool::add_pool_variable
+ */
+uint32_t add_pool_index(NodePool pool)
+{
+  size_t n = pool->nbr_variables + 1;
+  pool->variables = realloc(pool->variables, n * sizeof(*pool->variables));
+  pool->bindings  = realloc(pool->bindings, n * sizeof(*pool->bindings));
+  assert(pool->variables != NULL && pool->bindings != NULL);
+
+  pool->variables[pool->nbr_variables] = calloc(1, 1);
+  assert(pool->variables[pool->nbr_variables] != NULL);
+
+  return (uint32_t)pool->nbr_variables++;
+}
+
+
+/**
+ * @brief Finds the first variable of the pool which is not bound
+ * @details The indices of the aggregates are bound by their aggregates.
+ *
+ * @param pool The pool
+ * @param env The values of the variables, may be NULL
+ * @return The name of the variable, or NULL if all of them are bound
+ * @see Environment::find_variable
+ */
+const char *find_unbound_pool_variable(NodePool pool, Environment env)
+{
+  for (size_t i = 0; i < pool->nbr_variables; ++i)
+    if (*pool->variables[i] && find_variable(env, pool->variables[i]) < 0)
+      return pool->variables[i];
+
+  return NULL;
+}
+
+
+/**
+ * @brief Computes the values of a range of nodes stored in post-order
+ * @details The nodes are evaluated in the order of the array: the values of
+ *          the children of a node are computed before it. A variadic
+ *          function reduces the values of its arguments at once. The body
+ *          of an aggregate is skipped when its arguments are reached: it is
+ *          only evaluated by the aggregate, with its index bound over its
+ *          range.
+ *
+ * @param nodes The nodes
+ * @param first The index of the first node of the range
+ * @param end The index past the last node of the range
+ * @param bindings The values of the variables, by index
+ * @param values Where to store the values of the nodes, one for each node
+ * @see Apply::eval_function_id, Operator::eval_operator,
+ *      Aggregate::eval_aggregate, Aggregate::eval_variadic, Driver::eval_driver
+ */
+void eval_pool_range(const pool_node_t *nodes, size_t first, size_t end,
+                     long double *bindings, long double *values)
+{
+  for (size_t i = first; i < end; ++i) {
+    const pool_node_t *node = &nodes[i];
+
+    long double lc = node->left == POOL_NONE ? 0.0 : values[node->left];
+    long double rc = node->right == POOL_NONE ? 0.0 : values[node->right];
+
+    switch (node->type) {
+      case LITERAL:       values[i] = node->value.number; break;
+      case VARIABLE:      values[i] = bindings[node->value.variable]; break;
+      case FARGSEPARATOR:
+                values[i] = rc;
+                if (node->value.aggregate > i && node->value.aggregate < end)
+                  i = node->value.aggregate - 1;
+                break;
+      case FUNCTION:
+                switch (get_function_id_type(node->value.function)) {
+                  case AGGREGATE:
+                            values[i] = is_driver(node->value.function)
+                                      ? eval_driver(nodes, (uint32_t)i, bindings, values)
+                                      : eval_aggregate(nodes, (uint32_t)i, bindings, values);
+                            break;
+                  case VARIADIC:
+                            values[i] = eval_variadic(nodes, (uint32_t)i, values);
+                            break;
+                  default:
+                            values[i] = eval_function_id(node->value.function, lc, rc);
+                            break;
+                }
+                break;
+      default:            values[i] = eval_operator(node->type, lc, rc); break;
+    }
+  }
+}
+
+
+/**
+ * @brief Computes the value of a tree stored in post-order in an array
+ *
+ * @param nodes The nodes, the root is the last one
+ * @param size The number of nodes, not 0
+ * @param bindings The values of the variables, by index; those of the
+ *        indices of the aggregates are changed
+ * @param values Where to store the values of the nodes, one for each node
+ * @return The value of the root
+ * @see NodePool::eval_pool_range
+ */
+long double eval_pool_nodes(const pool_node_t *nodes, size_t size,
+                            long double *bindings, long double *values)
+{
+  assert(size > 0);
+
+  eval_pool_range(nodes, 0, size, bindings, values);
+
+  return values[size - 1];
+}
+
+
+/**
+ * @brief Computes the value of the tree stored in the pool
+ * @details The variables are looked up once, then the nodes are evaluated
+ *          by a forward scan of the pool. The values are kept in the pool,
+ *          so the evaluation doesn't allocate, and a pool must not be
+ *          evaluated by two threads at once.
+ *
+ *          A variable which is not bound evaluates to NaN.
+ *
+ * @param pool The pool, not empty
+ * @param env The values of the variables, may be NULL
+ * @return The value of the root
+ * @see NodePool::eval_pool_nodes, Environment::get_variable
+ */
+long double eval_pool(NodePool pool, Environment env)
+{
+  for (size_t i = 0; i < pool->nbr_variables; ++i)
+    pool->bindings[i] = get_variable(env, pool->variables[i]);
+
+  return eval_pool_nodes(pool->nodes, pool->size, pool->bindings, pool->values);
+}
+
+
+/**
+ * @brief Appends the nodes of a tree to a pool, in post-order
+ * @details The index of an aggregate is in scope in its body only.
+ *
+ * @param pool The pool
+ * @param root The root of the tree
+ * @param scope The indices of the aggregates around the tree
+ * @return The index of the root, or POOL_NONE if the tree is empty
+ * @see NodePool::add_pool_node, Number::parse_number
+ */
+static uint32_t add_tree(NodePool pool, ASTNode root, const pool_scope_t *scope)
+{
+  if (!root) return POOL_NONE;
+
+  TokenType type = root->token->type;
+  const char *data = root->token->data;
+
+  uint32_t left = POOL_NONE, right = POOL_NONE;
+  bool aggregate = type == FUNCTION && get_function_type(root->token->data) == AGGREGATE;
+  if (aggregate) {
+    // The arguments are ','(','(index, lo), hi), the index gets its own variable
+    ASTNode arguments = root->left;
+    uint32_t variable = add_pool_index(pool);
+
+    uint32_t leaf = add_pool_node(pool, VARIABLE, POOL_NONE, POOL_NONE, POOL_NONE);
+    pool->nodes[leaf].value.variable = variable;
+
+    uint32_t lo = add_tree(pool, arguments->left->right, scope);
+    uint32_t bounds = add_pool_node(pool, FARGSEPARATOR, POOL_NONE, leaf, lo);
+    uint32_t hi = add_tree(pool, arguments->right, scope);
+    left = add_pool_node(pool, FARGSEPARATOR, POOL_NONE, bounds, hi);
+
+    pool_scope_t body = { arguments->left->left->token->data, variable, scope };
+    right = add_tree(pool, root->right, &body);
+  } else {
+    left  = add_tree(pool, root->left, scope);
+    right = add_tree(pool, root->right, scope);
+  }
+
+  uint32_t index = add_pool_node(pool, type, POOL_NONE, left, right);
+  pool_node_t *node = &pool->nodes[index];
+
+  if (type == LITERAL) {
+    node->value.number = parse_number(data, strlen(data));
+  } else if (type == VARIABLE) {
+    while (scope && strcmp(scope->name, data)) scope = scope->next;
+    node->value.variable = scope ? scope->variable : add_pool_variable(pool, data, strlen(data));
+  } else if (type == FUNCTION) {
+    node->value.function = ((Function)root->token->data)->id;
+  }
+
+  if (aggregate) pool->nodes[left].value.aggregate = index;
+
+  return index;
+}
+
+
+/**
+ * @brief Creates a node pool from a tree
+ * @details The nodes don't come from a token array, their token is POOL_NONE.
+ *
+ * @param root The root of the tree
+ * @return The address of the created pool
+ * @see NodePool::trim_node_pool
+ */
+NodePool create_pool_from_tree(ASTNode root)
+{
+  assert(root != NULL);
+
+  NodePool pool = create_node_pool(0);
+  add_tree(pool, root, NULL);
+  trim_node_pool(pool);
+
+  return pool;
+}
+
+
+/**
+ * @brief Deletes a node pool
+ *
+ * @param pool The pool to delete
+ */
+void delete_node_pool(NodePool pool)
+{
+  for (size_t i = 0; i < pool->nbr_variables; ++i)
+    free(pool->variables[i]);
+
+  free(pool->variables);
+  free(pool->bindings);
+  free(pool->values);
+  free(pool->nodes);
+  free(pool);
+}
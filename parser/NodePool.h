@@ -0,0 +1,135 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../lexer/Token.h"
+#include "../lexer/Function.h"
+#include "Environment.h"
+#include "AST.h"
+
+/**
+ * The index of a missing child
+ */
+#define POOL_NONE UINT32_MAX
+
+/**
+ * The flag of the token of a node inlined from the body of a user-defined
+ * function: the other bits are the token of the call
+ */
+#define POOL_INLINED 0x80000000u
+
+/**
+ * @brief A node of the pool: its children are indices in the pool, and its
+ *        operand or function is stored inline
+ */
+typedef struct pool_node_t
+{
+  TokenType type;
+  uint32_t token;
+  uint32_t left;
+  uint32_t right;
+  union
+  {
+    long double number;
+    FunctionID function;
+    uint32_t variable;
+    uint32_t aggregate;
+  } value;
+} pool_node_t;
+
+/**
+ * @brief The nodes of a parse tree, stored in post-order in one array
+ * @details The children of a node come before it, and the root is the last
+ *          node, so the tree is evaluated by a forward scan of the array.
+ *          The variables are stored once, and the nodes refer to them by
+ *          index. The index variable of an aggregate has its own variable,
+ *          with an empty name, so it never clashes with a variable of the
+ *          same name outside of the aggregate.
+ *
+ *          An aggregate sum(i, lo, hi, body) is stored as:
+ *            i, lo..., ',', hi..., ',', body..., sum
+ *          its left child is the second ',', so its body is the range of
+ *          nodes from its left child (excluded) to its right child. That
+ *          ',' holds the index of the aggregate in value.aggregate, so a
+ *          scan of the array skips the body, which only the aggregate
+ *          evaluates. A driver integrate(body, x, a, b) is stored the same
+ *          way.
+ *
+ *          The arguments of a variadic call max(a, b, c, d) are stored as:
+ *            a..., b..., ',', c..., d..., ',', max
+ *          they are the leaves of a balanced tree of ',' nodes, whose root
+ *          is the call; a call of one argument has no left child. The
+ *          value of these ',' nodes, as of the other ones, is 0.
+ */
+typedef struct node_pool_t *NodePool;
+typedef struct node_pool_t
+{
+  pool_node_t *nodes;
+  size_t size;
+  size_t capacity;
+
+  char **variables;
+  size_t nbr_variables;
+
+  long double *values;
+  long double *bindings;
+} node_pool_t;
+
+/**
+ * @brief Creates an empty node pool
+ */
+NodePool create_node_pool(size_t);
+
+/**
+ * @brief Appends a node to the pool
+ */
+uint32_t add_pool_node(NodePool, TokenType, uint32_t, uint32_t, uint32_t);
+
+/**
+ * @brief Releases the storage reserved beyond the nodes of the pool
+ */
+void trim_node_pool(NodePool);
+
+/**
+ * @brief Returns the index of a variable of the pool, adding it if needed
+ */
+uint32_t add_pool_variable(NodePool, const char*, size_t);
+
+/**
+ * @brief Adds the variable of the index of an aggregate to the pool
+ */
+uint32_t add_pool_index(NodePool);
+
+/**
+ * @brief Finds the first variable of the pool which is not bound
+ */
+const char *find_unbound_pool_variable(NodePool, Environment);
+
+/**
+ * @brief Computes the values of a range of nodes stored in post-order
+ */
+void eval_pool_range(const pool_node_t*, size_t, size_t, long double*, long double*);
+
+/**
+ * @brief Computes the value of a tree stored in post-order in an array
+ */
+long double eval_pool_nodes(const pool_node_t*, size_t, long double*, long double*);
+
+/**
+ * @brief Computes the value of the tree stored in the pool
+ */
+long double eval_pool(NodePool, Environment);
+
+/**
+ * @brief Creates a node pool from a tree
+ */
+NodePool create_pool_from_tree(ASTNode);
+
+/**
+ * @brief Deletes a node pool
+ */
+void delete_node_pool(NodePool);
+
+#endif
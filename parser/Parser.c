@@ -1,130 +1,1148 @@
-#include <stdio.h>
-#include <stdlib.h>
+#include <string.h>
 
+#include "../CommonHeaders.h"
+#include "../Probes.h"
 #include "../lexer/Token.h"
-#include "../lexer/List.h"
+#include "../lexer/TokenArray.h"
 #include "../lexer/Operator.h"
+#include "../lexer/Function.h"
+#include "../lexer/Number.h"
+#include "../eval/Limits.h"
 
-#include "Stack.h"
+#include "Parser.h"
 #include "AST.h"
+#include "NodePool.h"
+#include "Definition.h"
 
 
 /**
- * @brief Creates a parse tree from a list of tokens
- * @details Implementing the shunting yard algorithm.
+ * @brief The index of an aggregate, in scope while its body is parsed
+ */
+typedef struct parser_scope_t
+{
+  const char *name;
+  size_t length;
+  uint32_t variable;
+  const struct parser_scope_t *next;
+} parser_scope_t;
+
+/**
+ * @brief The parser state: the tokens of the expression, the one read ahead,
+ *        and the pool where the nodes are stored
+ * @details depth counts the nested calls of parse_binary, which every
+ *          nesting of the expression goes through, up to max_depth.
+ */
+typedef struct parser_t
+{
+  TokenArray tokens;
+  size_t next;
+  size_t end;
+  const flat_token_t *current;
+  size_t position;
+  NodePool pool;
+  GroupArray groups;
+  ParseError error;
+  const char *input;
+  const parser_scope_t *scope;
+  size_t depth;
+  size_t max_depth;
+} parser_t, *Parser;
+
+
+/**
+ * @brief Records a syntax error
+ * @details Only the first error is kept, the following ones are only
+ *          consequences of it.
  *
- *          While there are tokens to be read:
- *            1. Read the token
- *            2. If it's a literal token, push it on the output stack.
- *            3. If it's a function token, push it on the operators stack.
- *            4. If it's a function argument separator, pop operators off the
- *               the stack, add their operands to them and then push them onto
- *               the output stack until a left parenthesis is encountered.
- *            5. If it's an operator: if the operator is associative and has
- *               lesser precedence than the operator below it on the operators
- *               stack, pop the lower operator off the operators stack, add
- *               their operands to it and push it to the output stack.
- *            6. If it's a left parenthesis, push it onto the operators stack
- *            7. If it's a right parenthesis, pop operators off the operators
- *               stack, add their operands to them and then push them onto the
- *               output stack until a left parenthesis is encountered.
+ * @param parser The parser
+ * @param message The reason of the error
+ * @param position The position of the error in the expression
+ */
+static void syntax_error(Parser parser, const char *message, size_t position)
+{
+  if (!parser->error->message) {
+    parser->error->message  = message;
+    parser->error->position = position;
+  }
+}
+
+
+/**
+ * @brief Moves to the next token of the array
+ * @details Past the last token of the range, the current token is NULL.
+ *          If the lexer stopped on an error, it is reported when the parser
+ *          reaches it, so the errors are found in the order of the expression.
  *
- *               If the top of the operators stack is a function token, add
- *               the operands to it, and then push it onto the output stack.
+ * @param parser The parser
+ * @return The token which was read ahead
+ */
+static const flat_token_t *advance(Parser parser)
+{
+  const flat_token_t *token = parser->current;
+  TokenArray tokens = parser->tokens;
+
+  if (parser->next < parser->end) {
+    parser->current  = &tokens->tokens[parser->next++];
+    parser->position = parser->current->offset;
+  } else {
+    parser->current = NULL;
+    if (parser->end == tokens->size && tokens->error) {
+      parser->position = tokens->error_position;
+      syntax_error(parser, tokens->error, tokens->error_position);
+    } else {
+      parser->position = parser->end
+                       ? tokens->tokens[parser->end - 1].offset + tokens->tokens[parser->end - 1].length
+                       : 0;
+    }
+  }
+
+  return token;
+}
+
+
+/**
+ * @brief Appends the node of a token to the pool
  *
- *            When there are no more tokens to read, pop operators off add
- *            their operands to them and then push them onto the output stack.
+ * @param parser The parser
+ * @param token The token of the node
+ * @param left The index of the left child, or POOL_NONE
+ * @param right The index of the right child, or POOL_NONE
+ * @return The index of the node
+ * @see NodePool::add_pool_node
+ */
+static uint32_t add_node(Parser parser, const flat_token_t *token, uint32_t left, uint32_t right)
+{
+  uint32_t index = add_pool_node(parser->pool, token->type,
+                                 (uint32_t)(token - parser->tokens->tokens), left, right);
+
+  if (token->type == LITERAL)
+    parser->pool->nodes[index].value.number = token->value.number;
+  else if (token->type == FUNCTION)
+    parser->pool->nodes[index].value.function = token->value.function;
+
+  return index;
+}
+
+
+/**
+ * @brief Returns the index of the current token in the array
  *
- * @param list The list of tokens
- * @return The root of the parse tree
- * @see Stack, Stack::create_stack, Token, Token::get_type, Token::clone_token,
- *      ASTNode::create_ast_node, Stack::add_operand_to_operator, List, Operator
+ * @param parser The parser
+ * @return The index, or the end of the range past its last token
  */
-ASTNode parse_expression(List list)
+static size_t current_index(Parser parser)
 {
-  if (!list) return NULL;
+  return parser->current ? (size_t)(parser->current - parser->tokens->tokens) : parser->end;
+}
 
-  Stack output = create_stack();
-  Stack operators = create_stack();
 
-  TokenNode ptr = list->head;
-  while (ptr) {
-    if (get_type(ptr->data) == LITERAL) {
+/**
+ * @brief Records a parenthesized group or a function call, if the groups
+ *        are asked
+ *
+ * @param parser The parser
+ * @param first The index of its first token: '(' or the function name
+ * @param last The index of its ')'
+ * @param node The index of the node it was parsed into
+ */
+static void add_group(Parser parser, size_t first, size_t last, uint32_t node)
+{
+  GroupArray groups = parser->groups;
+  if (!groups) return;
 
-      ASTNode node = create_ast_node(clone_token(ptr->data), NULL, NULL);
-      output->push(output, node, ASTNODE);
+  if (groups->size == groups->capacity) {
+    groups->capacity = groups->capacity ? 2 * groups->capacity : 16;
+    groups->groups = realloc(groups->groups, groups->capacity * sizeof(*groups->groups));
+    assert(groups->groups != NULL);
+  }
 
-    } else if (get_type(ptr->data) == FUNCTION) {
+  parse_group_t *group = &groups->groups[groups->size++];
+  group->first = first;
+  group->last  = last;
+  group->node  = node;
+}
 
-      operators->push(operators, clone_token(ptr->data), TOKEN);
 
-    } else if (get_type(ptr->data) == FARGSEPARATOR) {
+/**
+ * @brief Consumes the current token if it has a given type
+ *
+ * @param parser The parser
+ * @param type The expected type
+ * @param message The reason of the error if the type doesn't match
+ * @return true if the token was consumed, false otherwise
+ */
+static bool expect(Parser parser, TokenType type, const char *message)
+{
+  if (!parser->current || parser->current->type != type) {
+    syntax_error(parser, message, parser->position);
+    return false;
+  }
 
-      while (operators->top(operators)
-        && get_type(operators->top(operators)) != LPARENTHESIS) {
-        add_operand_to_operator(output, operators);
-      }
+  advance(parser);
 
-    } else if (is_operator(get_type(ptr->data))) {
+  return true;
+}
 
-      while (!(operators->is_empty(operators))
-          && is_operator(get_type(operators->top(operators)))) {
 
-        Token temp = operators->top(operators);
-        AssocType asso = ((Operator)ptr->data->data)->associativity;
-        unsigned int prec1 = ((Operator)ptr->data->data)->precedence;
-        unsigned int prec2 = ((Operator)temp->data)->precedence;
+static uint32_t parse_binary(Parser, unsigned int);
 
-        if ((asso == LEFT && prec1 <= prec2) || (asso == RIGHT && prec1 < prec2)) {
-          add_operand_to_operator(output, operators);
-        } else {
-          break;
-        }
-      }
 
-      operators->push(operators, clone_token(ptr->data), TOKEN);
+/**
+ * @brief Parses the index and the bounds of an aggregate
+ * @details The index is a variable of its own, in scope in the body only, so
+ *          the bounds and the expression around the aggregate don't see it:
+ *            index ',' expression ',' expression
+ *          They are the left child of the aggregate: ','(','(index, lo), hi).
+ *
+ * @param parser The parser, on the index
+ * @param scope Where to store the scope of the index, for the body
+ * @param arguments Where to store the index of the index and the bounds
+ * @return true if they were parsed, false if an error has occurred
+ * @see NodePool::add_pool_index
+ */
+static bool parse_bounds(Parser parser, parser_scope_t *scope, uint32_t *arguments)
+{
+  if (!parser->current || parser->current->type != VARIABLE) {
+    syntax_error(parser, "Expected the index variable of the aggregate", parser->position);
+    return false;
+  }
 
-    } else if (get_type(ptr->data) == LPARENTHESIS) {
+  const flat_token_t *name = advance(parser);
+  scope->name     = parser->input + name->offset;
+  scope->length   = name->length;
+  scope->variable = add_pool_index(parser->pool);
+  scope->next     = parser->scope;
 
-      operators->push(operators, clone_token(ptr->data), TOKEN);
+  uint32_t index = add_node(parser, name, POOL_NONE, POOL_NONE);
+  parser->pool->nodes[index].value.variable = scope->variable;
 
-    } else if (get_type(ptr->data) == RPARENTHESIS) {
+  for (int bound = 0; bound < 2; ++bound) {
+    const flat_token_t *separator = parser->current;
+    if (!expect(parser, FARGSEPARATOR, "Expected ',' between the function arguments"))
+      return false;
 
-      while (operators->top(operators)
-          && get_type(operators->top(operators)) != LPARENTHESIS) {
-        add_operand_to_operator(output, operators);
-      }
+    uint32_t value = parse_binary(parser, 0);
+    if (value == POOL_NONE) return false;
+
+    index = add_node(parser, separator, index, value);
+  }
+  *arguments = index;
+
+  return true;
+}
+
+
+/**
+ * @brief Parses the arguments of an aggregate, after its '('
+ * @details The index and the bounds come first, then the body:
+ *            index ',' expression ',' expression ',' expression
+ *          The index and the bounds are the left child of the aggregate:
+ *          ','(','(index, lo), hi), and the body is its right child.
+ *
+ * @param parser The parser
+ * @param arguments Where to store the index of the index and the bounds
+ * @param body Where to store the index of the body
+ * @return true if the arguments were parsed, false if an error has occurred
+ * @see Parser::parse_bounds
+ */
+static bool parse_aggregate(Parser parser, uint32_t *arguments, uint32_t *body)
+{
+  parser_scope_t scope;
+  if (!parse_bounds(parser, &scope, arguments)) return false;
+
+  if (!expect(parser, FARGSEPARATOR, "Expected ',' between the function arguments"))
+    return false;
+
+  parser->scope = &scope;
+  *body = parse_binary(parser, 0);
+  parser->scope = scope.next;
+
+  return *body != POOL_NONE;
+}
+
+
+/**
+ * @brief Moves the parser to a token of its range
+ *
+ * @param parser The parser
+ * @param index The index of the token, or the end of the range
+ */
+static void seek(Parser parser, size_t index)
+{
+  parser->next = index;
+  advance(parser);
+}
+
+
+/**
+ * @brief Parses the arguments of a driver, after its '('
+ * @details The body of solve and integrate comes first, and its index
+ *          after it:
+ *            expression ',' index ',' expression ',' expression
+ *          The nodes are laid out like those of the other aggregates, the
+ *          body right before the call, so the ',' which ends the body is
+ *          looked ahead, the index and the bounds are parsed from there,
+ *          then the body, with the index in scope. If the bounds are
+ *          malformed, the body is parsed for an error before theirs.
+ *
+ * @param parser The parser
+ * @param arguments Where to store the index of the index and the bounds
+ * @param body Where to store the index of the body
+ * @return true if the arguments were parsed, false if an error has occurred
+ * @see Parser::parse_bounds, Driver::eval_driver
+ */
+static bool parse_driver(Parser parser, uint32_t *arguments, uint32_t *body)
+{
+  const flat_token_t *tokens = parser->tokens->tokens;
+  size_t first = current_index(parser), separator = first, depth = 0;
+
+  for (; separator < parser->end; ++separator) {
+    if (tokens[separator].type == LPARENTHESIS) {
+      ++depth;
+    } else if (tokens[separator].type == RPARENTHESIS) {
+      if (!depth) break;
+      --depth;
+    } else if (tokens[separator].type == FARGSEPARATOR && !depth) {
+      break;
+    }
+  }
+
+  if (separator == parser->end || tokens[separator].type != FARGSEPARATOR) {
+    // Without a ',', the body is parsed as it is, up to the error
+    if (parse_binary(parser, 0) != POOL_NONE)
+      expect(parser, FARGSEPARATOR, "Expected ',' between the function arguments");
+    return false;
+  }
+
+  parser_scope_t scope;
+  seek(parser, separator + 1);
+  if (!parse_bounds(parser, &scope, arguments)) {
+    // An error in the body comes first in the expression
+    parse_error_t bounds = *parser->error;
+    parser->error->message = NULL;
+
+    seek(parser, first);
+    if (parse_binary(parser, 0) != POOL_NONE && current_index(parser) != separator)
+      syntax_error(parser, "Expected ',' between the function arguments", parser->position);
+
+    if (!parser->error->message) *parser->error = bounds;
+    return false;
+  }
+
+  size_t last = current_index(parser);
+  seek(parser, first);
+
+  parser->scope = &scope;
+  *body = parse_binary(parser, 0);
+  parser->scope = scope.next;
+  if (*body == POOL_NONE) return false;
+
+  if (current_index(parser) != separator) {
+    syntax_error(parser, "Expected ',' between the function arguments", parser->position);
+    return false;
+  }
+
+  seek(parser, last);
+
+  return true;
+}
+
+
+/**
+ * @brief Parses the arguments of a variadic call after its second one
+ * @details The arguments are joined into a balanced tree of ',' nodes:
+ *          like the digits of a binary counter, the two last trees are
+ *          joined when they have the same height and a new argument comes,
+ *          and the trees left at the ')' are joined from the last one.
+ *          It is kept apart from Parser::parse_variadic, so that the calls
+ *          of one or two arguments, which are nested as deep as the
+ *          expression, do not pay for its stack.
+ *
+ * @param parser The parser, after the ',' which follows the second argument
+ * @param arguments The first and second arguments
+ * @param commas The ',' after each of them
+ * @param left Where to store the index of the left child of the call
+ * @param right Where to store the index of the right child of the call
+ * @return true if the arguments were parsed, false if an error has occurred
+ */
+__attribute__((noinline))
+static bool parse_more_arguments(Parser parser, const uint32_t arguments[2],
+                                 const flat_token_t *const commas[2], uint32_t *left, uint32_t *right)
+{
+  uint32_t trees[64] = { arguments[0], arguments[1] };
+  unsigned char heights[64] = { 0, 0 };
+  const flat_token_t *separators[64] = { commas[0], commas[1] };
+  size_t nbr_trees = 2;
+
+  while (true) {
+    while (nbr_trees >= 2 && heights[nbr_trees - 1] == heights[nbr_trees - 2]) {
+      --nbr_trees;
+      trees[nbr_trees - 1] = add_node(parser, separators[nbr_trees - 1],
+                                      trees[nbr_trees - 1], trees[nbr_trees]);
+      ++heights[nbr_trees - 1];
+      separators[nbr_trees - 1] = separators[nbr_trees];
+    }
+
+    uint32_t argument = parse_binary(parser, 0);
+    if (argument == POOL_NONE) return false;
+
+    trees[nbr_trees] = argument;
+    heights[nbr_trees++] = 0;
+
+    if (!parser->current || parser->current->type != FARGSEPARATOR) break;
+    separators[nbr_trees - 1] = advance(parser);
+  }
+
+  while (nbr_trees > 2) {
+    --nbr_trees;
+    trees[nbr_trees - 1] = add_node(parser, separators[nbr_trees - 1],
+                                    trees[nbr_trees - 1], trees[nbr_trees]);
+  }
+
+  *left  = trees[0];
+  *right = trees[1];
+
+  return true;
+}
 
-      operators->pop(operators);
 
-      if (operators->top(operators)
-       && get_type(operators->top(operators)) == FUNCTION) {
-        add_operand_to_operator(output, operators);
+/**
+ * @brief Parses the arguments of a variadic function, after its '('
+ * @details The arguments are the leaves of a balanced tree of ',' nodes,
+ *          read from left to right, whose root is the call itself, so the
+ *          tree is as deep as the logarithm of the number of arguments:
+ *            max(a)          -> max(a)
+ *            max(a, b)       -> max(a, b)
+ *            max(a, b, c, d) -> max(','(a, b), ','(c, d))
+ *
+ * @param parser The parser
+ * @param left Where to store the index of the left child of the call, or
+ *        POOL_NONE if there is only one argument
+ * @param right Where to store the index of the right child of the call
+ * @return true if the arguments were parsed, false if an error has occurred
+ * @see Parser::parse_more_arguments
+ */
+static bool parse_variadic(Parser parser, uint32_t *left, uint32_t *right)
+{
+  uint32_t arguments[2];
+  const flat_token_t *commas[2];
+  if ((arguments[0] = parse_binary(parser, 0)) == POOL_NONE) return false;
+
+  if (!parser->current || parser->current->type != FARGSEPARATOR) {
+    *left  = POOL_NONE;
+    *right = arguments[0];
+    return true;
+  }
+
+  commas[0] = advance(parser);
+  if ((arguments[1] = parse_binary(parser, 0)) == POOL_NONE) return false;
+
+  if (parser->current && parser->current->type == FARGSEPARATOR) {
+    commas[1] = advance(parser);
+    return parse_more_arguments(parser, arguments, commas, left, right);
+  }
+
+  *left  = arguments[0];
+  *right = arguments[1];
+
+  return true;
+}
+
+
+/**
+ * @brief Counts the arguments of a call, from the tokens between its
+ *        parentheses
+ *
+ * @param parser The parser
+ * @param first The index of the '(' of the call
+ * @param last The index of the ')' of the call
+ * @return The number of arguments
+ */
+static size_t count_arguments(Parser parser, size_t first, size_t last)
+{
+  const flat_token_t *tokens = parser->tokens->tokens;
+  unsigned int depth = 0;
+  size_t count = 1;
+
+  for (size_t i = first + 1; i < last; ++i) {
+    if (tokens[i].type == LPARENTHESIS) ++depth;
+    else if (tokens[i].type == RPARENTHESIS) --depth;
+    else if (tokens[i].type == FARGSEPARATOR && !depth) ++count;
+  }
+
+  return count;
+}
+
+
+/**
+ * @brief Parses the arguments of a function, and appends its node
+ * @details A unary function takes its argument as the right child, and
+ *          a variadic function takes any number of arguments:
+ *                     func '(' expression (',' expression)* ')'
+ *          An aggregate takes an index, its bounds and a body:
+ *                     func '(' variable ',' expression ',' expression ','
+ *                              expression ')'
+ *          and a driver its body first:
+ *                     func '(' expression ',' variable ',' expression ','
+ *                              expression ')'
+ *          A function of a plugin is parsed like a variadic function, and
+ *          must have the number of arguments it takes.
+ *
+ * @param parser The parser
+ * @param token The function token
+ * @return The index of the function call, or POOL_NONE if an error has occurred
+ * @see Parser::parse_variadic, Parser::parse_aggregate, Parser::parse_driver
+ */
+static uint32_t parse_function(Parser parser, const flat_token_t *token)
+{
+  uint32_t left = POOL_NONE, right = POOL_NONE;
+  FunctionType type = get_function_id_type(token->value.function);
+
+  if (!expect(parser, LPARENTHESIS, "Expected '(' after the function name"))
+    return POOL_NONE;
+
+  switch (type) {
+    case AGGREGATE:
+              if (is_driver(token->value.function) ? !parse_driver(parser, &left, &right)
+                                                   : !parse_aggregate(parser, &left, &right))
+                return POOL_NONE;
+              break;
+    case VARIADIC:
+              if (!parse_variadic(parser, &left, &right)) return POOL_NONE;
+              break;
+    default:
+              if ((right = parse_binary(parser, 0)) == POOL_NONE) return POOL_NONE;
+              break;
+  }
+
+  size_t first = (size_t)(token - parser->tokens->tokens), last = current_index(parser);
+  if (!expect(parser, RPARENTHESIS, "Expected ')' after the function arguments"))
+    return POOL_NONE;
+
+  FunctionID function = token->value.function;
+  if (is_plugin(function) && count_arguments(parser, first + 1, last) != get_plugin_arity(function)) {
+    syntax_error(parser, "Wrong number of arguments", token->offset);
+    return POOL_NONE;
+  }
+
+  uint32_t node = add_node(parser, token, left, right);
+  if (type == AGGREGATE) parser->pool->nodes[left].value.aggregate = node;
+  add_group(parser, first, last, node);
+
+  return node;
+}
+
+
+/**
+ * @brief Returns the parameter a node of the body of a user-defined
+ *        function stands for
+ *
+ * @param definition The function
+ * @param node The node of its body
+ * @return The number of the parameter, or DEFINITION_INDEX if the node is
+ *         not a parameter
+ */
+static uint32_t get_parameter(Definition definition, const pool_node_t *node)
+{
+  return node->type == VARIABLE ? definition->roles[node->value.variable] : DEFINITION_INDEX;
+}
+
+
+/**
+ * @brief Appends a copy of the body of a user-defined function, whose
+ *        parameters are the arguments of a call
+ * @details Each parameter is replaced by a copy of the nodes of its
+ *          argument, and each index of an aggregate of the body by a new
+ *          index, so the copy is parsed as if the body were written in
+ *          place of the call. The other nodes are marked as inlined from
+ *          the call. The arguments themselves are removed afterwards, so
+ *          the pool is left in post-order, and the ',' which skip the body
+ *          of an aggregate are given the new index of their aggregate.
+ *
+ * @param parser The parser
+ * @param definition The function
+ * @param call The index of the token of the name of the call
+ * @param firsts The index of the first node of each argument
+ * @param roots The index of the root of each argument
+ * @return The index of the root of the copy
+ */
+static uint32_t inline_body(Parser parser, Definition definition, uint32_t call,
+                            const uint32_t *firsts, const uint32_t *roots)
+{
+  NodePool pool = parser->pool, body = definition->body;
+  size_t start = firsts[0], end = pool->size;
+
+  uint32_t *copies = malloc(body->size * sizeof(*copies));
+  uint32_t *variables = malloc((body->nbr_variables + 1) * sizeof(*variables));
+  assert(copies != NULL && variables != NULL);
+
+  for (size_t v = 0; v < body->nbr_variables; ++v)
+    if (definition->roles[v] == DEFINITION_INDEX) variables[v] = add_pool_index(pool);
+
+  for (size_t i = 0; i < body->size; ++i) {
+    const pool_node_t *node = &body->nodes[i];
+    uint32_t role = get_parameter(definition, node);
+
+    if (role != DEFINITION_INDEX) {
+      uint32_t offset = (uint32_t)pool->size - firsts[role];
+      for (uint32_t j = firsts[role]; j <= roots[role]; ++j) {
+        pool_node_t copy = pool->nodes[j];
+        uint32_t index = add_pool_node(pool, copy.type, copy.token,
+                                       copy.left == POOL_NONE ? POOL_NONE : copy.left + offset,
+                                       copy.right == POOL_NONE ? POOL_NONE : copy.right + offset);
+        pool->nodes[index].value = copy.value;
+        if (copy.type == FARGSEPARATOR && copy.value.aggregate)
+          pool->nodes[index].value.aggregate += offset;
       }
+      copies[i] = (uint32_t)pool->size - 1;
+      continue;
     }
 
-    ptr = ptr->next;
+    copies[i] = add_pool_node(pool, node->type, POOL_INLINED | call,
+                              node->left == POOL_NONE ? POOL_NONE : copies[node->left],
+                              node->right == POOL_NONE ? POOL_NONE : copies[node->right]);
+    pool->nodes[copies[i]].value = node->value;
+    if (node->type == VARIABLE)
+      pool->nodes[copies[i]].value.variable = variables[node->value.variable];
+    else if (node->type == FARGSEPARATOR)
+      pool->nodes[copies[i]].value.aggregate = 0;
+    else if (node->type == FUNCTION && get_function_id_type(node->value.function) == AGGREGATE)
+      pool->nodes[copies[node->left]].value.aggregate = copies[i];
+  }
+
+  free(variables);
+  free(copies);
+
+  size_t removed = end - start;
+  if (removed) {
+    memmove(&pool->nodes[start], &pool->nodes[end], (pool->size - end) * sizeof(*pool->nodes));
+    pool->size -= removed;
+
+    for (size_t i = start; i < pool->size; ++i) {
+      if (pool->nodes[i].left != POOL_NONE) pool->nodes[i].left -= (uint32_t)removed;
+      if (pool->nodes[i].right != POOL_NONE) pool->nodes[i].right -= (uint32_t)removed;
+      if (pool->nodes[i].type == FARGSEPARATOR && pool->nodes[i].value.aggregate)
+        pool->nodes[i].value.aggregate -= (uint32_t)removed;
+    }
   }
 
-  while (!(operators->is_empty(operators))) {
-    if (get_type(operators->top(operators)) == LPARENTHESIS) {
-      fprintf(stderr, "Error: Unmatched parenthesis\n");
-      exit(EXIT_FAILURE);
+  return (uint32_t)pool->size - 1;
+}
+
+
+/**
+ * @brief Parses a call of a user-defined function, after its name, and
+ *        appends the body of the function in its place
+ * @details The arguments are written like those of a variadic function:
+ *                     f '(' (expression (',' expression)*)? ')'
+ *          Before the body is copied, its size is checked against the limits
+ *          of nodes and memory, and against the indices of the pool, since
+ *          nested calls may grow the expression exponentially. The groups
+ *          inside the call are not recorded, since their nodes are copied or
+ *          removed: the call is one group.
+ *
+ * @param parser The parser
+ * @param token The token of the name of the function
+ * @param definition The function
+ * @return The index of the root of the body, or POOL_NONE if an error has
+ *         occurred
+ * @see Definition::define_function, Parser::inline_body
+ */
+static uint32_t parse_call(Parser parser, const flat_token_t *token, Definition definition)
+{
+  size_t first = (size_t)(token - parser->tokens->tokens);
+  size_t groups = parser->groups ? parser->groups->size : 0;
+  advance(parser);
+
+  uint32_t firsts[DEFINITION_PARAMETERS + 1], roots[DEFINITION_PARAMETERS + 1];
+  size_t count = 0;
+  firsts[0] = (uint32_t)parser->pool->size;
+
+  while (parser->current && parser->current->type != RPARENTHESIS) {
+    if (count && !expect(parser, FARGSEPARATOR, "Expected ',' between the function arguments"))
+      return POOL_NONE;
+
+    uint32_t start = (uint32_t)parser->pool->size;
+    uint32_t argument = parse_binary(parser, 0);
+    if (argument == POOL_NONE) return POOL_NONE;
+
+    if (count < definition->nbr_parameters) {
+      firsts[count] = start;
+      roots[count] = argument;
     }
+    ++count;
+  }
+
+  size_t last = current_index(parser);
+  if (!expect(parser, RPARENTHESIS, "Expected ')' after the function arguments"))
+    return POOL_NONE;
 
-    add_operand_to_operator(output, operators);
+  if (count != definition->nbr_parameters) {
+    syntax_error(parser, "Wrong number of arguments", token->offset);
+    return POOL_NONE;
   }
 
-  ASTNode temp = output->top(output);
-  output->pop(output);
+  NodePool body = definition->body;
+  size_t size = firsts[0];
+  for (size_t i = 0; i < body->size; ++i) {
+    uint32_t role = get_parameter(definition, &body->nodes[i]);
+    size += role == DEFINITION_INDEX ? 1 : roots[role] - firsts[role] + 1;
+  }
 
-  if (!(output->is_empty(output))) {
-    fprintf(stderr, "Error: Invalid expression\n");
-    exit(EXIT_FAILURE);
+  const limits_t *limits = get_limits();
+  if ((limits->nodes && size > limits->nodes) || size >= POOL_NONE) {
+    syntax_error(parser, "Too many nodes", token->offset);
+    return POOL_NONE;
   }
+  if (limits->memory && size > limits->memory / sizeof(pool_node_t)) {
+    syntax_error(parser, "Expression needs too much memory", token->offset);
+    return POOL_NONE;
+  }
+
+  uint32_t node = inline_body(parser, definition, (uint32_t)first, firsts, roots);
+  if (parser->groups) parser->groups->size = groups;
+  add_group(parser, first, last, node);
+
+  return node;
+}
+
+
+/**
+ * @brief Parses an operand: a literal, a variable, a function call,
+ *        a parenthesized expression or a unary minus followed by its operand
+ *
+ * @param parser The parser
+ * @return The index of the operand, or POOL_NONE if an error has occurred
+ */
+static uint32_t parse_primary(Parser parser)
+{
+  if (!parser->current) {
+    syntax_error(parser, "Expected an operand", parser->position);
+    return POOL_NONE;
+  }
+
+  uint32_t node = POOL_NONE;
+
+  switch (parser->current->type) {
+    case LITERAL:
+                node = add_node(parser, advance(parser), POOL_NONE, POOL_NONE);
+                break;
+    case VARIABLE:
+    {
+                const flat_token_t *token = advance(parser);
+                if (parser->current && parser->current->type == LPARENTHESIS) {
+                  Definition definition = find_definition(parser->input + token->offset,
+                                                          token->length);
+                  if (!definition)
+                    syntax_error(parser, "Unknown function", token->offset);
+                  else if (!definition->body)
+                    syntax_error(parser, "Recursive function", token->offset);
+                  else
+                    node = parse_call(parser, token, definition);
+                } else {
+                  const char *name = parser->input + token->offset;
+                  const parser_scope_t *scope = parser->scope;
+                  while (scope && (scope->length != token->length
+                                   || memcmp(scope->name, name, token->length)))
+                    scope = scope->next;
+
+                  node = add_node(parser, token, POOL_NONE, POOL_NONE);
+                  parser->pool->nodes[node].value.variable =
+                    scope ? scope->variable : add_pool_variable(parser->pool, name, token->length);
+                }
+                break;
+    }
+    case FUNCTION:
+                node = parse_function(parser, advance(parser));
+                break;
+    case UMINUS:
+    {
+                const flat_token_t *token = advance(parser);
+                uint32_t operand = parse_binary(parser, token->value.operator.precedence);
+                if (operand != POOL_NONE)
+                  node = add_node(parser, token, POOL_NONE, operand);
+                break;
+    }
+    case LPARENTHESIS:
+    {
+                size_t first = current_index(parser);
+                advance(parser);
+
+                node = parse_binary(parser, 0);
+                if (node == POOL_NONE) break;
+
+                size_t last = current_index(parser);
+                if (expect(parser, RPARENTHESIS, "Unmatched parenthesis"))
+                  add_group(parser, first, last, node);
+                else
+                  node = POOL_NONE;
+                break;
+    }
+    default:
+                syntax_error(parser, "Expected an operand", parser->position);
+                break;
+  }
+
+  return node;
+}
+
+
+/**
+ * @brief Parses a sequence of operands separated by binary operators
+ * @details Implementing the precedence climbing algorithm: an operator is
+ *          taken only if its precedence is at least the given one. The right
+ *          operand of a left associative operator is parsed with a higher
+ *          precedence, so the next operator of same precedence is applied
+ *          after it:  3 - 2 - 1 -> ((3 - 2) - 1)
+ *                     2 ^ 3 ^ 2 -> (2 ^ (3 ^ 2))
+ *
+ *          The operands of an operator are parsed before its node is
+ *          appended, so the pool is filled in post-order.
+ *
+ *          An expression nested deeper than the depth limit is refused
+ *          here, before it overflows the stack.
+ *
+ * @param parser The parser
+ * @param min_precedence The lowest precedence of the operators to take
+ * @return The index of the parsed expression, or POOL_NONE if an error
+ *         has occurred
+ * @see Operator::operator_properties, Operator::is_operator
+ */
+static uint32_t parse_binary(Parser parser, unsigned int min_precedence)
+{
+  if (parser->depth == parser->max_depth) {
+    syntax_error(parser, "Expression too deep", parser->position);
+    return POOL_NONE;
+  }
+  ++parser->depth;
+
+  uint32_t left = parse_primary(parser);
+
+  while (left != POOL_NONE && parser->current && is_operator(parser->current->type)
+      && parser->current->type != UMINUS) {
+    unsigned int precedence = parser->current->value.operator.precedence;
+    if (precedence < min_precedence) break;
+
+    unsigned int next_precedence = precedence;
+    if (parser->current->value.operator.associativity == LEFT) ++next_precedence;
+
+    const flat_token_t *token = advance(parser);
+    uint32_t right = parse_binary(parser, next_precedence);
+    if (right == POOL_NONE) {
+      left = POOL_NONE;
+      break;
+    }
+
+    left = add_node(parser, token, left, right);
+  }
+
+  --parser->depth;
+
+  return left;
+}
+
+
+/**
+ * @brief Checks that a parsed pool is within the limits of nodes, depth
+ *        and memory
+ * @details The depth of the tree is computed by a forward scan of the pool,
+ *          since a chain of left associative operators is deep but parsed
+ *          without nesting. The memory counts the tokens, the pool and the
+ *          tree the pool would be turned into, so a tree can be built
+ *          from any pool which fits. The errors of the nodes inlined from
+ *          a user-defined function are at their call.
+ *
+ * @param parser The parser, after the whole range
+ * @param nbr_tokens The number of tokens of the range
+ * @see Limits::get_limits
+ */
+static void check_limits(Parser parser, size_t nbr_tokens)
+{
+  const limits_t *limits = get_limits();
+  NodePool pool = parser->pool;
+  const flat_token_t *tokens = parser->tokens->tokens;
+
+  if (limits->nodes && pool->size > limits->nodes) {
+    uint32_t token = pool->nodes[limits->nodes].token & ~POOL_INLINED;
+    syntax_error(parser, "Too many nodes", tokens[token].offset);
+    return;
+  }
+
+  // A tree is never deeper than its number of nodes
+  if (pool->size <= limits->depth && !limits->memory) return;
+
+  uint32_t *depths = malloc(pool->size * sizeof(*depths));
+  assert(depths != NULL);
+
+  size_t memory = nbr_tokens * sizeof(flat_token_t);
+  for (size_t i = 0; i < pool->size; ++i) {
+    const pool_node_t *node = &pool->nodes[i];
+    const flat_token_t *token = &tokens[node->token & ~POOL_INLINED];
+    uint32_t left = node->left == POOL_NONE ? 0 : depths[node->left];
+    uint32_t right = node->right == POOL_NONE ? 0 : depths[node->right];
+    depths[i] = (left > right ? left : right) + 1;
+
+    if (depths[i] > limits->depth) {
+      syntax_error(parser, "Expression too deep", token->offset);
+      break;
+    }
+
+    memory += sizeof(pool_node_t) + sizeof(ast_t) + sizeof(token_t) + token->length + 1;
+    if (limits->memory && memory > limits->memory) {
+      syntax_error(parser, "Expression needs too much memory", token->offset);
+      break;
+    }
+  }
+
+  free(depths);
+}
+
+
+/**
+ * @brief Parses a range of tokens into a pool
+ * @details There are at most as many nodes as tokens, so the pool doesn't
+ *          grow while it is filled, and is trimmed afterwards. The range is
+ *          parsed as a whole expression: a parenthesized group or a function
+ *          call is parsed as it is in the expression around it.
+ *
+ *          If groups are asked, the parenthesized groups and the function
+ *          calls of the range are appended to them, with the indices of
+ *          their tokens in the array and the indices of their nodes in the
+ *          pool, inner ones first.
+ *
+ * @param tokens The tokens of the expression
+ * @param input The expression
+ * @param first The index of the first token of the range
+ * @param end The index past the last token of the range
+ * @param error Where to store the error if the range is malformed
+ * @param groups Where to append the groups of the range, may be NULL
+ * @return The pool, or NULL if the range is malformed
+ */
+NodePool parse_token_range(TokenArray tokens, const char *input, size_t first, size_t end,
+                           ParseError error, GroupArray groups)
+{
+  assert(first <= end && end <= tokens->size);
+  PROBE1(parse_start, end - first);
+
+  parse_error_t ignored;
+  if (!error) error = &ignored;
+
+  error->message  = NULL;
+  error->position = 0;
+
+  parser_t parser = { tokens, first, end, NULL, 0, create_node_pool(end - first), groups, error,
+                      input, NULL, 0, get_limits()->depth };
+  advance(&parser);
+
+  uint32_t root = POOL_NONE;
+  if (!parser.current && !error->message)
+    syntax_error(&parser, "Empty expression", parser.position);
+  else
+    root = parse_binary(&parser, 0);
+
+  if (root != POOL_NONE && parser.current) {
+    const char *message = "Unexpected token";
+    if (parser.current->type == RPARENTHESIS) message = "Unmatched parenthesis";
+
+    syntax_error(&parser, message, parser.position);
+  }
+
+  if (!error->message) check_limits(&parser, end - first);
+
+  if (error->message) {
+    delete_node_pool(parser.pool);
+    PROBE2(parse_done, end - first, 0);
+    return NULL;
+  }
+
+  trim_node_pool(parser.pool);
+  PROBE2(parse_done, end - first, parser.pool->size);
+
+  return parser.pool;
+}
+
+
+/**
+ * @brief Writes the lexeme of a node inlined from the body of a user-defined
+ *        function, which has no text in the expression
+ * @details The index of an aggregate is named after its variable, with
+ *          a character no variable of an expression has, so the arguments
+ *          of the call never refer to it.
+ *
+ * @param node The node
+ * @param lexeme Where to write the lexeme
+ * @param size The size of the buffer, at least NUMBER_BUFFER_SIZE
+ */
+static void inlined_lexeme(const pool_node_t *node, char *lexeme, size_t size)
+{
+  switch (node->type) {
+    case LITERAL:
+                format_number(node->value.number, lexeme, size);
+                break;
+    case VARIABLE:
+                snprintf(lexeme, size, "_%u", (unsigned int)node->value.variable);
+                break;
+    case FUNCTION:
+                snprintf(lexeme, size, "%s", get_function_name(node->value.function));
+                break;
+    case FARGSEPARATOR:
+                strcpy(lexeme, ",");
+                break;
+    default:
+                strcpy(lexeme, get_operator_symbol(node->type));
+                break;
+  }
+}
+
+
+/**
+ * @brief Creates the linked tree of a pool
+ * @details The nodes of the tree are created in the order of the pool, so
+ *          the children of a node are created before it. The tokens of the
+ *          nodes are created from the text of the expression, but for the
+ *          function of a call, which the parser may have changed (a sum
+ *          which is a series), and the nodes inlined from a user-defined
+ *          function.
+ *
+ * @param pool The pool, parsed from the tokens
+ * @param tokens The tokens of the expression
+ * @param input The expression
+ * @param nodes Where to store the tree node of each pool node, may be NULL
+ * @return The root of the tree
+ * @see ASTNode::create_ast_node, Token::create_token
+ */
+ASTNode create_tree_from_pool(NodePool pool, TokenArray tokens, const char *input, ASTNode *nodes)
+{
+  ASTNode *trees = nodes ? nodes : malloc(pool->size * sizeof(*trees));
+  assert(trees != NULL);
+
+  size_t length = NUMBER_BUFFER_SIZE;
+  for (size_t i = 0; i < pool->size; ++i) {
+    uint32_t token = pool->nodes[i].token;
+    if (!(token & POOL_INLINED) && tokens->tokens[token].length > length)
+      length = tokens->tokens[token].length;
+  }
+
+  char *lexeme = malloc(length + 1);
+  assert(lexeme != NULL);
+
+  for (size_t i = 0; i < pool->size; ++i) {
+    const pool_node_t *node = &pool->nodes[i];
+
+    if (node->token & POOL_INLINED) {
+      inlined_lexeme(node, lexeme, length + 1);
+    } else {
+      const flat_token_t *token = &tokens->tokens[node->token];
+      memcpy(lexeme, input + token->offset, token->length);
+      lexeme[token->length] = '\0';
+    }
+
+    Token tree_token = create_token(node->type, lexeme);
+    if (node->type == FUNCTION) {
+      Function function = tree_token->data;
+      function->id   = node->value.function;
+      function->type = get_function_type(function);
+    }
+
+    trees[i] = create_ast_node(tree_token,
+                               node->left == POOL_NONE ? NULL : trees[node->left],
+                               node->right == POOL_NONE ? NULL : trees[node->right]);
+  }
+
+  ASTNode root = trees[pool->size - 1];
+
+  free(lexeme);
+  if (!nodes) free(trees);
+
+  return root;
+}
+
+
+/**
+ * @brief Creates a parse tree from a mathematical expression, stored in
+ *        a node pool
+ * @details The expression is first tokenized into a contiguous array, then
+ *          the nodes are appended to the pool in a single pass over the
+ *          array.
+ *
+ *          expression := operand (operator operand)*
+ *          operand    := literal | variable | '-' operand | '(' expression ')'
+ *                      | function '(' expression (',' expression)* ')'
+ *                      | aggregate '(' variable ',' expression ','
+ *                                      expression ',' expression ')'
+ *                      | driver '(' expression ',' variable ','
+ *                                   expression ',' expression ')'
+ *                      | defined '(' (expression (',' expression)*)? ')'
+ *
+ * @param expression The expression to parse
+ * @param length The length of the expression
+ * @param error Where to store the error if the expression is malformed
+ * @return The pool, or NULL if the expression is malformed
+ * @see TokenArray::tokenize_expression, Parser::parse_token_range
+ */
+NodePool parse_expression_pool(const char *expression, size_t length, ParseError error)
+{
+  parse_error_t ignored;
+  if (!error) error = &ignored;
+
+  TokenArray tokens = create_token_array();
+  tokenize_expression(tokens, expression, length);
+
+  NodePool pool = parse_token_range(tokens, expression, 0, tokens->size, error, NULL);
+
+  delete_token_array(tokens);
+
+  return pool;
+}
+
+
+/**
+ * @brief Creates a parse tree from a mathematical expression
+ * @details The expression is parsed into a pool, then the nodes of the tree
+ *          are created in the order of the pool, so the children of a node
+ *          are created before it.
+ *
+ * @param expression The expression to parse
+ * @param length The length of the expression
+ * @param error Where to store the error if the expression is malformed
+ * @return The root of the parse tree, or NULL if the expression is malformed
+ * @see Parser::parse_token_range, Parser::create_tree_from_pool
+ */
+ASTNode parse_expression(const char *expression, size_t length, ParseError error)
+{
+  TokenArray tokens = create_token_array();
+  tokenize_expression(tokens, expression, length);
+
+  ASTNode root = NULL;
+  NodePool pool = parse_token_range(tokens, expression, 0, tokens->size, error, NULL);
+  if (pool) {
+    root = create_tree_from_pool(pool, tokens, expression, NULL);
+    delete_node_pool(pool);
+  }
+
+  delete_token_array(tokens);
+
+  return root;
+}
+
+
+/**
+ * @brief Prints a syntax error, and points to its position in the expression
+ *        example:  Error: Unmatched parenthesis at position 4
+ *                    max((1, 2)
+ *                        ^
+ *
+ * @param out The stream where to print the error
+ * @param expression The malformed expression
+ * @param length The length of the expression
+ * @param error The error to print
+ */
+void print_parse_error(FILE *out, const char *expression, size_t length, ParseError error)
+{
+  fprintf(out, "Error: %s at position %zu\n  ", error->message, error->position);
 
-  delete_stack(operators);
-  delete_stack(output);
+  for (size_t i = 0; i < length && expression[i] != '\n'; ++i)
+    fputc(expression[i], out);
 
-  return temp;
-}
\ No newline at end of file
+  fprintf(out, "\n  %*s^\n", (int)error->position, "");
+}
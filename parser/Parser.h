@@ -1,12 +1,66 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stdio.h>
+#include <stddef.h>
 #include "AST.h"
-#include "../lexer/List.h"
+#include "NodePool.h"
+#include "../lexer/TokenArray.h"
 
 /**
- * @brief Creates a parse tree from a list of tokens
+ * @brief Holds the reason and the position of a syntax error
  */
-ASTNode parse_expression(List);
+typedef struct parse_error_t
+{
+  const char *message;
+  size_t position;
+} parse_error_t, *ParseError;
 
-#endif
\ No newline at end of file
+/**
+ * @brief A parenthesized group or a function call: the indices of its first
+ *        and last tokens, and the index of the node it was parsed into
+ */
+typedef struct parse_group_t
+{
+  size_t first;
+  size_t last;
+  uint32_t node;
+} parse_group_t;
+
+/**
+ * @brief The groups found by the parser
+ */
+typedef struct group_array_t
+{
+  parse_group_t *groups;
+  size_t size;
+  size_t capacity;
+} group_array_t, *GroupArray;
+
+/**
+ * @brief Parses a range of tokens into a pool
+ */
+NodePool parse_token_range(TokenArray, const char*, size_t, size_t, ParseError, GroupArray);
+
+/**
+ * @brief Creates the linked tree of a pool
+ */
+ASTNode create_tree_from_pool(NodePool, TokenArray, const char*, ASTNode*);
+
+/**
+ * @brief Creates a parse tree from a mathematical expression
+ */
+ASTNode parse_expression(const char*, size_t, ParseError);
+
+/**
+ * @brief Creates a parse tree from a mathematical expression, stored in
+ *        a node pool
+ */
+NodePool parse_expression_pool(const char*, size_t, ParseError);
+
+/**
+ * @brief Prints a syntax error, and points to its position in the expression
+ */
+void print_parse_error(FILE*, const char*, size_t, ParseError);
+
+#endif
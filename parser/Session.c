@@ -0,0 +1,255 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/TokenArray.h"
+#include "AST.h"
+#include "Parser.h"
+#include "NodePool.h"
+#include "Session.h"
+
+
+/**
+ * @brief Creates a session, with an empty expression
+ *
+ * @return The address of the created session
+ */
+Session create_session(void)
+{
+  Session session = malloc(sizeof(*session));
+  assert(session != NULL);
+
+  session->capacity = 64;
+  session->length   = 0;
+  session->text     = malloc(session->capacity);
+  assert(session->text != NULL);
+
+  session->tokens = create_token_array();
+  tokenize_expression(session->tokens, session->text, 0);
+
+  session->root = NULL;
+  session->error.message  = "Empty expression";
+  session->error.position = 0;
+
+  session->groups          = NULL;
+  session->nbr_groups      = 0;
+  session->groups_capacity = 0;
+
+  session->found.groups   = NULL;
+  session->found.size     = 0;
+  session->found.capacity = 0;
+
+  return session;
+}
+
+
+/**
+ * @brief Parses a range of tokens, links its tree to a slot, and records
+ *        its groups
+ * @details The subtree which was linked to the slot is deleted. The slot of
+ *          a group is the field of the node which holds its subtree, so it
+ *          stays valid while the node exists.
+ *
+ * @param session The session
+ * @param first The index of the first token of the range
+ * @param end The index past the last token of the range
+ * @param slot Where to link the tree of the range
+ * @return true if the range was parsed, false if it is malformed
+ * @see Parser::parse_token_range, Parser::create_tree_from_pool
+ */
+static bool build_range(Session session, size_t first, size_t end, ASTNode *slot)
+{
+  session->found.size = 0;
+
+  NodePool pool = parse_token_range(session->tokens, session->text, first, end,
+                                    &session->error, &session->found);
+  if (!pool) return false;
+
+  ASTNode *nodes = malloc(pool->size * sizeof(*nodes));
+  ASTNode **slots = malloc(pool->size * sizeof(*slots));
+  assert(nodes != NULL && slots != NULL);
+
+  ASTNode tree = create_tree_from_pool(pool, session->tokens, session->text, nodes);
+
+  slots[pool->size - 1] = slot;
+  for (size_t i = 0; i < pool->size; ++i) {
+    if (pool->nodes[i].left != POOL_NONE) slots[pool->nodes[i].left] = &nodes[i]->left;
+    if (pool->nodes[i].right != POOL_NONE) slots[pool->nodes[i].right] = &nodes[i]->right;
+  }
+
+  size_t needed = session->nbr_groups + session->found.size;
+  if (needed > session->groups_capacity) {
+    session->groups_capacity = 2 * needed;
+    session->groups = realloc(session->groups, session->groups_capacity * sizeof(*session->groups));
+    assert(session->groups != NULL);
+  }
+
+  for (size_t i = 0; i < session->found.size; ++i) {
+    const parse_group_t *found = &session->found.groups[i];
+    session_group_t *group = &session->groups[session->nbr_groups++];
+
+    group->first = found->first;
+    group->last  = found->last;
+    group->slot  = slots[found->node];
+  }
+
+  if (*slot) (*slot)->destroy(*slot);
+  *slot = tree;
+
+  free(slots);
+  free(nodes);
+  delete_node_pool(pool);
+
+  return true;
+}
+
+
+/**
+ * @brief Parses the whole expression of a session again
+ *
+ * @param session The session
+ */
+static void parse_session(Session session)
+{
+  if (session->root) session->root->destroy(session->root);
+  session->root = NULL;
+  session->nbr_groups = 0;
+
+  build_range(session, 0, session->tokens->size, &session->root);
+}
+
+
+/**
+ * @brief Finds the innermost group which strictly contains the tokens
+ *        replaced by an edit
+ * @details The group is parsed again the same way as in the whole
+ *          expression only if its parentheses still match: if a parenthesis
+ *          or a function name was removed or added, no group is returned.
+ *
+ * @param session The session, whose tree is the tree before the edit
+ * @param edit The tokens replaced by the edit
+ * @return The group, or NULL if the whole expression must be parsed again
+ */
+static session_group_t *enclosing_group(Session session, const token_edit_t *edit)
+{
+  const flat_token_t *tokens = session->tokens->tokens;
+  for (size_t i = edit->first; i < edit->first + edit->added; ++i)
+    if (tokens[i].type == LPARENTHESIS || tokens[i].type == RPARENTHESIS)
+      return NULL;
+
+  size_t end = edit->first + edit->removed;
+  session_group_t *enclosing = NULL;
+
+  for (size_t i = 0; i < session->nbr_groups; ++i) {
+    session_group_t *group = &session->groups[i];
+
+    if ((group->first >= edit->first && group->first < end)
+     || (group->last >= edit->first && group->last < end))
+      return NULL;
+
+    if (group->first < edit->first && group->last >= end
+     && (!enclosing || group->last - group->first < enclosing->last - enclosing->first))
+      enclosing = group;
+  }
+
+  return enclosing;
+}
+
+
+/**
+ * @brief Parses a group again after an edit inside it, and replaces its
+ *        subtree
+ * @details The groups inside it are replaced by the new ones, and the
+ *          indices of the tokens of the groups after the edit are moved.
+ *
+ * @param session The session
+ * @param group The group, which strictly contains the edit
+ * @param edit The tokens replaced by the edit
+ * @return true if the group was parsed, false if it is malformed
+ */
+static bool reparse_group(Session session, const session_group_t *group, const token_edit_t *edit)
+{
+  size_t first = group->first, last = group->last, end = edit->first + edit->removed;
+  ASTNode *slot = group->slot;
+
+  size_t kept = 0;
+  for (size_t i = 0; i < session->nbr_groups; ++i) {
+    session_group_t current = session->groups[i];
+    if (current.first >= first && current.last <= last) continue;
+
+    if (current.first >= end) current.first = current.first + edit->added - edit->removed;
+    if (current.last >= end) current.last = current.last + edit->added - edit->removed;
+    session->groups[kept++] = current;
+  }
+  session->nbr_groups = kept;
+
+  return build_range(session, first, last + edit->added - edit->removed + 1, slot);
+}
+
+
+/**
+ * @brief Replaces a part of the expression of a session
+ * @details Only the tokens around the edit are read again, and only the
+ *          innermost parenthesized group or function call around it is
+ *          parsed again: its subtree is replaced in the tree, the rest of
+ *          the tree is kept. If the parentheses changed, if there is no such
+ *          group, or if the expression is malformed, the whole expression is
+ *          parsed again, so the tree and the error are always those that
+ *          parse_expression gives.
+ *
+ *          example: "2 * (x + 1)" -> "2 * (x + 10)" parses "(x + 10)" again
+ *
+ * @param session The session
+ * @param offset Where the edit starts in the expression
+ * @param deleted The number of characters to delete at the offset
+ * @param text The characters to insert at the offset
+ * @param length The number of characters to insert
+ * @return true if the expression is well formed, false otherwise
+ * @see TokenArray::retokenize_expression, Parser::parse_token_range
+ */
+bool edit_session(Session session, size_t offset, size_t deleted, const char *text, size_t length)
+{
+  assert(offset <= session->length && deleted <= session->length - offset);
+
+  size_t new_length = session->length - deleted + length;
+  if (new_length > session->capacity) {
+    session->capacity = 2 * new_length;
+    session->text = realloc(session->text, session->capacity);
+    assert(session->text != NULL);
+  }
+
+  memmove(session->text + offset + length, session->text + offset + deleted,
+          session->length - offset - deleted);
+  memcpy(session->text + offset, text, length);
+  session->length = new_length;
+
+  token_edit_t edit;
+  retokenize_expression(session->tokens, session->text, session->length,
+                        offset, deleted, length, &edit);
+
+  const session_group_t *group = NULL;
+  if (session->root && !session->tokens->error)
+    group = enclosing_group(session, &edit);
+
+  if (!group || !reparse_group(session, group, &edit))
+    parse_session(session);
+
+  return session->root != NULL;
+}
+
+
+/**
+ * @brief Deletes a session
+ *
+ * @param session The session to delete
+ */
+void delete_session(Session session)
+{
+  if (session->root) session->root->destroy(session->root);
+
+  delete_token_array(session->tokens);
+  free(session->found.groups);
+  free(session->groups);
+  free(session->text);
+  free(session);
+}
@@ -0,0 +1,62 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../lexer/TokenArray.h"
+#include "AST.h"
+#include "Parser.h"
+
+/**
+ * @brief A parenthesized group or a function call of the tree of a session:
+ *        its tokens, and where its subtree is linked
+ */
+typedef struct session_group_t
+{
+  size_t first;
+  size_t last;
+  ASTNode *slot;
+} session_group_t;
+
+/**
+ * @brief An expression edited in place, whose tokens and tree are updated
+ *        after each edit
+ * @details The tree belongs to the session: it can be read and evaluated
+ *          with eval_tree_value, but must be cloned to be changed (for
+ *          example by eval_tree). If the expression is malformed, the tree
+ *          is NULL and the error is set.
+ */
+typedef struct session_t *Session;
+typedef struct session_t
+{
+  char *text;
+  size_t length;
+  size_t capacity;
+
+  TokenArray tokens;
+  ASTNode root;
+  parse_error_t error;
+
+  session_group_t *groups;
+  size_t nbr_groups;
+  size_t groups_capacity;
+  group_array_t found;
+} session_t;
+
+/**
+ * @brief Creates a session, with an empty expression
+ */
+Session create_session(void);
+
+/**
+ * @brief Replaces a part of the expression of a session
+ */
+bool edit_session(Session, size_t, size_t, const char*, size_t);
+
+/**
+ * @brief Deletes a session
+ */
+void delete_session(Session);
+
+#endif
@@ -0,0 +1,202 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Function.h"
+#include "../eval/FastMath.h"
+
+/**
+ * The default number of arguments sampled in each domain
+ */
+#define CHECK_SAMPLES (1U << 22)
+
+#define PI_4 0.78539816339744830962
+
+/**
+ * @brief A function, and the domain its arguments are sampled from
+ * @details The arguments are uniform in [lo, hi], or log-uniform if the
+ *          domain is logarithmic.
+ */
+typedef struct domain_t
+{
+  const char *name;
+  FunctionID id;
+  double lo;
+  double hi;
+  int logarithmic;
+} domain_t;
+
+
+/**
+ * @brief Draws a random double in [0, 1) (xorshift64)
+ */
+static double random_unit(uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+
+  return (double)(*state >> 11) * 0x1p-53;
+}
+
+
+/**
+ * @brief Returns the current time in seconds
+ */
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return (double)t.tv_sec + 1e-9 * (double)t.tv_nsec;
+}
+
+
+/**
+ * @brief Computes the error of a result in units in the last place of
+ *        the reference, as a double
+ *
+ * @param result The result to check
+ * @param reference The correct result, in long double
+ * @return The error
+ */
+static double ulp_error(double result, long double reference)
+{
+  if (isnan(result) || isnan(reference)) return isnan(result) && isnan(reference) ? 0.0 : INFINITY;
+  if (isinf(reference)) return result == reference ? 0.0 : INFINITY;
+
+  double rounded = fabs((double)reference);
+  double ulp = rounded == 0.0 ? 0x1p-1074 : nextafter(rounded, INFINITY) - rounded;
+
+  return (double)(fabsl((long double)result - reference) / ulp);
+}
+
+
+/**
+ * @brief Computes the long double reference of a function
+ */
+static long double reference(FunctionID id, double x)
+{
+  switch (id) {
+    case SIN:  return sinl(x);
+    case COS:  return cosl(x);
+    case TAN:  return tanl(x);
+    case SQRT: return sqrtl(x);
+    case LN:   return logl(x);
+    default:   return NAN;
+  }
+}
+
+
+/**
+ * @brief Measures the accuracy and the throughput of the fast math kernels
+ * @details For each function, the arguments are sampled over large domains,
+ *          then computed in each mode. The errors are measured in units in
+ *          the last place of a double, and relatively, against the long
+ *          double functions of the C library. The throughput is measured in
+ *          millions of results per second, for the exact functions, for
+ *          fast_function called on each argument, and for fast_function_array.
+ *
+ *          usage: checkmath [samples]
+ *
+ * @return 0 if the kernels are within the documented accuracy, 1 otherwise
+ */
+int main(int argc, char *argv[])
+{
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s [samples]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t n = argc == 2 ? (size_t)strtoul(argv[1], NULL, 10) : CHECK_SAMPLES;
+  if (!n) n = CHECK_SAMPLES;
+
+  const domain_t domains[] = {
+    { "sin",  SIN,  -PI_4, PI_4, 0 },
+    { "sin",  SIN,  -FAST_MATH_MAX_TRIG, FAST_MATH_MAX_TRIG, 0 },
+    { "cos",  COS,  -PI_4, PI_4, 0 },
+    { "cos",  COS,  -FAST_MATH_MAX_TRIG, FAST_MATH_MAX_TRIG, 0 },
+    { "tan",  TAN,  -PI_4, PI_4, 0 },
+    { "tan",  TAN,  -FAST_MATH_MAX_TRIG, FAST_MATH_MAX_TRIG, 0 },
+    { "ln",   LN,   0.5, 2.0, 0 },
+    { "ln",   LN,   1e-300, 1e300, 1 },
+    { "sqrt", SQRT, 1e-300, 1e300, 1 }
+  };
+  const MathMode modes[] = { MATH_4ULP, MATH_FAST };
+  const char *mode_names[] = { "exact", "4ulp", "fast" };
+
+  double *in = malloc(n * sizeof(*in));
+  double *out = malloc(n * sizeof(*out));
+  assert(in != NULL && out != NULL);
+
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+  int failed = 0;
+
+  printf("%-5s %-20s %-5s %10s %10s %10s %10s %10s\n", "func", "domain", "mode",
+         "max ulps", "max rel", "exact M/s", "scalar M/s", "array M/s");
+
+  for (size_t d = 0; d < sizeof domains / sizeof *domains; ++d) {
+    const domain_t *domain = &domains[d];
+
+    for (size_t i = 0; i < n; ++i) {
+      double u = random_unit(&state);
+      in[i] = domain->logarithmic
+            ? exp(log(domain->lo) + u * (log(domain->hi) - log(domain->lo)))
+            : domain->lo + u * (domain->hi - domain->lo);
+    }
+
+    double start = now();
+    fast_function_array(domain->id, MATH_EXACT, in, out, n);
+    double exact = (double)n / (now() - start) * 1e-6;
+
+    for (size_t m = 0; m < sizeof modes / sizeof *modes; ++m) {
+      MathMode mode = modes[m];
+
+      start = now();
+      volatile double sink = 0.0;
+      for (size_t i = 0; i < n; ++i) sink = fast_function(domain->id, mode, in[i]);
+      (void)sink;
+      double scalar = (double)n / (now() - start) * 1e-6;
+
+      start = now();
+      fast_function_array(domain->id, mode, in, out, n);
+      double array = (double)n / (now() - start) * 1e-6;
+
+      double max_ulps = 0.0, max_relative = 0.0;
+      size_t mismatches = 0;
+      for (size_t i = 0; i < n; ++i) {
+        long double ref = reference(domain->id, in[i]);
+
+        double ulps = ulp_error(out[i], ref);
+        if (ulps > max_ulps) max_ulps = ulps;
+
+        double relative = (double)(fabsl((long double)out[i] - ref) / fabsl(ref));
+        if (ref != 0.0L && relative > max_relative) max_relative = relative;
+
+        if (out[i] != fast_function(domain->id, mode, in[i])) ++mismatches;
+      }
+
+      char range[32];
+      snprintf(range, sizeof range, "[%g, %g]", domain->lo, domain->hi);
+      printf("%-5s %-20s %-5s %10.2f %10.2e %10.1f %10.1f %10.1f\n", domain->name, range,
+             mode_names[mode], max_ulps, max_relative, exact, scalar, array);
+
+      if (mismatches) {
+        printf("  %zu results of fast_function_array differ from fast_function\n", mismatches);
+        failed = 1;
+      }
+
+      if (mode == MATH_4ULP && max_ulps > 4.0) failed = 1;
+      if (mode == MATH_FAST && max_relative > 1e-7) failed = 1;
+    }
+  }
+
+  free(in);
+  free(out);
+
+  return failed;
+}
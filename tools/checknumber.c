@@ -0,0 +1,223 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Number.h"
+
+/**
+ * The number of random literals and numbers checked by default
+ */
+#define CHECK_LITERALS 200000
+
+/**
+ * The literals which are checked first: the bounds of the fast path, of
+ * the mantissa and of the exponent range
+ */
+static const char *const edge_literals[] = {
+  "0", "0.0", ".5", "5.", "1", "0.1", "0.3", "2.5e-3", "1e27", "1e28", "1e-27", "1e-28",
+  "9007199254740993", "18446744073709551615", "18446744073709551616",
+  "9999999999999999999", "10000000000000000000", "123456789012345678901234",
+  "0.000000000000000000000000000001", "1e4932", "1.18973149535723176502e+4932",
+  "1e4933", "3.36210314311209350626e-4932", "3.6451995318824746025e-4951", "1e-4951",
+  "1e-4952", "4.9406564584124654e-324", "1.7976931348623157e308", "00000000000000000000001"
+};
+
+
+/**
+ * @brief Draws a random number
+ *
+ * @param state The state of the generator (xorshift64)
+ * @return The number
+ */
+static uint64_t random_bits(uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+
+  return *state;
+}
+
+
+/**
+ * @brief Writes a random literal: up to 25 significant digits, a decimal
+ *        point, and an exponent which is mostly small
+ *
+ * @param state The state of the generator
+ * @param str Where to write the literal
+ * @return The length of the literal
+ */
+static size_t random_literal(uint64_t *state, char *str)
+{
+  size_t length = 0;
+  size_t digits = 1 + random_bits(state) % 25;
+  size_t point = random_bits(state) % (digits + 2);
+
+  for (size_t i = 0; i < digits; ++i) {
+    if (i == point) str[length++] = '.';
+    str[length++] = (char)('0' + random_bits(state) % 10);
+  }
+
+  uint64_t exponent = random_bits(state) % 8;
+  if (exponent >= 4) {
+    int value = (int)(random_bits(state) % (exponent == 7 ? 4960 : 40));
+    length += (size_t)sprintf(str + length, "e%s%d",
+                              random_bits(state) % 2 ? "-" : (exponent == 6 ? "+" : ""), value);
+  }
+  str[length] = '\0';
+
+  return length;
+}
+
+
+/**
+ * @brief Checks that a literal is converted like strtold does
+ *
+ * @param str The literal
+ * @param length The length of the literal
+ * @return true if both conversions give the same long double
+ */
+static bool check_literal(const char *str, size_t length)
+{
+  long double expected = strtold(str, NULL);
+  long double value = parse_number(str, length);
+
+  if (value == expected && signbit(value) == signbit(expected))
+    return true;
+
+  printf("%s: %.21Lg instead of %.21Lg\n", str, value, expected);
+  return false;
+}
+
+
+/**
+ * @brief Draws a random finite long double: a random significand scaled by
+ *        a random power of two, mostly around 1 and else over the whole
+ *        exponent range
+ *
+ * @param state The state of the generator
+ * @return The number
+ */
+static long double random_number(uint64_t *state)
+{
+  uint64_t significand = random_bits(state) | UINT64_C(1) << 63;
+  int exponent = random_bits(state) % 8
+               ? (int)(random_bits(state) % 400) - 263
+               : (int)(random_bits(state) % (LDBL_MAX_EXP - LDBL_MIN_EXP + LDBL_MANT_DIG))
+                 + LDBL_MIN_EXP - LDBL_MANT_DIG - 63;
+  long double value = ldexpl((long double)significand, exponent);
+
+  return random_bits(state) % 2 ? -value : value;
+}
+
+
+/**
+ * @brief Counts the significant digits of a formatted number
+ *
+ * @param str The number
+ * @return The number of digits from the first nonzero one to the last one
+ */
+static size_t count_digits(const char *str)
+{
+  size_t end = strcspn(str, "eE");
+  size_t first = end, last = 0;
+
+  for (size_t i = 0; i < end; ++i)
+    if (str[i] >= '1' && str[i] <= '9') {
+      if (first == end) first = i;
+      last = i;
+    }
+
+  size_t digits = 0;
+  for (size_t i = first; i <= last && first < end; ++i)
+    if (str[i] >= '0' && str[i] <= '9') ++digits;
+
+  return digits;
+}
+
+
+/**
+ * @brief Checks that a number is formatted with the fewest digits which
+ *        read back to it
+ * @details The number read back by strtold must be the same long double, and
+ *          the number rounded to one digit less by printf must not be.
+ *
+ * @param value The number
+ * @return true if the representation reads back and is the shortest
+ */
+static bool check_format(long double value)
+{
+  char str[NUMBER_BUFFER_SIZE];
+  format_number(value, str, sizeof str);
+
+  long double read = strtold(str, NULL);
+  if (read != value || signbit(read) != signbit(value)) {
+    printf("%.21Lg: '%s' reads back as %.21Lg\n", value, str, read);
+    return false;
+  }
+
+  size_t digits = count_digits(str);
+  if (digits > 1) {
+    char shorter[NUMBER_BUFFER_SIZE];
+    snprintf(shorter, sizeof shorter, "%.*Le", (int)digits - 2, value);
+    if (strtold(shorter, NULL) == value) {
+      printf("%.21Lg: '%s' is longer than '%s'\n", value, str, shorter);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Checks the conversion of the literals against strtold
+ * @details The edge literals are checked first, then a fixed sequence of
+ *          random ones, so the corpus is the same at each run. parse_number
+ *          must give the same long double as strtold, bit for bit.
+ *
+ *          Then the edge values and a quarter as many random long doubles
+ *          are formatted by format_number, which must give the shortest
+ *          string that reads back to the same long double.
+ *
+ *          usage: checknumber [number of random literals]
+ *
+ * @return 0 if every literal is converted like strtold and every number is
+ *         formatted in the shortest way, 1 otherwise
+ */
+int main(int argc, char *argv[])
+{
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s [number of random literals]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t count = argc == 2 ? strtoul(argv[1], NULL, 10) : CHECK_LITERALS;
+  size_t checked = 0, failed = 0;
+
+  for (size_t i = 0; i < sizeof edge_literals / sizeof *edge_literals; ++i, ++checked)
+    if (!check_literal(edge_literals[i], strlen(edge_literals[i]))) ++failed;
+
+  char str[64];
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+  for (size_t i = 0; i < count; ++i, ++checked) {
+    size_t length = random_literal(&state, str);
+    if (!check_literal(str, length)) ++failed;
+  }
+
+  printf("%zu literals checked, %zu different from strtold\n", checked, failed);
+
+  size_t formatted = 0, wrong = 0;
+  for (size_t i = 0; i < sizeof edge_literals / sizeof *edge_literals; ++i, ++formatted)
+    if (!check_format(strtold(edge_literals[i], NULL))) ++wrong;
+
+  for (size_t i = 0; i < count / 4; ++i, ++formatted)
+    if (!check_format(random_number(&state))) ++wrong;
+
+  printf("%zu numbers formatted, %zu not the shortest round trip\n", formatted, wrong);
+
+  return failed || wrong ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Number.h"
+#include "../parser/AST.h"
+#include "../parser/Parser.h"
+#include "../parser/Environment.h"
+#include "../eval/Optimize.h"
+
+/**
+ * The number of random points each expression is evaluated at
+ */
+#define CHECK_SAMPLES 1000
+
+/**
+ * The range of the values given to the variables: [-CHECK_RANGE, CHECK_RANGE]
+ */
+#define CHECK_RANGE 4.0L
+
+
+/**
+ * @brief Draws a random value in [-CHECK_RANGE, CHECK_RANGE]
+ *
+ * @param state The state of the generator (xorshift64)
+ * @return The value
+ */
+static long double random_value(uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+
+  return CHECK_RANGE * ((long double)(*state >> 11) / 0x1p52L - 1.0L);
+}
+
+
+/**
+ * @brief Computes the magnitude of the terms of a tree
+ * @details The sums are computed on the absolute values of their terms, so
+ *          the result is the scale of the rounding errors of the tree, even
+ *          where its terms cancel out, like near the roots of a polynomial.
+ *
+ * @param root The root of the tree
+ * @param env The values of the variables
+ * @return The magnitude of the tree
+ * @see AST::eval_tree_value
+ */
+static long double magnitude(ASTNode root, Environment env)
+{
+  switch (root->token->type) {
+    case PLUS:
+    case BMINUS:
+                return magnitude(root->left, env) + magnitude(root->right, env);
+    case UMINUS:
+                return magnitude(root->right, env);
+    case MULTIPLY:
+                return magnitude(root->left, env) * magnitude(root->right, env);
+    default:
+                return fabsl(eval_tree_value(root, env));
+  }
+}
+
+
+/**
+ * @brief Computes the distance between two values in units in the last
+ *        place of a given scale
+ *
+ * @param a The first value
+ * @param b The second value
+ * @param scale The magnitude of the terms the values are computed from
+ * @return The distance, 0 if both are NaN, infinite if only one is
+ */
+static long double ulp_distance(long double a, long double b, long double scale)
+{
+  if (isnan(a) || isnan(b)) return isnan(a) && isnan(b) ? 0.0L : INFINITY;
+  if (a == b) return 0.0L;
+  if (isinf(a) || isinf(b)) return INFINITY;
+
+  long double m = fmaxl(fmaxl(fabsl(a), fabsl(b)), scale);
+  long double ulp = nextafterl(m, INFINITY) - m;
+
+  return fabsl(a - b) / ulp;
+}
+
+
+/**
+ * @brief Checks the accuracy of the optimized trees against the original ones
+ * @details Each line of the input file is an expression, which is optimized
+ *          (see Optimize::optimize_tree), then both trees are evaluated at
+ *          CHECK_SAMPLES random values of their variables. The expressions
+ *          whose results differ by more than the given number of units in the
+ *          last place (16 by default) are printed, with the worst point.
+ *
+ *          The units in the last place are the ones of the magnitude of the
+ *          terms, rather than of the result, since the rounding errors of
+ *          both trees are relative to it: where the terms cancel out, both
+ *          results are equally inaccurate.
+ *
+ *          usage: checkopt <expressions file> [max ulps]
+ *
+ * @return 0 if all the expressions are within the bound, 1 otherwise
+ */
+int main(int argc, char *argv[])
+{
+  if (argc != 2 && argc != 3) {
+    fprintf(stderr, "usage: %s <expressions file> [max ulps]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  long double bound = argc == 3 ? strtold(argv[2], NULL) : 16.0L;
+
+  FILE *in = fopen(argv[1], "r");
+  if (!in) {
+    fprintf(stderr, "Can't open '%s'\n", argv[1]);
+    exit(EXIT_FAILURE);
+  }
+
+  char *line = NULL;
+  size_t capacity = 0;
+  size_t lineno = 0, checked = 0, failed = 0;
+  long double worst = 0.0L;
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+  ssize_t length = 0;
+
+  while ((length = getline(&line, &capacity, in)) != -1)
+  {
+    ++lineno;
+
+    parse_error_t error;
+    ASTNode original = parse_expression(line, (size_t)length, &error);
+    if (!original) {
+      fprintf(stderr, "%s:%zu: ", argv[1], lineno);
+      print_parse_error(stderr, line, (size_t)length, &error);
+      continue;
+    }
+
+    ASTNode optimized = optimize_tree(clone_tree(original));
+
+    Environment env = create_environment();
+    collect_variables(original, env);
+
+    long double max = 0.0L;
+    char point[256] = "";
+    size_t samples = env->size ? CHECK_SAMPLES : 1;
+    for (size_t i = 0; i < samples; ++i) {
+      for (size_t j = 0; j < env->size; ++j)
+        env->values[j] = random_value(&state);
+
+      long double distance = ulp_distance(eval_tree_value(original, env),
+                                          eval_tree_value(optimized, env),
+                                          magnitude(original, env));
+      if (distance > max) {
+        max = distance;
+        size_t len = 0;
+        for (size_t j = 0; j < env->size && len < sizeof point; ++j) {
+          char str[NUMBER_BUFFER_SIZE];
+          format_number(env->values[j], str, sizeof str);
+          len += (size_t)snprintf(point + len, sizeof point - len, " %s=%s",
+                                  env->names[j], str);
+        }
+      }
+    }
+
+    if (max > bound) {
+      printf("%s:%zu: %.1Lf ulps at%s: %s", argv[1], lineno, max, point, line);
+      ++failed;
+    }
+
+    if (max > worst) worst = max;
+    ++checked;
+
+    delete_environment(env);
+    optimized->destroy(optimized);
+    original->destroy(original);
+  }
+
+  printf("%zu expressions checked, %zu above %.1Lf ulps, worst %.1Lf ulps\n",
+         checked, failed, bound, worst);
+
+  free(line);
+  fclose(in);
+
+  return failed ? 1 : 0;
+}
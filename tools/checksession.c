@@ -0,0 +1,245 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Operator.h"
+#include "../lexer/Function.h"
+#include "../parser/AST.h"
+#include "../parser/Parser.h"
+#include "../parser/Session.h"
+
+/**
+ * The number of random edits checked by default
+ */
+#define CHECK_EDITS 20000
+
+/**
+ * The length past which the edits only delete, so the expressions stay
+ * around a few hundred characters
+ */
+#define CHECK_MAX_LENGTH 400
+
+/**
+ * The pieces of expressions inserted by the random edits
+ */
+static const char *const fragments[] = {
+  "1", "7", "2.5", "x", "y", "+", "-", "*", "/", "^", "%", "(", ")", ",", " ",
+  "sin(", "max(", "+ 3", "* (x - 1)", "(2 + y)", "min(x, 4)", "e"
+};
+
+
+/**
+ * @brief Draws a random number
+ *
+ * @param state The state of the generator (xorshift64)
+ * @return The number
+ */
+static uint64_t random_bits(uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+
+  return *state;
+}
+
+
+/**
+ * @brief Writes a random well formed expression
+ *
+ * @param state The state of the generator
+ * @param str Where to write the expression
+ * @param depth The depth left for the nested groups
+ * @return The length of the expression
+ */
+static size_t random_expression(uint64_t *state, char *str, int depth)
+{
+  size_t length = 0;
+  size_t terms = 1 + random_bits(state) % 4;
+
+  for (size_t i = 0; i < terms; ++i) {
+    if (i) length += (size_t)sprintf(str + length, " %c ", "+-*/^"[random_bits(state) % 5]);
+
+    switch (depth > 0 ? random_bits(state) % 5 : random_bits(state) % 2) {
+      case 0:
+        length += (size_t)sprintf(str + length, "%u", (unsigned int)(random_bits(state) % 100));
+        break;
+      case 1:
+        str[length++] = random_bits(state) % 2 ? 'x' : 'y';
+        break;
+      case 2:
+        str[length++] = '(';
+        length += random_expression(state, str + length, depth - 1);
+        str[length++] = ')';
+        break;
+      case 3:
+        length += (size_t)sprintf(str + length, "sin(");
+        length += random_expression(state, str + length, depth - 1);
+        str[length++] = ')';
+        break;
+      default:
+        length += (size_t)sprintf(str + length, "max(");
+        length += random_expression(state, str + length, depth - 1);
+        length += (size_t)sprintf(str + length, ", ");
+        length += random_expression(state, str + length, depth - 1);
+        str[length++] = ')';
+        break;
+    }
+  }
+  str[length] = '\0';
+
+  return length;
+}
+
+
+/**
+ * @brief Compares two tokens of a tree
+ *
+ * @param a The first token
+ * @param b The second token
+ * @return true if both tokens have the same type and the same value
+ */
+static bool same_token(Token a, Token b)
+{
+  if (a->type != b->type) return false;
+
+  if (is_operator(a->type))
+    return !strcmp(((Operator)a->data)->value, ((Operator)b->data)->value);
+  if (a->type == FUNCTION)
+    return ((Function)a->data)->id == ((Function)b->data)->id;
+
+  return !strcmp(a->data, b->data);
+}
+
+
+/**
+ * @brief Compares two trees, node by node
+ *
+ * @param a The root of the first tree, may be NULL
+ * @param b The root of the second tree, may be NULL
+ * @return true if both trees have the same shape and the same tokens
+ */
+static bool same_tree(ASTNode a, ASTNode b)
+{
+  if (!a || !b) return a == b;
+
+  return same_token(a->token, b->token) && same_tree(a->left, b->left)
+      && same_tree(a->right, b->right);
+}
+
+
+/**
+ * @brief Applies a random edit to a session and to a copy of its expression
+ * @details Most edits replace a digit of a number, or insert one in it,
+ *          which keeps the expression well formed, so the group around it
+ *          is parsed again in place. The others insert and delete a few
+ *          characters at a random offset, and mostly leave the expression
+ *          malformed, as while typing.
+ *
+ * @param state The state of the generator
+ * @param session The session
+ * @param text The copy of the expression of the session
+ * @param length The length of the copy
+ */
+static void random_edit(uint64_t *state, Session session, char *text, size_t *length)
+{
+  size_t offset = *length ? random_bits(state) % (*length + 1) : 0;
+  size_t deleted = 0;
+  char inserted[32] = "";
+
+  size_t digit = offset;
+  while (digit < *length && !(text[digit] >= '0' && text[digit] <= '9')) ++digit;
+
+  if (random_bits(state) % 4 && digit < *length) {
+    offset = digit;
+    deleted = random_bits(state) % 2;
+    inserted[0] = (char)('1' + random_bits(state) % 9);
+  } else {
+    deleted = random_bits(state) % 3;
+    if (*length < CHECK_MAX_LENGTH)
+      strcpy(inserted, fragments[random_bits(state) % (sizeof fragments / sizeof *fragments)]);
+    else
+      deleted += 8;
+  }
+
+  if (deleted > *length - offset) deleted = *length - offset;
+  size_t size = strlen(inserted);
+
+  memmove(text + offset + size, text + offset + deleted, *length - offset - deleted);
+  memcpy(text + offset, inserted, size);
+  *length += size - deleted;
+
+  edit_session(session, offset, deleted, inserted, size);
+}
+
+
+/**
+ * @brief Checks the incremental parsing of the sessions against
+ *        parse_expression
+ * @details A fixed sequence of random edits is applied to a session, which
+ *          starts again from a random well formed expression every 10
+ *          edits. After each edit, the expression of the session must be
+ *          the edited one, and its tree and error must be those
+ *          parse_expression gives for the whole expression.
+ *
+ *          usage: checksession [number of edits]
+ *
+ * @return 0 if every edit gives the tree and the error of parse_expression,
+ *         1 otherwise
+ */
+int main(int argc, char *argv[])
+{
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s [number of edits]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t count = argc == 2 ? strtoul(argv[1], NULL, 10) : CHECK_EDITS;
+  size_t failed = 0, well_formed = 0;
+
+  char text[8 * CHECK_MAX_LENGTH];
+  size_t length = 0;
+
+  Session session = create_session();
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+  for (size_t i = 0; i < count; ++i) {
+    if (i % 10 == 0) {
+      char start[8 * CHECK_MAX_LENGTH];
+      size_t size = random_expression(&state, start, 2);
+
+      edit_session(session, 0, length, start, size);
+      memcpy(text, start, size);
+      length = size;
+    } else {
+      random_edit(&state, session, text, &length);
+    }
+
+    parse_error_t error;
+    ASTNode root = parse_expression(text, length, &error);
+
+    bool same = session->length == length && !memcmp(session->text, text, length)
+             && same_tree(session->root, root)
+             && (session->error.message == error.message
+                 || (session->error.message && error.message
+                     && !strcmp(session->error.message, error.message)))
+             && (!error.message || session->error.position == error.position);
+
+    if (!same) {
+      printf("%.*s: the session differs from parse_expression\n", (int)length, text);
+      ++failed;
+    }
+    if (root) {
+      ++well_formed;
+      root->destroy(root);
+    }
+  }
+
+  delete_session(session);
+
+  printf("%zu edits checked (%zu well formed), %zu different from parse_expression\n",
+         count, well_formed, failed);
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,661 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Operator.h"
+#include "../lexer/Function.h"
+#include "../parser/AST.h"
+#include "../parser/Parser.h"
+#include "../parser/Environment.h"
+#include "../parser/Definition.h"
+
+
+/**
+ * @brief Checks if a given name can be used as a C function name
+ *
+ * @param name The name to check
+ * @return true if the name is a valid C identifier, false otherwise
+ */
+static bool is_identifier(const char *name)
+{
+  if (!isalpha((unsigned char)name[0]) && name[0] != '_')
+    return false;
+
+  for (const char *p = name; *p; ++p) {
+    if (!isalnum((unsigned char)*p) && *p != '_')
+      return false;
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Checks if a name would clash with C in the generated code
+ * @details The generated source includes <math.h>, so the names of its
+ *          functions (and of their float and long double forms) and of its
+ *          macros are taken, as well as the keywords of C and main. The names
+ *          starting with '_' and an uppercase letter or another '_' are
+ *          reserved everywhere, and those starting with '_' at file scope.
+ *
+ * @param name The name to check
+ * @param file_scope true for the name of a function, false for a variable
+ * @return true if the name can't be used
+ */
+static bool is_reserved(const char *name, bool file_scope)
+{
+  static const char *const keywords[] = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do", "double",
+    "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long",
+    "register", "restrict", "return", "short", "signed", "sizeof", "static", "struct",
+    "switch", "typedef", "union", "unsigned", "void", "volatile", "while", "main",
+    "float_t", "double_t", "HUGE_VAL", "HUGE_VALF", "HUGE_VALL", "INFINITY", "NAN",
+    "FP_INFINITE", "FP_NAN", "FP_NORMAL", "FP_SUBNORMAL", "FP_ZERO", "FP_FAST_FMA",
+    "FP_FAST_FMAF", "FP_FAST_FMAL", "FP_ILOGB0", "FP_ILOGBNAN", "MATH_ERRNO",
+    "MATH_ERREXCEPT", "math_errhandling", "fpclassify", "isfinite", "isinf", "isnan",
+    "isnormal", "signbit", "isgreater", "isgreaterequal", "isless", "islessequal",
+    "islessgreater", "isunordered"
+  };
+  static const char *const functions[] = {
+    "acos", "asin", "atan", "atan2", "cos", "sin", "tan", "acosh", "asinh", "atanh",
+    "cosh", "sinh", "tanh", "exp", "exp2", "expm1", "frexp", "ilogb", "ldexp", "log",
+    "log10", "log1p", "log2", "logb", "modf", "scalbn", "scalbln", "cbrt", "fabs",
+    "hypot", "pow", "sqrt", "erf", "erfc", "lgamma", "tgamma", "ceil", "floor",
+    "nearbyint", "rint", "lrint", "llrint", "round", "lround", "llround", "trunc",
+    "fmod", "remainder", "remquo", "copysign", "nan", "nextafter", "nexttoward", "fdim",
+    "fmax", "fmin", "fma", "j0", "j1", "jn", "y0", "y1", "yn", "gamma", "drem",
+    "finite", "significand", "scalb", "exp10", "pow10", "sincos"
+  };
+
+  if (name[0] == '_' && (file_scope || isupper((unsigned char)name[1]) || name[1] == '_'))
+    return true;
+
+  for (size_t i = 0; i < sizeof keywords / sizeof *keywords; ++i)
+    if (!strcmp(name, keywords[i])) return true;
+
+  size_t length = strlen(name);
+  for (size_t i = 0; i < sizeof functions / sizeof *functions; ++i) {
+    size_t n = strlen(functions[i]);
+    if (!strncmp(name, functions[i], n)
+     && (length == n || (length == n + 1 && (name[n] == 'f' || name[n] == 'l'))))
+      return true;
+  }
+
+  return false;
+}
+
+
+/**
+ * @brief Finds a variable of a tree whose name would clash with C
+ * @details The variables are the parameters of the generated function, and
+ *          the indices of the aggregates are its local variables.
+ *
+ * @param root The root of the tree
+ * @return The name of the variable, or NULL if there is none
+ * @see codegen::is_reserved
+ */
+static const char *find_reserved_variable(ASTNode root)
+{
+  if (!root) return NULL;
+
+  if (root->token->type == VARIABLE && is_reserved(root->token->data, false))
+    return root->token->data;
+
+  const char *name = find_reserved_variable(root->left);
+  return name ? name : find_reserved_variable(root->right);
+}
+
+
+/**
+ * @brief Removes the leading and the trailing white spaces of a string
+ *
+ * @param str The string to trim
+ * @return The address of the first non-space character of the string
+ */
+static char *trim(char *str)
+{
+  while (isspace((unsigned char)*str)) ++str;
+
+  char *end = str + strlen(str);
+  while (end > str && isspace((unsigned char)end[-1])) --end;
+  *end = '\0';
+
+  return str;
+}
+
+
+/**
+ * @brief Writes a literal lexeme as a C long double constant
+ * @details An integer lexeme like '12' is written as '12.L', since '12L'
+ *          would be a long integer constant.
+ *
+ * @param out The output source file
+ * @param lexeme The literal lexeme
+ */
+static void emit_literal(FILE *out, const char *lexeme)
+{
+  if (strpbrk(lexeme, ".eE"))
+    fprintf(out, "%sL", lexeme);
+  else
+    fprintf(out, "%s.L", lexeme);
+}
+
+
+/**
+ * @brief Writes the prototype of the function of an expression
+ * @details The variables of the expression are the parameters of the
+ *          function, in the order they appear.
+ *
+ * @param out The output file
+ * @param name The name of the expression
+ * @param variables The variables of the expression
+ */
+static void emit_prototype(FILE *out, const char *name, Environment variables)
+{
+  fprintf(out, "long double %s(", name);
+  if (!variables->size) fprintf(out, "void");
+
+  for (size_t i = 0; i < variables->size; ++i)
+    fprintf(out, "%slong double %s", i ? ", " : "", variables->names[i]);
+
+  fprintf(out, ")");
+}
+
+
+static unsigned int emit_tree(FILE*, ASTNode, unsigned int*, int);
+
+
+/**
+ * @brief Writes the loop which computes an aggregate
+ * @details The index is a constant of the loop body, named after the index
+ *          variable, and the sum is compensated like at runtime, so the
+ *          rounding errors of the terms don't add up.
+ *
+ *          example: sum(i, 1, n, 1 / i)
+ *            long double t3 = 0.L, c3 = 0.L;
+ *            const long double n3 = floorl(t1 - t0) + 1.L;
+ *            if (isnan(t0) || isnan(t1) || (t1 >= t0 && !(n3 <= 0x1p62L))) t3 = NAN;
+ *            else for (long double k3 = 0.L; k3 < n3; ++k3) {
+ *              const long double i = t0 + k3;
+ *              ...
+ *            }
+ *
+ * @param out The output source file
+ * @param root The aggregate
+ * @param next Where to take the number of the next temporary
+ * @param indent The indentation of the statements
+ * @return The number of the temporary which holds the result of the aggregate
+ * @see Aggregate::eval_aggregate
+ */
+static unsigned int emit_aggregate(FILE *out, ASTNode root, unsigned int *next, int indent)
+{
+  ASTNode arguments = root->left;
+  bool sum = ((Function)root->token->data)->id == SERIES;
+
+  unsigned int lo = emit_tree(out, arguments->left->right, next, indent);
+  unsigned int hi = emit_tree(out, arguments->right, next, indent);
+  unsigned int tmp = (*next)++;
+
+  if (sum) fprintf(out, "%*slong double t%u = 0.L, c%u = 0.L;\n", indent, "", tmp, tmp);
+  else     fprintf(out, "%*slong double t%u = 1.L;\n", indent, "", tmp);
+  fprintf(out, "%*sconst long double n%u = floorl(t%u - t%u) + 1.L;\n", indent, "", tmp, hi, lo);
+  fprintf(out, "%*sif (isnan(t%u) || isnan(t%u) || (t%u >= t%u && !(n%u <= 0x1p62L))) t%u = NAN;\n",
+          indent, "", lo, hi, hi, lo, tmp, tmp);
+  fprintf(out, "%*selse for (long double k%u = 0.L; k%u < n%u; ++k%u) {\n", indent, "", tmp, tmp, tmp, tmp);
+  fprintf(out, "%*sconst long double %s = t%u + k%u;\n", indent + 2, "",
+          (char*)arguments->left->left->token->data, lo, tmp);
+
+  unsigned int body = emit_tree(out, root->right, next, indent + 2);
+
+  if (sum) {
+    fprintf(out, "%*sconst long double y%u = t%u - c%u, s%u = t%u + y%u;\n",
+            indent + 2, "", tmp, body, tmp, tmp, tmp, tmp);
+    fprintf(out, "%*sc%u = isfinite(s%u) ? (s%u - t%u) - y%u : 0.L;\n",
+            indent + 2, "", tmp, tmp, tmp, tmp, tmp);
+    fprintf(out, "%*st%u = s%u;\n", indent + 2, "", tmp, tmp);
+  } else {
+    fprintf(out, "%*st%u *= t%u;\n", indent + 2, "", tmp, body);
+  }
+
+  fprintf(out, "%*s}\n", indent, "");
+  if (sum) fprintf(out, "%*st%u -= c%u;\n", indent, "", tmp, tmp);
+
+  return tmp;
+}
+
+
+/**
+ * @brief Writes the loop which adds the values of the arguments of
+ *        a variadic call, or their squared deviations from their mean
+ * @details The sum is compensated like at runtime.
+ *
+ * @param out The output source file
+ * @param sum The name of the sum
+ * @param compensation The name of its compensation
+ * @param tmp The number of the call
+ * @param deviation true to add the squared deviations from m<tmp>
+ * @param indent The indentation of the statements
+ */
+static void emit_variadic_sum(FILE *out, char sum, char compensation, unsigned int tmp,
+                              bool deviation, int indent)
+{
+  fprintf(out, "%*slong double %c%u = 0.L, %c%u = 0.L;\n", indent, "", sum, tmp, compensation, tmp);
+  fprintf(out, "%*sfor (unsigned int k%u = 0; k%u < sizeof v%u / sizeof *v%u; ++k%u) {\n",
+          indent, "", tmp, tmp, tmp, tmp, tmp);
+
+  if (deviation)
+    fprintf(out, "%*sconst long double y%u = (v%u[k%u] - m%u) * (v%u[k%u] - m%u) - %c%u, ",
+            indent + 2, "", tmp, tmp, tmp, tmp, tmp, tmp, tmp, compensation, tmp);
+  else
+    fprintf(out, "%*sconst long double y%u = v%u[k%u] - %c%u, ",
+            indent + 2, "", tmp, tmp, tmp, compensation, tmp);
+  fprintf(out, "u%u = %c%u + y%u;\n", tmp, sum, tmp, tmp);
+
+  fprintf(out, "%*s%c%u = isfinite(u%u) ? (u%u - %c%u) - y%u : 0.L;\n",
+          indent + 2, "", compensation, tmp, tmp, tmp, sum, tmp, tmp);
+  fprintf(out, "%*s%c%u = u%u;\n", indent + 2, "", sum, tmp, tmp);
+  fprintf(out, "%*s}\n", indent, "");
+}
+
+
+/**
+ * @brief Writes the statements which compute a variadic call
+ * @details max and min compare the arguments one after the other; total,
+ *          mean and stddev gather them in an array, and add them in a loop.
+ *
+ *          example: mean(x, y, 2)
+ *            const long double v3[] = { t0, t1, t2 };
+ *            long double s3 = 0.L, c3 = 0.L;
+ *            for (unsigned int k3 = 0; k3 < sizeof v3 / sizeof *v3; ++k3) {
+ *              ...
+ *            }
+ *            const long double t3 = (s3 - c3) / 3.L;
+ *
+ * @param out The output source file
+ * @param root The call
+ * @param next Where to take the number of the next temporary
+ * @param indent The indentation of the statements
+ * @return The number of the temporary which holds the result of the call
+ * @see AST::get_arguments, Aggregate::reduce_values
+ */
+static unsigned int emit_variadic(FILE *out, ASTNode root, unsigned int *next, int indent)
+{
+  FunctionID id = ((Function)root->token->data)->id;
+
+  size_t n = get_arguments(root, NULL);
+  ASTNode *arguments = malloc(n * sizeof(*arguments));
+  unsigned int *values = malloc(n * sizeof(*values));
+  assert(n > 0 && arguments != NULL && values != NULL);
+
+  get_arguments(root, arguments);
+  for (size_t i = 0; i < n; ++i)
+    values[i] = emit_tree(out, arguments[i], next, indent);
+
+  unsigned int tmp = (*next)++;
+
+  if (id == MAX || id == MIN) {
+    fprintf(out, "%*slong double t%u = t%u;\n", indent, "", tmp, values[0]);
+    for (size_t i = 1; i < n; ++i)
+      fprintf(out, "%*sif (t%u %c t%u || isnan(t%u)) t%u = t%u;\n", indent, "",
+              values[i], id == MAX ? '>' : '<', tmp, tmp, tmp, values[i]);
+  } else {
+    fprintf(out, "%*sconst long double v%u[] = { ", indent, "", tmp);
+    for (size_t i = 0; i < n; ++i)
+      fprintf(out, "%st%u", i ? ", " : "", values[i]);
+    fprintf(out, " };\n");
+
+    emit_variadic_sum(out, 's', 'c', tmp, false, indent);
+
+    if (id == TOTAL) {
+      fprintf(out, "%*sconst long double t%u = s%u - c%u;\n", indent, "", tmp, tmp, tmp);
+    } else if (id == MEAN) {
+      fprintf(out, "%*sconst long double t%u = (s%u - c%u) / %zu.L;\n", indent, "", tmp, tmp, tmp, n);
+    } else {
+      fprintf(out, "%*sconst long double m%u = (s%u - c%u) / %zu.L;\n", indent, "", tmp, tmp, tmp, n);
+      emit_variadic_sum(out, 'q', 'd', tmp, true, indent);
+      fprintf(out, "%*sconst long double t%u = sqrtl((q%u - d%u) / %zu.L);\n",
+              indent, "", tmp, tmp, tmp, n);
+    }
+  }
+
+  free(values);
+  free(arguments);
+
+  return tmp;
+}
+
+
+/**
+ * @brief Checks if a tree calls a driver: solve or integrate
+ * @details The drivers choose their points as they go, which straight-line
+ *          code can't do, so they are left to the evaluator.
+ *
+ * @param root The root of the tree
+ * @return true if the tree has a driver
+ * @see Function::is_driver
+ */
+static bool has_driver(ASTNode root)
+{
+  if (!root) return false;
+
+  Token token = root->token;
+  if (token->type == FUNCTION && is_driver(((Function)token->data)->id)) return true;
+
+  return has_driver(root->left) || has_driver(root->right);
+}
+
+
+/**
+ * @brief Writes the statements which compute a parse tree
+ * @details Walks the tree in post-order, and assigns the result of each node
+ *          to a new temporary, so the generated function is straight-line
+ *          code, but for the loops of the aggregates and of the variadic
+ *          calls.
+ *
+ *          example: sin(5.12 * .6)
+ *            const long double t0 = 5.12L;
+ *            const long double t1 = .6L;
+ *            const long double t2 = t0 * t1;
+ *            const long double t3 = sinl(t2);
+ *
+ * @param out The output source file
+ * @param root The root of the tree
+ * @param next Where to take the number of the next temporary
+ * @param indent The indentation of the statements
+ * @return The number of the temporary which holds the result of the tree
+ */
+static unsigned int emit_tree(FILE *out, ASTNode root, unsigned int *next, int indent)
+{
+  const char *ufuncs[] = { "sinl", "cosl", "tanl", "sqrtl", "fabsl", "logl" };
+
+  Token token = root->token;
+  if (token->type == FUNCTION && get_function_type(token->data) == AGGREGATE)
+    return emit_aggregate(out, root, next, indent);
+
+  if (token->type == FUNCTION && get_function_type(token->data) == VARIADIC)
+    return emit_variadic(out, root, next, indent);
+
+  unsigned int lc = 0, rc = 0;
+  if (root->left)  lc = emit_tree(out, root->left, next, indent);
+  if (root->right) rc = emit_tree(out, root->right, next, indent);
+
+  unsigned int tmp = (*next)++;
+  fprintf(out, "%*sconst long double t%u = ", indent, "", tmp);
+
+  if (token->type == LITERAL) {
+    emit_literal(out, token->data);
+  } else if (token->type == VARIABLE) {
+    fprintf(out, "%s", (char*)token->data);
+  } else if (token->type == FUNCTION) {
+    fprintf(out, "%s(t%u)", ufuncs[((Function)token->data)->id], rc);
+  } else {
+    switch (token->type) {
+      case UMINUS:
+                  fprintf(out, "-t%u", rc);
+                  break;
+      case EXPONENT:
+                  fprintf(out, "powl(t%u, t%u)", lc, rc);
+                  break;
+      case MODULO:
+                  fprintf(out, "remainderl(t%u, t%u)", lc, rc);
+                  break;
+      default:
+                  fprintf(out, "t%u %s t%u", lc, ((Operator)token->data)->value, rc);
+                  break;
+    }
+  }
+  fprintf(out, ";\n");
+
+  return tmp;
+}
+
+
+/**
+ * @brief Writes an expression as a comment, so the generated code can be
+ *        traced back to its source
+ *
+ * @param out The output file
+ * @param name The name of the expression
+ * @param expression The expression to write
+ */
+static void emit_comment(FILE *out, const char *name, const char *expression)
+{
+  fprintf(out, "/* %s = ", name);
+  for (const char *p = expression; *p; ++p) {
+    fputc(*p, out);
+    if (p[0] == '*' && p[1] == '/') fputc(' ', out);
+  }
+  fprintf(out, " */\n");
+}
+
+
+/**
+ * The files being written, which are removed if codegen fails
+ */
+static char *temporaries[2] = {NULL, NULL};
+
+
+/**
+ * @brief Removes the files being written, at exit
+ * @details The files are renamed once they are complete, so an error never
+ *          leaves a partial '<basename>.c' or '<basename>.h' behind, which
+ *          make would take as up to date.
+ */
+static void remove_temporaries(void)
+{
+  for (size_t k = 0; k < 2; ++k)
+    if (temporaries[k]) {
+      remove(temporaries[k]);
+      free(temporaries[k]);
+    }
+}
+
+
+/**
+ * @brief Creates the temporary file of an output file
+ *
+ * @param k The number of the output file
+ * @param base The basename of the output files
+ * @param extension The extension of the output file
+ * @return The temporary file, or NULL if it can't be created
+ */
+static FILE *create_temporary(size_t k, const char *base, const char *extension)
+{
+  temporaries[k] = malloc(strlen(base) + strlen(extension) + 5);
+  assert(temporaries[k] != NULL);
+  sprintf(temporaries[k], "%s%s.tmp", base, extension);
+
+  return fopen(temporaries[k], "w");
+}
+
+
+/**
+ * @brief Replaces an output file by its complete temporary file
+ *
+ * @param k The number of the output file
+ * @return true if the output file was replaced, false otherwise
+ */
+static bool commit_temporary(size_t k)
+{
+  char *path = strdup(temporaries[k]);
+  assert(path != NULL);
+  path[strlen(path) - 4] = '\0';
+
+  bool renamed = !rename(temporaries[k], path);
+  if (renamed) {
+    free(temporaries[k]);
+    temporaries[k] = NULL;
+  }
+  free(path);
+
+  return renamed;
+}
+
+
+/**
+ * @brief Generates C code from a file of named expressions
+ * @details Each line of the input file has the form 'name = expression'.
+ *          Empty lines and lines starting with '#' are ignored. A line
+ *          'f(x, y) = expression' defines a function, which the lines after
+ *          it may call: its body is inlined at each call, so nothing is
+ *          generated for it.
+ *
+ *          For each expression, a function 'long double name(void)' is
+ *          written into '<basename>.c' and declared into '<basename>.h'.
+ *          The variables of the expression, if any, are the parameters
+ *          of the function: 'long double name(long double x, ...)'.
+ *          The functions are straight-line code (but for the loops of the
+ *          aggregates), so no parsing is left to be done at runtime and the
+ *          compiler can fully optimize them.
+ *
+ *          usage: codegen <expressions file> <basename>
+ */
+int main(int argc, char *argv[])
+{
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <expressions file> <basename>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  FILE *in = fopen(argv[1], "r");
+  if (!in) {
+    fprintf(stderr, "Can't open '%s'\n", argv[1]);
+    exit(EXIT_FAILURE);
+  }
+
+  // The files are written aside, and renamed once they are complete
+  atexit(remove_temporaries);
+  FILE *src = create_temporary(0, argv[2], ".c");
+  FILE *hdr = create_temporary(1, argv[2], ".h");
+  if (!src || !hdr) {
+    fprintf(stderr, "Can't create '%s.c' or '%s.h'\n", argv[2], argv[2]);
+    exit(EXIT_FAILURE);
+  }
+
+  // The include guard and the include path are taken from the file name
+  const char *base = strrchr(argv[2], '/');
+  base = base ? base + 1 : argv[2];
+
+  char *guard = malloc(strlen(base) + 3);
+  assert(guard != NULL);
+  size_t i = 0;
+  for (; base[i]; ++i)
+    guard[i] = isalnum((unsigned char)base[i]) ? (char)toupper((unsigned char)base[i]) : '_';
+  strcpy(guard + i, "_H");
+
+  fprintf(hdr, "/* Generated by codegen from '%s'. Do not edit. */\n", argv[1]);
+  fprintf(hdr, "#ifndef %s\n#define %s\n\n", guard, guard);
+  fprintf(src, "/* Generated by codegen from '%s'. Do not edit. */\n", argv[1]);
+  fprintf(src, "#include <math.h>\n\n#include \"%s.h\"\n", base);
+
+  char **names = NULL;
+  size_t nbr_names = 0;
+
+  char *line = NULL;
+  size_t capacity = 0;
+  size_t lineno = 0;
+  while (getline(&line, &capacity, in) != -1)
+  {
+    ++lineno;
+
+    char *name = trim(line);
+    if (*name == '\0' || *name == '#') continue;
+
+    char *equal = strchr(name, '=');
+    if (!equal) {
+      fprintf(stderr, "%s:%zu: Expected 'name = expression'\n", argv[1], lineno);
+      exit(EXIT_FAILURE);
+    }
+    char *parenthesis = strchr(name, '(');
+    if (parenthesis && parenthesis < equal) {
+      parse_error_t error;
+      if (!define_function(name, strlen(name), NULL, &error)) {
+        fprintf(stderr, "%s:%zu: ", argv[1], lineno);
+        print_parse_error(stderr, name, strlen(name), &error);
+        exit(EXIT_FAILURE);
+      }
+      continue;
+    }
+    *equal = '\0';
+
+    char *expression = trim(equal + 1);
+    name = trim(name);
+    if (!is_identifier(name)) {
+      fprintf(stderr, "%s:%zu: '%s' is not a valid name\n", argv[1], lineno, name);
+      exit(EXIT_FAILURE);
+    }
+    if (is_reserved(name, true) || !strcmp(name, guard)) {
+      fprintf(stderr, "%s:%zu: '%s' is a reserved name in C\n", argv[1], lineno, name);
+      exit(EXIT_FAILURE);
+    }
+    for (size_t k = 0; k < nbr_names; ++k)
+      if (!strcmp(names[k], name)) {
+        fprintf(stderr, "%s:%zu: '%s' is defined twice\n", argv[1], lineno, name);
+        exit(EXIT_FAILURE);
+      }
+
+    names = realloc(names, (nbr_names + 1) * sizeof(*names));
+    assert(names != NULL);
+    names[nbr_names] = strdup(name);
+    assert(names[nbr_names] != NULL);
+    ++nbr_names;
+
+    parse_error_t error;
+    ASTNode root = parse_expression(expression, strlen(expression), &error);
+    if (!root) {
+      fprintf(stderr, "%s:%zu: ", argv[1], lineno);
+      print_parse_error(stderr, expression, strlen(expression), &error);
+      exit(EXIT_FAILURE);
+    }
+
+    const char *reserved = find_reserved_variable(root);
+    if (reserved) {
+      fprintf(stderr, "%s:%zu: the variable '%s' is a reserved name in C\n", argv[1], lineno,
+              reserved);
+      exit(EXIT_FAILURE);
+    }
+
+    if (has_driver(root)) {
+      fprintf(stderr, "%s:%zu: solve and integrate can't be generated\n", argv[1], lineno);
+      exit(EXIT_FAILURE);
+    }
+
+    Environment variables = create_environment();
+    collect_variables(root, variables);
+
+    emit_prototype(hdr, name, variables);
+    fprintf(hdr, ";\n");
+
+    fprintf(src, "\n");
+    emit_comment(src, name, expression);
+    emit_prototype(src, name, variables);
+    fprintf(src, "\n{\n");
+    unsigned int next = 0;
+    unsigned int result = emit_tree(src, root, &next, 2);
+    fprintf(src, "  return t%u;\n}\n", result);
+
+    delete_environment(variables);
+    root->destroy(root);
+  }
+
+  fprintf(hdr, "\n#endif\n");
+
+  bool written = !ferror(src) && !ferror(hdr);
+  written = !fclose(src) && written;
+  written = !fclose(hdr) && written;
+  if (!written || !commit_temporary(0) || !commit_temporary(1)) {
+    fprintf(stderr, "Can't write '%s.c' or '%s.h'\n", argv[2], argv[2]);
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t k = 0; k < nbr_names; ++k) free(names[k]);
+  free(names);
+  free(line);
+  free(guard);
+  fclose(in);
+
+  return 0;
+}
@@ -0,0 +1,174 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "../CommonHeaders.h"
+#include "../parser/AST.h"
+#include "../parser/Parser.h"
+#include "../parser/NodePool.h"
+#include "../parser/Definition.h"
+#include "../eval/Optimize.h"
+#include "../io/Compiled.h"
+
+
+/**
+ * @brief Removes the leading and the trailing white spaces of a string
+ *
+ * @param str The string to trim
+ * @return The address of the first non-space character of the string
+ */
+static char *trim(char *str)
+{
+  while (isspace((unsigned char)*str)) ++str;
+
+  char *end = str + strlen(str);
+  while (end > str && isspace((unsigned char)end[-1])) --end;
+  *end = '\0';
+
+  return str;
+}
+
+
+/**
+ * @brief Parses an expression, and optimizes it if asked
+ *
+ * @param expression The expression
+ * @param optimize true to optimize the expression
+ * @param error Where to store the error if the expression is malformed
+ * @return The pool of the expression, or NULL if it is malformed
+ * @see Parser::parse_expression_pool, Optimize::optimize_tree,
+ *      NodePool::create_pool_from_tree
+ */
+static NodePool compile_expression(const char *expression, bool optimize, ParseError error)
+{
+  size_t length = strlen(expression);
+
+  if (!optimize) return parse_expression_pool(expression, length, error);
+
+  ASTNode root = parse_expression(expression, length, error);
+  if (!root) return NULL;
+
+  root = optimize_tree(root);
+  NodePool pool = create_pool_from_tree(root);
+  root->destroy(root);
+
+  return pool;
+}
+
+
+/**
+ * @brief Compiles a file of named expressions into a binary file, which is
+ *        loaded with 'main -c' without parsing anything
+ * @details The expressions file has one 'name = expression' per line, like
+ *          the files of codegen; lines starting with '#' are comments, and
+ *          a line 'f(x, y) = expression' defines a function which the lines
+ *          after it may call. With
+ *          -O, the expressions are optimized before they are written. The
+ *          layout of the output is documented in io/Compiled.h.
+ *
+ *          usage: compile [-O] <expressions file> <output file>
+ */
+int main(int argc, char *argv[])
+{
+  bool optimize = argc == 4 && !strcmp(argv[1], "-O");
+  if (argc != 3 + optimize) {
+    fprintf(stderr, "usage: %s [-O] <expressions file> <output file>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  const char *input = argv[1 + optimize], *output = argv[2 + optimize];
+
+  FILE *in = fopen(input, "r");
+  if (!in) {
+    fprintf(stderr, "Can't open '%s'\n", input);
+    exit(EXIT_FAILURE);
+  }
+
+  char **names = NULL;
+  NodePool *pools = NULL;
+  size_t count = 0, capacity = 0;
+
+  char *line = NULL;
+  size_t line_capacity = 0;
+  size_t lineno = 0;
+  while (getline(&line, &line_capacity, in) != -1)
+  {
+    ++lineno;
+
+    char *name = trim(line);
+    if (*name == '\0' || *name == '#') continue;
+
+    char *equal = strchr(name, '=');
+    if (!equal) {
+      fprintf(stderr, "%s:%zu: Expected 'name = expression'\n", input, lineno);
+      exit(EXIT_FAILURE);
+    }
+    char *parenthesis = strchr(name, '(');
+    if (parenthesis && parenthesis < equal) {
+      parse_error_t error;
+      if (!define_function(name, strlen(name), NULL, &error)) {
+        fprintf(stderr, "%s:%zu: ", input, lineno);
+        print_parse_error(stderr, name, strlen(name), &error);
+        exit(EXIT_FAILURE);
+      }
+      continue;
+    }
+    *equal = '\0';
+
+    char *expression = trim(equal + 1);
+    name = trim(name);
+    if (!*name) {
+      fprintf(stderr, "%s:%zu: Expected a name before '='\n", input, lineno);
+      exit(EXIT_FAILURE);
+    }
+
+    parse_error_t error;
+    NodePool pool = compile_expression(expression, optimize, &error);
+    if (!pool) {
+      fprintf(stderr, "%s:%zu: ", input, lineno);
+      print_parse_error(stderr, expression, strlen(expression), &error);
+      exit(EXIT_FAILURE);
+    }
+
+    if (count == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      names = realloc(names, capacity * sizeof(*names));
+      pools = realloc(pools, capacity * sizeof(*pools));
+      assert(names != NULL && pools != NULL);
+    }
+
+    names[count] = strdup(name);
+    assert(names[count] != NULL);
+    pools[count++] = pool;
+  }
+
+  FILE *out = fopen(output, "wb");
+  if (!out) {
+    fprintf(stderr, "Can't create '%s'\n", output);
+    exit(EXIT_FAILURE);
+  }
+
+  if (!write_compiled_file(out, (const char *const*)names, pools, count) || fclose(out)) {
+    if (errno == EINVAL)
+      fprintf(stderr, "%s: An expression name is defined twice\n", input);
+    else
+      fprintf(stderr, "Can't write '%s'\n", output);
+    remove(output);
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    free(names[i]);
+    delete_node_pool(pools[i]);
+  }
+
+  free(names);
+  free(pools);
+  free(line);
+  fclose(in);
+
+  return 0;
+}
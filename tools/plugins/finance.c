@@ -0,0 +1,86 @@
+#include <math.h>
+
+#include "../../eval/Plugin.h"
+
+/**
+ * A sample plugin of pricing and interpolation functions
+ *
+ *   make tools/plugins/finance.so
+ *   ./main -l ./tools/plugins/finance.so -x "bscall(spot, 100, t, 0.02, vol)" < quotes.csv
+ *
+ *   function                     value
+ *   ---------------------------  ------------------------------------------
+ *   ncdf(x)                      the standard normal distribution at x
+ *   discount(r, t)               e^(-rt), the value today of 1 paid at t
+ *   bscall(s, k, t, r, v)        the Black-Scholes price of a European call
+ *   interp(x, xa, ya, xb, yb)    the line through (xa, ya) and (xb, yb) at x
+ */
+
+
+/**
+ * @brief The standard normal distribution, from the complementary error
+ *        function so its tail keeps its digits
+ */
+static long double normal(long double x)
+{
+  return 0.5L * erfcl(-x / sqrtl(2.0L));
+}
+
+
+static long double ncdf(const long double *a)
+{
+  return normal(a[0]);
+}
+
+
+static void ncdf_array(const long double *const *a, long double *out, size_t n)
+{
+  for (size_t l = 0; l < n; ++l) out[l] = normal(a[0][l]);
+}
+
+
+static long double discount(const long double *a)
+{
+  return expl(-a[0] * a[1]);
+}
+
+
+static void discount_array(const long double *const *a, long double *out, size_t n)
+{
+  for (size_t l = 0; l < n; ++l) out[l] = expl(-a[0][l] * a[1][l]);
+}
+
+
+/**
+ * @brief The Black-Scholes price of a European call: spot, strike, time to
+ *        expiry in years, risk-free rate and volatility
+ */
+static long double bscall(const long double *a)
+{
+  long double s = a[0], k = a[1], t = a[2], r = a[3], v = a[4];
+  if (!(t > 0.0L) || !(v > 0.0L)) return fmaxl(s - k * expl(-r * t), 0.0L);
+
+  long double deviation = v * sqrtl(t);
+  long double d1 = (logl(s / k) + (r + v * v / 2) * t) / deviation;
+
+  return s * normal(d1) - k * expl(-r * t) * normal(d1 - deviation);
+}
+
+
+static long double interp(const long double *a)
+{
+  long double x = a[0], xa = a[1], ya = a[2], xb = a[3], yb = a[4];
+
+  return ya + (yb - ya) * (x - xa) / (xb - xa);
+}
+
+
+static const plugin_function_t functions[] = {
+  { "ncdf",     1, ncdf,     ncdf_array },
+  { "discount", 2, discount, discount_array },
+  { "bscall",   5, bscall,   NULL },
+  { "interp",   5, interp,   NULL },
+};
+
+const plugin_table_t calc_plugin = { PLUGIN_VERSION, sizeof functions / sizeof *functions,
+                                     functions };
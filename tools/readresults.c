@@ -0,0 +1,74 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Number.h"
+#include "../io/MappedFile.h"
+#include "../io/Records.h"
+
+
+/**
+ * @brief Prints the binary results written by the batch mode as text
+ * @details The file is mapped and its records are read in place, as an
+ *          array which follows the header (see Records.h). Each record is
+ *          printed on its own line: index, status, position and value.
+ *
+ *          usage: readresults <results file>
+ */
+int main(int argc, char *argv[])
+{
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <results file>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  MappedFile file = open_mapped_file(argv[1]);
+  if (!file) {
+    perror(argv[1]);
+    exit(EXIT_FAILURE);
+  }
+
+  const result_header_t *header = (const result_header_t*)file->data;
+  bool valid = file->size >= sizeof *header
+            && !memcmp(header->magic, RESULT_MAGIC, sizeof RESULT_MAGIC);
+
+  // The older versions are subsets of this one, the newer ones are unknown
+  if (valid && (header->version < 1 || header->version > RESULT_VERSION)) {
+    fprintf(stderr, "'%s' is a results file of version %u, expected at most %u\n", argv[1],
+            (unsigned int)header->version, (unsigned int)RESULT_VERSION);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t record_size = 0;
+  if (valid && header->value_type == RESULT_DOUBLE)
+    record_size = sizeof(result_double_t);
+  else if (valid && header->value_type == RESULT_LONG_DOUBLE)
+    record_size = sizeof(result_long_double_t);
+
+  if (!record_size || header->record_size != record_size
+   || (file->size - sizeof *header) % record_size) {
+    fprintf(stderr, "'%s' is not a results file\n", argv[1]);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t count = (file->size - sizeof *header) / record_size;
+  const result_double_t *doubles = (const result_double_t*)(header + 1);
+  const result_long_double_t *long_doubles = (const result_long_double_t*)(header + 1);
+
+  char str[NUMBER_BUFFER_SIZE];
+  for (size_t i = 0; i < count; ++i) {
+    if (header->value_type == RESULT_DOUBLE) {
+      format_number(doubles[i].value, str, sizeof str);
+      printf("%llu %u %u %s\n", (unsigned long long)doubles[i].index,
+             doubles[i].status, doubles[i].position, str);
+    } else {
+      format_number(long_doubles[i].value, str, sizeof str);
+      printf("%llu %u %u %s\n", (unsigned long long)long_doubles[i].index,
+             long_doubles[i].status, long_doubles[i].position, str);
+    }
+  }
+
+  close_mapped_file(file);
+
+  return 0;
+}
@@ -0,0 +1,721 @@
+#!/bin/sh
+#
+# Regression tests, run by 'make check' from the top of the tree. Each test
+# runs a program of the tree on a generated input and compares what it
+# prints and its exit status with the expected ones.
+
+main=./main
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+failures=0
+
+# expect NAME EXPECTED ACTUAL
+expect()
+{
+  if [ "$2" = "$3" ]; then
+    echo "ok   $1"
+  else
+    echo "FAIL $1"
+    echo "     expected: $2"
+    echo "     got:      $3"
+    failures=$((failures + 1))
+  fi
+}
+
+# evaluate EXPRESSION: prints the last step of main
+evaluate()
+{
+  echo "$1" | $main | sed -n 's/^[[:space:]]*= //p' | tail -n 1
+}
+
+# codegen: the generated functions compute what main -f computes, to the
+# last bit, since both print with format_number
+cat > "$tmp/formulas.expr" <<'END'
+# formulas
+area  = 3.14159 * 2 ^ 2
+angle = tan(max(sin(5.12 * .6), -3.34 + 6 / 4 * 10))
+mixed = ln(abs(-7.5)) - sqrt(2) / min(3, 4) + 10 % 4
+END
+./codegen "$tmp/formulas.expr" "$tmp/formulas"
+cat > "$tmp/driver.c" <<'END'
+#include <stdio.h>
+#include "formulas.h"
+#include "lexer/Number.h"
+static void print(long double value)
+{
+  char str[NUMBER_BUFFER_SIZE];
+  format_number(value, str, sizeof str);
+  printf("%s\n", str);
+}
+int main(void)
+{
+  print(area());
+  print(angle());
+  print(mixed());
+  return 0;
+}
+END
+out=$(gcc -std=c11 -Wall -Werror -I. -I"$tmp" -o "$tmp/driver" "$tmp/driver.c" "$tmp/formulas.c" \
+          lexer/Number.o -lm && "$tmp/driver")
+expected=$(grep '=' "$tmp/formulas.expr" | sed 's/^[^=]*=//' > "$tmp/formulas.txt"
+           $main -f "$tmp/formulas.txt")
+expect "codegen values" "$expected" "$out"
+
+# codegen refuses the names the generated C can't use, and keeps the files
+# of the last good run
+for name in int exp floorl powl main _x FORMULAS_H; do
+  echo "$name = 1" > "$tmp/bad.expr"
+  out=$(./codegen "$tmp/bad.expr" "$tmp/formulas" 2>&1; echo "rc=$?")
+  expect "codegen name $name" "$tmp/bad.expr:1: '$name' is a reserved name in C
+rc=1" "$out"
+done
+
+printf 'a = 1\na = 2\n' > "$tmp/bad.expr"
+out=$(./codegen "$tmp/bad.expr" "$tmp/formulas" 2>&1; echo "rc=$?")
+expect "codegen duplicate" "$tmp/bad.expr:2: 'a' is defined twice
+rc=1" "$out"
+
+out=$(cat "$tmp/formulas.h" | grep -c 'long double'; ls "$tmp" | grep -c '\.tmp$')
+expect "codegen keeps the last files" "3
+0" "$out"
+
+# The parser follows the precedence and the associativity of the operators,
+# and reports malformed expressions with their position
+for test in '2^3^2:512' '-2^2:-4' '1-2-3:-4' '2*3+4*5:26' '(1+2)*3:9' '8/4/2:1'; do
+  expect "parse ${test%%:*}" "${test#*:}" "$(evaluate "${test%%:*}")"
+done
+
+# error EXPRESSION: prints the error of main
+error()
+{
+  echo "$1" | $main 2>&1 >/dev/null | head -n 1
+}
+
+expect "error operand" "Error: Expected an operand at position 2" "$(error '1+')"
+expect "error open" "Error: Unmatched parenthesis at position 4" "$(error '(1+2')"
+expect "error close" "Error: Unmatched parenthesis at position 3" "$(error '1+2)')"
+expect "error arity" "Error: Expected ')' after the function arguments at position 5" \
+       "$(error 'sin(1,2)')"
+expect "error function" "Error: Unknown function at position 0" "$(error 'foo(1)')"
+expect "error character" "Error: Unexpected character at position 2" "$(error '1 $ 2')"
+
+# The scanner skips runs of any length, across its blocks of 16 and 32 bytes
+spaces=''; zeros=''; letters=''; scanned=0
+for n in $(seq 1 45); do
+  spaces="$spaces "; zeros="${zeros}0"; letters="${letters}x"
+  [ "$(evaluate "1$spaces+${zeros}2 * sqrt$spaces(${zeros}4)")" = 5 ] \
+  && [ "$(error "$letters(1)")" = "Error: Unknown function at position 0" ] \
+  && scanned=$((scanned + 1))
+done
+expect "scan runs" 45 "$scanned"
+
+# The literals are converted like strtold does, bit for bit
+numbers=$(./checknumber)
+expect "literals" "200029 literals checked, 0 different from strtold" "$(echo "$numbers" | head -n 1)"
+
+# The results are written with the fewest digits which read back to them
+expect "formats" "50029 numbers formatted, 0 not the shortest round trip" \
+       "$(echo "$numbers" | tail -n 1)"
+for test in '78e+23 * 2:1.56e+25' '1/3:0.33333333333333333334' '2^64:18446744073709551616' \
+            '-0.5:-0.5' '1e300*1e300:1e+600' '0.1*3:0.3'; do
+  expect "format ${test%%:*}" "${test#*:}" "$(evaluate "${test%%:*}")"
+done
+
+# The batch mode prints one result or one error for each line
+printf '1+1\n\n(2\nsin(0)\nfoo(1)\n' > "$tmp/lines.txt"
+out=$($main -f "$tmp/lines.txt" 2>&1; echo "rc=$?")
+expect "batch" "2
+error: Empty expression at position 0
+error: Unmatched parenthesis at position 2
+0
+error: Unknown function at position 0
+rc=0" "$out"
+
+# The chunks of a large file are written in order, whatever the workers
+awk 'BEGIN { for (i = 0; i < 400000; ++i) printf "%d * 3 + sqrt(%d)\n", i, i }' > "$tmp/large.txt"
+$main -f "$tmp/large.txt" -j 1 > "$tmp/large.1"
+$main -f "$tmp/large.txt" -j 4 > "$tmp/large.4"
+out=$(wc -l < "$tmp/large.1"; sed -n '2p;$p' "$tmp/large.1"; cmp "$tmp/large.1" "$tmp/large.4" && echo same)
+expect "batch chunks" "400000
+4
+1200629.4547414637667
+same" "$out"
+
+# A file which can't be mapped, like a pipe or a FIFO, is read instead
+out=$(printf '1+1\n2*3\n' | $main -f /dev/stdin 2>&1; echo "rc=$?")
+expect "pipe" "2
+6
+rc=0" "$out"
+
+mkfifo "$tmp/fifo"
+printf 'sqrt(16)\n' > "$tmp/fifo" &
+out=$($main -f "$tmp/fifo" 2>&1; echo "rc=$?")
+wait
+expect "fifo" "4
+rc=0" "$out"
+
+out=$(awk 'BEGIN { for (i = 0; i < 100000; ++i) print i "+1" }' | $main -f /dev/stdin | sed -n '1p;$p')
+expect "long pipe" "1
+1e+5" "$out"
+
+# The binary records: a header, then the index, the status, the position
+# and the value of each line, in the layout of io/Records.h
+printf '1+1\n(2\n0.5\n' > "$tmp/records.txt"
+out=$($main -o double -f "$tmp/records.txt" | od -An -tx1 -w8 -v)
+expect "records double" " 43 41 4c 43 52 45 53 00
+ 02 00 01 00 18 00 00 00
+ 00 00 00 00 00 00 00 00
+ 00 00 00 00 00 00 00 00
+ 00 00 00 00 00 00 00 40
+ 01 00 00 00 00 00 00 00
+ 01 00 00 00 02 00 00 00
+ 00 00 00 00 00 00 f8 7f
+ 02 00 00 00 00 00 00 00
+ 00 00 00 00 00 00 00 00
+ 00 00 00 00 00 00 e0 3f" "$out"
+
+out=$($main -o long-double -f "$tmp/records.txt" | od -An -tx1 -N16)
+expect "records long double header" " 43 41 4c 43 52 45 53 00 02 00 02 00 20 00 00 00" "$out"
+
+$main -o long-double -f "$tmp/records.txt" > "$tmp/records.bin"
+out=$(./readresults "$tmp/records.bin")
+expect "readresults" "0 0 0 2
+1 1 2 nan
+2 0 0 0.5" "$out"
+
+# The records of the chunks are numbered across the whole file
+$main -o double -f "$tmp/large.txt" -j 4 > "$tmp/large.bin"
+out=$(./readresults "$tmp/large.bin" | sed -n '2p;$p'; $main -o double -f "$tmp/large.txt" -j 1 | cmp - "$tmp/large.bin" && echo same)
+expect "records chunks" "1 0 0 4
+399999 0 0 1200629.4547414637636
+same" "$out"
+
+# The subtrees of a large expression evaluated in parallel give the serial
+# result, bit for bit
+awk 'function tree(lo, hi,  mid) {
+       if (lo == hi) return "sin(" lo ")*" lo "/3";
+       mid = int((lo + hi) / 2);
+       return "(" tree(lo, mid) (lo % 3 ? "+" : "-") tree(mid + 1, hi) ")";
+     }
+     BEGIN { print tree(1, 8192); print tree(1, 5000) "*" tree(1, 3000) }' > "$tmp/wide.txt"
+$main -f "$tmp/wide.txt" -t 1 -o long-double > "$tmp/wide.1"
+out=$($main -f "$tmp/wide.txt" -t 4 -o long-double | cmp - "$tmp/wide.1" && echo same
+      ./readresults "$tmp/wide.1" | wc -l)
+expect "parallel subtrees" "same
+2" "$out"
+
+# The derivatives with respect to the -d variables follow each result
+printf 'x^3\nsin(x)*y\nln(x)+sqrt(x)\nx/y - y%%x\nmax(x,y)\nabs(-x)*tan(0)\nz\n' > "$tmp/gradient.txt"
+out=$($main -D x=2 -D y=3 -d x,y -f "$tmp/gradient.txt" 2>&1; echo "rc=$?")
+expect "derivatives" "8 12 0
+2.7278922804770450862 -1.2484405096414271611 0.9092974268256816954
+2.1073607429330403582 0.8535533905932737622 0
+1.6666666666666666667 2.3333333333333333333 -1.2222222222222222222
+3 0 1
+0 0 0
+error: Unbound variable 'z'
+rc=0" "$out"
+
+# The binary records have no room for the derivatives
+for format in double long-double; do
+  out=$($main -D x=2 -d x -o $format -f "$tmp/gradient.txt" 2>&1; echo "rc=$?")
+  expect "-d with -o $format" "$main: -d can't be written with -o double or -o long-double
+rc=1" "$out"
+done
+
+# The variables of an expression are the parameters of its generated function
+printf 'poly = x^3 - 2*x*y + y\nwave = sin(t) * y\n' > "$tmp/params.expr"
+./codegen "$tmp/params.expr" "$tmp/params"
+cat > "$tmp/params_driver.c" <<'END'
+#include <stdio.h>
+#include "params.h"
+#include "lexer/Number.h"
+int main(void)
+{
+  char str[NUMBER_BUFFER_SIZE];
+  format_number(poly(2.5L, -3.0L), str, sizeof str);
+  printf("%s\n", str);
+  format_number(wave(0.5L, -3.0L), str, sizeof str);
+  printf("%s\n", str);
+  return 0;
+}
+END
+out=$(gcc -std=c11 -Wall -Werror -I. -I"$tmp" -o "$tmp/params_driver" "$tmp/params_driver.c" \
+          "$tmp/params.c" lexer/Number.o -lm && "$tmp/params_driver")
+expected=$(sed 's/^[^=]*=//' "$tmp/params.expr" > "$tmp/params.txt"
+           $main -D x=2.5 -D y=-3 -D t=0.5 -f "$tmp/params.txt")
+expect "codegen parameters" "$expected" "$out"
+
+echo 'f = powl + 1' > "$tmp/bad.expr"
+out=$(./codegen "$tmp/bad.expr" "$tmp/params" 2>&1; echo "rc=$?")
+expect "codegen variable name" "$tmp/bad.expr:1: the variable 'powl' is a reserved name in C
+rc=1" "$out"
+
+# The rewrites of -O keep the results within a few ulps, and the signs of
+# the zeros
+cat > "$tmp/polynomials.txt" <<'END'
+x^3 - 2*x^2 + 3*x - 1
+2*x^3 - x^2 + 4
+x^10 - 2*x^5 + 1
+0.5*x^4 + 1.25*x^3 - x + 7
+x^7
+x^-3 + 2
+(x + 1)^0.5 * x^2
+-x^2 + x^4 - 1
+END
+out=$(./checkopt "$tmp/polynomials.txt" 16 | tail -n 1 | sed 's/, worst.*//')
+expect "checkopt" "8 expressions checked, 0 above 16.0 ulps" "$out"
+
+printf 'x^0.5\nx^2-x\nx^3+x\n2*x^3 - x^2 + 4\nx^3\nx^-1\n' > "$tmp/zeros.txt"
+for x in 0 -0; do
+  out=$($main -O -D x=$x -f "$tmp/zeros.txt" | tr '\n' ' ')
+  expect "-O at x=$x" "$($main -D x=$x -f "$tmp/zeros.txt" | tr '\n' ' ')" "$out"
+done
+
+# The token array grows with the expression, and an error at the end of
+# the expression is reported just past its last token
+expect "error end" "Error: Expected an operand at position 7" "$(error '2 * 3 -   ')"
+expect "error lexer" "Error: Unexpected character at position 6" "$(error '1 + 2 # 3')"
+awk 'BEGIN { for (i = 0; i < 2000; ++i) printf "1 + "; print "1" }' > "$tmp/tokens.txt"
+out=$($main -f "$tmp/tokens.txt")
+expect "many tokens" "2001" "$out"
+
+# The node pool gives the results and the errors of the parse tree, which
+# -t builds, bit for bit
+cat > "$tmp/mixed.txt" <<'END'
+1 + 2 * 3 - 4 / 5
+-(2 ^ 0.5) * sin(1) + cos(2)
+max(3, min(4, 2)) ^ -2
+ln(abs(-7)) / tan(0.3)
+((((1 + 2) * 3) - 4) ^ 2) / 7
+sqrt(x) * y - x ^ y
+1 / 0
+2 +
+foo(3)
+z * 2
+END
+$main -D x=2 -D y=3 -f "$tmp/mixed.txt" > "$tmp/mixed.pool"
+out=$($main -D x=2 -D y=3 -t 2 -f "$tmp/mixed.txt" | cmp - "$tmp/mixed.pool" && echo same)
+expect "pool and tree" "same" "$out"
+$main -D x=2 -D y=3 -o long-double -f "$tmp/mixed.txt" > "$tmp/mixed.bin"
+out=$($main -D x=2 -D y=3 -t 2 -o long-double -f "$tmp/mixed.txt" | cmp - "$tmp/mixed.bin" && echo same)
+expect "pool and tree records" "same" "$out"
+expect "pool values" "error: Expected an operand at position 3
+error: Unknown function at position 0
+error: Unbound variable 'z'" "$(tail -n 3 "$tmp/mixed.pool")"
+
+# A compiled file gives the results of main -f, with or without -O, and a
+# truncated one is rejected
+./compile "$tmp/formulas.expr" "$tmp/formulas.bin"
+./compile -O "$tmp/formulas.expr" "$tmp/formulas.opt"
+grep '=' "$tmp/formulas.expr" | sed 's/ *=.*//' > "$tmp/names"
+expected=$($main -f "$tmp/formulas.txt" | paste -d ' ' "$tmp/names" - | sed 's/ / = /' | sort)
+expect "compiled values" "$expected" "$($main -c "$tmp/formulas.bin")"
+expect "compiled values -O" "$expected" "$($main -c "$tmp/formulas.opt")"
+head -c 40 "$tmp/formulas.bin" > "$tmp/truncated.bin"
+out=$($main -c "$tmp/truncated.bin" 2>&1; echo "rc=$?")
+expect "compiled truncated" "'$tmp/truncated.bin' is not a compiled expressions file
+rc=1" "$out"
+
+# The tree and the error of a session are those of parse_expression after
+# each edit
+out=$(./checksession 50000 | tail -n 1 | sed 's/ (.*)//')
+expect "checksession" "50000 edits checked, 0 different from parse_expression" "$out"
+
+# The kernels of -m 4ulp and -m fast are within their accuracy, and keep
+# the signs of the zeros
+out=$(./checkmath 65536 >/dev/null; echo "rc=$?")
+expect "checkmath" "rc=0" "$out"
+printf 'sin(-0)\ntan(-0)\nsin(0)\ncos(-0)\nsqrt(-0)\nln(0)\n' > "$tmp/zero.txt"
+for mode in exact 4ulp fast; do
+  out=$($main -m $mode -f "$tmp/zero.txt" | tr '\n' ' ')
+  expect "-m $mode zeros" "-0 -0 0 1 -0 -inf " "$out"
+done
+expect "-m 4ulp sin" "0.8414709848078965049" "$(echo 'sin(1)' | $main -m 4ulp | sed -n 's/^[[:space:]]*= //p' | tail -n 1)"
+
+# sum and prod bind their index in their body only, and give the same
+# values from the pool, the tree and a compiled file
+cat > "$tmp/aggregates.txt" <<'END'
+sum(i, 1, 100, i)
+prod(k, 1, 10, k)
+sum(i, 1, 3, sum(j, 1, i, j))
+sum(i, 5, 1, i)
+prod(i, 5, 1, i)
+sum(i, 1, 1e6, 0.1)
+sum(i, 1, 4, i) + i
+sum(x, 1, 3, x * y)
+sum(i, 0, 0/0, i)
+prod(i, 1, 3, sum(j, 1, i, 1 / j))
+END
+out=$($main -D y=2 -D i=100 -f "$tmp/aggregates.txt" | tr '\n' ' ')
+expect "aggregates" "5050 3628800 10 0 1 1e+5 110 12 nan 2.75 " "$out"
+out=$($main -D y=2 -D i=100 -t 2 -f "$tmp/aggregates.txt" | tr '\n' ' ')
+expect "aggregates tree" "5050 3628800 10 0 1 1e+5 110 12 nan 2.75 " "$out"
+awk '{ print "a" NR " = " $0 }' "$tmp/aggregates.txt" | grep -v ' i$' > "$tmp/aggregates.expr"
+./compile "$tmp/aggregates.expr" "$tmp/aggregates.bin"
+out=$($main -D y=2 -c "$tmp/aggregates.bin" | tr '\n' ' ')
+expect "aggregates compiled" "a1 = 5050 a10 = 2.75 a2 = 3628800 a3 = 10 a4 = 0 a5 = 1 a6 = 1e+5 a8 = 12 a9 = nan " "$out"
+./compile -O "$tmp/aggregates.expr" "$tmp/aggregates.opt"
+out=$($main -D y=2 -c "$tmp/aggregates.opt" | tr '\n' ' ')
+expect "aggregates compiled -O" "a1 = 5050 a10 = 2.75 a2 = 3628800 a3 = 10 a4 = 0 a5 = 1 a6 = 1e+5 a8 = 12 a9 = nan " "$out"
+
+# The variadic functions take any number of arguments; sum is always the
+# aggregate, total the sum of its arguments
+cat > "$tmp/variadic.txt" <<'END'
+total(a, b, c, d)
+sum(a, b, c, d)
+max(1, 0/0, 3)
+min(4)
+mean(1, 2, 3, 6)
+stddev(2, 4, 4, 4, 5, 5, 7, 9)
+total(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17)
+max(0/0, 0/0)
+END
+for options in "" "-t 2" "-O"; do
+  out=$($main -D a=1 -D b=2 -D c=3 -D d=4 $options -f "$tmp/variadic.txt" | tr '\n' ' ')
+  expect "variadic $options" "10 8 3 4 3 2 153 nan " "$out"
+done
+awk '{ print "v" NR " = " $0 }' "$tmp/variadic.txt" > "$tmp/variadic.expr"
+./compile "$tmp/variadic.expr" "$tmp/variadic.bin"
+out=$($main -D a=1 -D b=2 -D c=3 -D d=4 -c "$tmp/variadic.bin" | tr '\n' ' ')
+expect "variadic compiled" "v1 = 10 v2 = 8 v3 = 3 v4 = 4 v5 = 3 v6 = 2 v7 = 153 v8 = nan " "$out"
+out=$(printf 'total(x, x^2, 3)\nmax(x, 2*x)\nmean(x, y)\n' | $main -D x=2 -D y=3 -d x,y -f /dev/stdin)
+expect "variadic derivatives" "9 5 0
+4 2 0
+2.5 0.5 0.5" "$out"
+expect "variadic empty" "Error: Expected an operand at position 6" "$(error 'total()')"
+
+# The CSV mode binds the columns, then the -D values, and writes a column
+out=$(printf 'price,qty\n1.5,2\n3,4\n' | $main -x "price * qty * (1 + tax)" -D tax=0.25 | tr '\n' ' ')
+expect "csv columns" "result 3.75 15 " "$out"
+out=$(printf 'a,"b"\n"1",x\n\n2,"3"\n' | $main -x "a + b" | tr '\n' ' ')
+expect "csv fields" "result nan 5 " "$out"
+out=$(printf 'a,b\n1\n' | $main -x "a + b" | tr '\n' ' ')
+expect "csv short row" "result nan " "$out"
+out=$(printf 'a\n1\n' | $main -x "a + z" 2>&1; echo "rc=$?")
+expect "csv unbound" "Unbound variable 'z'
+rc=1" "$out"
+out=$(printf '' | $main -x "a" 2>&1; echo "rc=$?")
+expect "csv header" "The rows have no header
+rc=1" "$out"
+seq 1 300000 | sed '1i n' > "$tmp/rows.csv"
+awk 'NR == 1 { print "result" } NR > 1 { print 2 * $1 + 1 }' "$tmp/rows.csv" > "$tmp/rows.1"
+out=$($main -x "2 * n + 1" < "$tmp/rows.csv" | cmp - "$tmp/rows.1" && echo same)
+expect "csv rows" "same" "$out"
+
+# The pipeline gives the results of the chunks, and reports its stages
+for format in text double long-double; do
+  $main -o $format -f "$tmp/large.txt" -j 1 > "$tmp/large.$format"
+  out=$($main -o $format -f "$tmp/large.txt" -P 2> "$tmp/stages" | cmp - "$tmp/large.$format" && echo same)
+  expect "pipeline $format" "same" "$out"
+done
+out=$($main -D x=2 -D y=3 -f "$tmp/mixed.txt" -P 2> /dev/null | cmp - "$tmp/mixed.pool" && echo same)
+expect "pipeline errors" "same" "$out"
+out=$(sed 's/[0-9.]* s, busy: lex [0-9]*%, parse [0-9]*%, eval [0-9]*%$/S/' "$tmp/stages")
+expect "pipeline stages" "400000 lines in S" "$out"
+
+# The padding of the long double records is zeroed
+for options in "-j 4" "-P"; do
+  out=$($main -o long-double -f "$tmp/large.txt" $options 2> /dev/null | od -An -v -tx1 -w32 -j16 \
+        | awk '{ for (i = 27; i <= 32; ++i) if ($i != "00") ++bad } END { print NR, bad + 0 }')
+  expect "long double padding $options" "400000 0" "$out"
+done
+
+# The channel answers the requests of a client in order, until it is stopped
+channel="calc-regress-$$"
+timeout 60 $main -s "$channel" -D x=2 & server=$!
+tries=0
+until ./shmclient "$channel" 0 > /dev/null 2>&1 || [ $tries -ge 50 ]; do
+  sleep 0.1
+  tries=$((tries + 1))
+done
+out=$(timeout 10 ./shmclient "$channel" '1 + 2' 'x * 3' '1 +' 'z' '1/3')
+expect "channel" "3
+6
+error: Syntax error at position 3
+error: Unbound variable
+0.33333333333333333334" "$out"
+awk 'BEGIN { for (i = 0; i < 3000; ++i) print i " * x" }' > "$tmp/requests.txt"
+out=$(tr '\n' '\0' < "$tmp/requests.txt" | timeout 20 xargs -0 ./shmclient "$channel" | awk '$1 != 2 * (NR - 1)' | wc -l)
+expect "channel in flight" "0" "$out"
+out=$(timeout 10 ./shmclient "$channel" -b 1000 'x + 1' | sed -n 's/:.*//p' | tr '\n' ' ')
+expect "channel benchmark" "round trip pipelined " "$out"
+timeout 10 ./shmclient "$channel" -q
+stopped=$?
+wait $server
+out="rc=$stopped server=$?"
+expect "channel shutdown" "rc=0 server=0" "$out"
+out=$(./shmclient "$channel" 1 2>&1; echo "rc=$?")
+expect "channel removed" "$channel: No such file or directory
+rc=1" "$out"
+timeout 60 $main -s "$channel" & server=$!
+sleep 0.5
+kill -TERM $server
+wait $server
+out="server=$? $(./shmclient "$channel" 1 > /dev/null 2>&1 || echo removed)"
+expect "channel signal" "server=0 removed" "$out"
+
+# Deep expressions are refused without any -L, instead of overflowing the
+# stack of the parser or of the walks of the tree
+awk 'BEGIN { for (i = 0; i < 200000; ++i) printf "("; printf "1";
+             for (i = 0; i < 200000; ++i) printf ")"; print "" }' > "$tmp/nested.txt"
+awk 'BEGIN { printf "1"; for (i = 1; i < 300000; ++i) printf "+1"; print "" }' > "$tmp/chain.txt"
+
+out=$($main -f "$tmp/nested.txt" 2>&1; echo "rc=$?")
+expect "deep nesting" "error: Expression too deep at position 4096
+rc=0" "$out"
+
+for options in "" "-O" "-D x=1 -d x" "-P" "-t 2"; do
+  out=$($main $options -f "$tmp/chain.txt" 2>/dev/null; echo "rc=$?")
+  expect "deep tree $options" "error: Expression too deep at position 8191
+rc=0" "$out"
+done
+
+out=$($main -L depth=300000 -f "$tmp/chain.txt" 2>&1; echo "rc=$?")
+expect "raised depth" "3e+5
+rc=0" "$out"
+
+# The limits of size refuse an expression with a position, the deadline
+# stops an evaluation
+printf 'sum(i, 1, 1e15, i)\n((((1))))\n1 + 2 + 3\n' > "$tmp/untrusted.txt"
+out=$(timeout 10 $main -f "$tmp/untrusted.txt" -L time=50 -L depth=4)
+expect "limits" "error: Deadline exceeded
+error: Expression too deep at position 4
+6" "$out"
+out=$($main -f "$tmp/untrusted.txt" -L tokens=8 | tail -n 2)
+expect "limit tokens" "error: Too many tokens at position 8
+6" "$out"
+out=$(timeout 10 $main -f "$tmp/untrusted.txt" -L time=50 -t 2 -o double | od -An -tu4 -j24 -N4 | tr -d ' ')
+expect "deadline record" "3" "$out"
+out=$(timeout 10 $main -L time=50 -D 'x=sum(i, 1, 1e15, i)' -f "$tmp/untrusted.txt" 2>&1; echo "rc=$?")
+expect "deadline of -D" "Deadline exceeded
+rc=1" "$out"
+
+# The derivatives of the aggregates stop at the deadline too
+out=$(echo 'sum(i, 1, 6e6, x*i)' | timeout 10 $main -L time=300 -D x=1 -d x -f /dev/stdin)
+expect "deadline derivatives" "error: Deadline exceeded" "$out"
+out=$(echo 'sum(i, 1, 1e15, x*i)' | timeout 10 $main -L time=300 -D x=1 -d x -t 2 -f /dev/stdin)
+expect "deadline derivatives threads" "error: Deadline exceeded" "$out"
+
+# The version of the binary results has the status of an exceeded deadline,
+# and the older versions are still read
+out=$($main -o double -f "$tmp/records.txt" | od -An -tu2 -j8 -N2 | tr -d ' ')
+expect "results version" "2" "$out"
+$main -o double -f "$tmp/records.txt" > "$tmp/version.bin"
+printf '\001' | dd of="$tmp/version.bin" bs=1 seek=8 conv=notrunc 2> /dev/null
+out=$(./readresults "$tmp/version.bin" | head -n 1)
+expect "results version 1" "0 0 0 2" "$out"
+printf '\003' | dd of="$tmp/version.bin" bs=1 seek=8 conv=notrunc 2> /dev/null
+out=$(./readresults "$tmp/version.bin" 2>&1; echo "rc=$?")
+expect "results version 3" "'$tmp/version.bin' is a results file of version 3, expected at most 2
+rc=1" "$out"
+
+# The tracepoints are listed in the notes of the binary, each one on a nop
+if [ "$(uname -m)" = x86_64 ]; then
+  out=$(readelf -n $main | sed -n 's/^ *Provider: //p; s/^ *Name: //p' | sort -u | tr '\n' ' ')
+  expect "probes" "alloc calc parse_done parse_start step_done step_start tokenize_done tokenize_start " "$out"
+  out=$(for location in $(readelf -n $main | awk '/Location:/ { sub(",", "", $2); print $2 }'); do
+          objdump -d --start-address=$location --stop-address=$((location + 1)) $main | grep -c nop
+        done | sort -u)
+  expect "probes nop" "1" "$out"
+fi
+
+# The drivers find roots and integrals in-process, and are differentiated
+cat > "$tmp/drivers.txt" <<'END'
+solve(x^2 - 2, x, 0, 2)
+integrate(x^2, x, 0, 1)
+integrate(sin(x), x, 0, 3.14159265358979323846)
+solve(cos(x) - x, x, 0, 1)
+solve(x^2 + 1, x, -1, 1)
+integrate(a * x, x, 0, b)
+solve(x - a, x, -10, 10)
+sum(i, 1, 3, integrate(x^i, x, 0, 1))
+END
+for options in "" "-t 2" "-O"; do
+  out=$($main -D a=3 -D b=2 $options -f "$tmp/drivers.txt" | tr '\n' ' ')
+  expect "drivers $options" "1.4142135623730950488 0.33333333333333333334 2 0.73908513321516064166 nan 6 3.0000000000000000002 1.0833333333333333334 " "$out"
+done
+awk '{ print "d" NR " = " $0 }' "$tmp/drivers.txt" > "$tmp/drivers.expr"
+./compile "$tmp/drivers.expr" "$tmp/drivers.bin"
+out=$($main -D a=3 -D b=2 -c "$tmp/drivers.bin" | tr '\n' ' ')
+expect "drivers compiled" "d1 = 1.4142135623730950488 d2 = 0.33333333333333333334 d3 = 2 d4 = 0.73908513321516064166 d5 = nan d6 = 6 d7 = 3.0000000000000000002 d8 = 1.0833333333333333334 " "$out"
+out=$(sed -n '6,7p' "$tmp/drivers.txt" | $main -D a=3 -D b=2 -d a,b -f /dev/stdin)
+expect "drivers derivatives" "6 2 6
+3.0000000000000000002 1 -0" "$out"
+expect "driver arguments" "Error: Expected the index variable of the aggregate at position 9" "$(error 'solve(x, 1, 0, 1)')"
+expect "driver separator" "Error: Expected ',' between the function arguments at position 17" "$(error 'integrate(x, x, 0')"
+printf 'f = integrate(x, x, 0, 1)\n' > "$tmp/integral.expr"
+out=$(./codegen "$tmp/integral.expr" "$tmp/integral" 2>&1; echo "rc=$?"; ls "$tmp" | grep -c '^integral\.[ch]$')
+expect "driver codegen" "$tmp/integral.expr:1: solve and integrate can't be generated
+rc=1
+0" "$out"
+out=$(echo 'integrate(sin(1e6 * x * x), x, 0, 10)' | timeout 10 $main -L time=100 -f /dev/stdin)
+expect "driver deadline" "error: Deadline exceeded" "$out"
+out=$(echo 'integrate(sum(i, 1, 3e5, a * x * i), x, 0, 1)' | timeout 10 $main -D a=1 -L time=300 -d a -f /dev/stdin)
+expect "driver derivatives deadline" "error: Deadline exceeded" "$out"
+
+# The functions of a plugin are called like the built-in ones
+plugin=./tools/plugins/finance.so
+cat > "$tmp/plugin.txt" <<'END'
+ncdf(0)
+NCDF(1.96)
+discount(0.05, 2)
+sum(i, 1, 100, ncdf(i / 100))
+ncdf(1, 2)
+bscall(1)
+max(ncdf(x), 0.1)
+END
+for options in "" "-t 2" "-O"; do
+  out=$($main -D x=0.5 -l $plugin $options -f "$tmp/plugin.txt")
+  expect "plugin $options" "0.5
+0.97500210485177956585
+0.90483741803595957315
+68.60786058147563955
+error: Wrong number of arguments at position 0
+error: Wrong number of arguments at position 0
+0.6914624612740131036" "$out"
+done
+out=$(printf 'spot,vol\n100,0.2\n90,0.3\n' | $main -l $plugin -x "bscall(spot, 100, 0.5, 0.02, vol)" | tr '\n' ' ')
+expect "plugin csv" "result 6.1206541134558419305 4.2696738274732667796 " "$out"
+out=$(echo 'ncdf(x)' | $main -D x=0 -d x -l $plugin -f /dev/stdin)
+expect "plugin derivative" "0.5 0.39894228040142820646" "$out"
+out=$(echo 'y' | $main -D 'y=ncdf(0)' -l $plugin -f /dev/stdin)
+expect "plugin in -D" "0.5" "$out"
+out=$(echo 'ncdf(0) + 1' | $main -l $plugin | sed -n 's/^[[:space:]]*= //p' | head -n 1)
+expect "plugin steps" "(0.5 + 1)" "$out"
+
+# The plugins which can't be loaded whole are refused
+cat > "$tmp/plugin.c" <<'END'
+#include "eval/Plugin.h"
+static long double one(const long double *x) { (void)x; return 1.0; }
+static const plugin_function_t functions[] = { { NAME, 1, one, NULL } };
+const plugin_table_t calc_plugin = { VERSION, 1, functions };
+END
+for case in 'bad "two2" PLUGIN_VERSION' 'builtin "sin" PLUGIN_VERSION' 'version "one" 99'; do
+  set -- $case
+  gcc -shared -fPIC -I. -DNAME="$2" -DVERSION=$3 -o "$tmp/$1.so" "$tmp/plugin.c"
+done
+out=$($main -l "$tmp/bad.so" -f /dev/null 2>&1; echo "rc=$?")
+expect "plugin name" "$tmp/bad.so: function 'two2': its name is not made of letters
+rc=1" "$out"
+out=$($main -l "$tmp/builtin.so" -f /dev/null 2>&1; echo "rc=$?")
+expect "plugin builtin" "$tmp/builtin.so: function 'sin': it is already a function
+rc=1" "$out"
+out=$($main -l "$tmp/version.so" -f /dev/null 2>&1; echo "rc=$?")
+expect "plugin version" "$tmp/version.so: version 99, expected 1
+rc=1" "$out"
+out=$($main -l $plugin -l $plugin -f /dev/null 2>&1; echo "rc=$?")
+expect "plugin twice" "$plugin: function 'ncdf': it is already a function
+rc=1" "$out"
+out=$($main -l "$tmp/missing.so" -f /dev/null 2>&1; echo "rc=$?")
+expect "plugin missing" "$tmp/missing.so: cannot open shared object file: No such file or directory
+rc=1" "$out"
+
+# The user-defined functions are inlined where they are called, in every
+# mode, and may call the functions defined before them
+cat > "$tmp/calls.txt" <<'END'
+norm(3, 4)
+sum(i, 1, 3, norm(i, 1))
+prod(k, 1, 4, sq(k) + i)
+norm(sum(j, 1, 2, sq(j)), 0) * 2
+END
+for options in "" "-t 2" "-O"; do
+  out=$($main -D i=1 -D 'sq(x) = x*x' -D 'norm(a, b) = sqrt(sq(a) + sq(b))' $options \
+              -f "$tmp/calls.txt" | tr '\n' ' ')
+  expect "functions $options" "5 6.812559200041264077 1700 10 " "$out"
+done
+out=$(echo 'scale(2)' | $main -D a=3 -D 'scale(x) = a * x' -D a=10 -f /dev/stdin)
+expect "function variable" "6" "$out"
+out=$(echo 'cube(x) + x' | $main -D x=2 -D 'cube(t) = t^3' -d x -f /dev/stdin)
+expect "function derivative" "10 13" "$out"
+out=$(echo 'cube(2) + 1' | $main -D 'cube(t) = t^3' | sed -n 's/^[[:space:]]*= //p' | head -n 1)
+expect "function steps" "(8 + 1)" "$out"
+out=$(printf 'sq(1, 2)\nsq(1\n' | $main -D 'sq(x) = x*x' -f /dev/stdin)
+expect "function arguments" "error: Wrong number of arguments at position 0
+error: Expected ')' after the function arguments at position 4" "$out"
+out=$($main -D 'f(x) = f(x) + 1' -f /dev/null 2>&1; echo "rc=$?")
+expect "function recursion" "Error: Recursive function at position 7
+  f(x) = f(x) + 1
+         ^
+rc=1" "$out"
+
+# In the files of codegen and compile, the functions are defined by their
+# own lines, for which nothing is generated
+cat > "$tmp/calls.expr" <<'END'
+sq(x) = x*x
+hyp = sqrt(sq(3) + sq(4))
+norm(a, b) = sqrt(sq(a) + sq(b))
+n = sum(i, 1, 3, norm(i, 1))
+END
+./codegen "$tmp/calls.expr" "$tmp/calls"
+cat > "$tmp/callsmain.c" <<'END'
+#include <stdio.h>
+#include "calls.h"
+int main(void)
+{
+  printf("%.15Lg %.15Lg\n", hyp(), n());
+  return 0;
+}
+END
+out=$(gcc -std=c11 -Wall -Werror -I"$tmp" -o "$tmp/callsmain" "$tmp/callsmain.c" "$tmp/calls.c" \
+          -lm && "$tmp/callsmain")
+expect "functions codegen" "5 6.81255920004126" "$out"
+./compile "$tmp/calls.expr" "$tmp/calls.bin"
+./compile -O "$tmp/calls.expr" "$tmp/calls.opt"
+out=$($main -c "$tmp/calls.bin"; $main -c "$tmp/calls.opt")
+expect "functions compiled" "hyp = 5
+n = 6.812559200041264077
+hyp = 5
+n = 6.812559200041264077" "$out"
+printf 'f(x) = f(x)\n' > "$tmp/recursive.expr"
+out=$(./codegen "$tmp/recursive.expr" "$tmp/recursive" 2>&1 | head -n 1; ls "$tmp" | grep -c '^recursive\.[ch]$')
+expect "function codegen error" "$tmp/recursive.expr:1: Error: Recursive function at position 7
+0" "$out"
+
+# The threads which can't be created are done without: here none of them
+cat > "$tmp/nothreads.c" <<'END'
+#include <errno.h>
+#include <pthread.h>
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*run)(void *), void *arg)
+{
+  (void)thread; (void)attr; (void)run; (void)arg;
+  return EAGAIN;
+}
+END
+gcc -shared -fPIC -o "$tmp/nothreads.so" "$tmp/nothreads.c"
+nothreads="env LD_PRELOAD=$tmp/nothreads.so timeout 10"
+out=$($nothreads $main -f "$tmp/large.txt" -j 4 | cmp - "$tmp/large.1" && echo same)
+expect "batch without threads" "same" "$out"
+out=$($nothreads $main -o double -f "$tmp/large.txt" -j 4 | cmp - "$tmp/large.bin" && echo same)
+expect "records without threads" "same" "$out"
+out=$($nothreads $main -f "$tmp/wide.txt" -t 4 -o long-double | cmp - "$tmp/wide.1" && echo same)
+expect "parallel subtrees without threads" "same" "$out"
+out=$($nothreads $main -x "2 * n + 1" < "$tmp/rows.csv" | cmp - "$tmp/rows.1" && echo same)
+expect "csv without threads" "same" "$out"
+out=$($nothreads $main -f "$tmp/large.txt" -P 2> "$tmp/stages" | cmp - "$tmp/large.1" && echo same; cat "$tmp/stages")
+expect "pipeline without threads" "same" "$out"
+
+# Here only the first thread is created: the lexer of the pipeline
+cat > "$tmp/onethread.c" <<'END'
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*run)(void *), void *arg)
+{
+  static int created;
+  int (*create)(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *)
+    = (int (*)(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *))dlsym(RTLD_NEXT, "pthread_create");
+  return created++ ? EAGAIN : create(thread, attr, run, arg);
+}
+END
+gcc -shared -fPIC -o "$tmp/onethread.so" "$tmp/onethread.c" -ldl
+out=$(env LD_PRELOAD=$tmp/onethread.so timeout 10 $main -f "$tmp/large.txt" -P 2> "$tmp/stages" \
+      | cmp - "$tmp/large.1" && echo same; sed 's/.*\(parse [0-9]*%\).*/\1/' "$tmp/stages")
+expect "pipeline without parser" "same
+parse 0%" "$out"
+
+if [ $failures -ne 0 ]; then
+  echo "$failures test(s) failed"
+  exit 1
+fi
@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "../CommonHeaders.h"
+#include "../lexer/Number.h"
+#include "../io/Channel.h"
+
+
+/**
+ * @brief Reads a monotonic clock in nanoseconds
+ */
+static uint64_t now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+static int compare_times(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Prints a result received from the server
+ */
+static void print_response(const result_long_double_t *record)
+{
+  char str[NUMBER_BUFFER_SIZE];
+
+  if (record->status == RESULT_OK) {
+    format_number(record->value, str, sizeof str);
+    printf("%s\n", str);
+  } else if (record->status == RESULT_UNBOUND_VARIABLE) {
+    printf("error: Unbound variable\n");
+  } else if (record->status == RESULT_DEADLINE_EXCEEDED) {
+    printf("error: Deadline exceeded\n");
+  } else {
+    printf("error: Syntax error at position %u\n", record->position);
+  }
+}
+
+
+/**
+ * @brief Receives a result, or exits if the server is gone
+ */
+static void receive(Channel channel, result_long_double_t *record)
+{
+  if (!receive_response(channel, record)) {
+    perror("receive");
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+/**
+ * @brief Sends an expression, or exits if it can't be sent
+ */
+static void send(Channel channel, const char *text, size_t length)
+{
+  if (!send_request(channel, text, length)) {
+    perror("send");
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+/**
+ * @brief Sends expressions and prints their results in order
+ * @details Up to CHANNEL_SLOTS requests are in flight: the results are read
+ *          only when the rings are full, and at the end.
+ */
+static void evaluate(Channel channel, char *const *expressions, size_t count)
+{
+  result_long_double_t record;
+  size_t in_flight = 0;
+  char *line = NULL;
+  size_t size = 0;
+
+  for (size_t i = 0; count ? i < count : true; ++i) {
+    const char *text = NULL;
+    size_t length = 0;
+
+    if (count) {
+      text = expressions[i];
+      length = strlen(text);
+    } else {
+      ssize_t read = getline(&line, &size, stdin);
+      if (read < 0) break;
+      length = (size_t)read;
+      if (length && line[length - 1] == '\n') --length;
+      text = line;
+    }
+
+    if (in_flight == CHANNEL_SLOTS) {
+      receive(channel, &record);
+      print_response(&record);
+      --in_flight;
+    }
+
+    send(channel, text, length);
+    ++in_flight;
+  }
+
+  for (; in_flight; --in_flight) {
+    receive(channel, &record);
+    print_response(&record);
+  }
+
+  free(line);
+}
+
+
+/**
+ * @brief Measures the latency of the round trips of an expression, one at a
+ *        time, then the throughput with the rings kept full
+ */
+static void benchmark(Channel channel, const char *text, size_t count)
+{
+  size_t length = strlen(text);
+  result_long_double_t record;
+
+  uint64_t *times = malloc(count * sizeof(*times));
+  assert(times != NULL);
+
+  uint64_t total = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t start = now();
+    send(channel, text, length);
+    receive(channel, &record);
+    times[i] = now() - start;
+    total += times[i];
+  }
+
+  qsort(times, count, sizeof(*times), compare_times);
+  printf("round trip: min %llu ns, median %llu ns, p99 %llu ns, max %llu ns, mean %.0f ns\n",
+         (unsigned long long)times[0], (unsigned long long)times[count / 2],
+         (unsigned long long)times[count * 99 / 100], (unsigned long long)times[count - 1],
+         (double)total / (double)count);
+
+  uint64_t start = now();
+  size_t received = 0;
+  for (size_t sent = 0; sent < count; ++sent) {
+    if (sent - received == CHANNEL_SLOTS) {
+      receive(channel, &record);
+      ++received;
+    }
+    send(channel, text, length);
+  }
+  for (; received < count; ++received) receive(channel, &record);
+
+  double seconds = (double)(now() - start) / 1e9;
+  printf("pipelined: %.0f ns per request, %.0f requests/s\n",
+         seconds * 1e9 / (double)count, (double)count / seconds);
+
+  free(times);
+}
+
+
+/**
+ * @brief A client of the shared-memory channel of a server (main -s NAME)
+ * @details Sends each expression given, or each line of stdin, and prints
+ *          the results in order. With -b, measures the round trip latency
+ *          and the throughput of COUNT evaluations of one expression. With
+ *          -q, asks the server to stop.
+ *
+ *          usage: shmclient NAME [EXPRESSION]...
+ *                 shmclient NAME -b COUNT EXPRESSION
+ *                 shmclient NAME -q
+ */
+int main(int argc, char *argv[])
+{
+  bool bench = argc == 5 && !strcmp(argv[2], "-b");
+  bool quit = argc == 3 && !strcmp(argv[2], "-q");
+  size_t count = bench ? (size_t)strtoul(argv[3], NULL, 10) : 0;
+
+  if (argc < 2 || (bench && !count)) {
+    fprintf(stderr, "usage: %s NAME [EXPRESSION]...\n"
+                    "       %s NAME -b COUNT EXPRESSION\n"
+                    "       %s NAME -q\n", argv[0], argv[0], argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  Channel channel = open_channel(argv[1]);
+  if (!channel) {
+    if (errno == EINVAL) fprintf(stderr, "'%s' is not a channel\n", argv[1]);
+    else perror(argv[1]);
+    exit(EXIT_FAILURE);
+  }
+
+  if (bench)
+    benchmark(channel, argv[4], count);
+  else if (quit)
+    send_shutdown(channel);
+  else
+    evaluate(channel, argv + 2, (size_t)argc - 2);
+
+  close_channel(channel);
+}